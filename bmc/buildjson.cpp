@@ -22,9 +22,11 @@
 #include <sdbusplus/bus.hpp>
 
 #include <algorithm>
+#include <cstdint>
 #include <cstdio>
 #include <exception>
 #include <fstream>
+#include <stdexcept>
 #include <string>
 
 namespace ipmi_flash
@@ -67,4 +69,50 @@ std::unique_ptr<TriggerableActionInterface> buildSystemd(
                                               unit, systemdMode);
 }
 
+FileOptions buildFileOptions(const nlohmann::json& data)
+{
+    FileOptions options;
+
+    const auto& preallocate = data.find("preallocate");
+    if (preallocate != data.end())
+    {
+        preallocate->get_to(options.preallocate);
+    }
+
+    const auto& sync = data.find("sync");
+    if (sync != data.end())
+    {
+        const std::string syncType = *sync;
+        if (syncType == "none")
+        {
+            options.sync = FileSync::none;
+        }
+        else if (syncType == "batched")
+        {
+            options.sync = FileSync::batched;
+        }
+        else if (syncType == "close")
+        {
+            options.sync = FileSync::onClose;
+        }
+        else
+        {
+            throw std::runtime_error("Invalid sync type: " + syncType);
+        }
+    }
+
+    const auto& interval = data.find("syncIntervalMiB");
+    if (interval != data.end())
+    {
+        std::uint64_t mib = *interval;
+        if (mib == 0)
+        {
+            throw std::runtime_error("Invalid sync interval: 0");
+        }
+        options.syncInterval = mib * 1024 * 1024;
+    }
+
+    return options;
+}
+
 } // namespace ipmi_flash
@@ -1,5 +1,6 @@
 #pragma once
 
+#include "file_handler.hpp"
 #include "fs.hpp"
 #include "handler_config.hpp"
 #include "status.hpp"
@@ -25,6 +26,12 @@ std::unique_ptr<TriggerableActionInterface> buildFileSystemd(
 std::unique_ptr<TriggerableActionInterface> buildSystemd(
     const nlohmann::json& data);
 
+/**
+ * build the options of a file handler from its json data, the fields are all
+ * optional.
+ */
+FileOptions buildFileOptions(const nlohmann::json& data);
+
 constexpr std::array defaultConfigPaths = {
     "/usr/share/phosphor-ipmi-flash",
     "/run/phosphor-ipmi-flash",
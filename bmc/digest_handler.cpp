@@ -0,0 +1,347 @@
+/*
+ * Copyright 2026 Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "digest_handler.hpp"
+
+#include <openssl/evp.h>
+
+#include <algorithm>
+#include <charconv>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <optional>
+#include <span>
+#include <string>
+#include <system_error>
+#include <vector>
+
+namespace ipmi_flash
+{
+
+namespace
+{
+
+/* The most that's read back at once to hash bytes written out of order. */
+constexpr std::uint32_t readBackSize = 1024 * 1024;
+
+} // namespace
+
+DigestHandler::DigestHandler(std::unique_ptr<ImageHandlerInterface> handler,
+                             Algorithm algorithm,
+                             const std::string& imagePath) :
+    handler(std::move(handler)),
+    md(algorithm == Algorithm::sha256 ? EVP_sha256() : EVP_sha512()),
+    ctx(EVP_MD_CTX_new()), imagePath(imagePath),
+    digestPath(digestPathFor(imagePath, algorithm))
+{}
+
+std::string DigestHandler::digestPathFor(const std::string& imagePath,
+                                         Algorithm algorithm)
+{
+    return imagePath + (algorithm == Algorithm::sha256 ? ".sha256" : ".sha512");
+}
+
+std::optional<DigestHandler::Algorithm> DigestHandler::algorithmFromName(
+    const std::string& name)
+{
+    if (name == "sha256")
+    {
+        return Algorithm::sha256;
+    }
+    if (name == "sha512")
+    {
+        return Algorithm::sha512;
+    }
+    return std::nullopt;
+}
+
+void DigestHandler::reset()
+{
+    hashed = 0;
+    pending.clear();
+    valid = ctx && EVP_DigestInit_ex(ctx.get(), md, nullptr) == 1;
+}
+
+bool DigestHandler::open(const std::string& path, std::ios_base::openmode mode)
+{
+    if (!handler->open(path, mode))
+    {
+        return false;
+    }
+
+    /* A digest left from an earlier image doesn't describe this one. */
+    if (mode & std::ios::out)
+    {
+        (void)std::remove(digestPath.c_str());
+    }
+
+    reset();
+
+    /* The staged image is kept, its bytes are hashed as if just written.
+     * When more is written after them, some are likely rewritten, so they're
+     * only hashed on close.
+     */
+    if ((mode & std::ios::out) && (mode & (std::ios::in | std::ios::app)))
+    {
+        int size = handler->getSize();
+        if (size > 0)
+        {
+            addPending(0, size);
+            if (!(mode & std::ios::app))
+            {
+                hashPending();
+            }
+        }
+    }
+
+    return true;
+}
+
+void DigestHandler::close()
+{
+    hashPending();
+    auto digest = getDigest();
+    if (!digest.empty())
+    {
+        std::ofstream out(digestPath, std::ios::trunc);
+        for (auto byte : digest)
+        {
+            char hex[3];
+            std::snprintf(hex, sizeof(hex), "%02x", byte);
+            out << hex;
+        }
+        out << "  " << imagePath << "\n";
+        if (!out.good())
+        {
+            std::fprintf(stderr, "Failed to write digest to %s\n",
+                         digestPath.c_str());
+        }
+    }
+
+    handler->close();
+}
+
+bool DigestHandler::write(std::uint32_t offset,
+                          const std::vector<std::uint8_t>& data)
+{
+    return writeSpan(offset, data);
+}
+
+bool DigestHandler::writeSpan(std::uint32_t offset,
+                              std::span<const std::uint8_t> data)
+{
+    if (!handler->writeSpan(offset, data))
+    {
+        return false;
+    }
+
+    if (!valid || data.empty())
+    {
+        return true;
+    }
+
+    std::uint64_t end = std::uint64_t{offset} + data.size();
+    if (nextInLine(offset, end))
+    {
+        valid = EVP_DigestUpdate(ctx.get(), data.data(), data.size()) == 1;
+        hashed = end;
+        hashPending();
+    }
+
+    return true;
+}
+
+bool DigestHandler::fill(std::uint32_t offset, std::uint32_t length,
+                         std::uint8_t value)
+{
+    if (!handler->fill(offset, length, value))
+    {
+        return false;
+    }
+
+    if (!valid || length == 0)
+    {
+        return true;
+    }
+
+    /* The region is hashed from a run of its byte rather than read back, the
+     * handler may not have written it anywhere.
+     */
+    std::uint64_t end = std::uint64_t{offset} + length;
+    if (nextInLine(offset, end))
+    {
+        std::vector<std::uint8_t> run(
+            std::min<std::uint64_t>(length, readBackSize), value);
+        while (valid && hashed < end)
+        {
+            auto size = std::min<std::uint64_t>(end - hashed, run.size());
+            valid = EVP_DigestUpdate(ctx.get(), run.data(), size) == 1;
+            hashed += size;
+        }
+        hashPending();
+    }
+
+    return true;
+}
+
+bool DigestHandler::nextInLine(std::uint32_t offset, std::uint64_t end)
+{
+    if (offset < hashed)
+    {
+        std::fprintf(stderr, "Hashed bytes at 0x%x rewritten, no digest\n",
+                     offset);
+        valid = false;
+        return false;
+    }
+    if (offset > hashed)
+    {
+        addPending(offset, end);
+        return false;
+    }
+    return true;
+}
+
+void DigestHandler::addPending(std::uint64_t start, std::uint64_t end)
+{
+    /* Merge with every range this one overlaps or touches. */
+    auto it = pending.upper_bound(start);
+    if (it != pending.begin() && std::prev(it)->second >= start)
+    {
+        --it;
+    }
+    while (it != pending.end() && it->first <= end)
+    {
+        start = std::min(start, it->first);
+        end = std::max(end, it->second);
+        it = pending.erase(it);
+    }
+    pending.emplace(start, end);
+}
+
+void DigestHandler::hashPending()
+{
+    while (valid && !pending.empty() && pending.begin()->first <= hashed)
+    {
+        /* Whatever of it was just hashed was rewritten by that write, the file
+         * has the same bytes.
+         */
+        std::uint64_t end = pending.begin()->second;
+        pending.erase(pending.begin());
+
+        while (valid && hashed < end)
+        {
+            auto length = static_cast<std::uint32_t>(
+                std::min<std::uint64_t>(end - hashed, readBackSize));
+            auto bytes = handler->read(hashed, length);
+            if (!bytes || bytes->size() != length)
+            {
+                std::fprintf(stderr, "Failed to read back 0x%lx, no digest\n",
+                             static_cast<unsigned long>(hashed));
+                valid = false;
+                break;
+            }
+            valid = EVP_DigestUpdate(ctx.get(), bytes->data(), length) == 1;
+            hashed += length;
+        }
+    }
+}
+
+std::optional<std::vector<std::uint8_t>> DigestHandler::read(
+    std::uint32_t offset, std::uint32_t size)
+{
+    return handler->read(offset, size);
+}
+
+int DigestHandler::getSize()
+{
+    return handler->getSize();
+}
+
+bool DigestHandler::flush()
+{
+    return handler->flush();
+}
+
+std::optional<StagedImage> DigestHandler::getStaged()
+{
+    /* The digest is written when the image is closed, and removed when it's
+     * opened to be written again.  One older than the image doesn't match it.
+     */
+    std::error_code ec;
+    auto size = std::filesystem::file_size(imagePath, ec);
+    if (ec)
+    {
+        return std::nullopt;
+    }
+    auto imageTime = std::filesystem::last_write_time(imagePath, ec);
+    if (ec)
+    {
+        return std::nullopt;
+    }
+    auto digestTime = std::filesystem::last_write_time(digestPath, ec);
+    if (ec || digestTime < imageTime)
+    {
+        return std::nullopt;
+    }
+
+    std::string hex;
+    std::ifstream in(digestPath);
+    in >> hex;
+    if (hex.size() != 2 * static_cast<std::size_t>(EVP_MD_size(md)))
+    {
+        return std::nullopt;
+    }
+
+    StagedImage staged = {size, std::vector<std::uint8_t>(hex.size() / 2)};
+    for (std::size_t i = 0; i < staged.digest.size(); i++)
+    {
+        auto first = hex.data() + 2 * i;
+        auto [end, err] =
+            std::from_chars(first, first + 2, staged.digest[i], 16);
+        if (err != std::errc() || end != first + 2)
+        {
+            return std::nullopt;
+        }
+    }
+
+    return staged;
+}
+
+std::vector<std::uint8_t> DigestHandler::getDigest()
+{
+    if (!valid || hashed == 0 || !pending.empty())
+    {
+        return {};
+    }
+
+    /* Finish a copy, so more can still be written. */
+    std::unique_ptr<EVP_MD_CTX, CtxFree> done(EVP_MD_CTX_new());
+    std::vector<std::uint8_t> digest(EVP_MD_size(md));
+    unsigned int length = 0;
+    if (!done || EVP_MD_CTX_copy_ex(done.get(), ctx.get()) != 1 ||
+        EVP_DigestFinal_ex(done.get(), digest.data(), &length) != 1)
+    {
+        return {};
+    }
+    digest.resize(length);
+
+    return digest;
+}
+
+} // namespace ipmi_flash
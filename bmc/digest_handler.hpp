@@ -0,0 +1,122 @@
+#pragma once
+
+#include "image_handler.hpp"
+
+#include <openssl/evp.h>
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <optional>
+#include <span>
+#include <string>
+#include <vector>
+
+namespace ipmi_flash
+{
+
+/**
+ * Image handler that hashes the image as it's written to another image
+ * handler, so it doesn't have to be read back from storage to be verified.
+ * The digest is available from getDigest() while the image is open, and is
+ * written next to it on close in the format sha256sum and sha512sum check.
+ *
+ * Chunks written ahead of the ones before them are hashed once the gap is
+ * filled, by reading them back.  Rewriting bytes that were already hashed
+ * leaves the image without a digest.  Every byte has to come through here,
+ * so transports don't get a descriptor to write around it.
+ *
+ * Opening for std::ios::in | std::ios::out keeps the staged image, which is
+ * hashed again so its digest reflects what's actually there.  Opening for
+ * std::ios::out | std::ios::app keeps it to be written after, it's hashed
+ * on close.
+ */
+class DigestHandler : public ImageHandlerInterface
+{
+  public:
+    enum class Algorithm
+    {
+        sha256,
+        sha512,
+    };
+
+    /**
+     * Create a DigestHandler.
+     *
+     * @param[in] handler - the handler the writes are passed on to.
+     * @param[in] algorithm - the digest to compute.
+     * @param[in] imagePath - where the handler stages the image, the digest
+     * is written to this path with the algorithm's name appended.
+     */
+    DigestHandler(std::unique_ptr<ImageHandlerInterface> handler,
+                  Algorithm algorithm, const std::string& imagePath);
+
+    bool open(const std::string& path, std::ios_base::openmode mode) override;
+    void close() override;
+    bool write(std::uint32_t offset,
+               const std::vector<std::uint8_t>& data) override;
+    bool writeSpan(std::uint32_t offset,
+                   std::span<const std::uint8_t> data) override;
+    bool fill(std::uint32_t offset, std::uint32_t length,
+              std::uint8_t value) override;
+    std::optional<std::vector<std::uint8_t>> read(std::uint32_t offset,
+                                                  std::uint32_t size) override;
+    int getSize() override;
+    bool flush() override;
+    std::vector<std::uint8_t> getDigest() override;
+    std::optional<StagedImage> getStaged() override;
+
+    /**
+     * Parse the name of an algorithm, as used in the json configuration.
+     *
+     * @param[in] name - e.g. "sha256"
+     * @return the algorithm, or std::nullopt if it isn't supported.
+     */
+    static std::optional<Algorithm> algorithmFromName(const std::string& name);
+
+    /**
+     * The path the digest of an image is written to on close.
+     *
+     * @param[in] imagePath - where the image is staged.
+     * @param[in] algorithm - the digest computed.
+     * @return the path
+     */
+    static std::string digestPathFor(const std::string& imagePath,
+                                     Algorithm algorithm);
+
+  private:
+    struct CtxFree
+    {
+        void operator()(EVP_MD_CTX* ctx) const
+        {
+            EVP_MD_CTX_free(ctx);
+        }
+    };
+
+    /** Starts over, with nothing hashed. */
+    void reset();
+    /**
+     * Whether bytes written from offset to end are the next to be hashed.
+     * If they aren't, they're noted as pending or the digest is given up.
+     */
+    bool nextInLine(std::uint32_t offset, std::uint64_t end);
+    /** Notes bytes that were written ahead of the hashed ones. */
+    void addPending(std::uint64_t start, std::uint64_t end);
+    /** Reads back and hashes the pending bytes that are next in line. */
+    void hashPending();
+
+    std::unique_ptr<ImageHandlerInterface> handler;
+    const EVP_MD* md;
+    std::unique_ptr<EVP_MD_CTX, CtxFree> ctx;
+    std::string imagePath;
+    std::string digestPath;
+
+    /** Bytes from the start of the image that are hashed. */
+    std::uint64_t hashed = 0;
+    /** Written but not yet hashed ranges, start to end. */
+    std::map<std::uint64_t, std::uint64_t> pending;
+    /** Whether the digest can still be computed. */
+    bool valid = true;
+};
+
+} // namespace ipmi_flash
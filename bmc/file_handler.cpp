@@ -16,62 +16,263 @@
 
 #include "file_handler.hpp"
 
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
 #include <filesystem>
 #include <ios>
 #include <optional>
+#include <span>
 #include <utility>
 #include <vector>
 
 namespace ipmi_flash
 {
 
+FileHandler::~FileHandler()
+{
+    close();
+}
+
 bool FileHandler::open(const std::string& path, std::ios_base::openmode mode)
 {
-    /* force binary mode */
-    mode |= std::ios::binary;
     this->path = path;
 
-    if (file.is_open())
+    if (fd >= 0)
     {
         return true;
     }
-    file.open(filename, mode);
-    return file.good();
+
+    writable = (mode & std::ios::out) != 0;
+    int flags = O_CLOEXEC;
+    if (!writable)
+    {
+        flags |= O_RDONLY;
+    }
+    else if (mode & (std::ios::in | std::ios::app))
+    {
+        /* What's there is kept, to be reused or written after. */
+        flags |= O_RDWR;
+    }
+    else
+    {
+        /* Like an fstream opened for output, the file is created or emptied.
+         * It's readable too, so what was written can be read back.
+         */
+        flags |= O_RDWR | O_CREAT | O_TRUNC;
+    }
+
+    fd = ::open(filename.c_str(), flags, 0644);
+    if (fd < 0)
+    {
+        return false;
+    }
+
+    struct stat st;
+    if (::fstat(fd, &st) < 0)
+    {
+        std::perror("Failed to stat the file");
+        close();
+        return false;
+    }
+    size = st.st_size;
+    unsynced = 0;
+    fdHandedOut = false;
+
+    /* Reserving the blocks up front keeps the image from being fragmented
+     * across the staging storage.  It's only an optimization, so a filesystem
+     * that doesn't support it isn't an error.
+     */
+    if (writable && options.preallocate > 0 &&
+        ::fallocate(fd, FALLOC_FL_KEEP_SIZE, 0, options.preallocate) < 0 &&
+        errno != EOPNOTSUPP)
+    {
+        std::perror("Failed to preallocate the file");
+    }
+
+    return true;
 }
 
 void FileHandler::close()
 {
-    file.close();
+    if (fd < 0)
+    {
+        return;
+    }
+
+    /* Callers that need to know the image is on storage flush() first. */
+    flush();
+
+    /* The host doesn't say how large the image is before sending it, so the
+     * reservation is a size from the config.  Truncating the file to its own
+     * size gives back whatever the image didn't use, rather than leaving it
+     * allocated past the end of the file.
+     */
+    struct stat st;
+    if (writable && options.preallocate > 0 && ::fstat(fd, &st) == 0 &&
+        options.preallocate > static_cast<std::uint64_t>(st.st_size) &&
+        ::ftruncate(fd, st.st_size) < 0)
+    {
+        std::perror("Failed to release the unused preallocation");
+    }
+
+    ::close(fd);
+    fd = -1;
+}
+
+bool FileHandler::flush()
+{
+    if (fd < 0 || !writable || options.sync == FileSync::none)
+    {
+        return true;
+    }
+
+    /* Writes through a handed out descriptor aren't counted. */
+    if (unsynced == 0 && !fdHandedOut)
+    {
+        return true;
+    }
+
+    return sync();
+}
+
+bool FileHandler::sync()
+{
+    unsynced = 0;
+    if (::fdatasync(fd) < 0)
+    {
+        std::perror("Failed to sync the file");
+        return false;
+    }
+    return true;
 }
 
 bool FileHandler::write(std::uint32_t offset,
                         const std::vector<std::uint8_t>& data)
 {
-    file.seekp(offset);
-    file.write(reinterpret_cast<const char*>(data.data()), data.size());
-    return file.good();
+    return writeSpan(offset, data);
+}
+
+bool FileHandler::writeSpan(std::uint32_t offset,
+                            std::span<const std::uint8_t> data)
+{
+    if (fd < 0 || !writable)
+    {
+        return false;
+    }
+
+    std::size_t done = 0;
+    while (done < data.size())
+    {
+        ssize_t ret = ::pwrite(fd, data.data() + done, data.size() - done,
+                               static_cast<off_t>(offset) + done);
+        if (ret < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            std::perror("Failed to write the file");
+            return false;
+        }
+        done += ret;
+    }
+
+    size = std::max<std::uint64_t>(size, std::uint64_t{offset} + done);
+
+    unsynced += done;
+    if (options.sync == FileSync::batched && unsynced >= options.syncInterval)
+    {
+        return sync();
+    }
+
+    return true;
+}
+
+bool FileHandler::fill(std::uint32_t offset, std::uint32_t length,
+                       std::uint8_t value)
+{
+    if (fd < 0 || !writable)
+    {
+        return false;
+    }
+
+    /* Zeros don't have to be written.  What the file already has is punched
+     * out, and past its end it's only made longer, so the region is a hole
+     * that takes no space on the staging storage.
+     */
+    if (value != 0 || length == 0)
+    {
+        return ImageHandlerInterface::fill(offset, length, value);
+    }
+
+    std::uint64_t current = static_cast<std::uint32_t>(getSize());
+    std::uint64_t end = std::uint64_t{offset} + length;
+
+    if (offset < current &&
+        ::fallocate(fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, offset,
+                    std::min(end, current) - offset) < 0)
+    {
+        if (errno != EOPNOTSUPP)
+        {
+            std::perror("Failed to punch a hole in the file");
+            return false;
+        }
+        return ImageHandlerInterface::fill(offset, length, value);
+    }
+
+    if (end > current && ::ftruncate(fd, static_cast<off_t>(end)) < 0)
+    {
+        std::perror("Failed to extend the file");
+        return false;
+    }
+
+    size = std::max(size, end);
+    return true;
 }
 
 std::optional<std::vector<uint8_t>> FileHandler::read(std::uint32_t offset,
                                                       std::uint32_t size)
 {
     uint32_t file_size = getSize();
-    if (offset > file_size)
+    if (fd < 0 || offset > file_size)
     {
         return std::nullopt;
     }
     std::vector<uint8_t> ret(std::min(file_size - offset, size));
-    file.seekg(offset);
-    file.read(reinterpret_cast<char*>(ret.data()), ret.size());
-    if (!file.good())
+
+    std::size_t done = 0;
+    while (done < ret.size())
     {
-        return std::nullopt;
+        ssize_t bytes = ::pread(fd, ret.data() + done, ret.size() - done,
+                                static_cast<off_t>(offset) + done);
+        if (bytes < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (bytes <= 0)
+        {
+            return std::nullopt;
+        }
+        done += bytes;
     }
     return ret;
 }
 
 int FileHandler::getSize()
 {
+    /* Writes through a handed out descriptor aren't seen here, so the size is
+     * only known without asking once nothing else can write the file.
+     */
+    if (fd >= 0 && !fdHandedOut)
+    {
+        return size;
+    }
+
     std::error_code ec;
     auto ret = std::filesystem::file_size(filename, ec);
     if (ec)
@@ -84,4 +285,15 @@ int FileHandler::getSize()
     return ret;
 }
 
+int FileHandler::getFd()
+{
+    if (fd < 0 || !writable)
+    {
+        return -1;
+    }
+
+    fdHandedOut = true;
+    return fd;
+}
+
 } // namespace ipmi_flash
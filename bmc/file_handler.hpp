@@ -5,12 +5,38 @@
 #include <cstdint>
 #include <fstream>
 #include <memory>
+#include <span>
 #include <string>
 #include <vector>
 
 namespace ipmi_flash
 {
 
+/** When the bytes written to a FileHandler are synced to storage. */
+enum class FileSync
+{
+    /* Left to the kernel. */
+    none,
+    /* Every FileOptions::syncInterval bytes, and on close. */
+    batched,
+    /* Only once the image is complete, on flush() or close. */
+    onClose,
+};
+
+struct FileOptions
+{
+    /* Bytes reserved for the file when it's opened for writing, 0 for none.
+     * The size of the file doesn't change, only its blocks are allocated, and
+     * those past the end of the file are freed when it's closed.
+     */
+    std::uint64_t preallocate = 0;
+
+    FileSync sync = FileSync::none;
+
+    /* Bytes written between syncs, for FileSync::batched. */
+    std::uint64_t syncInterval = 4 * 1024 * 1024;
+};
+
 class FileHandler : public ImageHandlerInterface
 {
   public:
@@ -19,27 +45,63 @@ class FileHandler : public ImageHandlerInterface
      *
      * @param[in] filename - file to use for the contents, fully
      * qualified file system path.
+     * @param[in] options - how the file is allocated and synced.
      */
-    explicit FileHandler(const std::string& filename) : filename(filename) {}
+    explicit FileHandler(const std::string& filename,
+                         const FileOptions& options = FileOptions()) :
+        filename(filename), options(options)
+    {}
+    ~FileHandler() override;
+
+    FileHandler(const FileHandler&) = delete;
+    FileHandler& operator=(const FileHandler&) = delete;
 
     bool open(const std::string& path,
               std::ios_base::openmode mode = std::ios::out) override;
     void close() override;
     bool write(std::uint32_t offset,
                const std::vector<std::uint8_t>& data) override;
+    bool writeSpan(std::uint32_t offset,
+                   std::span<const std::uint8_t> data) override;
+    bool fill(std::uint32_t offset, std::uint32_t length,
+              std::uint8_t value) override;
     virtual std::optional<std::vector<uint8_t>> read(
         std::uint32_t offset, std::uint32_t size) override;
     int getSize() override;
+    int getFd() override;
+
+    /**
+     * Syncs what was written since the last sync, unless the sync policy is
+     * none.  It's how a failure to sync is reported, close() can't.
+     */
+    bool flush() override;
 
   private:
+    /** Syncs the data written so far, returns false on failure. */
+    bool sync();
+
     /** the active hash path, ignore. */
     std::string path;
 
-    /** The file handle. */
-    std::fstream file;
+    /** The file descriptor, -1 while closed. */
+    int fd = -1;
+
+    /** Whether the file was opened for writing. */
+    bool writable = false;
+
+    /** Whether getFd() handed out the descriptor, so the size isn't known. */
+    bool fdHandedOut = false;
+
+    /** The size of the file while it's open. */
+    std::uint64_t size = 0;
+
+    /** Bytes written since the last sync. */
+    std::uint64_t unsynced = 0;
 
     /** The filename (including path) to use to write bytes. */
     std::string filename;
+
+    FileOptions options;
 };
 
 } // namespace ipmi_flash
@@ -2,6 +2,8 @@
 
 #include <cstdint>
 #include <memory>
+#include <optional>
+#include <span>
 #include <vector>
 
 namespace ipmi_flash
@@ -38,6 +40,79 @@ class DataInterface
      */
     virtual std::vector<std::uint8_t> copyFrom(std::uint32_t length) = 0;
 
+    /**
+     * Copy bytes from an offset within the external interface's window
+     * (blocking call).  Transports without a shared window only support an
+     * offset of 0.
+     *
+     * @param[in] windowOffset - offset into the window where the data starts
+     * @param[in] length - number of bytes to copy
+     * @return the bytes read
+     */
+    virtual std::vector<std::uint8_t> copyFromWindow(std::uint32_t windowOffset,
+                                                     std::uint32_t length)
+    {
+        if (windowOffset != 0)
+        {
+            return {};
+        }
+
+        return copyFrom(length);
+    }
+
+    /**
+     * Lend bytes from the external interface (blocking call).  Transports that
+     * already hold the data in memory return it in place, the bytes stay valid
+     * until the next call on this interface.
+     *
+     * @param[in] length - number of bytes to lend
+     * @return the bytes read
+     */
+    virtual std::span<const std::uint8_t> borrow(std::uint32_t length) = 0;
+
+    /**
+     * Lend bytes from an offset within the external interface's window
+     * (blocking call), see borrow() and copyFromWindow().
+     *
+     * @param[in] windowOffset - offset into the window where the data starts
+     * @param[in] length - number of bytes to lend
+     * @return the bytes read
+     */
+    virtual std::span<const std::uint8_t> borrowFromWindow(
+        std::uint32_t windowOffset, std::uint32_t length) = 0;
+
+    /**
+     * Copy bytes from the external interface straight into a file, without
+     * passing them through memory here (blocking call).  Transports that can't
+     * do this return std::nullopt, and the caller uses copyFrom() instead.
+     *
+     * @param[in] fd - the file to write, only positioned writes are used
+     * @param[in] offset - offset into the file to write at
+     * @param[in] length - number of bytes to copy
+     * @return the number of bytes written, or std::nullopt if unsupported
+     */
+    virtual std::optional<std::uint32_t> copyToFile(int fd,
+                                                    std::uint32_t offset,
+                                                    std::uint32_t length)
+    {
+        (void)fd;
+        (void)offset;
+        (void)length;
+        return std::nullopt;
+    }
+
+    /**
+     * Whether copyToFile() would write the next bytes into a file.  The caller
+     * only asks the image handler for a file when it would, since one that
+     * hands out its file can't keep track of what's in it.
+     *
+     * @return true if copyToFile() is supported for the next bytes
+     */
+    virtual bool canCopyToFile()
+    {
+        return false;
+    }
+
     /**
      * set configuration.
      *
@@ -0,0 +1,144 @@
+/*
+ * Copyright 2026 Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "decompress_handler.hpp"
+
+#include <zstd.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <optional>
+#include <span>
+#include <string>
+#include <vector>
+
+namespace ipmi_flash
+{
+
+DecompressHandler::DecompressHandler(ImageHandlerInterface* handler) :
+    handler(handler), ctx(ZSTD_createDCtx(), ZSTD_freeDCtx),
+    output(ZSTD_DStreamOutSize())
+{
+    /* A frame asking for a larger window than the BMC can spare fails,
+     * instead of the allocation.
+     */
+    if (ctx)
+    {
+        ZSTD_DCtx_setParameter(ctx.get(), ZSTD_d_windowLogMax, windowLogMax);
+    }
+}
+
+bool DecompressHandler::open(const std::string& path,
+                             std::ios_base::openmode mode)
+{
+    if (!ctx)
+    {
+        std::fprintf(stderr, "Unable to allocate the decompression context\n");
+        return false;
+    }
+
+    /* The image is written from its start, the stream can't be continued. */
+    if (mode != std::ios::out)
+    {
+        return false;
+    }
+
+    ZSTD_DCtx_reset(ctx.get(), ZSTD_reset_session_only);
+    streamOffset = 0;
+    imageOffset = 0;
+    frameEnded = true;
+
+    return handler->open(path, mode);
+}
+
+void DecompressHandler::close()
+{
+    handler->close();
+}
+
+bool DecompressHandler::write(std::uint32_t offset,
+                              const std::vector<std::uint8_t>& data)
+{
+    return writeSpan(offset, data);
+}
+
+bool DecompressHandler::writeSpan(std::uint32_t offset,
+                                  std::span<const std::uint8_t> data)
+{
+    if (offset != streamOffset)
+    {
+        std::fprintf(stderr, "Compressed data at %u, expected it at %u\n",
+                     offset, streamOffset);
+        return false;
+    }
+    if (data.empty())
+    {
+        return true;
+    }
+
+    ZSTD_inBuffer in = {data.data(), data.size(), 0};
+
+    /* A full output buffer may leave more to flush once the input's used. */
+    bool full = true;
+    while (in.pos < in.size || full)
+    {
+        ZSTD_outBuffer out = {output.data(), output.size(), 0};
+        std::size_t result = ZSTD_decompressStream(ctx.get(), &out, &in);
+        if (ZSTD_isError(result))
+        {
+            std::fprintf(stderr, "Unable to decompress data at %u: %s\n",
+                         offset, ZSTD_getErrorName(result));
+            return false;
+        }
+
+        if (out.pos > 0 &&
+            !handler->writeSpan(imageOffset,
+                                std::span(output).first(out.pos)))
+        {
+            return false;
+        }
+
+        imageOffset += out.pos;
+        frameEnded = (result == 0);
+        full = (out.pos == out.size);
+    }
+
+    streamOffset += data.size();
+    return true;
+}
+
+std::optional<std::vector<std::uint8_t>> DecompressHandler::read(
+    std::uint32_t offset, std::uint32_t size)
+{
+    return handler->read(offset, size);
+}
+
+int DecompressHandler::getSize()
+{
+    return handler->getSize();
+}
+
+bool DecompressHandler::flush()
+{
+    return handler->flush();
+}
+
+std::vector<std::uint8_t> DecompressHandler::getDigest()
+{
+    return handler->getDigest();
+}
+
+} // namespace ipmi_flash
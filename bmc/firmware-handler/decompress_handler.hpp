@@ -0,0 +1,72 @@
+#pragma once
+
+#include "image_handler.hpp"
+
+#include <zstd.h>
+
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <span>
+#include <string>
+#include <vector>
+
+namespace ipmi_flash
+{
+
+/**
+ * Image handler that decompresses a zstd stream as it's written, and writes
+ * what comes out to another image handler.  That handler sees the image's
+ * offsets, as if it had been sent uncompressed.
+ *
+ * The stream has to be written in order, and there's no descriptor for
+ * transports to write it into directly.
+ */
+class DecompressHandler : public ImageHandlerInterface
+{
+  public:
+    /** The most memory a frame may need to be decompressed, 1 << 23 bytes. */
+    static constexpr int windowLogMax = 23;
+
+    /**
+     * Create a DecompressHandler.
+     *
+     * @param[in] handler - the handler the decompressed image is written to,
+     * which must outlive this one.
+     */
+    explicit DecompressHandler(ImageHandlerInterface* handler);
+
+    bool open(const std::string& path, std::ios_base::openmode mode) override;
+    void close() override;
+    bool write(std::uint32_t offset,
+               const std::vector<std::uint8_t>& data) override;
+    bool writeSpan(std::uint32_t offset,
+                   std::span<const std::uint8_t> data) override;
+    std::optional<std::vector<std::uint8_t>> read(std::uint32_t offset,
+                                                  std::uint32_t size) override;
+    int getSize() override;
+    bool flush() override;
+    std::vector<std::uint8_t> getDigest() override;
+
+    /**
+     * Check the stream isn't cut off in the middle of a frame.
+     *
+     * @return bool - returns true if every frame written was complete.
+     */
+    bool finished() const
+    {
+        return frameEnded;
+    }
+
+  private:
+    ImageHandlerInterface* handler;
+    std::unique_ptr<ZSTD_DCtx, decltype(&ZSTD_freeDCtx)> ctx;
+    std::vector<std::uint8_t> output;
+
+    /** How far into the stream and the image the writes have reached. */
+    std::uint32_t streamOffset = 0;
+    std::uint32_t imageOffset = 0;
+    bool frameEnded = true;
+};
+
+} // namespace ipmi_flash
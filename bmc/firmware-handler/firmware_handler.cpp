@@ -16,6 +16,7 @@
 
 #include "firmware_handler.hpp"
 
+#include "crc32c.hpp"
 #include "data.hpp"
 #include "flags.hpp"
 #include "image_handler.hpp"
@@ -29,6 +30,7 @@
 #include <cstring>
 #include <fstream>
 #include <memory>
+#include <span>
 #include <string>
 #include <vector>
 
@@ -141,10 +143,62 @@ bool FirmwareBlobHandler::stat(const std::string& path, blobs::BlobMeta* meta)
 
     /* Older host tools expect the blobState to contain a bitmask of available
      * transport backends, so report that we support all of them in order to
-     * preserve backwards compatibility.
+     * preserve backwards compatibility.  The option bits stay set along with
+     * them, as they always were, so the options taken are listed in the
+     * metadata instead.
      */
-    meta->blobState = transportMask;
+    meta->blobState = transportMask | optionMask;
     meta->size = 0;
+
+    struct BlobOptionsHdr options = {blobOptions};
+    auto* optionBytes = reinterpret_cast<const std::uint8_t*>(&options);
+    meta->metadata.assign(optionBytes, optionBytes + sizeof(options));
+
+    /* In a transaction, the signature can't be replaced while the one for an
+     * earlier image is still being verified.
+     */
+    if (path == hashBlobId && verifyingEarlier())
+    {
+        meta->blobState |= blobs::StateFlags::committing;
+    }
+
+    /* What's left of an earlier session's image is described, so the host
+     * can tell whether it has to send it again, or where to resume.
+     */
+    auto h = std::find_if(
+        handlers.begin(), handlers.end(),
+        [&path](const auto& iter) { return (iter.blobName == path); });
+    if (h != handlers.end() && !fileOpen())
+    {
+        struct StagedImageHdr header = {};
+        if (path == progressPath)
+        {
+            header.written = progress.written();
+            header.checkpoint = progress.checkpoint();
+            header.crc = progress.checkpointCrc();
+            meta->size = progress.end();
+        }
+
+        auto staged = h->handler->getStaged();
+        if (staged)
+        {
+            meta->size = staged->size;
+        }
+
+        if (staged || header.written > 0)
+        {
+            auto* bytes = reinterpret_cast<const std::uint8_t*>(&header);
+            meta->metadata.insert(meta->metadata.end(), bytes,
+                                  bytes + sizeof(header));
+            if (staged)
+            {
+                meta->metadata.insert(meta->metadata.end(),
+                                      staged->digest.begin(),
+                                      staged->digest.end());
+            }
+        }
+    }
+
     return true;
 }
 
@@ -165,7 +219,8 @@ ActionStatus FirmwareBlobHandler::getActionStatus()
             {
                 break;
             }
-            value = pack->verification->status();
+            value = transaction ? getTransactionVerifyStatus()
+                                : pack->verification->status();
             lastVerificationStatus = value;
             break;
         case UpdateState::verificationCompleted:
@@ -179,7 +234,8 @@ ActionStatus FirmwareBlobHandler::getActionStatus()
             {
                 break;
             }
-            value = pack->update->status();
+            value = transaction ? getTransactionUpdateStatus()
+                                : pack->update->status();
             lastUpdateStatus = value;
             break;
         case UpdateState::updateCompleted:
@@ -192,6 +248,83 @@ ActionStatus FirmwareBlobHandler::getActionStatus()
     return value;
 }
 
+ActionStatus FirmwareBlobHandler::getTransactionVerifyStatus()
+{
+    /* They're all verified at once, and all have to pass. */
+    bool running = false;
+    for (auto* pack : getActionPacks())
+    {
+        switch (pack->verification->status())
+        {
+            case ActionStatus::failed:
+                return ActionStatus::failed;
+            case ActionStatus::success:
+                break;
+            default:
+                running = true;
+                break;
+        }
+    }
+
+    return running ? ActionStatus::running : ActionStatus::success;
+}
+
+ActionStatus FirmwareBlobHandler::getTransactionUpdateStatus()
+{
+    /* The updates run one at a time, in the order the images were sent, so
+     * only the last one, usually the BMC's own, reboots.
+     */
+    auto packs = getActionPacks();
+    while (updating < packs.size())
+    {
+        ActionStatus value = packs[updating]->update->status();
+        if (value != ActionStatus::success)
+        {
+            return (value == ActionStatus::failed) ? ActionStatus::failed
+                                                   : ActionStatus::running;
+        }
+
+        if (++updating < packs.size() && !packs[updating]->update->trigger())
+        {
+            std::fprintf(stderr, "Failed to start the update of %s\n",
+                         (updating < transactionTypes.size())
+                             ? transactionTypes[updating].c_str()
+                             : openedFirmwareType.c_str());
+            return ActionStatus::failed;
+        }
+    }
+
+    return ActionStatus::success;
+}
+
+std::vector<ActionPack*> FirmwareBlobHandler::getActionPacks()
+{
+    std::vector<ActionPack*> packs;
+    for (const auto& type : transactionTypes)
+    {
+        packs.push_back(actionPacks[type].get());
+    }
+
+    auto* pack = getActionPack();
+    if (pack)
+    {
+        packs.push_back(pack);
+    }
+
+    return packs;
+}
+
+bool FirmwareBlobHandler::verifyingEarlier()
+{
+    return std::any_of(transactionTypes.begin(), transactionTypes.end(),
+                       [this](const auto& type) {
+                           auto value =
+                               actionPacks[type]->verification->status();
+                           return value != ActionStatus::success &&
+                                  value != ActionStatus::failed;
+                       });
+}
+
 /*
  * Return stat information on an open session.  It therefore must be an active
  * handle to either the active image or active hash.
@@ -205,6 +338,8 @@ bool FirmwareBlobHandler::stat(uint16_t session, blobs::BlobMeta* meta)
     }
 
     /* The size here refers to the size of the file -- of something analogous.
+     * Writes still queued for the image land first, but it isn't flushed, that
+     * would end the image mid-upload.
      */
     meta->size = (item->second->imageHandler)
                      ? item->second->imageHandler->getSize()
@@ -217,14 +352,34 @@ bool FirmwareBlobHandler::stat(uint16_t session, blobs::BlobMeta* meta)
     {
         ActionStatus value = getActionStatus();
 
+        /* A chained update is part of the verify session's status. */
+        bool chained = thenUpdate && item->second->activePath == verifyBlobId;
+        if (chained && state == UpdateState::verificationStarted &&
+            value == ActionStatus::success)
+        {
+            chainUpdate();
+            value = getActionStatus();
+        }
+
         meta->metadata.push_back(static_cast<std::uint8_t>(value));
+        if (chained)
+        {
+            meta->metadata.push_back(
+                state == UpdateState::updateStarted ||
+                state == UpdateState::updateCompleted);
+        }
 
         /* Change the firmware handler's state and the blob's stat value
          * depending.
          */
         if (value == ActionStatus::success || value == ActionStatus::failed)
         {
-            if (item->second->activePath == verifyBlobId)
+            if (chained)
+            {
+                lastUpdateStatus = value;
+                changeState(UpdateState::updateCompleted);
+            }
+            else if (item->second->activePath == verifyBlobId)
             {
                 changeState(UpdateState::verificationCompleted);
             }
@@ -248,9 +403,18 @@ bool FirmwareBlobHandler::stat(uint16_t session, blobs::BlobMeta* meta)
     }
 
     /* The blobState here relates to an active session, so we should return the
-     * flags used to open this session.
+     * flags used to open this session, without the options it was opened with.
+     */
+    meta->blobState = item->second->flags & ~optionMask;
+
+    /* Transports with a chunk header can send a fill in place of the chunk,
+     * or have it checked before it's written.
      */
-    meta->blobState = item->second->flags;
+    if (item->second->dataHandler && item->second->imageHandler)
+    {
+        meta->blobState |= FirmwareFlags::SessionFlags::fillChunks;
+        meta->blobState |= FirmwareFlags::SessionFlags::checkChunks;
+    }
 
     /* The metadata blob returned comes from the data handler... it's used for
      * instance, in P2A bridging to get required information about the mapping,
@@ -386,6 +550,7 @@ bool FirmwareBlobHandler::open(uint16_t session, uint16_t flags,
      * opening the one they already opened during this update sequence, or it's
      * the first time they're opening it.
      */
+    bool nextInTransaction = false;
     if (path != hashBlobId)
     {
         /* If they're not opening the hashBlobId they must be opening a firmware
@@ -396,9 +561,19 @@ bool FirmwareBlobHandler::open(uint16_t session, uint16_t flags,
             /* First time for this sequence. */
             openedFirmwareType = path;
         }
-        else
+        else if (openedFirmwareType != path)
         {
-            if (openedFirmwareType != path)
+            /* In a transaction, another firmware type can follow once the
+             * one before it has its image and hash.
+             */
+            nextInTransaction =
+                transaction &&
+                (flags & FirmwareFlags::UpdateFlags::transaction) &&
+                state == UpdateState::verificationPending &&
+                std::count(blobIDs.begin(), blobIDs.end(), activeHashBlobId) &&
+                std::count(transactionTypes.begin(), transactionTypes.end(),
+                           path) == 0;
+            if (!nextInTransaction)
             {
                 /* Previously, in this sequence they opened /flash/image, and
                  * now they're opening /flash/bios without finishing out
@@ -410,6 +585,13 @@ bool FirmwareBlobHandler::open(uint16_t session, uint16_t flags,
             }
         }
     }
+    else if (verifyingEarlier())
+    {
+        /* The verification of the image before may still read the signature.
+         */
+        std::fprintf(stderr, "Signature still in use, can't replace it\n");
+        return false;
+    }
 
     /* There are two abstractions at play, how you get the data and how you
      * handle that data. such that, whether the data comes from the PCI bridge
@@ -431,6 +613,51 @@ bool FirmwareBlobHandler::open(uint16_t session, uint16_t flags,
 
     /* We found the transport handler they requested */
 
+    /* Do we have a file handler for the type of file they're opening.
+     * Note: This should only fail if something is somehow crazy wrong.
+     * Since the canHandle() said yes, and that's tied into the list of explicit
+     * firmware handers (and file handlers, like this'll know where to write the
+     * tarball, etc).
+     */
+    auto h = std::find_if(
+        handlers.begin(), handlers.end(),
+        [&path](const auto& iter) { return (iter.blobName == path); });
+    if (h == handlers.end())
+    {
+        return false;
+    }
+
+    /* The staged image is only kept if there's one the host can check. */
+    std::ios_base::openmode mode = std::ios::out;
+    if (flags & FirmwareFlags::UpdateFlags::reuseStaged)
+    {
+        if (path == hashBlobId || !h->handler->getStaged())
+        {
+            return false;
+        }
+        mode |= std::ios::in;
+    }
+
+    /* An upload is only resumed where the host could check what came before.
+     */
+    if (flags & FirmwareFlags::UpdateFlags::resume)
+    {
+        if (path != progressPath || progress.checkpoint() == 0)
+        {
+            return false;
+        }
+        mode |= std::ios::app;
+    }
+
+    /* A compressed stream is decompressed from its start, so it can't add to
+     * an image that's kept.
+     */
+    bool compressed = flags & FirmwareFlags::UpdateFlags::compressed;
+    if (compressed && mode != std::ios::out)
+    {
+        return false;
+    }
+
     /* Elsewhere I do this check by checking "if ::ipmi" because that's the
      * only non-external data pathway -- but this is just a more generic
      * approach to that.
@@ -444,26 +671,78 @@ bool FirmwareBlobHandler::open(uint16_t session, uint16_t flags,
         }
     }
 
-    /* Do we have a file handler for the type of file they're opening.
-     * Note: This should only fail if something is somehow crazy wrong.
-     * Since the canHandle() said yes, and that's tied into the list of explicit
-     * firmware handers (and file handlers, like this'll know where to write the
-     * tarball, etc).
-     */
-    auto h = std::find_if(
-        handlers.begin(), handlers.end(),
-        [&path](const auto& iter) { return (iter.blobName == path); });
-    if (h == handlers.end())
+    ImageHandlerInterface* image = h->handler.get();
+    if (compressed)
     {
-        return false;
+        decompressor = std::make_unique<DecompressHandler>(image);
+        image = decompressor.get();
     }
 
     /* Ok, so we found a handler that matched, so call open() */
-    if (!h->handler->open(path, std::ios::out))
+    if (!image->open(path, mode))
+    {
+        if (d->handler)
+        {
+            d->handler->close();
+        }
+        return false;
+    }
+
+    /* The image may have been cleaned up since, then there's nothing to
+     * resume.
+     */
+    if ((mode & std::ios::app) &&
+        static_cast<std::uint64_t>(std::max(h->handler->getSize(), 0)) <
+            progress.checkpoint())
     {
+        std::fprintf(stderr, "%s is shorter than its checkpoint\n",
+                     path.c_str());
+        h->handler->close();
+        if (d->handler)
+        {
+            d->handler->close();
+        }
         return false;
     }
 
+    /* The signature the host sent is for the image before this one, so it's
+     * verified now, while this one is sent.  Nothing after it can fail, so
+     * the transaction only moves on once the open succeeds.
+     */
+    if (nextInTransaction)
+    {
+        auto* pack = getActionPack();
+        if (!pack || !pack->verification->trigger())
+        {
+            std::fprintf(stderr, "Failed to start verifying %s\n",
+                         openedFirmwareType.c_str());
+            image->close();
+            if (d->handler)
+            {
+                d->handler->close();
+            }
+            return false;
+        }
+
+        transactionTypes.push_back(openedFirmwareType);
+        openedFirmwareType = path;
+        preparationTriggered = false;
+        removeBlobId(activeHashBlobId);
+    }
+    else if (path != hashBlobId && transactionTypes.empty())
+    {
+        /* Whether the first type starts a transaction is up to its last open.
+         */
+        transaction = flags & FirmwareFlags::UpdateFlags::transaction;
+    }
+
+    /* Where a compressed upload got to can't be resumed from. */
+    if (path != hashBlobId && mode == std::ios::out)
+    {
+        progress.reset();
+        progressPath = compressed ? "" : path;
+    }
+
     Session* curr;
     const char* active;
 
@@ -481,7 +760,7 @@ bool FirmwareBlobHandler::open(uint16_t session, uint16_t flags,
 
     curr->flags = flags;
     curr->dataHandler = d->handler.get();
-    curr->imageHandler = h->handler.get();
+    curr->imageHandler = image;
 
     lookup[session] = curr;
 
@@ -523,12 +802,85 @@ bool FirmwareBlobHandler::write(uint16_t session, uint32_t offset,
         return false;
     }
 
-    std::vector<std::uint8_t> bytes;
+    /* Nothing is copied on the way to the image handler, the bytes are either
+     * the IPMI payload itself or lent by the transport.
+     */
+    std::span<const std::uint8_t> bytes;
 
     if (item->second->flags & FirmwareFlags::UpdateFlags::ipmi)
     {
         bytes = data;
     }
+    else if (data.size() == sizeof(ExtChunkWindowHdr))
+    {
+        /* The host staged this chunk at an offset within the window, so it
+         * can stage the next chunk while this one is being copied out.
+         */
+        struct ExtChunkWindowHdr header;
+
+        std::memcpy(&header, data.data(), data.size());
+        bytes = item->second->dataHandler->borrowFromWindow(
+            header.windowOffset, header.length);
+        if (bytes.size() != header.length)
+        {
+            return false;
+        }
+    }
+    else if (data.size() == sizeof(ExtChunkCrcHdr))
+    {
+        /* The host asked for the chunk to be checked before it's written, so
+         * it can't be copied straight into the file.
+         */
+        struct ExtChunkCrcHdr header;
+
+        std::memcpy(&header, data.data(), data.size());
+        bytes = (header.windowOffset == 0)
+                    ? item->second->dataHandler->borrow(header.length)
+                    : item->second->dataHandler->borrowFromWindow(
+                          header.windowOffset, header.length);
+        if (bytes.size() != header.length)
+        {
+            return false;
+        }
+
+        if (crc32c(0, bytes) != header.crc)
+        {
+            std::fprintf(stderr, "Chunk at %u failed its CRC check\n", offset);
+            return false;
+        }
+    }
+    else if (data.size() == sizeof(ExtChunkFillHdr))
+    {
+        /* Nothing was staged, the region is all one byte value. */
+        struct ExtChunkFillHdr header;
+
+        std::memcpy(&header, data.data(), data.size());
+        if (!item->second->imageHandler->fill(offset, header.length,
+                                              header.value))
+        {
+            if (item->second == &activeImage)
+            {
+                progress.reset();
+            }
+            return false;
+        }
+
+        if (item->second == &activeImage && !decompressing(*item->second))
+        {
+            std::vector<std::uint8_t> run(
+                std::min<std::uint32_t>(header.length,
+                                        UploadProgress::checkpointSize),
+                header.value);
+            for (std::uint32_t done = 0; done < header.length;
+                 done += run.size())
+            {
+                progress.add(offset + done,
+                             std::span(run).first(std::min<std::uint32_t>(
+                                 header.length - done, run.size())));
+            }
+        }
+        return true;
+    }
     else
     {
         /* little endian required per design, and so on, but TODO: do endianness
@@ -542,10 +894,48 @@ bool FirmwareBlobHandler::write(uint16_t session, uint32_t offset,
         }
 
         std::memcpy(&header, data.data(), data.size());
-        bytes = item->second->dataHandler->copyFrom(header.length);
+
+        /* If both ends can, the transport writes straight into the staged
+         * file and the data never comes through here.  The file is only asked
+         * for when the transport can use it.
+         */
+        int fd = item->second->dataHandler->canCopyToFile()
+                     ? item->second->imageHandler->getFd()
+                     : -1;
+        if (fd >= 0)
+        {
+            auto copied = item->second->dataHandler->copyToFile(fd, offset,
+                                                                header.length);
+            /* The bytes can't be added to the progress without reading them
+             * back, so an upload sent this way has no checkpoint to resume.
+             */
+            if (copied)
+            {
+                return *copied == header.length;
+            }
+        }
+
+        bytes = item->second->dataHandler->borrow(header.length);
+    }
+
+    /* A write behind the image reports an earlier, already counted write
+     * failing here.
+     */
+    if (!item->second->imageHandler->writeSpan(offset, bytes))
+    {
+        if (item->second == &activeImage)
+        {
+            progress.reset();
+        }
+        return false;
+    }
+
+    if (item->second == &activeImage && !decompressing(*item->second))
+    {
+        progress.add(offset, bytes);
     }
 
-    return item->second->imageHandler->write(offset, bytes);
+    return true;
 }
 
 /*
@@ -587,7 +977,8 @@ bool FirmwareBlobHandler::writeMeta(uint16_t session, uint32_t,
  * For this file to have opened, the other two must be closed, which means any
  * out-of-band transport mechanism involved is closed.
  */
-bool FirmwareBlobHandler::commit(uint16_t session, const std::vector<uint8_t>&)
+bool FirmwareBlobHandler::commit(uint16_t session,
+                                 const std::vector<uint8_t>& data)
 {
     auto item = lookup.find(session);
     if (item == lookup.end())
@@ -607,9 +998,20 @@ bool FirmwareBlobHandler::commit(uint16_t session, const std::vector<uint8_t>&)
     switch (state)
     {
         case UpdateState::verificationPending:
+        {
             /* Set state to committing. */
             item->second->flags |= blobs::StateFlags::committing;
+
+            /* Older host tools commit without any data. */
+            struct VerifyCommitRequest request = {};
+            if (item->second->activePath == verifyBlobId &&
+                data.size() >= sizeof(request))
+            {
+                std::memcpy(&request, data.data(), sizeof(request));
+            }
+            thenUpdate = request.thenUpdate != 0;
             return triggerVerification();
+        }
         case UpdateState::verificationStarted:
             /* Calling repeatedly has no effect within an update process. */
             return true;
@@ -650,6 +1052,24 @@ bool FirmwareBlobHandler::close(uint16_t session)
     switch (state)
     {
         case UpdateState::uploadInProgress:
+            /* Everything written has to be in the image before it can be
+             * verified.
+             */
+            if (!flushImage(*item->second))
+            {
+                std::fprintf(stderr, "Failed to write out %s\n",
+                             item->second->activePath.c_str());
+                abortProcess();
+                return false;
+            }
+            if (decompressing(*item->second) && !decompressor->finished())
+            {
+                std::fprintf(stderr, "%s ends in the middle of a frame\n",
+                             item->second->activePath.c_str());
+                abortProcess();
+                return false;
+            }
+
             /* They are closing a data pathway (image, tarball, hash). */
             changeState(UpdateState::verificationPending);
 
@@ -786,19 +1206,40 @@ void FirmwareBlobHandler::abortProcess()
         }
         if (item.second->imageHandler)
         {
+            /* The progress is kept for a resume, unless writes it counted
+             * never made it.
+             */
+            flushImage(*item.second);
             item.second->imageHandler->close();
         }
     }
     lookup.clear();
 
     openedFirmwareType = "";
+    thenUpdate = false;
+    transaction = false;
+    transactionTypes.clear();
+    updating = 0;
     changeState(UpdateState::notYetStarted);
 }
 
+bool FirmwareBlobHandler::flushImage(Session& session)
+{
+    if (!session.imageHandler || session.imageHandler->flush())
+    {
+        return true;
+    }
+
+    if (&session == &activeImage)
+    {
+        progress.reset();
+    }
+    return false;
+}
+
 void FirmwareBlobHandler::abortVerification()
 {
-    auto* pack = getActionPack();
-    if (pack)
+    for (auto* pack : getActionPacks())
     {
         pack->verification->abort();
     }
@@ -812,39 +1253,104 @@ bool FirmwareBlobHandler::triggerVerification()
         return false;
     }
 
+    /* The update starts as soon as every verification is done, instead of
+     * when the host next checks.
+     */
+    if (thenUpdate)
+    {
+        for (auto* each : getActionPacks())
+        {
+            each->verification->setCallback(
+                [this](TriggerableActionInterface&) { chainUpdate(); });
+        }
+    }
+
     bool result = pack->verification->trigger();
     if (result)
     {
         changeState(UpdateState::verificationStarted);
+
+        /* It may have finished before there was a state to chain from. */
+        chainUpdate();
     }
 
     return result;
 }
 
+bool FirmwareBlobHandler::chainUpdate()
+{
+    if (!thenUpdate || state != UpdateState::verificationStarted ||
+        getActionStatus() != ActionStatus::success)
+    {
+        return false;
+    }
+
+    if (!triggerUpdate())
+    {
+        std::fprintf(stderr, "Failed to start the chained update\n");
+        lastUpdateStatus = ActionStatus::failed;
+        changeState(UpdateState::updateCompleted);
+        return false;
+    }
+
+    return true;
+}
+
 void FirmwareBlobHandler::abortUpdate()
 {
-    auto* pack = getActionPack();
-    if (pack)
+    auto packs = getActionPacks();
+    if (updating < packs.size())
     {
-        pack->update->abort();
+        packs[updating]->update->abort();
     }
 }
 
 bool FirmwareBlobHandler::triggerUpdate()
 {
-    auto* pack = getActionPack();
-    if (!pack)
+    /* In a transaction, the first update starts the others in turn. */
+    auto packs = getActionPacks();
+    if (packs.empty())
     {
         return false;
     }
 
-    bool result = pack->update->trigger();
+    if (transaction)
+    {
+        for (auto* each : packs)
+        {
+            each->update->setCallback(
+                [this](TriggerableActionInterface&) { nextUpdate(); });
+        }
+    }
+
+    updating = 0;
+    bool result = packs.front()->update->trigger();
     if (result)
     {
         changeState(UpdateState::updateStarted);
+
+        /* It may have finished before there was a state to go on from. */
+        nextUpdate();
     }
 
     return result;
 }
 
+void FirmwareBlobHandler::nextUpdate()
+{
+    if (!transaction || state != UpdateState::updateStarted)
+    {
+        return;
+    }
+
+    /* Checking the status starts the next update when the last one is done.
+     * A failure ends the transaction.
+     */
+    if (getTransactionUpdateStatus() == ActionStatus::failed)
+    {
+        lastUpdateStatus = ActionStatus::failed;
+        changeState(UpdateState::updateCompleted);
+    }
+}
+
 } // namespace ipmi_flash
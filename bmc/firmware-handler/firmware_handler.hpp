@@ -3,13 +3,17 @@
 #include "config.h"
 
 #include "data_handler.hpp"
+#include "decompress_handler.hpp"
+#include "flags.hpp"
 #include "image_handler.hpp"
 #include "status.hpp"
+#include "upload_progress.hpp"
 #include "util.hpp"
 
 #include <blobs-ipmid/blobs.hpp>
 
 #include <algorithm>
+#include <cstddef>
 #include <cstdint>
 #include <map>
 #include <memory>
@@ -212,8 +216,51 @@ class FirmwareBlobHandler : public blobs::GenericBlobInterface
         return !lookup.empty();
     }
 
+    /** Whether the session's data is decompressed before it's written. */
+    bool decompressing(const Session& session) const
+    {
+        return decompressor && session.imageHandler == decompressor.get();
+    }
+
+    /**
+     * Write out what's queued for the session's image.  The progress may
+     * already count queued writes, so it's forgotten if one of them failed.
+     *
+     * @return false if a queued write failed.
+     */
+    bool flushImage(Session& session);
+
+    /**
+     * The action packs of every firmware type in the sequence, in the order
+     * they were sent.  Only a transaction has more than one.
+     */
+    std::vector<ActionPack*> getActionPacks();
+
+    /** Whether an earlier firmware type's verification is still running, and
+     * may still read the signature.
+     */
+    bool verifyingEarlier();
+
+    /**
+     * Start the update of a verify commit that chained it, once the
+     * verification succeeded.  It's called from the verification's callback,
+     * and from stat() in case that hasn't run yet.
+     *
+     * @return true if the update was started.
+     */
+    bool chainUpdate();
+
+    /**
+     * Start the next update of a transaction once the one before succeeded.
+     * It's called from each update's callback, so the updates go on whether
+     * or not the host still checks on them.
+     */
+    void nextUpdate();
+
     ActionStatus getVerifyStatus();
     ActionStatus getActionStatus();
+    ActionStatus getTransactionVerifyStatus();
+    ActionStatus getTransactionUpdateStatus();
 
     /** List of handlers by type. */
     std::vector<HandlerPack> handlers;
@@ -245,6 +292,20 @@ class FirmwareBlobHandler : public blobs::GenericBlobInterface
     /** Track what firmware blobid they opened to start this sequence. */
     std::string openedFirmwareType;
 
+    /** Whether the sequence was opened as a transaction. */
+    bool transaction = false;
+
+    /** The firmware types sent before openedFirmwareType in a transaction.
+     * Their verification was started when the next one was opened.
+     */
+    std::vector<std::string> transactionTypes;
+
+    /** The firmware type in getActionPacks() whose update is running. */
+    std::size_t updating = 0;
+
+    /** Whether the verify commit asked for the update to follow it. */
+    bool thenUpdate = false;
+
     /* preparation is triggered once we go into uploadInProgress(), but only
      * once per full cycle, going back to notYetStarted resets this.
      */
@@ -255,10 +316,36 @@ class FirmwareBlobHandler : public blobs::GenericBlobInterface
 
     ActionStatus lastUpdateStatus = ActionStatus::unknown;
 
+    /** How far the last firmware image sent got, kept across sessions so an
+     * interrupted upload can be resumed.
+     */
+    UploadProgress progress;
+
+    /** The firmware blob id the progress is for. */
+    std::string progressPath;
+
+    /** Decompresses the image in front of its handler, for a session opened
+     * with the compressed flag.
+     */
+    std::unique_ptr<DecompressHandler> decompressor;
+
     /** Portion of "flags" argument to open() which specifies the desired
      *  transport type
      */
-    static constexpr std::uint16_t transportMask = 0xff00;
+    static constexpr std::uint16_t transportMask = 0x0f00;
+
+    /** Portion of "flags" argument to open() with the options for the
+     *  session, which aren't part of its state.
+     */
+    static constexpr std::uint16_t optionMask = 0xf000;
+
+    /** The options open() takes, listed in the stat metadata. */
+    static constexpr std::uint16_t blobOptions =
+        FirmwareFlags::UpdateFlags::reuseStaged |
+        FirmwareFlags::UpdateFlags::resume |
+        FirmwareFlags::UpdateFlags::compressed |
+        FirmwareFlags::UpdateFlags::transaction;
+
 };
 
 } // namespace ipmi_flash
@@ -15,23 +15,53 @@
  */
 #include "firmware_handlers_builder.hpp"
 
+#include "digest_handler.hpp"
 #include "file_handler.hpp"
 #include "fs.hpp"
 #include "general_systemd.hpp"
+#include "mtd_handler.hpp"
+#include "signature_action.hpp"
 #include "skip_action.hpp"
+#include "tar_stream_handler.hpp"
+#include "write_behind_handler.hpp"
 
 #include <nlohmann/json.hpp>
 
 #include <algorithm>
+#include <cstdint>
 #include <cstdio>
 #include <exception>
 #include <fstream>
+#include <optional>
 #include <regex>
 #include <string>
 #include <vector>
 
 namespace ipmi_flash
 {
+namespace
+{
+
+/* The digest is optional, std::nullopt if it isn't configured. */
+std::optional<DigestHandler::Algorithm> buildDigest(const nlohmann::json& h)
+{
+    const auto& digest = h.find("digest");
+    if (digest == h.end())
+    {
+        return std::nullopt;
+    }
+
+    const std::string digestType = *digest;
+    auto algorithm = DigestHandler::algorithmFromName(digestType);
+    if (!algorithm)
+    {
+        throw std::runtime_error("Invalid digest type: " + digestType);
+    }
+    return algorithm;
+}
+
+} // namespace
+
 std::vector<HandlerConfig<ActionPack>>
     FirmwareHandlersBuilder::buildHandlerFromJson(const nlohmann::json& data)
 {
@@ -54,13 +84,59 @@ std::vector<HandlerConfig<ActionPack>>
                     "' must start with /flash/");
             }
 
+            /* Set if the handler computes a digest of the image. */
+            std::optional<DigestHandler::Algorithm> digestAlgorithm;
+            std::string digestPath;
+
             /* handler is required. */
             const auto& h = item.at("handler");
             const std::string handlerType = h.at("type");
             if (handlerType == "file")
             {
-                const auto& path = h.at("path");
-                output.handler = std::make_unique<FileHandler>(path);
+                const std::string path = h.at("path");
+                output.handler = std::make_unique<FileHandler>(
+                    path, buildFileOptions(h));
+
+                /* the digest is computed as the image is written. */
+                digestAlgorithm = buildDigest(h);
+                if (digestAlgorithm)
+                {
+                    digestPath =
+                        DigestHandler::digestPathFor(path, *digestAlgorithm);
+                    output.handler = std::make_unique<DigestHandler>(
+                        std::move(output.handler), *digestAlgorithm, path);
+                }
+            }
+            else if (handlerType == "mtd")
+            {
+                const std::string path = h.at("path");
+
+                /* the erase-ahead is optional, in erase blocks. */
+                std::uint32_t eraseAhead = 16;
+                const auto& ahead = h.find("eraseAhead");
+                if (ahead != h.end())
+                {
+                    ahead->get_to(eraseAhead);
+                }
+
+                output.handler = std::make_unique<MtdHandler>(path, eraseAhead);
+            }
+            else if (handlerType == "tar-stream")
+            {
+                const std::string path = h.at("path");
+
+                /* the window is optional, writes ahead fail without it. */
+                std::size_t windowKiB = 0;
+                const auto& window = h.find("reorderWindowKiB");
+                if (window != h.end())
+                {
+                    window->get_to(windowKiB);
+                }
+
+                /* here the digest is computed for each member. */
+                output.handler = std::make_unique<TarStreamHandler>(
+                    path, buildFileOptions(h), buildDigest(h),
+                    windowKiB * 1024);
             }
             else
             {
@@ -68,6 +144,19 @@ std::vector<HandlerConfig<ActionPack>>
                     "Invalid handler type: " + handlerType);
             }
 
+            /* write-behind is optional, it queues up this many writes. */
+            const auto& writeBehind = h.find("writeBehind");
+            if (writeBehind != h.end())
+            {
+                std::size_t depth = *writeBehind;
+                if (depth == 0)
+                {
+                    throw std::runtime_error("Invalid writeBehind: 0");
+                }
+                output.handler = std::make_unique<WriteBehindHandler>(
+                    std::move(output.handler), depth);
+            }
+
             /* actions are required (presently). */
             const auto& a = item.at("actions");
             std::unique_ptr<ActionPack> pack = std::make_unique<ActionPack>();
@@ -99,6 +188,28 @@ std::vector<HandlerConfig<ActionPack>>
             {
                 pack->verification = buildSystemd(verify);
             }
+            else if (verifyType == "signature")
+            {
+                /* This checks the digest computed during the upload. */
+                if (!digestAlgorithm)
+                {
+                    throw std::runtime_error(
+                        "Signature verification requires a handler digest");
+                }
+
+                /* the signature path is optional. */
+                std::string signaturePath = HASH_FILENAME;
+                const auto& signature = verify.find("signature");
+                if (signature != verify.end())
+                {
+                    signaturePath = signature->get<std::string>();
+                }
+
+                pack->verification =
+                    SignatureVerification::CreateSignatureVerification(
+                        verify.at("publicKey"), signaturePath, digestPath,
+                        *digestAlgorithm);
+            }
             else if (verifyType == "skip")
             {
                 pack->verification = SkipAction::CreateSkipAction();
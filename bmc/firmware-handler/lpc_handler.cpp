@@ -21,6 +21,7 @@
 #include <cstdint>
 #include <cstdio>
 #include <cstring>
+#include <span>
 #include <vector>
 
 namespace ipmi_flash
@@ -63,13 +64,16 @@ bool LpcDataHandler::close()
 
 std::vector<std::uint8_t> LpcDataHandler::copyFrom(std::uint32_t length)
 {
-    /* TODO: implement this -- in an earlier and different version of this that
-     * didn't use BLOBs, the region was memory-mapped and the writes to the data
-     * were just done directly from the memory-mapped region instead of a
-     * copyFrom() first call.  The idea with this change is that we may not be
-     * able to get a memory-mapped handle from the driver from which to
-     * automatically read data, but rather must perform some ioctl or other
-     * access to get the data from the driver.
+    auto window = borrow(length);
+    return std::vector<std::uint8_t>(window.begin(), window.end());
+}
+
+std::span<const std::uint8_t> LpcDataHandler::borrow(std::uint32_t length)
+{
+    /* The host data sits in the memory-mapped region, so it's handed out
+     * from there directly.  A driver that can't provide a memory-mapped
+     * handle would have to copy it out with some ioctl or other access
+     * instead.
      */
     if (!initialized)
     {
@@ -79,11 +83,25 @@ std::vector<std::uint8_t> LpcDataHandler::copyFrom(std::uint32_t length)
         return {};
     }
 
-    std::vector<std::uint8_t> results(length);
-    std::memcpy(results.data(), memory.mapped + mappingResult.windowOffset,
-                length);
+    if (length > mappingResult.windowSize)
+    {
+        std::fprintf(stderr, "Invalid window access, length: %u\n", length);
+        return {};
+    }
+
+    return {memory.mapped + mappingResult.windowOffset, length};
+}
+
+std::span<const std::uint8_t> LpcDataHandler::borrowFromWindow(
+    std::uint32_t windowOffset, std::uint32_t length)
+{
+    /* The host stages every chunk at the start of the window. */
+    if (windowOffset != 0)
+    {
+        return {};
+    }
 
-    return results;
+    return borrow(length);
 }
 
 bool LpcDataHandler::writeMeta(const std::vector<std::uint8_t>& configuration)
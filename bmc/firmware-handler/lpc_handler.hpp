@@ -5,6 +5,7 @@
 
 #include <cstdint>
 #include <memory>
+#include <span>
 #include <vector>
 
 namespace ipmi_flash
@@ -38,6 +39,9 @@ class LpcDataHandler : public DataInterface
     bool open() override;
     bool close() override;
     std::vector<std::uint8_t> copyFrom(std::uint32_t length) override;
+    std::span<const std::uint8_t> borrow(std::uint32_t length) override;
+    std::span<const std::uint8_t> borrowFromWindow(
+        std::uint32_t windowOffset, std::uint32_t length) override;
     bool writeMeta(const std::vector<std::uint8_t>& configuration) override;
     std::vector<std::uint8_t> readMeta() override;
 
@@ -105,8 +105,9 @@ std::unique_ptr<blobs::GenericBlobInterface> createHandler()
 #endif
 
 #ifdef ENABLE_NET_BRIDGE
-    supportedTransports.emplace_back(FirmwareFlags::UpdateFlags::net,
-                                     std::make_unique<NetDataHandler>());
+    supportedTransports.emplace_back(
+        FirmwareFlags::UpdateFlags::net,
+        std::make_unique<NetDataHandler>(loadNetConfig(NET_CONFIG_FILENAME)));
 #endif
 
     ActionMap actionPacks = {};
@@ -16,19 +16,41 @@
 
 #include "net_handler.hpp"
 
+#include "data.hpp"
+
 #include <errno.h>
+#include <fcntl.h>
 #include <netinet/in.h>
 #include <poll.h>
+#include <sys/eventfd.h>
 #include <sys/socket.h>
 #include <unistd.h>
 
+#include <nlohmann/json.hpp>
+
+#include <algorithm>
+#include <array>
+#include <chrono>
 #include <cstdio>
+#include <cstring>
+#include <exception>
+#include <fstream>
+#include <functional>
+#include <span>
 
 namespace ipmi_flash
 {
 
+NetDataHandler::~NetDataHandler()
+{
+    close();
+}
+
 bool NetDataHandler::open()
 {
+    /* Start over if a previous transfer left anything behind. */
+    close();
+
     listenFd.reset(::socket(AF_INET6, SOCK_STREAM, 0));
     if (*listenFd < 0)
     {
@@ -37,9 +59,18 @@ bool NetDataHandler::open()
         return false;
     }
 
+    /* Accepted connections inherit the receive buffer size. */
+    int rcvBuf = config.receiveBuffer;
+    if (::setsockopt(*listenFd, SOL_SOCKET, SO_RCVBUF, &rcvBuf,
+                     sizeof(rcvBuf)) < 0)
+    {
+        std::perror("Failed to set receive buffer size");
+        return false;
+    }
+
     struct sockaddr_in6 listenAddr;
     listenAddr.sin6_family = AF_INET6;
-    listenAddr.sin6_port = htons(listenPort);
+    listenAddr.sin6_port = htons(config.port);
     listenAddr.sin6_flowinfo = 0;
     listenAddr.sin6_addr = in6addr_any;
     listenAddr.sin6_scope_id = 0;
@@ -51,103 +82,619 @@ bool NetDataHandler::open()
         return false;
     }
 
-    if (::listen(*listenFd, 1) < 0)
+    if (::listen(*listenFd, config.maxStreams) < 0)
     {
         std::perror("Failed to listen");
         return false;
     }
+
+    stopFd.reset(::eventfd(0, EFD_CLOEXEC));
+    if (*stopFd < 0)
+    {
+        std::perror("Failed to create eventfd");
+        (void)stopFd.release();
+        return false;
+    }
+
+    int fds[2];
+    if (::pipe2(fds, O_CLOEXEC) < 0)
+    {
+        std::perror("Failed to create pipe");
+        return false;
+    }
+    pipeRead.reset(fds[0]);
+    pipeWrite.reset(fds[1]);
+
+    /* The pipe takes the place of a receive buffer, so size it to the window
+     * if we're allowed to.
+     */
+    if (::fcntl(*pipeWrite, F_SETPIPE_SZ, config.receiveBuffer) < 0)
+    {
+        std::perror("Failed to resize pipe");
+    }
+    int size = ::fcntl(*pipeWrite, F_GETPIPE_SZ);
+    if (size <= 0)
+    {
+        std::perror("Failed to get pipe size");
+        return false;
+    }
+    pipeSize = size;
+    pipeUsed = 0;
+    stopping = false;
+    ended = false;
+    accepted = false;
+    streams = 0;
+    chunks.clear();
+    chunkBytes = 0;
+    nextOffset = 0;
+    receiver = std::thread(&NetDataHandler::receive, this);
+
     return true;
 }
 
 bool NetDataHandler::close()
 {
+    if (receiver.joinable())
+    {
+        {
+            std::lock_guard<std::mutex> l(lock);
+            stopping = true;
+        }
+        cv.notify_all();
+
+        std::uint64_t one = 1;
+        if (::write(*stopFd, &one, sizeof(one)) < 0)
+        {
+            std::perror("Failed to stop the receiver");
+        }
+        receiver.join();
+    }
+
+    stripeFds.clear();
     connFd.reset();
     listenFd.reset();
+    stopFd.reset();
+    pipeRead.reset();
+    pipeWrite.reset();
+    lent = std::vector<std::uint8_t>();
 
     return true;
 }
 
-std::vector<std::uint8_t> NetDataHandler::copyFrom(std::uint32_t length)
+bool NetDataHandler::waitFor(int fd)
 {
-    if (!connFd)
-    {
-        struct pollfd fds;
-        fds.fd = *listenFd;
-        fds.events = POLLIN;
+    std::array<struct pollfd, 2> fds = {};
+    fds[0].fd = fd;
+    fds[0].events = POLLIN;
+    fds[1].fd = *stopFd;
+    fds[1].events = POLLIN;
 
-        int ret = ::poll(&fds, 1, timeoutS * 1000);
+    while (true)
+    {
+        int ret = ::poll(fds.data(), fds.size(), -1);
         if (ret < 0)
         {
+            if (errno == EINTR)
+            {
+                continue;
+            }
             std::perror("Failed to poll");
-            return std::vector<uint8_t>();
+            return false;
         }
-        else if (ret == 0)
+        if (fds[1].revents)
         {
-            fprintf(stderr, "Timed out waiting for connection\n");
-            return std::vector<uint8_t>();
+            return false;
         }
-        else if (fds.revents != POLLIN)
+        if (fds[0].revents & (POLLIN | POLLHUP | POLLERR))
         {
-            fprintf(stderr, "Invalid poll state: 0x%x\n", fds.revents);
-            return std::vector<uint8_t>();
+            return true;
         }
+        fprintf(stderr, "Invalid poll state: 0x%x\n", fds[0].revents);
+        return false;
+    }
+}
 
+void NetDataHandler::receive()
+{
+    if (waitFor(*listenFd))
+    {
         connFd.reset(::accept(*listenFd, nullptr, nullptr));
         if (*connFd < 0)
         {
             std::perror("Failed to accept connection");
             (void)connFd.release();
-            return std::vector<uint8_t>();
+        }
+    }
+
+    /* The host configures striping before it connects. */
+    std::uint32_t connections;
+    {
+        std::lock_guard<std::mutex> l(lock);
+        accepted = true;
+        connections = streams;
+    }
+
+    if (connFd)
+    {
+        if (connections > 0)
+        {
+            receiveStriped(connections);
+        }
+        else
+        {
+            receiveStream();
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> l(lock);
+        ended = true;
+    }
+    cv.notify_all();
+}
+
+void NetDataHandler::receiveStream()
+{
+    while (true)
+    {
+        std::size_t used;
+        {
+            std::unique_lock<std::mutex> l(lock);
+            cv.wait(l, [&] { return stopping || pipeUsed < pipeSize; });
+            if (stopping)
+            {
+                break;
+            }
+            used = pipeUsed;
         }
 
-        struct timeval tv = {};
-        tv.tv_sec = timeoutS;
-        if (setsockopt(*connFd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv)) < 0)
+        if (!waitFor(*connFd))
         {
-            std::perror("Failed to set receive timeout");
-            return std::vector<uint8_t>();
+            break;
+        }
+
+        /* Only this thread writes to the pipe.  The socket has data, so this
+         * doesn't block, but it can still come back empty handed.
+         */
+        ssize_t ret = ::splice(*connFd, nullptr, *pipeWrite, nullptr,
+                               pipeSize - used,
+                               SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+        if (ret < 0)
+        {
+            if (errno == EINTR || (errno == EAGAIN && used == 0))
+            {
+                continue;
+            }
+            if (errno == EAGAIN)
+            {
+                /* A pipe fills up by buffers, not bytes, small segments can
+                 * fill it early.  Wait for some to be consumed.
+                 */
+                std::unique_lock<std::mutex> l(lock);
+                cv.wait(l, [&] { return stopping || pipeUsed < used; });
+                continue;
+            }
+            std::perror("Failed to splice from socket");
+            break;
+        }
+        if (ret == 0)
+        {
+            break;
+        }
+
+        {
+            std::lock_guard<std::mutex> l(lock);
+            pipeUsed += ret;
+        }
+        cv.notify_all();
+    }
+}
+
+void NetDataHandler::receiveStriped(std::uint32_t connections)
+{
+    while (stripeFds.size() + 1 < connections)
+    {
+        if (!waitFor(*listenFd))
+        {
+            return;
+        }
+
+        stripeFds.emplace_back(std::nullopt);
+        stripeFds.back().reset(::accept(*listenFd, nullptr, nullptr));
+        if (*stripeFds.back() < 0)
+        {
+            std::perror("Failed to accept connection");
+            (void)stripeFds.back().release();
+            stripeFds.pop_back();
+            return;
         }
     }
 
-    std::vector<std::uint8_t> data(length);
+    std::vector<std::thread> readers;
+    readers.emplace_back(&NetDataHandler::receiveChunks, this, *connFd);
+    for (auto& fd : stripeFds)
+    {
+        readers.emplace_back(&NetDataHandler::receiveChunks, this, *fd);
+    }
+    for (auto& reader : readers)
+    {
+        reader.join();
+    }
+}
+
+bool NetDataHandler::readAll(int fd, void* data, std::size_t length)
+{
+    auto bytes = static_cast<std::uint8_t*>(data);
 
-    std::uint32_t bytesRead = 0;
-    ssize_t ret;
-    do
+    while (length > 0)
     {
-        ret = read(*connFd, data.data() + bytesRead, length - bytesRead);
+        if (!waitFor(fd))
+        {
+            return false;
+        }
+
+        ssize_t ret = ::read(fd, bytes, length);
         if (ret < 0)
         {
             if (errno == EINTR || errno == EAGAIN)
+            {
                 continue;
+            }
             std::perror("Failed to read from socket");
+            return false;
+        }
+        if (ret == 0)
+        {
+            return false;
+        }
+
+        bytes += ret;
+        length -= ret;
+    }
+
+    return true;
+}
+
+void NetDataHandler::receiveChunks(int fd)
+{
+    while (true)
+    {
+        struct NetChunkHdr header;
+        if (!readAll(fd, &header, sizeof(header)))
+        {
+            return;
+        }
+
+        if (header.length == 0 ||
+            header.length > static_cast<std::uint32_t>(config.receiveBuffer))
+        {
+            fprintf(stderr, "Invalid chunk of %u bytes at 0x%x\n",
+                    header.length, header.offset);
+            return;
+        }
+
+        {
+            /* The host keeps within the window, but don't let chunks ahead
+             * of the next one take more than that.
+             */
+            std::unique_lock<std::mutex> l(lock);
+            cv.wait(l, [&] {
+                return stopping || header.offset == nextOffset ||
+                       chunkBytes + header.length <=
+                           static_cast<std::size_t>(config.receiveBuffer);
+            });
+            if (stopping)
+            {
+                return;
+            }
+            chunkBytes += header.length;
+        }
+
+        std::vector<std::uint8_t> data(header.length);
+        if (!readAll(fd, data.data(), data.size()))
+        {
+            std::lock_guard<std::mutex> l(lock);
+            chunkBytes -= header.length;
+            return;
+        }
+
+        {
+            /* A chunk sent again replaces the copy still here, or is dropped
+             * if that was already taken, so its bytes are only counted once.
+             */
+            std::lock_guard<std::mutex> l(lock);
+            if (header.offset < nextOffset)
+            {
+                chunkBytes -= data.size();
+            }
+            else
+            {
+                auto [chunk, inserted] = chunks.try_emplace(header.offset);
+                if (!inserted)
+                {
+                    chunkBytes -= chunk->second.size();
+                }
+                chunk->second = std::move(data);
+            }
+        }
+        cv.notify_all();
+    }
+}
+
+std::vector<std::uint8_t> NetDataHandler::takeChunk(std::uint32_t length)
+{
+    std::unique_lock<std::mutex> l(lock);
+
+    /* The host sends the data before asking for it, so this only waits for
+     * whatever is still in flight.
+     */
+    if (!cv.wait_for(l, std::chrono::seconds(timeoutS), [&] {
+            return ended || chunks.contains(nextOffset);
+        }))
+    {
+        fprintf(stderr, "Timed out waiting for data\n");
+        return std::vector<std::uint8_t>();
+    }
+
+    auto chunk = chunks.find(nextOffset);
+    if (chunk == chunks.end())
+    {
+        fprintf(stderr, "Connections closed before chunk at 0x%x\n",
+                nextOffset);
+        return std::vector<std::uint8_t>();
+    }
+    if (chunk->second.size() != length)
+    {
+        fprintf(stderr, "Chunk at 0x%x has %zu bytes, expected %u\n",
+                nextOffset, chunk->second.size(), length);
+        return std::vector<std::uint8_t>();
+    }
+
+    std::vector<std::uint8_t> data = std::move(chunk->second);
+    chunks.erase(chunk);
+    chunkBytes -= length;
+    nextOffset += length;
+
+    l.unlock();
+    cv.notify_all();
+
+    return data;
+}
+
+std::uint32_t NetDataHandler::drain(
+    std::uint32_t length,
+    const std::function<ssize_t(std::uint32_t, std::size_t)>& move)
+{
+    if (length > static_cast<std::uint32_t>(config.receiveBuffer))
+    {
+        fprintf(stderr, "Chunk of %u bytes exceeds the receive window\n",
+                length);
+        return 0;
+    }
+
+    if (!receiver.joinable())
+    {
+        return 0;
+    }
+
+    /* The host sends the data before asking for it, so this only waits for
+     * whatever is still in flight.  It's taken out as it arrives, a chunk may
+     * not fit in the pipe all at once.
+     */
+    auto deadline =
+        std::chrono::steady_clock::now() + std::chrono::seconds(timeoutS);
+    std::uint32_t done = 0;
+
+    while (done < length)
+    {
+        std::size_t available;
+        {
+            std::unique_lock<std::mutex> l(lock);
+            if (!cv.wait_until(l, deadline,
+                               [&] { return ended || pipeUsed > 0; }))
+            {
+                fprintf(stderr, "Timed out waiting for data\n");
+                break;
+            }
+            available = std::min<std::size_t>(pipeUsed, length - done);
+        }
+        if (available == 0)
+        {
             break;
         }
 
-        bytesRead += ret;
-    } while (ret > 0 && bytesRead < length);
+        /* Only this thread reads from the pipe. */
+        ssize_t ret = move(done, available);
+        if (ret < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            std::perror("Failed to read from pipe");
+            break;
+        }
+        if (ret == 0)
+        {
+            break;
+        }
 
-    if (bytesRead != length)
+        {
+            std::lock_guard<std::mutex> l(lock);
+            pipeUsed -= ret;
+        }
+        cv.notify_all();
+        done += ret;
+    }
+
+    if (done != length)
     {
         fprintf(stderr,
                 "Couldn't read full expected amount. Wanted %u but got %u\n",
-                length, bytesRead);
-        data.resize(bytesRead);
+                length, done);
     }
 
-    return data;
+    return done;
+}
+
+std::vector<std::uint8_t> NetDataHandler::copyFrom(std::uint32_t length)
+{
+    auto data = borrow(length);
+    return std::vector<std::uint8_t>(data.begin(), data.end());
 }
 
-bool NetDataHandler::writeMeta(const std::vector<std::uint8_t>&)
+std::span<const std::uint8_t> NetDataHandler::borrow(std::uint32_t length)
+{
+    if (isStriped())
+    {
+        lent = takeChunk(length);
+        return lent;
+    }
+
+    /* The same buffer is read into for every chunk, it only grows to the size
+     * of the largest one.  drain() refuses anything larger than the window
+     * anyway.
+     */
+    lent.resize(std::min<std::uint32_t>(
+        length, static_cast<std::uint32_t>(config.receiveBuffer)));
+
+    auto bytesRead =
+        drain(length, [&](std::uint32_t done, std::size_t available) {
+            return ::read(*pipeRead, lent.data() + done, available);
+        });
+
+    return std::span<const std::uint8_t>(lent).first(bytesRead);
+}
+
+std::span<const std::uint8_t> NetDataHandler::borrowFromWindow(
+    std::uint32_t windowOffset, std::uint32_t length)
+{
+    /* There's no window, the data is only ever at its start. */
+    if (windowOffset != 0)
+    {
+        return {};
+    }
+
+    return borrow(length);
+}
+
+std::optional<std::uint32_t> NetDataHandler::copyToFile(
+    int fd, std::uint32_t offset, std::uint32_t length)
+{
+    /* Striped chunks are already in memory, they're written like any other
+     * copied data.
+     */
+    if (isStriped())
+    {
+        return std::nullopt;
+    }
+
+    return drain(length, [&](std::uint32_t done, std::size_t available) {
+        loff_t position = static_cast<loff_t>(offset) + done;
+        return ::splice(*pipeRead, nullptr, fd, &position, available,
+                        SPLICE_F_MOVE);
+    });
+}
+
+bool NetDataHandler::canCopyToFile()
+{
+    return !isStriped();
+}
+
+bool NetDataHandler::isStriped()
+{
+    std::lock_guard<std::mutex> l(lock);
+    return streams > 0;
+}
+
+bool NetDataHandler::writeMeta(const std::vector<std::uint8_t>& configuration)
 {
     // TODO: have the host tool send the expected IP address that it will
     // connect from
+    if (configuration.size() != sizeof(NetConfigRequest))
+    {
+        return true;
+    }
+
+    struct NetConfigRequest request;
+    std::memcpy(&request, configuration.data(), configuration.size());
+
+    std::lock_guard<std::mutex> l(lock);
+    if (accepted || request.streams == 0)
+    {
+        return false;
+    }
+    streams = std::min(request.streams, config.maxStreams);
+
     return true;
 }
 
 std::vector<std::uint8_t> NetDataHandler::readMeta()
 {
-    return std::vector<std::uint8_t>();
+    std::lock_guard<std::mutex> l(lock);
+    if (streams == 0)
+    {
+        return std::vector<std::uint8_t>();
+    }
+
+    struct NetConfigResponse response;
+    response.streams = streams;
+    response.window = config.receiveBuffer;
+
+    std::vector<std::uint8_t> bytes(sizeof(response));
+    std::memcpy(bytes.data(), &response, sizeof(response));
+    return bytes;
+}
+
+NetConfig loadNetConfig(const std::string& path)
+{
+    NetConfig config;
+
+    std::ifstream jsonFile(path);
+    if (!jsonFile.is_open())
+    {
+        return config;
+    }
+
+    auto data = nlohmann::json::parse(jsonFile, nullptr, false);
+    if (data.is_discarded())
+    {
+        std::fprintf(stderr, "Parsing json failed: %s\n", path.c_str());
+        return config;
+    }
+
+    try
+    {
+        /* Each setting is optional. */
+        if (data.contains("port"))
+        {
+            data.at("port").get_to(config.port);
+        }
+        if (data.contains("streams"))
+        {
+            data.at("streams").get_to(config.maxStreams);
+        }
+        if (data.contains("receiveBuffer"))
+        {
+            data.at("receiveBuffer").get_to(config.receiveBuffer);
+        }
+    }
+    catch (const std::exception& e)
+    {
+        std::fprintf(stderr, "Invalid net config %s: %s\n", path.c_str(),
+                     e.what());
+        return NetConfig();
+    }
+
+    /* A chunk from the host has to fit. */
+    if (config.maxStreams == 0 || config.receiveBuffer < 64 * 1024)
+    {
+        std::fprintf(stderr, "Invalid net config %s, using the defaults\n",
+                     path.c_str());
+        return NetConfig();
+    }
+
+    return config;
 }
 
 } // namespace ipmi_flash
@@ -6,28 +6,77 @@
 
 #include <stdplus/handle/managed.hpp>
 
+#include <condition_variable>
 #include <cstdint>
+#include <functional>
+#include <map>
+#include <mutex>
 #include <optional>
+#include <span>
+#include <string>
+#include <thread>
 #include <vector>
 
 namespace ipmi_flash
 {
 
+/** Settings for the net transport. */
+struct NetConfig
+{
+    /** The TCP port the host connects to. */
+    std::uint16_t port = 623;
+    /** The most connections a host may stripe a transfer across. */
+    std::uint32_t maxStreams = 4;
+    /** Receive buffer size of each connection, this also bounds how far the
+     * host may send ahead of the chunks it has asked us to consume, and the
+     * size of each chunk.
+     */
+    int receiveBuffer = 1024 * 1024;
+};
+
+/**
+ * Read the net transport settings from a json file, anything not set there
+ * keeps its default.
+ *
+ * @param[in] path - the json file, it's fine for it not to exist
+ * @return the settings
+ */
+NetConfig loadNetConfig(const std::string& path);
+
 /**
- * Data Handler for receiving the image over a network port
+ * Data Handler for receiving the image over a network port.  A receiver thread
+ * splices the connection into a pipe, so copyFrom() only has to wait for data
+ * still in flight, and copyToFile() can splice it on into the staged file
+ * without it ever being copied into userspace.
+ *
+ * If the host configures it via writeMeta, the transfer is striped across
+ * several connections instead, each chunk sent with its offset, and the
+ * chunks are handed out in order as they complete.
  */
 class NetDataHandler : public DataInterface
 {
   public:
-    NetDataHandler() : listenFd(std::nullopt), connFd(std::nullopt) {}
+    explicit NetDataHandler(const NetConfig& config = NetConfig()) :
+        config(config), listenFd(std::nullopt), connFd(std::nullopt),
+        stopFd(std::nullopt), pipeRead(std::nullopt), pipeWrite(std::nullopt)
+    {}
+    ~NetDataHandler() override;
+
+    NetDataHandler(const NetDataHandler&) = delete;
+    NetDataHandler& operator=(const NetDataHandler&) = delete;
 
     bool open() override;
     bool close() override;
     std::vector<std::uint8_t> copyFrom(std::uint32_t length) override;
+    std::span<const std::uint8_t> borrow(std::uint32_t length) override;
+    std::span<const std::uint8_t> borrowFromWindow(
+        std::uint32_t windowOffset, std::uint32_t length) override;
+    std::optional<std::uint32_t> copyToFile(int fd, std::uint32_t offset,
+                                            std::uint32_t length) override;
+    bool canCopyToFile() override;
     bool writeMeta(const std::vector<std::uint8_t>& configuration) override;
     std::vector<std::uint8_t> readMeta() override;
 
-    static constexpr std::uint16_t listenPort = 623;
     static constexpr int timeoutS = 5;
 
   private:
@@ -37,8 +86,64 @@ class NetDataHandler : public DataInterface
     }
     using Fd = stdplus::Managed<int>::Handle<closefd>;
 
+    /** Accepts the connections and receives the data until stopped. */
+    void receive();
+    /** Fills the pipe from the only connection. */
+    void receiveStream();
+    /** Accepts the rest of the connections and reads chunks from them all. */
+    void receiveStriped(std::uint32_t connections);
+    /** Reads chunks from one of the striped connections. */
+    void receiveChunks(int fd);
+    /** Reads exactly length bytes, returns false if it can't. */
+    bool readAll(int fd, void* data, std::size_t length);
+    /** Whether the host configured a striped transfer. */
+    bool isStriped();
+    /** Takes the next chunk of a striped transfer. */
+    std::vector<std::uint8_t> takeChunk(std::uint32_t length);
+    /** Waits for the fd or the stop event, returns false if stopping. */
+    bool waitFor(int fd);
+    /**
+     * Takes length bytes out of the pipe as they arrive, move(done, n) moves
+     * the next n bytes to wherever they go and returns how many it did.
+     *
+     * @return the number of bytes taken
+     */
+    std::uint32_t drain(
+        std::uint32_t length,
+        const std::function<ssize_t(std::uint32_t, std::size_t)>& move);
+
+    NetConfig config;
+
     Fd listenFd;
     Fd connFd;
+    /* The connections after the first of a striped transfer. */
+    std::vector<Fd> stripeFds;
+    /* eventfd used to interrupt the receiver's poll() on close(). */
+    Fd stopFd;
+
+    std::thread receiver;
+    std::mutex lock;
+    std::condition_variable cv;
+    /* Holds the received but not yet consumed bytes, pipeUsed of them. */
+    Fd pipeRead;
+    Fd pipeWrite;
+    std::size_t pipeSize = 0;
+    std::size_t pipeUsed = 0;
+    bool stopping = false;
+    /* Set once the connection is closed or failed, nothing more will come. */
+    bool ended = false;
+
+    /* Set once the first connection is accepted, the mode is fixed then. */
+    bool accepted = false;
+    /* Connections of a striped transfer, 0 if it isn't striped. */
+    std::uint32_t streams = 0;
+    /* Received chunks of a striped transfer by offset, and their size. */
+    std::map<std::uint32_t, std::vector<std::uint8_t>> chunks;
+    std::size_t chunkBytes = 0;
+    /* Offset of the chunk to hand out next. */
+    std::uint32_t nextOffset = 0;
+    /* Holds the bytes borrow() lends until the next call. */
+    std::vector<std::uint8_t> lent;
 };
 
 } // namespace ipmi_flash
@@ -4,6 +4,7 @@
 #include "internal/sys.hpp"
 
 #include <cstdint>
+#include <span>
 #include <string>
 #include <vector>
 
@@ -25,6 +26,11 @@ class PciDataHandler : public DataInterface
     bool open() override;
     bool close() override;
     std::vector<std::uint8_t> copyFrom(std::uint32_t length) override;
+    std::vector<std::uint8_t> copyFromWindow(std::uint32_t windowOffset,
+                                             std::uint32_t length) override;
+    std::span<const std::uint8_t> borrow(std::uint32_t length) override;
+    std::span<const std::uint8_t> borrowFromWindow(
+        std::uint32_t windowOffset, std::uint32_t length) override;
     bool writeMeta(const std::vector<std::uint8_t>& configuration) override;
     std::vector<std::uint8_t> readMeta() override;
 
@@ -20,7 +20,9 @@
 #include <fcntl.h>
 
 #include <cstdint>
+#include <cstdio>
 #include <cstring>
+#include <span>
 #include <string>
 #include <vector>
 
@@ -74,16 +76,51 @@ bool PciDataHandler::close()
 
 std::vector<std::uint8_t> PciDataHandler::copyFrom(std::uint32_t length)
 {
-    std::vector<std::uint8_t> results(length);
-    std::memcpy(results.data(), mapped, length);
+    return copyFromWindow(0, length);
+}
+
+std::vector<std::uint8_t> PciDataHandler::copyFromWindow(
+    std::uint32_t windowOffset, std::uint32_t length)
+{
+    auto window = borrowFromWindow(windowOffset, length);
+    return std::vector<std::uint8_t>(window.begin(), window.end());
+}
+
+std::span<const std::uint8_t> PciDataHandler::borrow(std::uint32_t length)
+{
+    return borrowFromWindow(0, length);
+}
+
+std::span<const std::uint8_t> PciDataHandler::borrowFromWindow(
+    std::uint32_t windowOffset, std::uint32_t length)
+{
+    if (!mapped || windowOffset > memoryRegionSize ||
+        length > memoryRegionSize - windowOffset)
+    {
+        std::fprintf(stderr, "Invalid window access at 0x%x, length: %u\n",
+                     windowOffset, length);
+        return {};
+    }
 
-    return results;
+    return {mapped + windowOffset, length};
 }
 
-bool PciDataHandler::writeMeta(const std::vector<std::uint8_t>&)
+bool PciDataHandler::writeMeta(const std::vector<std::uint8_t>& configuration)
 {
-    /* PCI handler doesn't require configuration write, only read. */
-    return false;
+    /* The configuration write is optional, hosts that split the window into
+     * multiple slots send it to check that chunks may be staged at offsets.
+     */
+    struct PciConfigRequest request;
+
+    if (configuration.size() != sizeof(request))
+    {
+        return false;
+    }
+
+    std::memcpy(&request, configuration.data(), sizeof(request));
+
+    /* Every slot must be able to hold at least one byte. */
+    return request.slots != 0 && request.slots <= memoryRegionSize;
 }
 
 std::vector<std::uint8_t> PciDataHandler::readMeta()
@@ -0,0 +1,149 @@
+/*
+ * Copyright 2026 Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "signature_action.hpp"
+
+#include <openssl/evp.h>
+#include <openssl/pem.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace ipmi_flash
+{
+
+namespace
+{
+
+/** Reads the digest from the start of a sha256sum style line. */
+std::vector<std::uint8_t> readDigest(const std::string& path)
+{
+    std::ifstream file(path);
+    std::string hex;
+    if (!(file >> hex) || hex.size() % 2)
+    {
+        return {};
+    }
+
+    std::vector<std::uint8_t> digest;
+    for (std::size_t i = 0; i < hex.size(); i += 2)
+    {
+        unsigned int byte;
+        if (std::sscanf(hex.c_str() + i, "%2x", &byte) != 1)
+        {
+            return {};
+        }
+        digest.push_back(byte);
+    }
+    return digest;
+}
+
+} // namespace
+
+std::unique_ptr<TriggerableActionInterface>
+    SignatureVerification::CreateSignatureVerification(
+        const std::string& publicKeyPath, const std::string& signaturePath,
+        const std::string& digestPath, DigestHandler::Algorithm algorithm)
+{
+    return std::make_unique<SignatureVerification>(
+        publicKeyPath, signaturePath, digestPath, algorithm);
+}
+
+bool SignatureVerification::verify()
+{
+    auto digest = readDigest(digestPath);
+    if (digest.empty())
+    {
+        std::fprintf(stderr, "No digest of the image in %s\n",
+                     digestPath.c_str());
+        return false;
+    }
+
+    std::ifstream sigFile(signaturePath, std::ios::binary);
+    std::vector<std::uint8_t> signature(
+        (std::istreambuf_iterator<char>(sigFile)),
+        std::istreambuf_iterator<char>());
+    if (signature.empty())
+    {
+        std::fprintf(stderr, "No signature in %s\n", signaturePath.c_str());
+        return false;
+    }
+
+    std::unique_ptr<std::FILE, decltype(&std::fclose)> keyFile(
+        std::fopen(publicKeyPath.c_str(), "r"), &std::fclose);
+    if (!keyFile)
+    {
+        std::perror("Failed to open the public key");
+        return false;
+    }
+    std::unique_ptr<EVP_PKEY, decltype(&EVP_PKEY_free)> key(
+        PEM_read_PUBKEY(keyFile.get(), nullptr, nullptr, nullptr),
+        &EVP_PKEY_free);
+    if (!key)
+    {
+        std::fprintf(stderr, "Invalid public key in %s\n",
+                     publicKeyPath.c_str());
+        return false;
+    }
+
+    /* The image was hashed as it arrived, only the digest is verified. */
+    std::unique_ptr<EVP_PKEY_CTX, decltype(&EVP_PKEY_CTX_free)> ctx(
+        EVP_PKEY_CTX_new(key.get(), nullptr), &EVP_PKEY_CTX_free);
+    const EVP_MD* md = algorithm == DigestHandler::Algorithm::sha256
+                           ? EVP_sha256()
+                           : EVP_sha512();
+    if (!ctx || EVP_PKEY_verify_init(ctx.get()) != 1 ||
+        EVP_PKEY_CTX_set_signature_md(ctx.get(), md) != 1)
+    {
+        std::fprintf(stderr, "Unable to verify with the public key\n");
+        return false;
+    }
+
+    return EVP_PKEY_verify(ctx.get(), signature.data(), signature.size(),
+                           digest.data(), digest.size()) == 1;
+}
+
+bool SignatureVerification::trigger()
+{
+    currentStatus = verify() ? ActionStatus::success : ActionStatus::failed;
+    if (currentStatus == ActionStatus::failed)
+    {
+        std::fprintf(stderr, "Signature verification of the image failed\n");
+    }
+
+    if (cb)
+    {
+        cb(*this);
+    }
+    return true;
+}
+
+void SignatureVerification::abort()
+{
+    /* It's complete by the time trigger() returns, there's nothing running. */
+}
+
+ActionStatus SignatureVerification::status()
+{
+    return currentStatus;
+}
+
+} // namespace ipmi_flash
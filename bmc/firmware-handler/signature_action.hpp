@@ -0,0 +1,64 @@
+#pragma once
+
+#include "digest_handler.hpp"
+#include "status.hpp"
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace ipmi_flash
+{
+
+/**
+ * Verification that checks the signature the host sent against the digest
+ * the image's DigestHandler computed while it was uploaded, with a public key.
+ * Nothing is started and the image isn't read again, so it's complete by the
+ * time trigger() returns.
+ */
+class SignatureVerification : public TriggerableActionInterface
+{
+  public:
+    /**
+     * Create a SignatureVerification.
+     *
+     * @param[in] publicKeyPath - PEM file with the key the image is signed by.
+     * @param[in] signaturePath - where the host stages the signature.
+     * @param[in] digestPath - where the image's digest is written on close.
+     * @param[in] algorithm - the algorithm of that digest.
+     */
+    static std::unique_ptr<TriggerableActionInterface>
+        CreateSignatureVerification(const std::string& publicKeyPath,
+                                    const std::string& signaturePath,
+                                    const std::string& digestPath,
+                                    DigestHandler::Algorithm algorithm);
+
+    SignatureVerification(const std::string& publicKeyPath,
+                          const std::string& signaturePath,
+                          const std::string& digestPath,
+                          DigestHandler::Algorithm algorithm) :
+        publicKeyPath(publicKeyPath), signaturePath(signaturePath),
+        digestPath(digestPath), algorithm(algorithm)
+    {}
+
+    SignatureVerification(const SignatureVerification&) = delete;
+    SignatureVerification& operator=(const SignatureVerification&) = delete;
+
+    bool trigger() override;
+    void abort() override;
+    ActionStatus status() override;
+
+  private:
+    /** Checks the signature, returns whether it's valid. */
+    bool verify();
+
+    const std::string publicKeyPath;
+    const std::string signaturePath;
+    const std::string digestPath;
+    const DigestHandler::Algorithm algorithm;
+
+    ActionStatus currentStatus = ActionStatus::unknown;
+};
+
+} // namespace ipmi_flash
@@ -2,6 +2,10 @@
 
 #include "data_handler.hpp"
 
+#include <cstdint>
+#include <span>
+#include <vector>
+
 #include <gmock/gmock.h>
 
 namespace ipmi_flash
@@ -16,9 +20,31 @@ class DataHandlerMock : public DataInterface
     MOCK_METHOD(bool, close, (), (override));
     MOCK_METHOD(std::vector<std::uint8_t>, copyFrom, (std::uint32_t),
                 (override));
+    MOCK_METHOD(std::vector<std::uint8_t>, copyFromWindow,
+                (std::uint32_t, std::uint32_t), (override));
+    MOCK_METHOD(std::optional<std::uint32_t>, copyToFile,
+                (int, std::uint32_t, std::uint32_t), (override));
+    MOCK_METHOD(bool, canCopyToFile, (), (override));
     MOCK_METHOD(bool, writeMeta, (const std::vector<std::uint8_t>&),
                 (override));
     MOCK_METHOD(std::vector<std::uint8_t>, readMeta, (), (override));
+
+    /* Lends whatever the copy expectations return. */
+    std::span<const std::uint8_t> borrow(std::uint32_t length) override
+    {
+        lent = copyFrom(length);
+        return lent;
+    }
+
+    std::span<const std::uint8_t> borrowFromWindow(
+        std::uint32_t windowOffset, std::uint32_t length) override
+    {
+        lent = copyFromWindow(windowOffset, length);
+        return lent;
+    }
+
+  private:
+    std::vector<std::uint8_t> lent;
 };
 
 } // namespace ipmi_flash
@@ -0,0 +1,130 @@
+#include "decompress_handler.hpp"
+#include "image_mock.hpp"
+
+#include <zstd.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <span>
+#include <string>
+#include <vector>
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+namespace ipmi_flash
+{
+namespace
+{
+
+using ::testing::_;
+using ::testing::Invoke;
+using ::testing::Return;
+
+class DecompressHandlerTest : public ::testing::Test
+{
+  protected:
+    DecompressHandlerTest() : image(300 * 1024, 0xff), handler(&imageMock)
+    {
+        /* Like a BIOS image, mostly erased with some code in it. */
+        for (std::size_t i = 100 * 1024; i < 120 * 1024; i++)
+        {
+            image[i] = static_cast<std::uint8_t>(i * 7 + i / 251);
+        }
+
+        stream.resize(ZSTD_compressBound(image.size()));
+        stream.resize(ZSTD_compress(stream.data(), stream.size(), image.data(),
+                                    image.size(), ZSTD_CLEVEL_DEFAULT));
+
+        ON_CALL(imageMock, write(_, _))
+            .WillByDefault(Invoke([this](std::uint32_t offset,
+                                         const std::vector<std::uint8_t>& d) {
+                EXPECT_EQ(written.size(), offset);
+                written.insert(written.end(), d.begin(), d.end());
+                return true;
+            }));
+    }
+
+    /* Writes the stream from offset, in chunks of size. */
+    bool write(std::uint32_t offset, std::uint32_t end, std::uint32_t size)
+    {
+        for (; offset < end; offset += size)
+        {
+            if (!handler.writeSpan(offset,
+                                   std::span(stream).subspan(
+                                       offset, std::min(size, end - offset))))
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    std::vector<std::uint8_t> image;
+    std::vector<std::uint8_t> stream;
+    std::vector<std::uint8_t> written;
+    ImageHandlerMock imageMock;
+    DecompressHandler handler;
+};
+
+TEST_F(DecompressHandlerTest, WritesDecompressedImage)
+{
+    EXPECT_CALL(imageMock, open("asdf", std::ios::out)).WillOnce(Return(true));
+    EXPECT_TRUE(handler.open("asdf", std::ios::out));
+
+    EXPECT_LT(stream.size(), image.size() / 4);
+    EXPECT_TRUE(write(0, stream.size(), 1000));
+    EXPECT_TRUE(handler.finished());
+    EXPECT_EQ(image, written);
+}
+
+TEST_F(DecompressHandlerTest, TruncatedStreamIsNotFinished)
+{
+    EXPECT_CALL(imageMock, open("asdf", std::ios::out)).WillOnce(Return(true));
+    EXPECT_TRUE(handler.open("asdf", std::ios::out));
+
+    EXPECT_TRUE(write(0, stream.size() - 1, 4096));
+    EXPECT_FALSE(handler.finished());
+}
+
+TEST_F(DecompressHandlerTest, OutOfOrderWriteFails)
+{
+    EXPECT_CALL(imageMock, open("asdf", std::ios::out)).WillOnce(Return(true));
+    EXPECT_TRUE(handler.open("asdf", std::ios::out));
+
+    EXPECT_FALSE(write(100, 200, 100));
+}
+
+TEST_F(DecompressHandlerTest, CorruptStreamFails)
+{
+    EXPECT_CALL(imageMock, open("asdf", std::ios::out)).WillOnce(Return(true));
+    EXPECT_TRUE(handler.open("asdf", std::ios::out));
+
+    stream[0] ^= 0xff;
+    EXPECT_FALSE(write(0, stream.size(), 4096));
+}
+
+TEST_F(DecompressHandlerTest, KeepingTheImageFails)
+{
+    EXPECT_CALL(imageMock, open(_, _)).Times(0);
+    EXPECT_FALSE(handler.open("asdf", std::ios::out | std::ios::app));
+}
+
+TEST_F(DecompressHandlerTest, ReopeningStartsANewStream)
+{
+    EXPECT_CALL(imageMock, open("asdf", std::ios::out))
+        .Times(2)
+        .WillRepeatedly(Return(true));
+    EXPECT_CALL(imageMock, close());
+    EXPECT_TRUE(handler.open("asdf", std::ios::out));
+    EXPECT_TRUE(write(0, stream.size() / 2, 4096));
+    handler.close();
+
+    written.clear();
+    EXPECT_TRUE(handler.open("asdf", std::ios::out));
+    EXPECT_TRUE(write(0, stream.size(), 4096));
+    EXPECT_EQ(image, written);
+}
+
+} // namespace
+} // namespace ipmi_flash
@@ -0,0 +1,198 @@
+#include "digest_handler.hpp"
+#include "file_handler.hpp"
+
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+namespace ipmi_flash
+{
+namespace
+{
+
+static constexpr auto TESTPATH = "test.digest";
+
+/* The digests of "abc". */
+const std::vector<std::uint8_t> abcSha256 = {
+    0xba, 0x78, 0x16, 0xbf, 0x8f, 0x01, 0xcf, 0xea, 0x41, 0x41, 0x40,
+    0xde, 0x5d, 0xae, 0x22, 0x23, 0xb0, 0x03, 0x61, 0xa3, 0x96, 0x17,
+    0x7a, 0x9c, 0xb4, 0x10, 0xff, 0x61, 0xf2, 0x00, 0x15, 0xad};
+const std::vector<std::uint8_t> abcSha512 = {
+    0xdd, 0xaf, 0x35, 0xa1, 0x93, 0x61, 0x7a, 0xba, 0xcc, 0x41, 0x73,
+    0x49, 0xae, 0x20, 0x41, 0x31, 0x12, 0xe6, 0xfa, 0x4e, 0x89, 0xa9,
+    0x7e, 0xa2, 0x0a, 0x9e, 0xee, 0xe6, 0x4b, 0x55, 0xd3, 0x9a, 0x21,
+    0x92, 0x99, 0x2a, 0x27, 0x4f, 0xc1, 0xa8, 0x36, 0xba, 0x3c, 0x23,
+    0xa3, 0xfe, 0xeb, 0xbd, 0x45, 0x4d, 0x44, 0x23, 0x64, 0x3c, 0xe8,
+    0x0e, 0x2a, 0x9a, 0xc9, 0x4f, 0xa5, 0x4c, 0xa4, 0x9f};
+
+class DigestHandlerTest : public ::testing::Test
+{
+  protected:
+    void TearDown() override
+    {
+        (void)std::remove(TESTPATH);
+        (void)std::remove((std::string(TESTPATH) + ".sha256").c_str());
+        (void)std::remove((std::string(TESTPATH) + ".sha512").c_str());
+    }
+
+    std::unique_ptr<DigestHandler> create(
+        DigestHandler::Algorithm algorithm = DigestHandler::Algorithm::sha256)
+    {
+        return std::make_unique<DigestHandler>(
+            std::make_unique<FileHandler>(TESTPATH), algorithm, TESTPATH);
+    }
+
+    std::vector<std::uint8_t> a = {'a'};
+    std::vector<std::uint8_t> bc = {'b', 'c'};
+};
+
+TEST_F(DigestHandlerTest, InOrderWritesAreHashed)
+{
+    auto handler = create();
+    EXPECT_TRUE(handler->open("", std::ios::out));
+    EXPECT_TRUE(handler->getDigest().empty());
+    EXPECT_TRUE(handler->write(0, a));
+    EXPECT_TRUE(handler->write(1, bc));
+    EXPECT_EQ(handler->getDigest(), abcSha256);
+
+    /* Taking the digest doesn't stop more from being written. */
+    EXPECT_EQ(handler->getDigest(), abcSha256);
+}
+
+TEST_F(DigestHandlerTest, Sha512)
+{
+    auto handler = create(DigestHandler::Algorithm::sha512);
+    EXPECT_TRUE(handler->open("", std::ios::out));
+    EXPECT_TRUE(handler->write(0, a));
+    EXPECT_TRUE(handler->write(1, bc));
+    EXPECT_EQ(handler->getDigest(), abcSha512);
+}
+
+TEST_F(DigestHandlerTest, OutOfOrderWritesAreReadBack)
+{
+    auto handler = create();
+    EXPECT_TRUE(handler->open("", std::ios::out));
+    EXPECT_TRUE(handler->write(1, bc));
+    EXPECT_TRUE(handler->getDigest().empty());
+    EXPECT_TRUE(handler->write(0, a));
+    EXPECT_EQ(handler->getDigest(), abcSha256);
+}
+
+TEST_F(DigestHandlerTest, FillsAreHashed)
+{
+    std::vector<std::uint8_t> image = {'a', 0, 0, 0, 0xff, 0xff};
+    auto handler = create();
+    EXPECT_TRUE(handler->open("", std::ios::out));
+    EXPECT_TRUE(handler->write(0, image));
+    auto expected = handler->getDigest();
+    handler->close();
+
+    /* Ahead of the bytes before them and in line. */
+    handler = create();
+    EXPECT_TRUE(handler->open("", std::ios::out));
+    EXPECT_TRUE(handler->fill(1, 3, 0));
+    EXPECT_TRUE(handler->write(0, a));
+    EXPECT_TRUE(handler->fill(4, 2, 0xff));
+    EXPECT_EQ(handler->getDigest(), expected);
+}
+
+TEST_F(DigestHandlerTest, RewritingHashedBytesLosesTheDigest)
+{
+    auto handler = create();
+    EXPECT_TRUE(handler->open("", std::ios::out));
+    EXPECT_TRUE(handler->write(0, a));
+    EXPECT_TRUE(handler->write(1, bc));
+    EXPECT_TRUE(handler->write(0, a));
+    EXPECT_TRUE(handler->getDigest().empty());
+}
+
+TEST_F(DigestHandlerTest, DigestIsWrittenOnClose)
+{
+    auto handler = create();
+    EXPECT_TRUE(handler->open("", std::ios::out));
+    EXPECT_TRUE(handler->write(0, a));
+    EXPECT_TRUE(handler->write(1, bc));
+    handler->close();
+
+    std::ifstream digest(std::string(TESTPATH) + ".sha256");
+    std::stringstream contents;
+    contents << digest.rdbuf();
+    EXPECT_EQ(contents.str(), "ba7816bf8f01cfea414140de5dae2223"
+                              "b00361a396177a9cb410ff61f20015ad  " +
+                                  std::string(TESTPATH) + "\n");
+}
+
+TEST_F(DigestHandlerTest, ClosedImageIsStaged)
+{
+    auto handler = create();
+    EXPECT_FALSE(handler->getStaged());
+    EXPECT_TRUE(handler->open("", std::ios::out));
+    EXPECT_TRUE(handler->write(0, a));
+    EXPECT_TRUE(handler->write(1, bc));
+    /* Until it's closed, there's no digest to go by. */
+    EXPECT_FALSE(handler->getStaged());
+    handler->close();
+
+    auto staged = handler->getStaged();
+    ASSERT_TRUE(staged);
+    EXPECT_EQ(3, staged->size);
+    EXPECT_EQ(abcSha256, staged->digest);
+}
+
+TEST_F(DigestHandlerTest, ReopeningTheStagedImageHashesIt)
+{
+    auto handler = create();
+    EXPECT_TRUE(handler->open("", std::ios::out));
+    EXPECT_TRUE(handler->write(0, a));
+    EXPECT_TRUE(handler->write(1, bc));
+    handler->close();
+
+    EXPECT_TRUE(handler->open("", std::ios::in | std::ios::out));
+    EXPECT_EQ(3, handler->getSize());
+    EXPECT_EQ(handler->getDigest(), abcSha256);
+    handler->close();
+    EXPECT_TRUE(handler->getStaged());
+
+    /* Opened to be written, it's replaced. */
+    EXPECT_TRUE(handler->open("", std::ios::out));
+    EXPECT_EQ(0, handler->getSize());
+    EXPECT_FALSE(handler->getStaged());
+}
+
+TEST_F(DigestHandlerTest, ResumedImageIsHashedOnClose)
+{
+    auto handler = create();
+    EXPECT_TRUE(handler->open("", std::ios::out));
+    EXPECT_TRUE(handler->write(0, a));
+    EXPECT_TRUE(handler->write(1, {'x'}));
+    handler->close();
+
+    /* Bytes kept from before may be rewritten, they're hashed last. */
+    EXPECT_TRUE(handler->open("", std::ios::out | std::ios::app));
+    EXPECT_EQ(2, handler->getSize());
+    EXPECT_TRUE(handler->write(1, bc));
+    EXPECT_TRUE(handler->getDigest().empty());
+    handler->close();
+
+    auto staged = handler->getStaged();
+    ASSERT_TRUE(staged);
+    EXPECT_EQ(abcSha256, staged->digest);
+}
+
+TEST_F(DigestHandlerTest, AlgorithmNames)
+{
+    EXPECT_EQ(DigestHandler::algorithmFromName("sha256"),
+              DigestHandler::Algorithm::sha256);
+    EXPECT_EQ(DigestHandler::algorithmFromName("sha512"),
+              DigestHandler::Algorithm::sha512);
+    EXPECT_FALSE(DigestHandler::algorithmFromName("md5"));
+}
+
+} // namespace
+} // namespace ipmi_flash
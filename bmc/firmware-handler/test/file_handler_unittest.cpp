@@ -1,8 +1,13 @@
 #include "file_handler.hpp"
 
+#include <sys/stat.h>
+#include <unistd.h>
+
 #include <cstdint>
 #include <cstdio>
+#include <filesystem>
 #include <fstream>
+#include <span>
 #include <vector>
 
 #include <gtest/gtest.h>
@@ -70,6 +75,154 @@ TEST_F(FileHandlerOpenTest, VerifyWriteDataWrites)
     /* annoyingly the memcmp was failing... but it's the same data. */
 }
 
+TEST_F(FileHandlerOpenTest, VerifyWriteSpanWritesAtOffset)
+{
+    FileHandler handler(TESTPATH);
+    EXPECT_TRUE(handler.open(""));
+
+    std::vector<std::uint8_t> bytes = {0x01, 0x02, 0x03, 0x04};
+
+    /* Only the middle of the buffer is lent to the handler. */
+    EXPECT_TRUE(handler.writeSpan(2, std::span(bytes).subspan(1, 2)));
+    handler.close();
+
+    std::ifstream data(TESTPATH, std::ios::binary);
+    std::vector<char> written(4);
+    data.read(written.data(), written.size());
+    EXPECT_EQ(data.gcount(), 4);
+    EXPECT_EQ(written, std::vector<char>({0x00, 0x00, 0x02, 0x03}));
+}
+
+TEST_F(FileHandlerOpenTest, VerifySizeTracksWrites)
+{
+    FileHandler handler(TESTPATH);
+    EXPECT_TRUE(handler.open(""));
+    EXPECT_EQ(handler.getSize(), 0);
+
+    std::vector<std::uint8_t> bytes = {0x01, 0x02};
+    EXPECT_TRUE(handler.write(10, bytes));
+    EXPECT_EQ(handler.getSize(), 12);
+    EXPECT_TRUE(handler.write(0, bytes));
+    EXPECT_EQ(handler.getSize(), 12);
+    EXPECT_EQ(std::filesystem::file_size(TESTPATH), 12);
+}
+
+TEST_F(FileHandlerOpenTest, VerifyFillWritesTheValue)
+{
+    FileHandler handler(TESTPATH);
+    EXPECT_TRUE(handler.open(""));
+
+    std::vector<std::uint8_t> bytes = {0x01, 0x02, 0x03, 0x04};
+    EXPECT_TRUE(handler.write(0, bytes));
+
+    /* Zeros punch out what's there and extend the file, other values are
+     * written.
+     */
+    EXPECT_TRUE(handler.fill(1, 5, 0x00));
+    EXPECT_EQ(handler.getSize(), 6);
+    EXPECT_TRUE(handler.fill(6, 2, 0xff));
+    EXPECT_EQ(handler.getSize(), 8);
+    handler.close();
+
+    std::ifstream data(TESTPATH, std::ios::binary);
+    std::vector<char> written(8);
+    data.read(written.data(), written.size());
+    EXPECT_EQ(data.gcount(), 8);
+    EXPECT_EQ(written,
+              std::vector<char>({0x01, 0x00, 0x00, 0x00, 0x00, 0x00,
+                                 static_cast<char>(0xff),
+                                 static_cast<char>(0xff)}));
+}
+
+TEST_F(FileHandlerOpenTest, VerifyPreallocateKeepsFileSize)
+{
+    FileOptions options;
+    options.preallocate = 1024 * 1024;
+    FileHandler handler(TESTPATH, options);
+    EXPECT_TRUE(handler.open(""));
+    EXPECT_EQ(std::filesystem::file_size(TESTPATH), 0);
+
+    std::vector<std::uint8_t> bytes = {0x01, 0x02};
+    EXPECT_TRUE(handler.write(0, bytes));
+    handler.close();
+
+    EXPECT_EQ(std::filesystem::file_size(TESTPATH), 2);
+}
+
+TEST_F(FileHandlerOpenTest, VerifyUnusedPreallocationIsReleased)
+{
+    FileOptions options;
+    options.preallocate = 1024 * 1024;
+    FileHandler handler(TESTPATH, options);
+    EXPECT_TRUE(handler.open(""));
+
+    std::vector<std::uint8_t> bytes(4096, 0x01);
+    EXPECT_TRUE(handler.write(0, bytes));
+    handler.close();
+
+    /* Only the written block is left, not the whole reservation. */
+    struct stat st;
+    ASSERT_EQ(0, ::stat(TESTPATH, &st));
+    EXPECT_LT(st.st_blocks * 512, options.preallocate);
+}
+
+TEST_F(FileHandlerOpenTest, VerifyBatchedSyncWritesEverything)
+{
+    FileOptions options;
+    options.sync = FileSync::batched;
+    options.syncInterval = 3;
+    FileHandler handler(TESTPATH, options);
+    EXPECT_TRUE(handler.open(""));
+
+    std::vector<std::uint8_t> bytes = {0x01, 0x02};
+    for (std::uint32_t offset = 0; offset < 8; offset += bytes.size())
+    {
+        EXPECT_TRUE(handler.write(offset, bytes));
+    }
+    handler.close();
+
+    std::ifstream data(TESTPATH, std::ios::binary);
+    std::vector<char> written(8);
+    data.read(written.data(), written.size());
+    EXPECT_EQ(data.gcount(), 8);
+    EXPECT_EQ(written, std::vector<char>({1, 2, 1, 2, 1, 2, 1, 2}));
+}
+
+TEST_F(FileHandlerOpenTest, VerifyFlushReportsFailedSync)
+{
+    /* Writes to /dev/null succeed, but it can't be synced. */
+    FileOptions options;
+    options.sync = FileSync::onClose;
+    FileHandler handler("/dev/null", options);
+    EXPECT_TRUE(handler.open(""));
+
+    EXPECT_TRUE(handler.write(0, {0x01, 0x02}));
+    EXPECT_FALSE(handler.flush());
+    handler.close();
+}
+
+TEST_F(FileHandlerOpenTest, VerifyFlushWithoutSyncPolicyDoesNotSync)
+{
+    FileHandler handler("/dev/null");
+    EXPECT_TRUE(handler.open(""));
+
+    EXPECT_TRUE(handler.write(0, {0x01, 0x02}));
+    EXPECT_TRUE(handler.flush());
+    handler.close();
+}
+
+TEST_F(FileHandlerOpenTest, VerifyWriteFailsWhenOpenForRead)
+{
+    std::ofstream testfile(TESTPATH, std::ios::out);
+    testfile << "Hello world";
+    testfile.close();
+
+    FileHandler handler(TESTPATH);
+    EXPECT_TRUE(handler.open("", std::ios::in));
+    std::vector<std::uint8_t> bytes = {0x01, 0x02};
+    EXPECT_FALSE(handler.write(0, bytes));
+}
+
 TEST_F(FileHandlerOpenTest, VerifySimpleRead)
 {
     std::ofstream testfile;
@@ -133,4 +286,38 @@ TEST_F(FileHandlerOpenTest, VerifyBadOffsetReadsFail)
     EXPECT_FALSE(result);
 }
 
+TEST_F(FileHandlerOpenTest, VerifyFdWritesLandAfterBufferedWrites)
+{
+    FileHandler handler(TESTPATH);
+    EXPECT_TRUE(handler.open(""));
+
+    std::vector<std::uint8_t> bytes = {0x01, 0x02};
+    EXPECT_TRUE(handler.write(0, bytes));
+
+    int fd = handler.getFd();
+    ASSERT_GE(fd, 0);
+    EXPECT_EQ(fd, handler.getFd());
+    std::vector<std::uint8_t> more = {0x03, 0x04};
+    EXPECT_EQ(static_cast<ssize_t>(more.size()),
+              ::pwrite(fd, more.data(), more.size(), 2));
+    handler.close();
+
+    std::ifstream data;
+    data.open(TESTPATH, std::ios::binary);
+    std::vector<std::uint8_t> result(4);
+    data.read(reinterpret_cast<char*>(result.data()), result.size());
+    EXPECT_EQ(result, std::vector<std::uint8_t>({0x01, 0x02, 0x03, 0x04}));
+}
+
+TEST_F(FileHandlerOpenTest, VerifyNoFdWhenOpenForRead)
+{
+    std::ofstream testfile;
+    testfile.open(TESTPATH, std::ios::out);
+    testfile << "Hello world";
+    testfile.close();
+    FileHandler handler(TESTPATH);
+    EXPECT_TRUE(handler.open("", std::ios::in));
+    EXPECT_EQ(-1, handler.getFd());
+}
+
 } // namespace ipmi_flash
@@ -583,6 +583,209 @@ TEST(FirmwareJsonTest, VerifyValidUpdateWithFilePath)
     EXPECT_THAT(updater->getMode(), "replace-fake");
 }
 
+TEST(FirmwareJsonTest, VerifyFileOptions)
+{
+    auto j2 = R"(
+        [{
+            "blob" : "/flash/image",
+            "handler" : {
+                "type" : "file",
+                "path" : "/run/initramfs/bmc-image",
+                "preallocate" : 33554432,
+                "sync" : "batched",
+                "syncIntervalMiB" : 8,
+                "digest" : "sha512",
+                "writeBehind" : 4
+            },
+            "actions" : {
+                "preparation" : {
+                    "type" : "skip"
+                },
+                "verification" : {
+                    "type" : "skip"
+                },
+                "update" : {
+                    "type" : "skip"
+                }
+            }
+         }]
+    )"_json;
+
+    auto h = FirmwareHandlersBuilder().buildHandlerFromJson(j2);
+    ASSERT_EQ(h.size(), 1);
+    EXPECT_FALSE(h[0].handler == nullptr);
+}
+
+TEST(FirmwareJsonTest, InvalidFileSyncType)
+{
+    auto j2 = R"(
+        [{
+            "blob" : "/flash/image",
+            "handler" : {
+                "type" : "file",
+                "path" : "/run/initramfs/bmc-image",
+                "sync" : "sometimes"
+            },
+            "actions" : {
+                "preparation" : {
+                    "type" : "skip"
+                },
+                "verification" : {
+                    "type" : "skip"
+                },
+                "update" : {
+                    "type" : "skip"
+                }
+            }
+         }]
+    )"_json;
+    EXPECT_THAT(FirmwareHandlersBuilder().buildHandlerFromJson(j2), IsEmpty());
+}
+
+TEST(FirmwareJsonTest, InvalidDigestType)
+{
+    auto j2 = R"(
+        [{
+            "blob" : "/flash/image",
+            "handler" : {
+                "type" : "file",
+                "path" : "/run/initramfs/bmc-image",
+                "digest" : "md5"
+            },
+            "actions" : {
+                "preparation" : {
+                    "type" : "skip"
+                },
+                "verification" : {
+                    "type" : "skip"
+                },
+                "update" : {
+                    "type" : "skip"
+                }
+            }
+         }]
+    )"_json;
+    EXPECT_THAT(FirmwareHandlersBuilder().buildHandlerFromJson(j2), IsEmpty());
+}
+
+TEST(FirmwareJsonTest, VerifySignatureVerification)
+{
+    auto j2 = R"(
+        [{
+            "blob" : "/flash/image",
+            "handler" : {
+                "type" : "file",
+                "path" : "/run/initramfs/bmc-image",
+                "digest" : "sha256"
+            },
+            "actions" : {
+                "preparation" : {
+                    "type" : "skip"
+                },
+                "verification" : {
+                    "type" : "signature",
+                    "publicKey" : "/etc/phosphor-ipmi-flash/image.pem"
+                },
+                "update" : {
+                    "type" : "skip"
+                }
+            }
+         }]
+    )"_json;
+
+    auto h = FirmwareHandlersBuilder().buildHandlerFromJson(j2);
+    ASSERT_EQ(h.size(), 1);
+    EXPECT_FALSE(h[0].actions->verification == nullptr);
+}
+
+TEST(FirmwareJsonTest, SignatureVerificationRequiresDigest)
+{
+    auto j2 = R"(
+        [{
+            "blob" : "/flash/image",
+            "handler" : {
+                "type" : "file",
+                "path" : "/run/initramfs/bmc-image"
+            },
+            "actions" : {
+                "preparation" : {
+                    "type" : "skip"
+                },
+                "verification" : {
+                    "type" : "signature",
+                    "publicKey" : "/etc/phosphor-ipmi-flash/image.pem"
+                },
+                "update" : {
+                    "type" : "skip"
+                }
+            }
+         }]
+    )"_json;
+    EXPECT_THAT(FirmwareHandlersBuilder().buildHandlerFromJson(j2), IsEmpty());
+}
+
+TEST(FirmwareJsonTest, VerifyMtdHandler)
+{
+    auto j2 = R"(
+        [{
+            "blob" : "/flash/image",
+            "handler" : {
+                "type" : "mtd",
+                "path" : "/dev/mtd/image-b",
+                "eraseAhead" : 8,
+                "writeBehind" : 2
+            },
+            "actions" : {
+                "preparation" : {
+                    "type" : "skip"
+                },
+                "verification" : {
+                    "type" : "skip"
+                },
+                "update" : {
+                    "type" : "skip"
+                }
+            }
+         }]
+    )"_json;
+
+    auto h = FirmwareHandlersBuilder().buildHandlerFromJson(j2);
+    ASSERT_EQ(h.size(), 1);
+    EXPECT_EQ(h[0].blobId, "/flash/image");
+    EXPECT_FALSE(h[0].handler == nullptr);
+}
+
+TEST(FirmwareJsonTest, VerifyTarStreamHandler)
+{
+    auto j2 = R"(
+        [{
+            "blob" : "/flash/tarball",
+            "handler" : {
+                "type" : "tar-stream",
+                "path" : "/tmp/images/update",
+                "digest" : "sha256",
+                "reorderWindowKiB" : 256
+            },
+            "actions" : {
+                "preparation" : {
+                    "type" : "skip"
+                },
+                "verification" : {
+                    "type" : "skip"
+                },
+                "update" : {
+                    "type" : "skip"
+                }
+            }
+         }]
+    )"_json;
+
+    auto h = FirmwareHandlersBuilder().buildHandlerFromJson(j2);
+    ASSERT_EQ(h.size(), 1);
+    EXPECT_EQ(h[0].blobId, "/flash/tarball");
+    EXPECT_FALSE(h[0].handler == nullptr);
+}
+
 TEST(FirmwareJsonTest, VerifySkipFields)
 {
     // In this configuration, nothing happens because all actions are set to
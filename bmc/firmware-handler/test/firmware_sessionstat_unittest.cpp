@@ -69,7 +69,9 @@ TEST_F(FirmwareSessionStateTestLpc, DataTypeP2AReturnsMetadata)
     EXPECT_TRUE(handler->stat(0, &meta));
     EXPECT_EQ(meta.blobState,
               static_cast<std::uint16_t>(blobs::OpenFlags::write) |
-                  FirmwareFlags::UpdateFlags::lpc);
+                  FirmwareFlags::UpdateFlags::lpc |
+                  FirmwareFlags::SessionFlags::fillChunks |
+                  FirmwareFlags::SessionFlags::checkChunks);
     EXPECT_EQ(meta.size, size);
     EXPECT_EQ(meta.metadata.size(), mBytes.size());
     EXPECT_EQ(meta.metadata[0], mBytes[0]);
@@ -1,9 +1,11 @@
 #include "create_action_map.hpp"
+#include "data.hpp"
 #include "firmware_handler.hpp"
 #include "flags.hpp"
 #include "image_mock.hpp"
 #include "util.hpp"
 
+#include <cstring>
 #include <memory>
 #include <vector>
 
@@ -37,8 +39,18 @@ TEST(FirmwareHandlerStatTest, StatOnInactiveBlobIDReturnsAllTransports)
 
     blobs::BlobMeta meta;
     EXPECT_TRUE(handler->stat("asdf", &meta));
-    /* All transport flags are set */
+    /* All transport flags are set. */
     EXPECT_EQ(0xff00, meta.blobState);
+
+    /* The options open() takes are listed in the metadata. */
+    struct BlobOptionsHdr options;
+    ASSERT_EQ(sizeof(options), meta.metadata.size());
+    std::memcpy(&options, meta.metadata.data(), sizeof(options));
+    EXPECT_EQ(FirmwareFlags::UpdateFlags::reuseStaged |
+                  FirmwareFlags::UpdateFlags::resume |
+                  FirmwareFlags::UpdateFlags::compressed |
+                  FirmwareFlags::UpdateFlags::transaction,
+              options.options);
 }
 
 } // namespace
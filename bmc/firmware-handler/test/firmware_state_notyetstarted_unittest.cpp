@@ -2,10 +2,14 @@
  * The goal of these tests is to verify the behavior of all blob commands given
  * the current state is notYetStarted.  The initial state.
  */
+#include "data.hpp"
 #include "firmware_handler.hpp"
 #include "firmware_unittest.hpp"
 
+#include <zstd.h>
+
 #include <cstdint>
+#include <optional>
 #include <string>
 #include <vector>
 
@@ -16,6 +20,7 @@ namespace ipmi_flash
 namespace
 {
 
+using ::testing::_;
 using ::testing::Return;
 using ::testing::UnorderedElementsAreArray;
 
@@ -84,6 +89,23 @@ TEST_F(FirmwareHandlerNotYetStartedTest, StatEachBlobIdVerifyResults)
     }
 }
 
+TEST_F(FirmwareHandlerNotYetStartedTest, StatDescribesStagedImage)
+{
+    /* An image left from an earlier attempt is described by its digest. */
+    StagedImage staged = {4, {0x01, 0x02, 0x03}};
+    EXPECT_CALL(*imageMock2, getStaged()).WillOnce(Return(staged));
+
+    blobs::BlobMeta meta = {};
+    EXPECT_TRUE(handler->stat(staticLayoutBlobId, &meta));
+
+    /* Nothing was written since the BMC started, there's no checkpoint. */
+    std::vector<std::uint8_t> metadata = optionsMeta;
+    metadata.insert(metadata.end(), sizeof(StagedImageHdr), 0);
+    metadata.insert(metadata.end(), {0x01, 0x02, 0x03});
+    blobs::BlobMeta expected = {0xff00, 4, metadata};
+    EXPECT_EQ(expected, meta);
+}
+
 /* open(each blob id) (verifyblobid will no longer be available at this state.
  */
 TEST_F(FirmwareHandlerNotYetStartedTest, OpenStaticImageFileVerifyStateChange)
@@ -99,6 +121,113 @@ TEST_F(FirmwareHandlerNotYetStartedTest, OpenStaticImageFileVerifyStateChange)
     EXPECT_TRUE(handler->canHandleBlob(activeImageBlobId));
 }
 
+TEST_F(FirmwareHandlerNotYetStartedTest, OpenReusingStagedImageKeepsIt)
+{
+    StagedImage staged = {4, {0x01, 0x02, 0x03}};
+    EXPECT_CALL(*imageMock2, getStaged()).WillOnce(Return(staged));
+    EXPECT_CALL(*imageMock2,
+                open(staticLayoutBlobId, std::ios::in | std::ios::out))
+        .WillOnce(Return(true));
+    EXPECT_CALL(*prepareMockPtr, trigger()).WillOnce(Return(true));
+
+    EXPECT_TRUE(handler->open(
+        session, flags | FirmwareFlags::UpdateFlags::reuseStaged,
+        staticLayoutBlobId));
+
+    expectedState(FirmwareBlobHandler::UpdateState::uploadInProgress);
+
+    /* The option isn't part of the session's state. */
+    EXPECT_CALL(*imageMock2, getSize()).WillOnce(Return(4));
+    blobs::BlobMeta meta;
+    EXPECT_TRUE(handler->stat(session, &meta));
+    EXPECT_EQ(flags, meta.blobState);
+}
+
+TEST_F(FirmwareHandlerNotYetStartedTest, OpenReusingWithoutStagedImageFails)
+{
+    EXPECT_CALL(*imageMock2, getStaged()).WillOnce(Return(std::nullopt));
+    EXPECT_CALL(*imageMock2, open(_, _)).Times(0);
+
+    EXPECT_FALSE(handler->open(
+        session, flags | FirmwareFlags::UpdateFlags::reuseStaged,
+        staticLayoutBlobId));
+}
+
+TEST_F(FirmwareHandlerNotYetStartedTest, OpenResumingWithoutCheckpointFails)
+{
+    EXPECT_CALL(*imageMock2, open(_, _)).Times(0);
+
+    EXPECT_FALSE(
+        handler->open(session, flags | FirmwareFlags::UpdateFlags::resume,
+                      staticLayoutBlobId));
+}
+
+TEST_F(FirmwareHandlerNotYetStartedTest, OpenCompressedDecompressesWrites)
+{
+    std::vector<std::uint8_t> image(64 * 1024, 0xff);
+    std::vector<std::uint8_t> stream(ZSTD_compressBound(image.size()));
+    stream.resize(ZSTD_compress(stream.data(), stream.size(), image.data(),
+                                image.size(), ZSTD_CLEVEL_DEFAULT));
+
+    EXPECT_CALL(*imageMock2, open(staticLayoutBlobId, std::ios::out))
+        .WillOnce(Return(true));
+    EXPECT_CALL(*prepareMockPtr, trigger()).WillOnce(Return(true));
+
+    EXPECT_TRUE(
+        handler->open(session, flags | FirmwareFlags::UpdateFlags::compressed,
+                      staticLayoutBlobId));
+
+    EXPECT_CALL(*imageMock2, write(0, image)).WillOnce(Return(true));
+    EXPECT_TRUE(handler->write(session, 0, stream));
+
+    EXPECT_CALL(*imageMock2, close());
+    EXPECT_TRUE(handler->close(session));
+    expectedState(FirmwareBlobHandler::UpdateState::verificationPending);
+
+    /* Where the compressed stream got to isn't something to resume from. */
+    blobs::BlobMeta meta;
+    EXPECT_CALL(*imageMock2, getStaged()).WillOnce(Return(std::nullopt));
+    EXPECT_TRUE(handler->stat(staticLayoutBlobId, &meta));
+    EXPECT_EQ(optionsMeta, meta.metadata);
+}
+
+TEST_F(FirmwareHandlerNotYetStartedTest, CloseCompressedMidFrameAborts)
+{
+    std::vector<std::uint8_t> image(64 * 1024, 0xff);
+    std::vector<std::uint8_t> stream(ZSTD_compressBound(image.size()));
+    stream.resize(ZSTD_compress(stream.data(), stream.size(), image.data(),
+                                image.size(), ZSTD_CLEVEL_DEFAULT));
+    stream.pop_back();
+
+    EXPECT_CALL(*imageMock2, open(staticLayoutBlobId, std::ios::out))
+        .WillOnce(Return(true));
+    EXPECT_CALL(*prepareMockPtr, trigger()).WillOnce(Return(true));
+
+    EXPECT_TRUE(
+        handler->open(session, flags | FirmwareFlags::UpdateFlags::compressed,
+                      staticLayoutBlobId));
+
+    EXPECT_CALL(*imageMock2, write(_, _)).WillRepeatedly(Return(true));
+    EXPECT_TRUE(handler->write(session, 0, stream));
+
+    EXPECT_CALL(*imageMock2, close());
+    EXPECT_FALSE(handler->close(session));
+    expectedState(FirmwareBlobHandler::UpdateState::notYetStarted);
+}
+
+TEST_F(FirmwareHandlerNotYetStartedTest, OpenCompressedReusingFails)
+{
+    StagedImage staged = {4, {0x01, 0x02, 0x03}};
+    EXPECT_CALL(*imageMock2, getStaged()).WillOnce(Return(staged));
+    EXPECT_CALL(*imageMock2, open(_, _)).Times(0);
+
+    EXPECT_FALSE(handler->open(
+        session,
+        flags | FirmwareFlags::UpdateFlags::reuseStaged |
+            FirmwareFlags::UpdateFlags::compressed,
+        staticLayoutBlobId));
+}
+
 TEST_F(FirmwareHandlerNotYetStartedTest, OpenHashFileVerifyStateChange)
 {
     EXPECT_CALL(*hashImageMock, open(hashBlobId, std::ios::out))
@@ -3,13 +3,17 @@
  * the current state is verificationPending.  This state is achieved as a
  * transition out of uploadInProgress.
  */
+#include "crc32c.hpp"
+#include "data.hpp"
 #include "firmware_handler.hpp"
 #include "firmware_unittest.hpp"
 #include "status.hpp"
+#include "upload_progress.hpp"
 #include "util.hpp"
 
 #include <algorithm>
 #include <cstdint>
+#include <span>
 #include <string>
 #include <vector>
 
@@ -43,7 +47,36 @@ using ::testing::UnorderedElementsAreArray;
  */
 
 class FirmwareHandlerVerificationPendingTest : public IpmiOnlyFirmwareStaticTest
-{};
+{
+  protected:
+    /* Writes the image past its first checkpoint before closing it. */
+    void writeToVerificationPending()
+    {
+        openToInProgress(staticLayoutBlobId);
+        EXPECT_CALL(*imageMock2, write(0, image)).WillOnce(Return(true));
+        EXPECT_TRUE(handler->write(session, 0, image));
+        EXPECT_CALL(*imageMock2, close()).WillRepeatedly(Return());
+        handler->close(session);
+        expectedState(FirmwareBlobHandler::UpdateState::verificationPending);
+    }
+
+    /* The stat of the image's blob id, describing what was written. */
+    blobs::BlobMeta progressMeta() const
+    {
+        struct StagedImageHdr header = {
+            static_cast<std::uint32_t>(image.size()),
+            UploadProgress::checkpointSize,
+            crc32c(0, std::span(image).first(UploadProgress::checkpointSize)),
+        };
+        auto* bytes = reinterpret_cast<const std::uint8_t*>(&header);
+        std::vector<std::uint8_t> metadata = optionsMeta;
+        metadata.insert(metadata.end(), bytes, bytes + sizeof(header));
+        return {0xff00, static_cast<std::uint32_t>(image.size()), metadata};
+    }
+
+    std::vector<std::uint8_t> image =
+        std::vector<std::uint8_t>(UploadProgress::checkpointSize + 16, 0x5a);
+};
 
 /*
  * getBlobIds
@@ -256,6 +289,90 @@ TEST_F(FirmwareHandlerVerificationPendingTest,
                 UnorderedElementsAreArray(expectedBlobs));
 }
 
+TEST_F(FirmwareHandlerVerificationPendingTest, StatDescribesUploadProgress)
+{
+    writeToVerificationPending();
+
+    blobs::BlobMeta meta = {};
+    EXPECT_TRUE(handler->stat(staticLayoutBlobId, &meta));
+    EXPECT_EQ(progressMeta(), meta);
+}
+
+TEST_F(FirmwareHandlerVerificationPendingTest,
+       OpenResumingContinuesFromCheckpoint)
+{
+    writeToVerificationPending();
+
+    EXPECT_CALL(*imageMock2,
+                open(staticLayoutBlobId, std::ios::out | std::ios::app))
+        .WillOnce(Return(true));
+    EXPECT_CALL(*imageMock2, getSize()).WillOnce(Return(image.size()));
+    EXPECT_TRUE(handler->open(session,
+                              flags | FirmwareFlags::UpdateFlags::resume,
+                              staticLayoutBlobId));
+    expectedState(FirmwareBlobHandler::UpdateState::uploadInProgress);
+
+    /* Rewriting from the checkpoint keeps what came before it. */
+    std::vector<std::uint8_t> rest(16, 0x5a);
+    EXPECT_CALL(*imageMock2, write(UploadProgress::checkpointSize, rest))
+        .WillOnce(Return(true));
+    EXPECT_TRUE(handler->write(session, UploadProgress::checkpointSize, rest));
+    handler->close(session);
+
+    blobs::BlobMeta meta = {};
+    EXPECT_TRUE(handler->stat(staticLayoutBlobId, &meta));
+    EXPECT_EQ(progressMeta(), meta);
+}
+
+TEST_F(FirmwareHandlerVerificationPendingTest,
+       OpenResumingCleanedUpImageFails)
+{
+    writeToVerificationPending();
+
+    EXPECT_CALL(*imageMock2,
+                open(staticLayoutBlobId, std::ios::out | std::ios::app))
+        .WillOnce(Return(true));
+    EXPECT_CALL(*imageMock2, getSize()).WillOnce(Return(16));
+    EXPECT_FALSE(handler->open(session,
+                               flags | FirmwareFlags::UpdateFlags::resume,
+                               staticLayoutBlobId));
+    expectedState(FirmwareBlobHandler::UpdateState::verificationPending);
+}
+
+TEST_F(FirmwareHandlerVerificationPendingTest,
+       OpenImageBlobForgetsUploadProgress)
+{
+    writeToVerificationPending();
+
+    EXPECT_CALL(*imageMock2, open(staticLayoutBlobId, std::ios::out))
+        .WillOnce(Return(true));
+    EXPECT_TRUE(handler->open(session, flags, staticLayoutBlobId));
+    handler->close(session);
+
+    blobs::BlobMeta meta = {};
+    EXPECT_TRUE(handler->stat(staticLayoutBlobId, &meta));
+    EXPECT_EQ(expectedIdleMeta, meta);
+}
+
+TEST_F(FirmwareHandlerVerificationPendingTest, FailedWriteForgetsUploadProgress)
+{
+    /* Behind a write-behind handler, the failed write may be one the progress
+     * already counted.
+     */
+    openToInProgress(staticLayoutBlobId);
+    EXPECT_CALL(*imageMock2, write(0, image)).WillOnce(Return(true));
+    EXPECT_TRUE(handler->write(session, 0, image));
+    std::vector<std::uint8_t> rest(16, 0x5a);
+    EXPECT_CALL(*imageMock2, write(image.size(), rest)).WillOnce(Return(false));
+    EXPECT_FALSE(handler->write(session, image.size(), rest));
+    EXPECT_CALL(*imageMock2, close()).WillRepeatedly(Return());
+    handler->close(session);
+
+    blobs::BlobMeta meta = {};
+    EXPECT_TRUE(handler->stat(staticLayoutBlobId, &meta));
+    EXPECT_EQ(expectedIdleMeta, meta);
+}
+
 /*
  * close(session)
  */
@@ -2,6 +2,7 @@
  * the current state is verificationStarted.  This state is achieved as a out of
  * verificationPending.
  */
+#include "data.hpp"
 #include "firmware_handler.hpp"
 #include "firmware_unittest.hpp"
 #include "status.hpp"
@@ -41,7 +42,20 @@ using ::testing::UnorderedElementsAreArray;
  */
 
 class FirmwareHandlerVerificationStartedTest : public IpmiOnlyFirmwareStaticTest
-{};
+{
+  protected:
+    /* Commit the verify blob id, asking for the update to follow it. */
+    void commitThenUpdate()
+    {
+        getToVerificationPending(staticLayoutBlobId);
+
+        EXPECT_TRUE(handler->open(session, flags, verifyBlobId));
+        EXPECT_CALL(*verifyMockPtr, trigger()).WillOnce(Return(true));
+
+        VerifyCommitRequest request = {1};
+        EXPECT_TRUE(handler->commit(session, {request.thenUpdate}));
+    }
+};
 
 /*
  * canHandleBlob(blob)
@@ -266,6 +280,79 @@ TEST_F(FirmwareHandlerVerificationStartedTest,
     expectedState(FirmwareBlobHandler::UpdateState::verificationStarted);
 }
 
+TEST_F(FirmwareHandlerVerificationStartedTest,
+       CommitThenUpdateStartsUpdateOnceVerified)
+{
+    EXPECT_CALL(*verifyMockPtr, status())
+        .WillOnce(Return(ActionStatus::running))
+        .WillRepeatedly(Return(ActionStatus::success));
+    commitThenUpdate();
+    expectedState(FirmwareBlobHandler::UpdateState::verificationStarted);
+
+    /* The verification reports it's done. */
+    EXPECT_CALL(*updateMockPtr, trigger()).WillOnce(Return(true));
+    verifyMockPtr->cb(*verifyMockPtr);
+    expectedState(FirmwareBlobHandler::UpdateState::updateStarted);
+
+    EXPECT_CALL(*updateMockPtr, status())
+        .WillOnce(Return(ActionStatus::running))
+        .WillOnce(Return(ActionStatus::success));
+
+    blobs::BlobMeta meta;
+    EXPECT_TRUE(handler->stat(session, &meta));
+    EXPECT_EQ(std::vector<std::uint8_t>(
+                  {static_cast<std::uint8_t>(ActionStatus::running), 1}),
+              meta.metadata);
+
+    EXPECT_TRUE(handler->stat(session, &meta));
+    EXPECT_EQ(std::vector<std::uint8_t>(
+                  {static_cast<std::uint8_t>(ActionStatus::success), 1}),
+              meta.metadata);
+    EXPECT_EQ(flags | blobs::StateFlags::committed, meta.blobState);
+    expectedState(FirmwareBlobHandler::UpdateState::updateCompleted);
+}
+
+TEST_F(FirmwareHandlerVerificationStartedTest,
+       CommitThenUpdateStatStartsUpdateWithoutCallback)
+{
+    EXPECT_CALL(*verifyMockPtr, status())
+        .WillOnce(Return(ActionStatus::running))
+        .WillRepeatedly(Return(ActionStatus::success));
+    commitThenUpdate();
+
+    EXPECT_CALL(*updateMockPtr, trigger()).WillOnce(Return(true));
+    EXPECT_CALL(*updateMockPtr, status())
+        .WillOnce(Return(ActionStatus::running));
+
+    blobs::BlobMeta meta;
+    EXPECT_TRUE(handler->stat(session, &meta));
+    EXPECT_EQ(std::vector<std::uint8_t>(
+                  {static_cast<std::uint8_t>(ActionStatus::running), 1}),
+              meta.metadata);
+    expectedState(FirmwareBlobHandler::UpdateState::updateStarted);
+}
+
+TEST_F(FirmwareHandlerVerificationStartedTest,
+       CommitThenUpdateSkipsUpdateIfVerificationFails)
+{
+    EXPECT_CALL(*verifyMockPtr, status())
+        .WillOnce(Return(ActionStatus::running))
+        .WillRepeatedly(Return(ActionStatus::failed));
+    commitThenUpdate();
+    EXPECT_CALL(*updateMockPtr, trigger()).Times(0);
+
+    blobs::BlobMeta meta;
+    EXPECT_TRUE(handler->stat(session, &meta));
+    EXPECT_EQ(std::vector<std::uint8_t>(
+                  {static_cast<std::uint8_t>(ActionStatus::failed), 0}),
+              meta.metadata);
+    EXPECT_EQ(flags | blobs::StateFlags::commit_error, meta.blobState);
+
+    /* Closing the session aborts the process. */
+    EXPECT_TRUE(handler->close(session));
+    expectedState(FirmwareBlobHandler::UpdateState::notYetStarted);
+}
+
 /*
  * close(session) - close while state if verificationStarted without calling
  * stat first will abort.
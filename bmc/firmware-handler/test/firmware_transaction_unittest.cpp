@@ -0,0 +1,376 @@
+/* The goal of these tests is to verify that several firmware types can be
+ * sent in one transaction, each verified while the next one is sent, and
+ * updated one after the other.
+ */
+#include "firmware_handler.hpp"
+#include "flags.hpp"
+#include "image_mock.hpp"
+#include "status.hpp"
+#include "triggerable_mock.hpp"
+#include "upload_progress.hpp"
+#include "util.hpp"
+
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+namespace ipmi_flash
+{
+namespace
+{
+
+using ::testing::Return;
+
+class FirmwareTransactionTest : public ::testing::Test
+{
+  protected:
+    void SetUp() override
+    {
+        std::unique_ptr<ImageHandlerInterface> image =
+            std::make_unique<ImageHandlerMock>();
+        hashImageMock = reinterpret_cast<ImageHandlerMock*>(image.get());
+        blobs.emplace_back(hashBlobId, std::move(image));
+
+        image = std::make_unique<ImageHandlerMock>();
+        staticImageMock = reinterpret_cast<ImageHandlerMock*>(image.get());
+        blobs.emplace_back(staticLayoutBlobId, std::move(image));
+
+        image = std::make_unique<ImageHandlerMock>();
+        biosImageMock = reinterpret_cast<ImageHandlerMock*>(image.get());
+        blobs.emplace_back(biosBlobId, std::move(image));
+
+        std::unique_ptr<TriggerableActionInterface> bmcPrepareMock =
+            std::make_unique<TriggerMock>();
+        bmcPrepareMockPtr =
+            reinterpret_cast<TriggerMock*>(bmcPrepareMock.get());
+
+        std::unique_ptr<TriggerableActionInterface> bmcVerifyMock =
+            std::make_unique<TriggerMock>();
+        bmcVerifyMockPtr = reinterpret_cast<TriggerMock*>(bmcVerifyMock.get());
+
+        std::unique_ptr<TriggerableActionInterface> bmcUpdateMock =
+            std::make_unique<TriggerMock>();
+        bmcUpdateMockPtr = reinterpret_cast<TriggerMock*>(bmcUpdateMock.get());
+
+        std::unique_ptr<TriggerableActionInterface> biosPrepareMock =
+            std::make_unique<TriggerMock>();
+        biosPrepareMockPtr =
+            reinterpret_cast<TriggerMock*>(biosPrepareMock.get());
+
+        std::unique_ptr<TriggerableActionInterface> biosVerifyMock =
+            std::make_unique<TriggerMock>();
+        biosVerifyMockPtr =
+            reinterpret_cast<TriggerMock*>(biosVerifyMock.get());
+
+        std::unique_ptr<TriggerableActionInterface> biosUpdateMock =
+            std::make_unique<TriggerMock>();
+        biosUpdateMockPtr =
+            reinterpret_cast<TriggerMock*>(biosUpdateMock.get());
+
+        ActionMap packs;
+
+        std::unique_ptr<ActionPack> bmcPack = std::make_unique<ActionPack>();
+        bmcPack->preparation = std::move(bmcPrepareMock);
+        bmcPack->verification = std::move(bmcVerifyMock);
+        bmcPack->update = std::move(bmcUpdateMock);
+
+        std::unique_ptr<ActionPack> biosPack = std::make_unique<ActionPack>();
+        biosPack->preparation = std::move(biosPrepareMock);
+        biosPack->verification = std::move(biosVerifyMock);
+        biosPack->update = std::move(biosUpdateMock);
+
+        packs[staticLayoutBlobId] = std::move(bmcPack);
+        packs[biosBlobId] = std::move(biosPack);
+
+        std::vector<DataHandlerPack> data;
+        data.emplace_back(FirmwareFlags::UpdateFlags::ipmi, nullptr);
+
+        handler = FirmwareBlobHandler::CreateFirmwareBlobHandler(
+            std::move(blobs), std::move(data), std::move(packs));
+    }
+
+    void expectedState(FirmwareBlobHandler::UpdateState state)
+    {
+        auto realHandler = dynamic_cast<FirmwareBlobHandler*>(handler.get());
+        EXPECT_EQ(state, realHandler->getCurrentState());
+    }
+
+    ImageHandlerMock *hashImageMock, *staticImageMock, *biosImageMock;
+
+    std::vector<HandlerPack> blobs;
+
+    std::unique_ptr<blobs::GenericBlobInterface> handler;
+
+    TriggerMock *bmcPrepareMockPtr, *bmcVerifyMockPtr, *bmcUpdateMockPtr;
+    TriggerMock *biosPrepareMockPtr, *biosVerifyMockPtr, *biosUpdateMockPtr;
+
+    std::uint16_t session = 1;
+    std::uint16_t flags = static_cast<std::uint16_t>(blobs::OpenFlags::write) |
+                          FirmwareFlags::UpdateFlags::ipmi |
+                          FirmwareFlags::UpdateFlags::transaction;
+
+    /* Send the BMC image and its hash, then open the BIOS image, which starts
+     * verifying the BMC image.
+     */
+    void sendBmcThenOpenBios()
+    {
+        EXPECT_CALL(*staticImageMock, open(staticLayoutBlobId, std::ios::out))
+            .WillOnce(Return(true));
+        EXPECT_CALL(*bmcPrepareMockPtr, trigger()).WillOnce(Return(true));
+        EXPECT_TRUE(handler->open(session, flags, staticLayoutBlobId));
+        EXPECT_CALL(*staticImageMock, close()).WillOnce(Return());
+        handler->close(session);
+
+        EXPECT_CALL(*hashImageMock, open(hashBlobId, std::ios::out))
+            .WillOnce(Return(true));
+        EXPECT_TRUE(handler->open(session, flags, hashBlobId));
+        EXPECT_CALL(*hashImageMock, close()).WillOnce(Return());
+        handler->close(session);
+        expectedState(FirmwareBlobHandler::UpdateState::verificationPending);
+
+        EXPECT_CALL(*biosImageMock, open(biosBlobId, std::ios::out))
+            .WillOnce(Return(true));
+        EXPECT_CALL(*bmcVerifyMockPtr, trigger()).WillOnce(Return(true));
+        EXPECT_CALL(*biosPrepareMockPtr, trigger()).WillOnce(Return(true));
+        EXPECT_TRUE(handler->open(session, flags, biosBlobId));
+        expectedState(FirmwareBlobHandler::UpdateState::uploadInProgress);
+        EXPECT_CALL(*biosImageMock, close()).WillOnce(Return());
+        handler->close(session);
+    }
+
+    /* Send the BIOS hash and verify both images. */
+    void verifyBoth()
+    {
+        EXPECT_CALL(*bmcVerifyMockPtr, status())
+            .WillRepeatedly(Return(ActionStatus::success));
+        EXPECT_CALL(*hashImageMock, open(hashBlobId, std::ios::out))
+            .WillOnce(Return(true));
+        EXPECT_TRUE(handler->open(session, flags, hashBlobId));
+        EXPECT_CALL(*hashImageMock, close()).WillOnce(Return());
+        handler->close(session);
+
+        EXPECT_TRUE(handler->open(session, flags, verifyBlobId));
+        EXPECT_CALL(*biosVerifyMockPtr, trigger()).WillOnce(Return(true));
+        EXPECT_TRUE(handler->commit(session, {}));
+        expectedState(FirmwareBlobHandler::UpdateState::verificationStarted);
+    }
+};
+
+TEST_F(FirmwareTransactionTest, OpeningNextTypeStartsVerification)
+{
+    sendBmcThenOpenBios();
+
+    /* The BMC image's signature is in use until it's verified. */
+    EXPECT_CALL(*bmcVerifyMockPtr, status())
+        .WillRepeatedly(Return(ActionStatus::running));
+    blobs::BlobMeta meta;
+    EXPECT_TRUE(handler->stat(hashBlobId, &meta));
+    EXPECT_TRUE(meta.blobState & blobs::StateFlags::committing);
+
+    EXPECT_CALL(*hashImageMock, open(hashBlobId, std::ios::out)).Times(0);
+    EXPECT_FALSE(handler->open(session, flags, hashBlobId));
+}
+
+TEST_F(FirmwareTransactionTest, OpeningNextTypeWithoutHashFails)
+{
+    EXPECT_CALL(*staticImageMock, open(staticLayoutBlobId, std::ios::out))
+        .WillOnce(Return(true));
+    EXPECT_CALL(*bmcPrepareMockPtr, trigger()).WillOnce(Return(true));
+    EXPECT_TRUE(handler->open(session, flags, staticLayoutBlobId));
+    EXPECT_CALL(*staticImageMock, close()).WillOnce(Return());
+    handler->close(session);
+
+    EXPECT_CALL(*biosImageMock, open(biosBlobId, std::ios::out)).Times(0);
+    EXPECT_CALL(*bmcVerifyMockPtr, trigger()).Times(0);
+    EXPECT_FALSE(handler->open(session, flags, biosBlobId));
+}
+
+TEST_F(FirmwareTransactionTest, OpeningNextTypeOutsideTransactionFails)
+{
+    std::uint16_t single = flags & ~FirmwareFlags::UpdateFlags::transaction;
+
+    EXPECT_CALL(*staticImageMock, open(staticLayoutBlobId, std::ios::out))
+        .WillOnce(Return(true));
+    EXPECT_CALL(*bmcPrepareMockPtr, trigger()).WillOnce(Return(true));
+    EXPECT_TRUE(handler->open(session, single, staticLayoutBlobId));
+    EXPECT_CALL(*staticImageMock, close()).WillOnce(Return());
+    handler->close(session);
+
+    EXPECT_CALL(*hashImageMock, open(hashBlobId, std::ios::out))
+        .WillOnce(Return(true));
+    EXPECT_TRUE(handler->open(session, single, hashBlobId));
+    EXPECT_CALL(*hashImageMock, close()).WillOnce(Return());
+    handler->close(session);
+
+    EXPECT_CALL(*biosImageMock, open(biosBlobId, std::ios::out)).Times(0);
+    EXPECT_FALSE(handler->open(session, flags, biosBlobId));
+}
+
+TEST_F(FirmwareTransactionTest, ResumeFailureLeavesTransactionAlone)
+{
+    /* An earlier sequence sent part of the BIOS image. */
+    std::vector<std::uint8_t> image(UploadProgress::checkpointSize, 0x5a);
+    EXPECT_CALL(*biosImageMock, open(biosBlobId, std::ios::out))
+        .WillOnce(Return(true));
+    EXPECT_CALL(*biosPrepareMockPtr, trigger()).WillOnce(Return(true));
+    EXPECT_TRUE(handler->open(session, flags, biosBlobId));
+    EXPECT_CALL(*biosImageMock, write(0, image)).WillOnce(Return(true));
+    EXPECT_TRUE(handler->write(session, 0, image));
+    EXPECT_CALL(*biosImageMock, close()).WillOnce(Return());
+    handler->close(session);
+    EXPECT_TRUE(handler->deleteBlob(biosBlobId));
+
+    /* This one keeps the staged BMC image, then resumes the BIOS image. */
+    EXPECT_CALL(*staticImageMock, getStaged())
+        .WillRepeatedly(Return(StagedImage{16, {}}));
+    EXPECT_CALL(*staticImageMock,
+                open(staticLayoutBlobId, std::ios::out | std::ios::in))
+        .WillOnce(Return(true));
+    EXPECT_CALL(*bmcPrepareMockPtr, trigger()).WillOnce(Return(true));
+    EXPECT_TRUE(handler->open(session,
+                              flags | FirmwareFlags::UpdateFlags::reuseStaged,
+                              staticLayoutBlobId));
+    EXPECT_CALL(*staticImageMock, close()).WillOnce(Return());
+    handler->close(session);
+
+    EXPECT_CALL(*hashImageMock, open(hashBlobId, std::ios::out))
+        .WillOnce(Return(true));
+    EXPECT_TRUE(handler->open(session, flags, hashBlobId));
+    EXPECT_CALL(*hashImageMock, close()).WillOnce(Return());
+    handler->close(session);
+
+    /* The BIOS image was cleaned up since, so the open fails before the BMC
+     * image is verified.
+     */
+    EXPECT_CALL(*biosImageMock, open(biosBlobId, std::ios::out | std::ios::app))
+        .WillOnce(Return(true));
+    EXPECT_CALL(*biosImageMock, getSize()).WillOnce(Return(16));
+    EXPECT_CALL(*biosImageMock, close()).WillOnce(Return());
+    EXPECT_CALL(*bmcVerifyMockPtr, trigger()).Times(0);
+    EXPECT_FALSE(handler->open(session,
+                               flags | FirmwareFlags::UpdateFlags::resume,
+                               biosBlobId));
+    expectedState(FirmwareBlobHandler::UpdateState::verificationPending);
+
+    /* The BMC image's hash is still there to verify it with. */
+    std::vector<std::string> ids = handler->getBlobIds();
+    EXPECT_TRUE(std::count(ids.begin(), ids.end(), activeHashBlobId));
+}
+
+TEST_F(FirmwareTransactionTest, VerificationFailsIfAnyFails)
+{
+    sendBmcThenOpenBios();
+    verifyBoth();
+
+    EXPECT_CALL(*biosVerifyMockPtr, status())
+        .WillOnce(Return(ActionStatus::failed));
+    blobs::BlobMeta meta;
+    EXPECT_TRUE(handler->stat(session, &meta));
+    EXPECT_EQ(static_cast<std::uint8_t>(ActionStatus::failed),
+              meta.metadata[0]);
+    expectedState(FirmwareBlobHandler::UpdateState::verificationCompleted);
+}
+
+TEST_F(FirmwareTransactionTest, UpdatesRunInOrder)
+{
+    sendBmcThenOpenBios();
+    verifyBoth();
+
+    EXPECT_CALL(*biosVerifyMockPtr, status())
+        .WillOnce(Return(ActionStatus::success));
+    blobs::BlobMeta meta;
+    EXPECT_TRUE(handler->stat(session, &meta));
+    expectedState(FirmwareBlobHandler::UpdateState::verificationCompleted);
+    handler->close(session);
+    expectedState(FirmwareBlobHandler::UpdateState::updatePending);
+
+    /* The BMC image was sent first, so it's updated first. */
+    EXPECT_TRUE(handler->open(session, flags, updateBlobId));
+    EXPECT_CALL(*bmcUpdateMockPtr, trigger()).WillOnce(Return(true));
+    EXPECT_CALL(*bmcUpdateMockPtr, status())
+        .WillOnce(Return(ActionStatus::running));
+    EXPECT_CALL(*biosUpdateMockPtr, trigger()).Times(0);
+    EXPECT_TRUE(handler->commit(session, {}));
+    expectedState(FirmwareBlobHandler::UpdateState::updateStarted);
+
+    /* Once it's done, the BIOS update starts. */
+    EXPECT_CALL(*bmcUpdateMockPtr, status())
+        .WillRepeatedly(Return(ActionStatus::success));
+    EXPECT_CALL(*biosUpdateMockPtr, trigger()).WillOnce(Return(true));
+    EXPECT_CALL(*biosUpdateMockPtr, status())
+        .WillOnce(Return(ActionStatus::running))
+        .WillOnce(Return(ActionStatus::success));
+    EXPECT_TRUE(handler->stat(session, &meta));
+    EXPECT_EQ(static_cast<std::uint8_t>(ActionStatus::running),
+              meta.metadata[0]);
+    expectedState(FirmwareBlobHandler::UpdateState::updateStarted);
+
+    EXPECT_TRUE(handler->stat(session, &meta));
+    EXPECT_EQ(static_cast<std::uint8_t>(ActionStatus::success),
+              meta.metadata[0]);
+    expectedState(FirmwareBlobHandler::UpdateState::updateCompleted);
+}
+
+TEST_F(FirmwareTransactionTest, NextUpdateStartsWhenOneFinishes)
+{
+    sendBmcThenOpenBios();
+    verifyBoth();
+
+    EXPECT_CALL(*biosVerifyMockPtr, status())
+        .WillOnce(Return(ActionStatus::success));
+    blobs::BlobMeta meta;
+    EXPECT_TRUE(handler->stat(session, &meta));
+    handler->close(session);
+
+    EXPECT_TRUE(handler->open(session, flags, updateBlobId));
+    EXPECT_CALL(*bmcUpdateMockPtr, trigger()).WillOnce(Return(true));
+    EXPECT_CALL(*bmcUpdateMockPtr, status())
+        .WillOnce(Return(ActionStatus::running));
+    EXPECT_TRUE(handler->commit(session, {}));
+
+    /* The BIOS update starts from the BMC update's callback, without the host
+     * checking on it.
+     */
+    EXPECT_CALL(*bmcUpdateMockPtr, status())
+        .WillOnce(Return(ActionStatus::success));
+    EXPECT_CALL(*biosUpdateMockPtr, trigger()).WillOnce(Return(true));
+    EXPECT_CALL(*biosUpdateMockPtr, status())
+        .WillOnce(Return(ActionStatus::running));
+    bmcUpdateMockPtr->cb(*bmcUpdateMockPtr);
+    expectedState(FirmwareBlobHandler::UpdateState::updateStarted);
+}
+
+TEST_F(FirmwareTransactionTest, NextUpdateFailingToStartFailsTheUpdate)
+{
+    sendBmcThenOpenBios();
+    verifyBoth();
+
+    EXPECT_CALL(*biosVerifyMockPtr, status())
+        .WillOnce(Return(ActionStatus::success));
+    blobs::BlobMeta meta;
+    EXPECT_TRUE(handler->stat(session, &meta));
+    handler->close(session);
+
+    EXPECT_TRUE(handler->open(session, flags, updateBlobId));
+    EXPECT_CALL(*bmcUpdateMockPtr, trigger()).WillOnce(Return(true));
+    EXPECT_CALL(*bmcUpdateMockPtr, status())
+        .WillOnce(Return(ActionStatus::running));
+    EXPECT_TRUE(handler->commit(session, {}));
+
+    EXPECT_CALL(*bmcUpdateMockPtr, status())
+        .WillOnce(Return(ActionStatus::success));
+    EXPECT_CALL(*biosUpdateMockPtr, trigger()).WillOnce(Return(false));
+    bmcUpdateMockPtr->cb(*bmcUpdateMockPtr);
+    expectedState(FirmwareBlobHandler::UpdateState::updateCompleted);
+
+    EXPECT_TRUE(handler->stat(session, &meta));
+    EXPECT_EQ(static_cast<std::uint8_t>(ActionStatus::failed),
+              meta.metadata[0]);
+}
+
+} // namespace
+} // namespace ipmi_flash
@@ -191,7 +191,11 @@ class IpmiOnlyFirmwareStaticTest : public ::testing::Test
     std::uint16_t flags = static_cast<std::uint16_t>(blobs::OpenFlags::write) |
                           FirmwareFlags::UpdateFlags::ipmi;
 
-    blobs::BlobMeta expectedIdleMeta = {0xff00, 0, {}};
+    /* The BlobOptionsHdr leading the stat metadata: reuseStaged, resume,
+     * compressed and transaction.
+     */
+    std::vector<std::uint8_t> optionsMeta = {0x00, 0xf0};
+    blobs::BlobMeta expectedIdleMeta = {0xff00, 0, optionsMeta};
 
     std::vector<std::string> startingBlobs = {staticLayoutBlobId, hashBlobId};
 };
@@ -1,3 +1,4 @@
+#include "crc32c.hpp"
 #include "data.hpp"
 #include "data_mock.hpp"
 #include "firmware_handler.hpp"
@@ -17,6 +18,7 @@ namespace ipmi_flash
 namespace
 {
 
+using ::testing::_;
 using ::testing::Eq;
 using ::testing::Return;
 
@@ -63,11 +65,274 @@ TEST_F(FirmwareHandlerWriteTestLpc, DataTypeNonIpmiWriteSuccess)
 
     std::vector<std::uint8_t> bytes = {0x01, 0x02, 0x03, 0x04};
 
+    EXPECT_CALL(*dataMock, canCopyToFile()).WillOnce(Return(false));
+    EXPECT_CALL(*imageMock, getFd()).Times(0);
     EXPECT_CALL(*dataMock, copyFrom(request.length)).WillOnce(Return(bytes));
     EXPECT_CALL(*imageMock, write(0, Eq(bytes))).WillOnce(Return(true));
     EXPECT_TRUE(handler->write(0, 0, ipmiRequest));
 }
 
+TEST_F(FirmwareHandlerWriteTestLpc, DataTypeNonIpmiWriteToFileSuccess)
+{
+    /* Verify a file-backed image lets the transport write into it directly. */
+    EXPECT_CALL(*dataMock, open()).WillOnce(Return(true));
+    EXPECT_CALL(*imageMock, open("asdf", std::ios::out)).WillOnce(Return(true));
+
+    EXPECT_TRUE(
+        handler->open(0,
+                      static_cast<std::uint16_t>(blobs::OpenFlags::write) |
+                          FirmwareFlags::UpdateFlags::lpc,
+                      "asdf"));
+
+    struct ExtChunkHdr request;
+    request.length = 4; /* number of bytes to read. */
+    std::vector<std::uint8_t> ipmiRequest;
+    ipmiRequest.resize(sizeof(request));
+    std::memcpy(ipmiRequest.data(), &request, sizeof(request));
+
+    EXPECT_CALL(*dataMock, canCopyToFile()).WillOnce(Return(true));
+    EXPECT_CALL(*imageMock, getFd()).WillOnce(Return(5));
+    EXPECT_CALL(*dataMock, copyToFile(5, 0x1000, request.length))
+        .WillOnce(Return(request.length));
+    EXPECT_CALL(*imageMock, write(_, _)).Times(0);
+    EXPECT_TRUE(handler->write(0, 0x1000, ipmiRequest));
+}
+
+TEST_F(FirmwareHandlerWriteTestLpc, DataTypeNonIpmiWriteToFileIsNotReadBack)
+{
+    /* Verify the bytes written into the file aren't read back to be counted
+     * toward a checkpoint.
+     */
+    EXPECT_CALL(*dataMock, open()).WillOnce(Return(true));
+    EXPECT_CALL(*imageMock, open("asdf", std::ios::out)).WillOnce(Return(true));
+
+    EXPECT_TRUE(
+        handler->open(0,
+                      static_cast<std::uint16_t>(blobs::OpenFlags::write) |
+                          FirmwareFlags::UpdateFlags::lpc,
+                      "asdf"));
+
+    struct ExtChunkHdr request;
+    request.length = 4; /* number of bytes to read. */
+    std::vector<std::uint8_t> ipmiRequest;
+    ipmiRequest.resize(sizeof(request));
+    std::memcpy(ipmiRequest.data(), &request, sizeof(request));
+
+    EXPECT_CALL(*dataMock, canCopyToFile()).WillOnce(Return(true));
+    EXPECT_CALL(*imageMock, getFd()).WillOnce(Return(5));
+    EXPECT_CALL(*dataMock, copyToFile(5, 0, request.length))
+        .WillOnce(Return(request.length));
+    EXPECT_CALL(*imageMock, read(_, _)).Times(0);
+    EXPECT_TRUE(handler->write(0, 0, ipmiRequest));
+}
+
+TEST_F(FirmwareHandlerWriteTestLpc, DataTypeNonIpmiWriteToFileFailsShortCopy)
+{
+    /* Verify a direct write that can't provide all the bytes fails. */
+    EXPECT_CALL(*dataMock, open()).WillOnce(Return(true));
+    EXPECT_CALL(*imageMock, open("asdf", std::ios::out)).WillOnce(Return(true));
+
+    EXPECT_TRUE(
+        handler->open(0,
+                      static_cast<std::uint16_t>(blobs::OpenFlags::write) |
+                          FirmwareFlags::UpdateFlags::lpc,
+                      "asdf"));
+
+    struct ExtChunkHdr request;
+    request.length = 4; /* number of bytes to read. */
+    std::vector<std::uint8_t> ipmiRequest;
+    ipmiRequest.resize(sizeof(request));
+    std::memcpy(ipmiRequest.data(), &request, sizeof(request));
+
+    EXPECT_CALL(*dataMock, canCopyToFile()).WillOnce(Return(true));
+    EXPECT_CALL(*imageMock, getFd()).WillOnce(Return(5));
+    EXPECT_CALL(*dataMock, copyToFile(5, 0, request.length))
+        .WillOnce(Return(2));
+    EXPECT_FALSE(handler->write(0, 0, ipmiRequest));
+}
+
+TEST_F(FirmwareHandlerWriteTestLpc, DataTypeNonIpmiWriteToFileUnsupported)
+{
+    /* Verify a transport that can't write into the file falls back to
+     * copying the bytes out.
+     */
+    EXPECT_CALL(*dataMock, open()).WillOnce(Return(true));
+    EXPECT_CALL(*imageMock, open("asdf", std::ios::out)).WillOnce(Return(true));
+
+    EXPECT_TRUE(
+        handler->open(0,
+                      static_cast<std::uint16_t>(blobs::OpenFlags::write) |
+                          FirmwareFlags::UpdateFlags::lpc,
+                      "asdf"));
+
+    struct ExtChunkHdr request;
+    request.length = 4; /* number of bytes to read. */
+    std::vector<std::uint8_t> ipmiRequest;
+    ipmiRequest.resize(sizeof(request));
+    std::memcpy(ipmiRequest.data(), &request, sizeof(request));
+
+    std::vector<std::uint8_t> bytes = {0x01, 0x02, 0x03, 0x04};
+
+    EXPECT_CALL(*dataMock, canCopyToFile()).WillOnce(Return(true));
+    EXPECT_CALL(*imageMock, getFd()).WillOnce(Return(5));
+    EXPECT_CALL(*dataMock, copyToFile(5, 0, request.length))
+        .WillOnce(Return(std::nullopt));
+    EXPECT_CALL(*dataMock, copyFrom(request.length)).WillOnce(Return(bytes));
+    EXPECT_CALL(*imageMock, write(0, Eq(bytes))).WillOnce(Return(true));
+    EXPECT_TRUE(handler->write(0, 0, ipmiRequest));
+}
+
+TEST_F(FirmwareHandlerWriteTestLpc, DataTypeNonIpmiWindowWriteSuccess)
+{
+    /* Verify the extended header copies from the requested window offset. */
+    EXPECT_CALL(*dataMock, open()).WillOnce(Return(true));
+    EXPECT_CALL(*imageMock, open("asdf", std::ios::out)).WillOnce(Return(true));
+
+    EXPECT_TRUE(
+        handler->open(0,
+                      static_cast<std::uint16_t>(blobs::OpenFlags::write) |
+                          FirmwareFlags::UpdateFlags::lpc,
+                      "asdf"));
+
+    struct ExtChunkWindowHdr request;
+    request.length = 4; /* number of bytes to read. */
+    request.windowOffset = 0x800;
+    std::vector<std::uint8_t> ipmiRequest;
+    ipmiRequest.resize(sizeof(request));
+    std::memcpy(ipmiRequest.data(), &request, sizeof(request));
+
+    std::vector<std::uint8_t> bytes = {0x01, 0x02, 0x03, 0x04};
+
+    EXPECT_CALL(*dataMock, copyFromWindow(request.windowOffset, request.length))
+        .WillOnce(Return(bytes));
+    EXPECT_CALL(*imageMock, write(0x1000, Eq(bytes))).WillOnce(Return(true));
+    EXPECT_TRUE(handler->write(0, 0x1000, ipmiRequest));
+}
+
+TEST_F(FirmwareHandlerWriteTestLpc, DataTypeNonIpmiWindowWriteFailsShortCopy)
+{
+    /* Verify a window copy that can't provide all the bytes fails. */
+    EXPECT_CALL(*dataMock, open()).WillOnce(Return(true));
+    EXPECT_CALL(*imageMock, open("asdf", std::ios::out)).WillOnce(Return(true));
+
+    EXPECT_TRUE(
+        handler->open(0,
+                      static_cast<std::uint16_t>(blobs::OpenFlags::write) |
+                          FirmwareFlags::UpdateFlags::lpc,
+                      "asdf"));
+
+    struct ExtChunkWindowHdr request;
+    request.length = 4; /* number of bytes to read. */
+    request.windowOffset = 0xfffe;
+    std::vector<std::uint8_t> ipmiRequest;
+    ipmiRequest.resize(sizeof(request));
+    std::memcpy(ipmiRequest.data(), &request, sizeof(request));
+
+    EXPECT_CALL(*dataMock, copyFromWindow(request.windowOffset, request.length))
+        .WillOnce(Return(std::vector<std::uint8_t>{}));
+    EXPECT_FALSE(handler->write(0, 0, ipmiRequest));
+}
+
+TEST_F(FirmwareHandlerWriteTestLpc, DataTypeNonIpmiCrcWriteSuccess)
+{
+    /* Verify a chunk whose CRC matches is written. */
+    EXPECT_CALL(*dataMock, open()).WillOnce(Return(true));
+    EXPECT_CALL(*imageMock, open("asdf", std::ios::out)).WillOnce(Return(true));
+
+    EXPECT_TRUE(
+        handler->open(0,
+                      static_cast<std::uint16_t>(blobs::OpenFlags::write) |
+                          FirmwareFlags::UpdateFlags::lpc,
+                      "asdf"));
+
+    std::vector<std::uint8_t> bytes = {0x01, 0x02, 0x03, 0x04};
+
+    struct ExtChunkCrcHdr request;
+    request.length = 4; /* number of bytes to read. */
+    request.windowOffset = 0x800;
+    request.crc = crc32c(0, bytes);
+    std::vector<std::uint8_t> ipmiRequest;
+    ipmiRequest.resize(sizeof(request));
+    std::memcpy(ipmiRequest.data(), &request, sizeof(request));
+
+    EXPECT_CALL(*dataMock, copyFromWindow(request.windowOffset, request.length))
+        .WillOnce(Return(bytes));
+    EXPECT_CALL(*imageMock, write(0x1000, Eq(bytes))).WillOnce(Return(true));
+    EXPECT_TRUE(handler->write(0, 0x1000, ipmiRequest));
+}
+
+TEST_F(FirmwareHandlerWriteTestLpc, DataTypeNonIpmiFillWriteSuccess)
+{
+    /* Verify a fill is passed to the image handler, nothing is borrowed. */
+    EXPECT_CALL(*dataMock, open()).WillOnce(Return(true));
+    EXPECT_CALL(*imageMock, open("asdf", std::ios::out)).WillOnce(Return(true));
+
+    EXPECT_TRUE(
+        handler->open(0,
+                      static_cast<std::uint16_t>(blobs::OpenFlags::write) |
+                          FirmwareFlags::UpdateFlags::lpc,
+                      "asdf"));
+
+    struct ExtChunkFillHdr request;
+    request.length = 0x10000;
+    request.value = 0xff;
+    std::vector<std::uint8_t> ipmiRequest;
+    ipmiRequest.resize(sizeof(request));
+    std::memcpy(ipmiRequest.data(), &request, sizeof(request));
+
+    EXPECT_CALL(*imageMock, fill(0x1000, 0x10000, 0xff)).WillOnce(Return(true));
+    EXPECT_TRUE(handler->write(0, 0x1000, ipmiRequest));
+}
+
+TEST_F(FirmwareHandlerWriteTestLpc, DataTypeNonIpmiFillWriteFails)
+{
+    EXPECT_CALL(*dataMock, open()).WillOnce(Return(true));
+    EXPECT_CALL(*imageMock, open("asdf", std::ios::out)).WillOnce(Return(true));
+
+    EXPECT_TRUE(
+        handler->open(0,
+                      static_cast<std::uint16_t>(blobs::OpenFlags::write) |
+                          FirmwareFlags::UpdateFlags::lpc,
+                      "asdf"));
+
+    struct ExtChunkFillHdr request;
+    request.length = 0x100;
+    request.value = 0;
+    std::vector<std::uint8_t> ipmiRequest;
+    ipmiRequest.resize(sizeof(request));
+    std::memcpy(ipmiRequest.data(), &request, sizeof(request));
+
+    EXPECT_CALL(*imageMock, fill(0, 0x100, 0)).WillOnce(Return(false));
+    EXPECT_FALSE(handler->write(0, 0, ipmiRequest));
+}
+
+TEST_F(FirmwareHandlerWriteTestLpc, DataTypeNonIpmiCrcWriteFailsBadCrc)
+{
+    /* Verify a chunk whose CRC doesn't match is rejected, not written. */
+    EXPECT_CALL(*dataMock, open()).WillOnce(Return(true));
+    EXPECT_CALL(*imageMock, open("asdf", std::ios::out)).WillOnce(Return(true));
+
+    EXPECT_TRUE(
+        handler->open(0,
+                      static_cast<std::uint16_t>(blobs::OpenFlags::write) |
+                          FirmwareFlags::UpdateFlags::lpc,
+                      "asdf"));
+
+    std::vector<std::uint8_t> bytes = {0x01, 0x02, 0x03, 0x04};
+
+    struct ExtChunkCrcHdr request;
+    request.length = 4; /* number of bytes to read. */
+    request.windowOffset = 0;
+    request.crc = crc32c(0, bytes) ^ 1;
+    std::vector<std::uint8_t> ipmiRequest;
+    ipmiRequest.resize(sizeof(request));
+    std::memcpy(ipmiRequest.data(), &request, sizeof(request));
+
+    EXPECT_CALL(*dataMock, copyFrom(request.length)).WillOnce(Return(bytes));
+    EXPECT_CALL(*imageMock, write(_, _)).Times(0);
+    EXPECT_FALSE(handler->write(0, 0, ipmiRequest));
+}
+
 TEST_F(FirmwareHandlerWriteTestLpc, DataTypeNonIpmiWriteFailsBadRequest)
 {
     /* Verify the data type non-ipmi, if the request's structure doesn't match,
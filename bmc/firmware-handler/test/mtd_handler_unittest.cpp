@@ -0,0 +1,269 @@
+#include "internal/sys.hpp"
+#include "mtd_handler.hpp"
+
+#include <fcntl.h>
+#include <mtd/mtd-user.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+namespace ipmi_flash
+{
+namespace
+{
+
+constexpr std::uint32_t flashSize = 64 * 1024;
+constexpr std::uint32_t eraseSize = 4096;
+constexpr std::uint32_t writeSize = 16;
+
+/* Stands in for an MTD device with a temporary file.  Like flash, bytes can
+ * only be written once they're erased, in whole write units.
+ */
+class FlashSys : public internal::SysImpl
+{
+  public:
+    FlashSys()
+    {
+        char name[] = "/tmp/mtd_handler.XXXXXX";
+        int fd = ::mkstemp(name);
+        std::vector<std::uint8_t> old(flashSize, 0x5a);
+        if (fd < 0 || ::write(fd, old.data(), old.size()) != flashSize)
+        {
+            std::abort();
+        }
+        ::close(fd);
+        path = name;
+    }
+
+    ~FlashSys() override
+    {
+        ::unlink(path.c_str());
+    }
+
+    int open(const char*, int flags) const override
+    {
+        return internal::SysImpl::open(path.c_str(), flags);
+    }
+
+    int ioctl(int fd, unsigned long request, void* param) const override
+    {
+        if (request == MEMGETINFO)
+        {
+            auto info = static_cast<struct mtd_info_user*>(param);
+            *info = {};
+            info->type = MTD_NORFLASH;
+            info->size = flashSize;
+            info->erasesize = eraseSize;
+            info->writesize = writeSize;
+            return 0;
+        }
+        if (request == MEMERASE)
+        {
+            auto erase = static_cast<struct erase_info_user*>(param);
+            erases.push_back(*erase);
+            if (erase->start % eraseSize || erase->length % eraseSize)
+            {
+                errno = EINVAL;
+                return -1;
+            }
+            std::vector<std::uint8_t> ones(erase->length, 0xff);
+            return internal::SysImpl::pwrite(fd, ones.data(), ones.size(),
+                                             erase->start) < 0
+                       ? -1
+                       : 0;
+        }
+        errno = ENOTTY;
+        return -1;
+    }
+
+    int pwrite(int fd, const void* buf, std::size_t count,
+               off_t offset) const override
+    {
+        std::vector<std::uint8_t> current(count);
+        internal::SysImpl::pread(fd, current.data(), count, offset);
+        if (failWrites || offset % writeSize || count % writeSize ||
+            !std::all_of(current.begin(), current.end(),
+                         [](std::uint8_t b) { return b == 0xff; }))
+        {
+            errno = EIO;
+            return -1;
+        }
+        return internal::SysImpl::pwrite(fd, buf, count, offset);
+    }
+
+    std::vector<std::uint8_t> contents() const
+    {
+        std::vector<std::uint8_t> bytes(flashSize);
+        int fd = internal::SysImpl::open(path.c_str(), O_RDONLY);
+        internal::SysImpl::pread(fd, bytes.data(), bytes.size(), 0);
+        internal::SysImpl::close(fd);
+        return bytes;
+    }
+
+    mutable std::vector<struct erase_info_user> erases;
+    bool failWrites = false;
+
+  private:
+    std::string path;
+};
+
+class MtdHandlerTest : public ::testing::Test
+{
+  protected:
+    std::vector<std::uint8_t> pattern(std::size_t size, std::uint8_t seed)
+    {
+        std::vector<std::uint8_t> bytes(size);
+        for (std::size_t i = 0; i < size; i++)
+        {
+            bytes[i] = seed + i;
+        }
+        return bytes;
+    }
+
+    FlashSys sys;
+};
+
+TEST_F(MtdHandlerTest, UnalignedChunksAreWrittenInWholeUnits)
+{
+    MtdHandler handler("/dev/mtd5", 2, &sys);
+    EXPECT_TRUE(handler.open("", std::ios::out));
+
+    auto first = pattern(7, 0);
+    auto second = pattern(30, 7);
+    EXPECT_TRUE(handler.write(0, first));
+    EXPECT_TRUE(handler.write(7, second));
+    EXPECT_EQ(37, handler.getSize());
+
+    /* Reads see the bytes still held back as well. */
+    auto readBack = handler.read(0, 37);
+    ASSERT_TRUE(readBack);
+    EXPECT_EQ(pattern(37, 0), *readBack);
+    handler.close();
+
+    auto flash = sys.contents();
+    EXPECT_TRUE(std::equal(first.begin(), first.end(), flash.begin()));
+    EXPECT_TRUE(std::equal(second.begin(), second.end(), flash.begin() + 7));
+    /* The last write unit is padded. */
+    EXPECT_TRUE(std::all_of(flash.begin() + 37, flash.begin() + 48,
+                            [](std::uint8_t b) { return b == 0xff; }));
+    /* Erase blocks past the batch keep their old contents. */
+    EXPECT_EQ(0x5a, flash[2 * eraseSize]);
+}
+
+TEST_F(MtdHandlerTest, EraseBlocksAreErasedAheadInBatches)
+{
+    MtdHandler handler("/dev/mtd5", 4, &sys);
+    EXPECT_TRUE(handler.open("", std::ios::out));
+
+    auto chunk = pattern(1024, 3);
+    for (std::uint32_t offset = 0; offset < 6 * eraseSize; offset += 1024)
+    {
+        EXPECT_TRUE(handler.write(offset, chunk));
+    }
+    handler.close();
+
+    ASSERT_EQ(2, sys.erases.size());
+    EXPECT_EQ(0, sys.erases[0].start);
+    EXPECT_EQ(4 * eraseSize, sys.erases[0].length);
+    EXPECT_EQ(4 * eraseSize, sys.erases[1].start);
+    EXPECT_EQ(4 * eraseSize, sys.erases[1].length);
+}
+
+TEST_F(MtdHandlerTest, ResentChunkIsAccepted)
+{
+    MtdHandler handler("/dev/mtd5", 1, &sys);
+    EXPECT_TRUE(handler.open("", std::ios::out));
+
+    auto chunk = pattern(8, 1);
+    EXPECT_TRUE(handler.write(0, chunk));
+    EXPECT_TRUE(handler.write(0, chunk));
+    EXPECT_EQ(8, handler.getSize());
+}
+
+TEST_F(MtdHandlerTest, OutOfOrderWriteFails)
+{
+    MtdHandler handler("/dev/mtd5", 1, &sys);
+    EXPECT_TRUE(handler.open("", std::ios::out));
+
+    auto chunk = pattern(32, 1);
+    EXPECT_FALSE(handler.write(32, chunk));
+    EXPECT_TRUE(handler.write(0, chunk));
+    /* Those bytes were written, they can't be changed without an erase. */
+    EXPECT_FALSE(handler.write(0, chunk));
+}
+
+TEST_F(MtdHandlerTest, FlushEndsTheImage)
+{
+    MtdHandler handler("/dev/mtd5", 1, &sys);
+    EXPECT_TRUE(handler.open("", std::ios::out));
+
+    auto chunk = pattern(7, 1);
+    EXPECT_TRUE(handler.write(0, chunk));
+    EXPECT_TRUE(handler.flush());
+    EXPECT_EQ(7, handler.getSize());
+
+    auto flash = sys.contents();
+    EXPECT_TRUE(std::equal(chunk.begin(), chunk.end(), flash.begin()));
+    EXPECT_TRUE(std::all_of(flash.begin() + 7, flash.begin() + writeSize,
+                            [](std::uint8_t b) { return b == 0xff; }));
+
+    /* The padding can't be written over. */
+    EXPECT_FALSE(handler.write(7, chunk));
+}
+
+TEST_F(MtdHandlerTest, FailedPaddingFailsFlush)
+{
+    MtdHandler handler("/dev/mtd5", 1, &sys);
+    EXPECT_TRUE(handler.open("", std::ios::out));
+
+    EXPECT_TRUE(handler.write(0, pattern(7, 1)));
+    sys.failWrites = true;
+    EXPECT_FALSE(handler.flush());
+}
+
+TEST_F(MtdHandlerTest, ImageLargerThanThePartitionFails)
+{
+    MtdHandler handler("/dev/mtd5", 1, &sys);
+    EXPECT_TRUE(handler.open("", std::ios::out));
+
+    auto chunk = pattern(32, 1);
+    EXPECT_FALSE(handler.write(flashSize - 16, chunk));
+}
+
+TEST_F(MtdHandlerTest, ReadModeSpansThePartition)
+{
+    MtdHandler handler("/dev/mtd5", 1, &sys);
+    EXPECT_TRUE(handler.open("", std::ios::in));
+    EXPECT_EQ(flashSize, handler.getSize());
+    auto bytes = handler.read(flashSize - 4, 16);
+    ASSERT_TRUE(bytes);
+    EXPECT_EQ(std::vector<std::uint8_t>(4, 0x5a), *bytes);
+    EXPECT_FALSE(handler.write(0, *bytes));
+}
+
+TEST_F(MtdHandlerTest, ReadModeAfterAWriteSpansTheImage)
+{
+    MtdHandler handler("/dev/mtd5", 1, &sys);
+    EXPECT_TRUE(handler.open("", std::ios::out));
+    EXPECT_TRUE(handler.write(0, pattern(37, 0)));
+    handler.close();
+
+    /* Not the padding after it, or the rest of the partition. */
+    EXPECT_TRUE(handler.open("", std::ios::in));
+    EXPECT_EQ(37, handler.getSize());
+    auto bytes = handler.read(0, 64);
+    ASSERT_TRUE(bytes);
+    EXPECT_EQ(pattern(37, 0), *bytes);
+}
+
+} // namespace
+} // namespace ipmi_flash
@@ -0,0 +1,263 @@
+#include "data.hpp"
+#include "net_handler.hpp"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+namespace ipmi_flash
+{
+namespace
+{
+
+/* Finds a port nothing listens on, for the handler to listen on instead. */
+std::uint16_t freePort()
+{
+    int fd = ::socket(AF_INET6, SOCK_STREAM, 0);
+    struct sockaddr_in6 addr = {};
+    addr.sin6_family = AF_INET6;
+    addr.sin6_addr = in6addr_loopback;
+    socklen_t length = sizeof(addr);
+    ::bind(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr));
+    ::getsockname(fd, reinterpret_cast<struct sockaddr*>(&addr), &length);
+    ::close(fd);
+    return ntohs(addr.sin6_port);
+}
+
+class NetHandlerTest : public ::testing::Test
+{
+  protected:
+    void TearDown() override
+    {
+        for (int fd : clients)
+        {
+            ::close(fd);
+        }
+        handler.close();
+    }
+
+    /* Connects to the handler the way the host does, returns the socket. */
+    int connect()
+    {
+        int fd = ::socket(AF_INET6, SOCK_STREAM, 0);
+        struct sockaddr_in6 addr = {};
+        addr.sin6_family = AF_INET6;
+        addr.sin6_addr = in6addr_loopback;
+        addr.sin6_port = htons(config.port);
+        EXPECT_EQ(0, ::connect(fd, reinterpret_cast<struct sockaddr*>(&addr),
+                               sizeof(addr)));
+        clients.push_back(fd);
+        return fd;
+    }
+
+    void send(int fd, const std::vector<std::uint8_t>& data)
+    {
+        ASSERT_EQ(static_cast<ssize_t>(data.size()),
+                  ::write(fd, data.data(), data.size()));
+    }
+
+    /* Sends a chunk of a striped transfer, with its header. */
+    void sendChunk(int fd, std::uint32_t offset,
+                   const std::vector<std::uint8_t>& data)
+    {
+        struct NetChunkHdr header;
+        header.offset = offset;
+        header.length = data.size();
+        auto* bytes = reinterpret_cast<const std::uint8_t*>(&header);
+        std::vector<std::uint8_t> chunk(bytes, bytes + sizeof(header));
+        chunk.insert(chunk.end(), data.begin(), data.end());
+        send(fd, chunk);
+    }
+
+    /* Asks for the transfer to be striped, before connecting. */
+    void stripe(NetDataHandler& receiver, std::uint32_t streams)
+    {
+        struct NetConfigRequest request;
+        request.streams = streams;
+        auto* bytes = reinterpret_cast<const std::uint8_t*>(&request);
+        EXPECT_TRUE(receiver.writeMeta(
+            std::vector<std::uint8_t>(bytes, bytes + sizeof(request))));
+    }
+
+    NetConfig config = [] {
+        NetConfig c;
+        c.port = freePort();
+        return c;
+    }();
+    NetDataHandler handler{config};
+    std::vector<int> clients;
+
+    std::vector<std::uint8_t> first = {0x01, 0x02, 0x03, 0x04};
+    std::vector<std::uint8_t> second = {0x05, 0x06, 0x07, 0x08};
+    std::vector<std::uint8_t> third = {0x09, 0x0a, 0x0b, 0x0c};
+};
+
+TEST_F(NetHandlerTest, StreamIsReadInOrder)
+{
+    ASSERT_TRUE(handler.open());
+    int fd = connect();
+    send(fd, first);
+    send(fd, second);
+
+    EXPECT_EQ(first, handler.copyFrom(first.size()));
+    auto lent = handler.borrow(second.size());
+    EXPECT_EQ(second, std::vector<std::uint8_t>(lent.begin(), lent.end()));
+    EXPECT_TRUE(handler.readMeta().empty());
+}
+
+TEST_F(NetHandlerTest, StreamEndedEarlyReturnsWhatCame)
+{
+    ASSERT_TRUE(handler.open());
+    int fd = connect();
+    send(fd, {0x01, 0x02});
+    ::shutdown(fd, SHUT_WR);
+
+    EXPECT_EQ(std::vector<std::uint8_t>({0x01, 0x02}), handler.copyFrom(4));
+}
+
+TEST_F(NetHandlerTest, StreamIsSplicedIntoTheFile)
+{
+    ASSERT_TRUE(handler.open());
+    int fd = connect();
+    send(fd, first);
+
+    std::FILE* file = std::tmpfile();
+    ASSERT_NE(nullptr, file);
+    EXPECT_TRUE(handler.canCopyToFile());
+    auto copied = handler.copyToFile(::fileno(file), 0x10, first.size());
+    ASSERT_TRUE(copied);
+    EXPECT_EQ(first.size(), *copied);
+
+    std::vector<std::uint8_t> written(first.size());
+    EXPECT_EQ(static_cast<ssize_t>(written.size()),
+              ::pread(::fileno(file), written.data(), written.size(), 0x10));
+    EXPECT_EQ(first, written);
+    std::fclose(file);
+}
+
+TEST_F(NetHandlerTest, ChunkLargerThanTheWindowIsRefused)
+{
+    ASSERT_TRUE(handler.open());
+    EXPECT_TRUE(handler.copyFrom(config.receiveBuffer + 1).empty());
+}
+
+TEST_F(NetHandlerTest, StripingIsConfiguredBeforeConnecting)
+{
+    ASSERT_TRUE(handler.open());
+
+    /* Anything that isn't a request is left to other handlers. */
+    EXPECT_TRUE(handler.writeMeta({0x01}));
+    EXPECT_FALSE(handler.writeMeta(std::vector<std::uint8_t>(
+        sizeof(NetConfigRequest), 0)));
+
+    stripe(handler, config.maxStreams + 1);
+    auto meta = handler.readMeta();
+    ASSERT_EQ(sizeof(NetConfigResponse), meta.size());
+    struct NetConfigResponse response;
+    std::memcpy(&response, meta.data(), meta.size());
+    std::uint32_t streams = response.streams;
+    std::uint32_t window = response.window;
+    EXPECT_EQ(config.maxStreams, streams);
+    EXPECT_EQ(static_cast<std::uint32_t>(config.receiveBuffer), window);
+}
+
+TEST_F(NetHandlerTest, StripedChunksAreTakenInOrder)
+{
+    ASSERT_TRUE(handler.open());
+    stripe(handler, 2);
+    int a = connect();
+    int b = connect();
+
+    /* The later chunk arrives first, on the other connection. */
+    sendChunk(b, 4, second);
+    sendChunk(a, 0, first);
+
+    EXPECT_FALSE(handler.canCopyToFile());
+    EXPECT_FALSE(handler.copyToFile(0, 0, first.size()));
+    EXPECT_EQ(first, handler.copyFrom(first.size()));
+    auto lent = handler.borrowFromWindow(0, second.size());
+    EXPECT_EQ(second, std::vector<std::uint8_t>(lent.begin(), lent.end()));
+}
+
+TEST_F(NetHandlerTest, StripedChunkOfTheWrongLengthFails)
+{
+    ASSERT_TRUE(handler.open());
+    stripe(handler, 1);
+    int fd = connect();
+    sendChunk(fd, 0, first);
+
+    EXPECT_TRUE(handler.copyFrom(first.size() + 1).empty());
+}
+
+TEST_F(NetHandlerTest, ResentChunksAreOnlyCountedOnce)
+{
+    /* A window of two chunks.  Were a chunk sent again counted again, the
+     * third copy wouldn't fit and the chunk behind it would never be read.
+     */
+    config.receiveBuffer = 2 * first.size();
+    NetDataHandler small(config);
+    ASSERT_TRUE(small.open());
+    stripe(small, 1);
+    int fd = connect();
+
+    sendChunk(fd, 4, second);
+    sendChunk(fd, 4, second);
+    sendChunk(fd, 4, second);
+    sendChunk(fd, 0, first);
+
+    EXPECT_EQ(first, small.copyFrom(first.size()));
+    EXPECT_EQ(second, small.copyFrom(second.size()));
+
+    /* One that was already taken is dropped, not handed out again. */
+    sendChunk(fd, 0, first);
+    sendChunk(fd, 8, third);
+    EXPECT_EQ(third, small.copyFrom(third.size()));
+    ::shutdown(fd, SHUT_WR);
+    EXPECT_TRUE(small.copyFrom(first.size()).empty());
+    small.close();
+}
+
+TEST_F(NetHandlerTest, ResentChunkReplacesTheOneWaiting)
+{
+    ASSERT_TRUE(handler.open());
+    stripe(handler, 1);
+    int fd = connect();
+
+    /* On one connection, so both copies are in before the first chunk. */
+    sendChunk(fd, 4, third);
+    sendChunk(fd, 4, second);
+    sendChunk(fd, 0, first);
+
+    EXPECT_EQ(first, handler.copyFrom(first.size()));
+    EXPECT_EQ(second, handler.copyFrom(second.size()));
+}
+
+TEST_F(NetHandlerTest, ClosedConnectionsEndTheTransfer)
+{
+    ASSERT_TRUE(handler.open());
+    stripe(handler, 1);
+    int fd = connect();
+    sendChunk(fd, 4, second);
+    ::shutdown(fd, SHUT_WR);
+
+    /* The chunk at 0 never comes, so nothing is handed out. */
+    EXPECT_TRUE(handler.copyFrom(first.size()).empty());
+}
+
+TEST(NetConfigTest, MissingFileKeepsTheDefaults)
+{
+    auto config = loadNetConfig("test.net.missing.json");
+    EXPECT_EQ(623, config.port);
+    EXPECT_EQ(4u, config.maxStreams);
+}
+
+} // namespace
+} // namespace ipmi_flash
@@ -0,0 +1,119 @@
+#include "digest_handler.hpp"
+#include "signature_action.hpp"
+#include "status.hpp"
+
+#include <openssl/evp.h>
+#include <openssl/pem.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+namespace ipmi_flash
+{
+namespace
+{
+
+static constexpr auto KEYPATH = "test.pem";
+static constexpr auto SIGPATH = "test.sig";
+static constexpr auto DIGESTPATH = "test.image.sha256";
+
+/* The sha256 digest of "abc". */
+static constexpr auto abcSha256 =
+    "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad";
+
+class SignatureVerificationTest : public ::testing::Test
+{
+  protected:
+    SignatureVerificationTest() : key(EVP_EC_gen("P-256"), &EVP_PKEY_free)
+    {
+        std::unique_ptr<std::FILE, decltype(&std::fclose)> pem(
+            std::fopen(KEYPATH, "w"), &std::fclose);
+        PEM_write_PUBKEY(pem.get(), key.get());
+
+        std::ofstream digest(DIGESTPATH);
+        digest << abcSha256 << "  test.image\n";
+    }
+
+    void TearDown() override
+    {
+        (void)std::remove(KEYPATH);
+        (void)std::remove(SIGPATH);
+        (void)std::remove(DIGESTPATH);
+    }
+
+    /** Signs the data with the key, as the build system would. */
+    void sign(const std::string& data)
+    {
+        std::unique_ptr<EVP_MD_CTX, decltype(&EVP_MD_CTX_free)> ctx(
+            EVP_MD_CTX_new(), &EVP_MD_CTX_free);
+        std::size_t length = 0;
+        ASSERT_EQ(1, EVP_DigestSignInit(ctx.get(), nullptr, EVP_sha256(),
+                                        nullptr, key.get()));
+        ASSERT_EQ(1, EVP_DigestSign(ctx.get(), nullptr, &length,
+                                    reinterpret_cast<const unsigned char*>(
+                                        data.data()),
+                                    data.size()));
+        std::vector<unsigned char> signature(length);
+        ASSERT_EQ(1, EVP_DigestSign(ctx.get(), signature.data(), &length,
+                                    reinterpret_cast<const unsigned char*>(
+                                        data.data()),
+                                    data.size()));
+
+        std::ofstream out(SIGPATH, std::ios::binary);
+        out.write(reinterpret_cast<const char*>(signature.data()), length);
+    }
+
+    std::unique_ptr<TriggerableActionInterface> create()
+    {
+        return SignatureVerification::CreateSignatureVerification(
+            KEYPATH, SIGPATH, DIGESTPATH, DigestHandler::Algorithm::sha256);
+    }
+
+    std::unique_ptr<EVP_PKEY, decltype(&EVP_PKEY_free)> key;
+};
+
+TEST_F(SignatureVerificationTest, ValidSignatureSucceeds)
+{
+    sign("abc");
+    auto action = create();
+    EXPECT_EQ(ActionStatus::unknown, action->status());
+
+    bool called = false;
+    action->setCallback([&](TriggerableActionInterface&) { called = true; });
+    EXPECT_TRUE(action->trigger());
+    EXPECT_TRUE(called);
+    EXPECT_EQ(ActionStatus::success, action->status());
+}
+
+TEST_F(SignatureVerificationTest, SignatureOfOtherDataFails)
+{
+    sign("abd");
+    auto action = create();
+    EXPECT_TRUE(action->trigger());
+    EXPECT_EQ(ActionStatus::failed, action->status());
+}
+
+TEST_F(SignatureVerificationTest, MissingDigestFails)
+{
+    sign("abc");
+    (void)std::remove(DIGESTPATH);
+    auto action = create();
+    EXPECT_TRUE(action->trigger());
+    EXPECT_EQ(ActionStatus::failed, action->status());
+}
+
+TEST_F(SignatureVerificationTest, MissingSignatureFails)
+{
+    auto action = create();
+    EXPECT_TRUE(action->trigger());
+    EXPECT_EQ(ActionStatus::failed, action->status());
+}
+
+} // namespace
+} // namespace ipmi_flash
@@ -0,0 +1,265 @@
+#include "tar_stream_handler.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+namespace ipmi_flash
+{
+namespace
+{
+
+static constexpr auto TESTDIR = "test.tar_stream";
+
+/* Builds a ustar entry, the header followed by the padded contents. */
+std::vector<std::uint8_t> entry(const std::string& name, char type,
+                                const std::vector<std::uint8_t>& contents = {})
+{
+    std::vector<std::uint8_t> block(512, 0);
+    auto text = reinterpret_cast<char*>(block.data());
+    std::copy(name.begin(), name.end(), text);
+    std::snprintf(text + 100, 8, "%07o", 0644);
+    std::snprintf(text + 124, 12, "%011zo", contents.size());
+    block[156] = type;
+    std::copy_n("ustar\0" "00", 8, text + 257);
+
+    std::fill_n(text + 148, 8, ' ');
+    unsigned sum = 0;
+    for (auto byte : block)
+    {
+        sum += byte;
+    }
+    std::snprintf(text + 148, 8, "%06o", sum);
+
+    block.insert(block.end(), contents.begin(), contents.end());
+    block.resize((block.size() + 511) / 512 * 512, 0);
+    return block;
+}
+
+std::vector<std::uint8_t> archive(
+    const std::vector<std::vector<std::uint8_t>>& entries)
+{
+    std::vector<std::uint8_t> bytes;
+    for (const auto& e : entries)
+    {
+        bytes.insert(bytes.end(), e.begin(), e.end());
+    }
+    /* The end-of-archive, and the rest of a 10 KiB record. */
+    bytes.resize(bytes.size() + 1024, 0);
+    bytes.resize((bytes.size() + 10239) / 10240 * 10240, 0);
+    return bytes;
+}
+
+std::vector<std::uint8_t> contentsOf(const std::filesystem::path& path)
+{
+    std::ifstream in(path, std::ios::binary);
+    return std::vector<std::uint8_t>(std::istreambuf_iterator<char>(in), {});
+}
+
+class TarStreamHandlerTest : public ::testing::Test
+{
+  protected:
+    void TearDown() override
+    {
+        std::filesystem::remove_all(TESTDIR);
+    }
+
+    /* Writes the bytes in chunks, in order. */
+    bool writeAll(TarStreamHandler& handler,
+                  const std::vector<std::uint8_t>& bytes,
+                  std::size_t chunk = 300)
+    {
+        for (std::size_t offset = 0; offset < bytes.size(); offset += chunk)
+        {
+            auto length = std::min(chunk, bytes.size() - offset);
+            std::vector<std::uint8_t> data(bytes.begin() + offset,
+                                           bytes.begin() + offset + length);
+            if (!handler.write(offset, data))
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    std::vector<std::uint8_t> kernel = std::vector<std::uint8_t>(700, 'k');
+    std::vector<std::uint8_t> rofs = std::vector<std::uint8_t>(1500, 'r');
+};
+
+TEST_F(TarStreamHandlerTest, MembersAreExtractedAsTheyArrive)
+{
+    auto bytes = archive({entry("images/", '5'),
+                          entry("images/image-kernel", '0', kernel),
+                          entry("./image-rofs", '0', rofs)});
+
+    TarStreamHandler handler(TESTDIR);
+    EXPECT_TRUE(handler.open("", std::ios::out));
+
+    /* Up to the end of the kernel, the directory entry and its header. */
+    std::vector<std::uint8_t> first(bytes.begin(), bytes.begin() + 1024 + 700);
+    EXPECT_TRUE(handler.write(0, first));
+    ASSERT_EQ(1, handler.members().size());
+    EXPECT_EQ("images/image-kernel", handler.members()[0]);
+    EXPECT_EQ(kernel,
+              contentsOf(std::filesystem::path(TESTDIR) / "images/image-kernel"));
+
+    std::vector<std::uint8_t> rest(bytes.begin() + first.size(), bytes.end());
+    EXPECT_TRUE(handler.write(first.size(), rest));
+    EXPECT_EQ(bytes.size(), handler.getSize());
+    handler.close();
+
+    ASSERT_EQ(2, handler.members().size());
+    EXPECT_EQ(rofs, contentsOf(std::filesystem::path(TESTDIR) / "image-rofs"));
+}
+
+TEST_F(TarStreamHandlerTest, MembersGetTheirDigest)
+{
+    std::vector<std::uint8_t> abc = {'a', 'b', 'c'};
+    auto bytes = archive({entry("image-u-boot", '0', abc)});
+
+    TarStreamHandler handler(TESTDIR, FileOptions(),
+                             DigestHandler::Algorithm::sha256);
+    EXPECT_TRUE(handler.open("", std::ios::out));
+    EXPECT_TRUE(writeAll(handler, bytes));
+    handler.close();
+
+    auto path = std::filesystem::path(TESTDIR) / "image-u-boot";
+    auto digest = contentsOf(path.string() + ".sha256");
+    std::string expected =
+        "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad  " +
+        path.string() + "\n";
+    EXPECT_EQ(expected, std::string(digest.begin(), digest.end()));
+}
+
+TEST_F(TarStreamHandlerTest, GnuLongNamesAreUsed)
+{
+    std::string name(150, 'n');
+    std::vector<std::uint8_t> longName(name.begin(), name.end());
+    longName.push_back(0);
+    auto bytes = archive({entry("././@LongLink", 'L', longName),
+                          entry(name.substr(0, 100), '0', kernel)});
+
+    TarStreamHandler handler(TESTDIR);
+    EXPECT_TRUE(handler.open("", std::ios::out));
+    EXPECT_TRUE(writeAll(handler, bytes));
+    handler.close();
+
+    EXPECT_EQ(kernel, contentsOf(std::filesystem::path(TESTDIR) / name));
+}
+
+TEST_F(TarStreamHandlerTest, WritesAheadWithinTheWindowAreHeld)
+{
+    auto bytes = archive({entry("image-kernel", '0', kernel)});
+
+    TarStreamHandler handler(TESTDIR, FileOptions(), std::nullopt, 4096);
+    EXPECT_TRUE(handler.open("", std::ios::out));
+
+    std::vector<std::uint8_t> first(bytes.begin(), bytes.begin() + 1024);
+    std::vector<std::uint8_t> rest(bytes.begin() + 1024, bytes.end());
+    EXPECT_FALSE(handler.write(1024 + 4096, rest));
+    EXPECT_TRUE(handler.write(1024, std::vector<std::uint8_t>(
+                                        rest.begin(), rest.begin() + 1024)));
+    EXPECT_TRUE(handler.members().empty());
+    EXPECT_TRUE(handler.write(0, first));
+    EXPECT_EQ(1, handler.members().size());
+
+    /* Those bytes have been extracted. */
+    EXPECT_FALSE(handler.write(0, first));
+}
+
+TEST_F(TarStreamHandlerTest, WritesAheadFailWithoutAWindow)
+{
+    auto bytes = archive({entry("image-kernel", '0', kernel)});
+
+    TarStreamHandler handler(TESTDIR);
+    EXPECT_TRUE(handler.open("", std::ios::out));
+    std::vector<std::uint8_t> data(bytes.begin() + 512, bytes.begin() + 1024);
+    EXPECT_FALSE(handler.write(512, data));
+}
+
+TEST_F(TarStreamHandlerTest, MembersOutsideTheDirectoryAreRefused)
+{
+    auto bytes = archive({entry("../image-kernel", '0', kernel)});
+
+    TarStreamHandler handler(TESTDIR);
+    EXPECT_TRUE(handler.open("", std::ios::out));
+    EXPECT_FALSE(writeAll(handler, bytes));
+    /* Nothing more is taken once the tarball is known to be bad. */
+    EXPECT_FALSE(handler.write(bytes.size(), kernel));
+    EXPECT_FALSE(std::filesystem::exists("image-kernel"));
+}
+
+TEST_F(TarStreamHandlerTest, SymlinksAreRefused)
+{
+    auto bytes = archive({entry("image-kernel", '2')});
+
+    TarStreamHandler handler(TESTDIR);
+    EXPECT_TRUE(handler.open("", std::ios::out));
+    EXPECT_FALSE(writeAll(handler, bytes));
+}
+
+TEST_F(TarStreamHandlerTest, CorruptHeaderFails)
+{
+    auto bytes = archive({entry("image-kernel", '0', kernel)});
+    bytes[0] = 'x';
+
+    TarStreamHandler handler(TESTDIR);
+    EXPECT_TRUE(handler.open("", std::ios::out));
+    EXPECT_FALSE(writeAll(handler, bytes));
+}
+
+TEST_F(TarStreamHandlerTest, IncompleteMemberIsRemoved)
+{
+    auto bytes = archive({entry("image-kernel", '0', kernel)});
+
+    TarStreamHandler handler(TESTDIR);
+    EXPECT_TRUE(handler.open("", std::ios::out));
+    std::vector<std::uint8_t> data(bytes.begin(), bytes.begin() + 600);
+    EXPECT_TRUE(handler.write(0, data));
+    EXPECT_TRUE(
+        std::filesystem::exists(std::filesystem::path(TESTDIR) / "image-kernel"));
+    handler.close();
+
+    EXPECT_TRUE(handler.members().empty());
+    EXPECT_FALSE(
+        std::filesystem::exists(std::filesystem::path(TESTDIR) / "image-kernel"));
+}
+
+TEST_F(TarStreamHandlerTest, EarlierUploadIsRemovedOnOpen)
+{
+    TarStreamHandler handler(TESTDIR);
+    EXPECT_TRUE(handler.open("", std::ios::out));
+    EXPECT_TRUE(writeAll(handler, archive({entry("images/", '5'),
+                                           entry("images/image-kernel", '0',
+                                                 kernel)})));
+    handler.close();
+
+    /* The next upload doesn't have the kernel, it mustn't be found there. */
+    EXPECT_TRUE(handler.open("", std::ios::out));
+    EXPECT_FALSE(std::filesystem::exists(std::filesystem::path(TESTDIR) /
+                                         "images"));
+    EXPECT_TRUE(writeAll(handler, archive({entry("image-rofs", '0', rofs)})));
+    handler.close();
+
+    EXPECT_FALSE(std::filesystem::exists(std::filesystem::path(TESTDIR) /
+                                         "images/image-kernel"));
+    EXPECT_EQ(rofs, contentsOf(std::filesystem::path(TESTDIR) / "image-rofs"));
+}
+
+TEST_F(TarStreamHandlerTest, TarballCannotBeReadBack)
+{
+    TarStreamHandler handler(TESTDIR);
+    EXPECT_FALSE(handler.open("", std::ios::in));
+    EXPECT_TRUE(handler.open("", std::ios::out));
+    EXPECT_FALSE(handler.read(0, 512));
+}
+
+} // namespace
+} // namespace ipmi_flash
@@ -0,0 +1,140 @@
+#include "crc32c.hpp"
+#include "upload_progress.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <span>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+namespace ipmi_flash
+{
+namespace
+{
+
+constexpr std::uint32_t checkpointSize = UploadProgress::checkpointSize;
+
+class UploadProgressTest : public ::testing::Test
+{
+  protected:
+    UploadProgressTest() : image(2 * checkpointSize + 100)
+    {
+        for (std::size_t i = 0; i < image.size(); i++)
+        {
+            image[i] = static_cast<std::uint8_t>(i * 7);
+        }
+    }
+
+    /* Writes the image from offset, in chunks of size. */
+    void write(std::uint32_t offset, std::uint32_t end, std::uint32_t size)
+    {
+        for (; offset < end; offset += size)
+        {
+            progress.add(offset, std::span(image).subspan(
+                                     offset, std::min(size, end - offset)));
+        }
+    }
+
+    std::uint32_t crcTo(std::uint32_t end)
+    {
+        return crc32c(0, std::span(image).first(end));
+    }
+
+    std::vector<std::uint8_t> image;
+    UploadProgress progress;
+};
+
+TEST(Crc32cTest, CheckValue)
+{
+    std::string check = "123456789";
+    EXPECT_EQ(0xe3069283,
+              crc32c(0, std::span(reinterpret_cast<const std::uint8_t*>(
+                                      check.data()),
+                                  check.size())));
+}
+
+TEST(Crc32cTest, HardwareMatchesSoftware)
+{
+    if (!internal::haveCrc32cHardware())
+    {
+        GTEST_SKIP() << "No CRC instructions";
+    }
+
+    std::vector<std::uint8_t> data(1000);
+    for (std::size_t i = 0; i < data.size(); i++)
+    {
+        data[i] = static_cast<std::uint8_t>(i * 31 + 5);
+    }
+
+    /* Lengths and starts that aren't multiples of eight cover the tails. */
+    for (std::size_t start : {0, 1, 3})
+    {
+        for (std::size_t length : {0, 1, 7, 8, 9, 64, 997})
+        {
+            auto bytes = std::span(data).subspan(start, length);
+            EXPECT_EQ(internal::crc32cSoftware(0xffffffff, bytes),
+                      internal::crc32cHardware(0xffffffff, bytes));
+        }
+    }
+}
+
+TEST_F(UploadProgressTest, InOrderWritesReachCheckpoints)
+{
+    write(0, image.size(), 1000);
+
+    EXPECT_EQ(image.size(), progress.written());
+    EXPECT_EQ(image.size(), progress.end());
+    EXPECT_EQ(2 * checkpointSize, progress.checkpoint());
+    EXPECT_EQ(crcTo(2 * checkpointSize), progress.checkpointCrc());
+}
+
+TEST_F(UploadProgressTest, BytesAfterAGapArentCounted)
+{
+    write(0, checkpointSize + 10, 4096);
+    write(checkpointSize + 20, image.size(), 4096);
+
+    EXPECT_EQ(checkpointSize + 10, progress.written());
+    EXPECT_EQ(image.size(), progress.end());
+    EXPECT_EQ(checkpointSize, progress.checkpoint());
+    EXPECT_EQ(crcTo(checkpointSize), progress.checkpointCrc());
+}
+
+TEST_F(UploadProgressTest, ResumingAtTheCheckpointContinues)
+{
+    write(0, checkpointSize + 500, 4096);
+
+    /* As a resumed upload would, from the checkpoint to the end. */
+    write(checkpointSize, image.size(), 4096);
+
+    EXPECT_EQ(image.size(), progress.written());
+    EXPECT_EQ(2 * checkpointSize, progress.checkpoint());
+    EXPECT_EQ(crcTo(2 * checkpointSize), progress.checkpointCrc());
+}
+
+TEST_F(UploadProgressTest, RewritingBeforeTheCheckpointStartsOver)
+{
+    write(0, checkpointSize + 500, 4096);
+
+    write(4096, 8192, 4096);
+    EXPECT_EQ(0, progress.written());
+    EXPECT_EQ(0, progress.checkpoint());
+
+    write(0, checkpointSize, 4096);
+    EXPECT_EQ(checkpointSize, progress.checkpoint());
+    EXPECT_EQ(crcTo(checkpointSize), progress.checkpointCrc());
+}
+
+TEST_F(UploadProgressTest, ResetForgetsEverything)
+{
+    write(0, image.size(), 4096);
+    progress.reset();
+
+    EXPECT_EQ(0, progress.written());
+    EXPECT_EQ(0, progress.end());
+    EXPECT_EQ(0, progress.checkpoint());
+}
+
+} // namespace
+} // namespace ipmi_flash
@@ -0,0 +1,127 @@
+#include "image_mock.hpp"
+#include "write_behind_handler.hpp"
+
+#include <chrono>
+#include <cstdint>
+#include <future>
+#include <memory>
+#include <vector>
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+namespace ipmi_flash
+{
+namespace
+{
+
+using ::testing::Eq;
+using ::testing::InSequence;
+using ::testing::Return;
+
+class WriteBehindHandlerTest : public ::testing::Test
+{
+  protected:
+    WriteBehindHandlerTest()
+    {
+        std::unique_ptr<ImageHandlerMock> mock = CreateImageMock();
+        imageMock = mock.get();
+        handler = std::make_unique<WriteBehindHandler>(std::move(mock), 2);
+
+        EXPECT_CALL(*imageMock, open("", Eq(std::ios::out)))
+            .WillOnce(Return(true));
+        /* Handing out the descriptor costs the handler, so it's not asked
+         * for unless a transport wants it.
+         */
+        EXPECT_CALL(*imageMock, getFd()).Times(0);
+        EXPECT_CALL(*imageMock, close());
+    }
+
+    ImageHandlerMock* imageMock;
+    std::unique_ptr<WriteBehindHandler> handler;
+    std::vector<std::uint8_t> bytes = {0x01, 0x02};
+};
+
+TEST_F(WriteBehindHandlerTest, WritesReachTheHandlerInOrder)
+{
+    {
+        InSequence seq;
+        EXPECT_CALL(*imageMock, write(0, Eq(bytes))).WillOnce(Return(true));
+        EXPECT_CALL(*imageMock, write(2, Eq(bytes))).WillOnce(Return(true));
+        EXPECT_CALL(*imageMock, write(4, Eq(bytes))).WillOnce(Return(true));
+    }
+
+    EXPECT_TRUE(handler->open("", std::ios::out));
+    EXPECT_TRUE(handler->writeSpan(0, bytes));
+    EXPECT_TRUE(handler->writeSpan(2, bytes));
+    EXPECT_TRUE(handler->writeSpan(4, bytes));
+    EXPECT_TRUE(handler->flush());
+    handler->close();
+}
+
+TEST_F(WriteBehindHandlerTest, DescriptorIsHandedOutOnceWritesLand)
+{
+    {
+        InSequence seq;
+        EXPECT_CALL(*imageMock, write(0, Eq(bytes))).WillOnce(Return(true));
+        EXPECT_CALL(*imageMock, getFd()).WillOnce(Return(5));
+    }
+
+    EXPECT_TRUE(handler->open("", std::ios::out));
+    EXPECT_TRUE(handler->writeSpan(0, bytes));
+    EXPECT_EQ(5, handler->getFd());
+    handler->close();
+}
+
+TEST_F(WriteBehindHandlerTest, FailedWriteIsReportedAfterwards)
+{
+    EXPECT_CALL(*imageMock, write(0, Eq(bytes))).WillOnce(Return(false));
+
+    EXPECT_TRUE(handler->open("", std::ios::out));
+    EXPECT_TRUE(handler->writeSpan(0, bytes));
+    EXPECT_FALSE(handler->flush());
+    EXPECT_FALSE(handler->writeSpan(2, bytes));
+    handler->close();
+}
+
+TEST_F(WriteBehindHandlerTest, WriteWaitsForAFreeSlot)
+{
+    std::promise<void> release;
+    auto released = release.get_future().share();
+    EXPECT_CALL(*imageMock, write(0, Eq(bytes)))
+        .WillOnce([&](std::uint32_t, const std::vector<std::uint8_t>&) {
+            released.wait();
+            return true;
+        });
+    EXPECT_CALL(*imageMock, write(2, Eq(bytes))).WillOnce(Return(true));
+    EXPECT_CALL(*imageMock, write(4, Eq(bytes))).WillOnce(Return(true));
+
+    EXPECT_TRUE(handler->open("", std::ios::out));
+    EXPECT_TRUE(handler->writeSpan(0, bytes));
+    EXPECT_TRUE(handler->writeSpan(2, bytes));
+
+    /* Both slots are taken until the first write completes. */
+    auto third = std::async(std::launch::async,
+                            [&] { return handler->writeSpan(4, bytes); });
+    EXPECT_EQ(std::future_status::timeout,
+              third.wait_for(std::chrono::milliseconds(50)));
+
+    release.set_value();
+    EXPECT_TRUE(third.get());
+    EXPECT_TRUE(handler->flush());
+    handler->close();
+}
+
+TEST_F(WriteBehindHandlerTest, SizeWaitsForQueuedWrites)
+{
+    EXPECT_CALL(*imageMock, write(0, Eq(bytes))).WillOnce(Return(true));
+    EXPECT_CALL(*imageMock, getSize()).WillOnce(Return(2));
+
+    EXPECT_TRUE(handler->open("", std::ios::out));
+    EXPECT_TRUE(handler->writeSpan(0, bytes));
+    EXPECT_EQ(2, handler->getSize());
+    handler->close();
+}
+
+} // namespace
+} // namespace ipmi_flash
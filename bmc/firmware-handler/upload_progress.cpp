@@ -0,0 +1,82 @@
+/*
+ * Copyright 2026 Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "upload_progress.hpp"
+
+#include "crc32c.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <span>
+
+namespace ipmi_flash
+{
+
+void UploadProgress::reset()
+{
+    bytes = 0;
+    furthest = 0;
+    crc = 0;
+    lastCheckpoint = 0;
+    lastCheckpointCrc = 0;
+}
+
+void UploadProgress::add(std::uint32_t offset,
+                         std::span<const std::uint8_t> data)
+{
+    if (data.empty())
+    {
+        return;
+    }
+
+    furthest = std::max<std::uint32_t>(furthest, offset + data.size());
+
+    /* Only the CRC at the last checkpoint is kept, rewriting anything before
+     * it starts over.
+     */
+    if (offset < bytes)
+    {
+        if (offset < lastCheckpoint)
+        {
+            lastCheckpoint = 0;
+            lastCheckpointCrc = 0;
+        }
+        bytes = lastCheckpoint;
+        crc = lastCheckpointCrc;
+    }
+
+    if (offset != bytes)
+    {
+        return;
+    }
+
+    while (!data.empty())
+    {
+        std::size_t length = std::min<std::size_t>(
+            checkpointSize - bytes % checkpointSize, data.size());
+        crc = crc32c(crc, data.first(length));
+        bytes += length;
+        data = data.subspan(length);
+
+        if (bytes % checkpointSize == 0)
+        {
+            lastCheckpoint = bytes;
+            lastCheckpointCrc = crc;
+        }
+    }
+}
+
+} // namespace ipmi_flash
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+
+namespace ipmi_flash
+{
+
+/**
+ * Tracks how much of an image was written in order from its start, so an
+ * interrupted upload can be resumed instead of sent again.  Every
+ * checkpointSize bytes a checkpoint records the CRC-32C of the bytes before
+ * it, which the host compares with its image before resuming there.
+ *
+ * Rewriting bytes goes back to the checkpoint before them, bytes past a gap
+ * aren't counted until it's filled.
+ */
+class UploadProgress
+{
+  public:
+    static constexpr std::uint32_t checkpointSize = 64 * 1024;
+
+    /** Forget what was written, for a new upload. */
+    void reset();
+
+    /**
+     * Note bytes written to the image.
+     *
+     * @param[in] offset - where they were written.
+     * @param[in] data - the bytes.
+     */
+    void add(std::uint32_t offset, std::span<const std::uint8_t> data);
+
+    /** Bytes written in order from the start of the image. */
+    std::uint32_t written() const
+    {
+        return bytes;
+    }
+
+    /** The end of the furthest write, whether it was in order or not. */
+    std::uint32_t end() const
+    {
+        return furthest;
+    }
+
+    /** The last checkpoint, where the upload can be resumed. */
+    std::uint32_t checkpoint() const
+    {
+        return lastCheckpoint;
+    }
+
+    /** CRC-32C of the bytes before the last checkpoint. */
+    std::uint32_t checkpointCrc() const
+    {
+        return lastCheckpointCrc;
+    }
+
+  private:
+    std::uint32_t bytes = 0;
+    std::uint32_t furthest = 0;
+    /* CRC-32C of the written bytes. */
+    std::uint32_t crc = 0;
+    std::uint32_t lastCheckpoint = 0;
+    std::uint32_t lastCheckpointCrc = 0;
+};
+
+} // namespace ipmi_flash
@@ -40,6 +40,9 @@ class SystemdNoFile : public TriggerableActionInterface
     const std::string triggerService;
     const std::string mode;
 
+    /* The IPMI daemon processes bus between commands, so the match keeps
+     * currentStatus up to date and status() never has to wait on the job.
+     */
     std::optional<sdbusplus::bus::match_t> jobMonitor;
     std::optional<std::string> job;
     ActionStatus currentStatus = ActionStatus::unknown;
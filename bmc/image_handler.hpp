@@ -1,15 +1,24 @@
 #pragma once
 
+#include <algorithm>
 #include <cstdint>
 #include <fstream>
 #include <memory>
 #include <optional>
+#include <span>
 #include <string>
 #include <vector>
 
 namespace ipmi_flash
 {
 
+/** An image left staged by an earlier session. */
+struct StagedImage
+{
+    std::uint64_t size;
+    std::vector<std::uint8_t> digest;
+};
+
 /**
  * Each image update mechanism must implement the ImageHandlerInterface.
  */
@@ -22,6 +31,9 @@ class ImageHandlerInterface
      * open the firmware update mechanism.
      *
      * @param[in] path - the path passed to the handler (the blob_id).
+     * @param[in] mode - std::ios::out to write a new image, adding
+     * std::ios::app to keep what an earlier session wrote and write more of
+     * it.  Handlers that can't do that fail to open.
      * @return bool - returns true on success.
      */
     virtual bool open(const std::string& path,
@@ -41,6 +53,50 @@ class ImageHandlerInterface
      */
     virtual bool write(std::uint32_t offset,
                        const std::vector<std::uint8_t>& data) = 0;
+
+    /**
+     * write data to the staged file, straight from the caller's memory.
+     * Handlers that don't implement this get a copy through write().
+     *
+     * @param[in] offset - 0-based offset into the file.
+     * @param[in] data - the data to write.
+     * @return bool - returns true on success.
+     */
+    virtual bool writeSpan(std::uint32_t offset,
+                           std::span<const std::uint8_t> data)
+    {
+        return write(offset,
+                     std::vector<std::uint8_t>(data.begin(), data.end()));
+    }
+
+    /**
+     * write a region that's all one byte value, which the host sent as a fill
+     * instead of its data.  Handlers that don't implement this get the bytes
+     * through writeSpan().
+     *
+     * @param[in] offset - 0-based offset into the file.
+     * @param[in] length - the length of the region.
+     * @param[in] value - the byte the region is filled with.
+     * @return bool - returns true on success.
+     */
+    virtual bool fill(std::uint32_t offset, std::uint32_t length,
+                      std::uint8_t value)
+    {
+        std::vector<std::uint8_t> run(
+            std::min<std::uint32_t>(length, fillRunSize), value);
+        while (length > 0)
+        {
+            std::uint32_t size = std::min<std::uint32_t>(length, run.size());
+            if (!writeSpan(offset, std::span(run).first(size)))
+            {
+                return false;
+            }
+            offset += size;
+            length -= size;
+        }
+        return true;
+    }
+
     /**
      * read data from a file.
      *
@@ -59,6 +115,56 @@ class ImageHandlerInterface
      * @return the size in bytes of the image staged.
      */
     virtual int getSize() = 0;
+
+    /**
+     * return a file descriptor for the staged image, which transports can
+     * write directly into with positioned writes.
+     *
+     * @return the file descriptor, or -1 if the image isn't backed by a file.
+     */
+    virtual int getFd()
+    {
+        return -1;
+    }
+
+    /**
+     * wait for writes still in progress to complete, and finish the image,
+     * e.g. make it durable.  It's called once the image is complete, the
+     * handler may not accept writes after it.
+     *
+     * @return bool - returns false if any of them failed.
+     */
+    virtual bool flush()
+    {
+        return true;
+    }
+
+    /**
+     * return the digest of the image as written so far, for handlers that
+     * compute one.
+     *
+     * @return the digest, or empty if there's none.
+     */
+    virtual std::vector<std::uint8_t> getDigest()
+    {
+        return {};
+    }
+
+    /**
+     * return the image staged by an earlier session, if it's still in place
+     * and its digest is known, so the host can skip sending it again.  It's
+     * kept by opening the handler for std::ios::in | std::ios::out.
+     *
+     * @return the staged image, or std::nullopt if there's none.
+     */
+    virtual std::optional<StagedImage> getStaged()
+    {
+        return std::nullopt;
+    }
+
+  protected:
+    /** The most bytes of a fill materialised at once by the default fill(). */
+    static constexpr std::uint32_t fillRunSize = 64 * 1024;
 };
 
 class HandlerPack
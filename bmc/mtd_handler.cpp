@@ -0,0 +1,290 @@
+/*
+ * Copyright 2026 Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "mtd_handler.hpp"
+
+#include <fcntl.h>
+#include <mtd/mtd-user.h>
+#include <sys/ioctl.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <optional>
+#include <span>
+#include <string>
+#include <vector>
+
+namespace ipmi_flash
+{
+
+MtdHandler::~MtdHandler()
+{
+    close();
+}
+
+bool MtdHandler::open(const std::string&, std::ios_base::openmode mode)
+{
+    if (fd >= 0)
+    {
+        return true;
+    }
+
+    /* Which blocks were erased isn't known, so writing can't be continued. */
+    if (mode & std::ios::app)
+    {
+        return false;
+    }
+
+    writable = (mode & std::ios::out) != 0;
+    fd = sys->open(device.c_str(), (writable ? O_RDWR : O_RDONLY) | O_CLOEXEC);
+    if (fd < 0)
+    {
+        std::fprintf(stderr, "Unable to open %s\n", device.c_str());
+        return false;
+    }
+
+    if (sys->ioctl(fd, MEMGETINFO, &info) < 0 || info.erasesize == 0 ||
+        info.writesize == 0)
+    {
+        std::fprintf(stderr, "Unable to get the MTD info of %s\n",
+                     device.c_str());
+        close();
+        return false;
+    }
+
+    erased = 0;
+    written = 0;
+    held.clear();
+    padding = 0;
+    if (writable)
+    {
+        imageSize.reset();
+    }
+    return true;
+}
+
+void MtdHandler::close()
+{
+    if (fd < 0)
+    {
+        return;
+    }
+
+    if (!flush())
+    {
+        std::fprintf(stderr, "Failed to write the end of the image\n");
+    }
+    if (writable)
+    {
+        imageSize = written + held.size() - padding;
+    }
+
+    sys->close(fd);
+    fd = -1;
+}
+
+bool MtdHandler::flush()
+{
+    if (fd < 0 || !writable || held.empty())
+    {
+        return true;
+    }
+
+    /* The last write unit is only partly the image. */
+    std::size_t size = held.size();
+    held.resize((size + info.writesize - 1) / info.writesize * info.writesize,
+                0xff);
+    padding += held.size() - size;
+
+    return writeOut();
+}
+
+bool MtdHandler::eraseThrough(std::uint64_t end)
+{
+    if (end <= erased)
+    {
+        return true;
+    }
+
+    /* Erasing a batch at once keeps the erases from stalling every write. */
+    std::uint64_t blocks = (end - erased + info.erasesize - 1) / info.erasesize;
+    blocks = std::max<std::uint64_t>(blocks, eraseAhead);
+    std::uint64_t until =
+        std::min<std::uint64_t>(erased + blocks * info.erasesize, info.size);
+
+    for (std::uint64_t block = erased; block < until; block += info.erasesize)
+    {
+        loff_t offset = block;
+        if (mtd_type_is_nand_user(&info) &&
+            sys->ioctl(fd, MEMGETBADBLOCK, &offset) > 0)
+        {
+            std::fprintf(stderr, "Bad block at 0x%llx in %s\n",
+                         static_cast<unsigned long long>(block),
+                         device.c_str());
+            return false;
+        }
+    }
+
+    struct erase_info_user erase;
+    erase.start = erased;
+    erase.length = until - erased;
+    if (sys->ioctl(fd, MEMERASE, &erase) < 0)
+    {
+        std::fprintf(stderr, "Failed to erase 0x%x bytes at 0x%x in %s\n",
+                     erase.length, erase.start, device.c_str());
+        return false;
+    }
+
+    erased = until;
+    return true;
+}
+
+bool MtdHandler::writeOut()
+{
+    std::size_t length = held.size() / info.writesize * info.writesize;
+    if (length == 0)
+    {
+        return true;
+    }
+
+    if (!eraseThrough(written + length))
+    {
+        return false;
+    }
+
+    std::size_t done = 0;
+    while (done < length)
+    {
+        int ret = sys->pwrite(fd, held.data() + done, length - done,
+                              written + done);
+        if (ret <= 0)
+        {
+            std::fprintf(stderr, "Failed to write at 0x%llx in %s\n",
+                         static_cast<unsigned long long>(written + done),
+                         device.c_str());
+            return false;
+        }
+        done += ret;
+    }
+
+    written += length;
+    held.erase(held.begin(), held.begin() + length);
+    return true;
+}
+
+bool MtdHandler::write(std::uint32_t offset,
+                       const std::vector<std::uint8_t>& data)
+{
+    return writeSpan(offset, data);
+}
+
+bool MtdHandler::writeSpan(std::uint32_t offset,
+                           std::span<const std::uint8_t> data)
+{
+    if (fd < 0 || !writable)
+    {
+        return false;
+    }
+
+    std::uint64_t end = std::uint64_t{offset} + data.size();
+    if (end > info.size)
+    {
+        std::fprintf(stderr, "Image doesn't fit in %s\n", device.c_str());
+        return false;
+    }
+
+    /* Bytes that are held back can still change, e.g. when a chunk is sent
+     * again, anything else has to follow them.
+     */
+    if (offset < written || offset > written + held.size())
+    {
+        std::fprintf(stderr, "Out of order write at 0x%x to %s\n", offset,
+                     device.c_str());
+        return false;
+    }
+
+    std::size_t start = offset - written;
+    if (held.size() < start + data.size())
+    {
+        held.resize(start + data.size());
+    }
+    std::copy(data.begin(), data.end(), held.begin() + start);
+
+    return writeOut();
+}
+
+std::optional<std::vector<std::uint8_t>> MtdHandler::read(std::uint32_t offset,
+                                                          std::uint32_t size)
+{
+    std::uint64_t total = getSize();
+    if (fd < 0 || offset > total)
+    {
+        return std::nullopt;
+    }
+
+    std::vector<std::uint8_t> ret(
+        std::min<std::uint64_t>(total - offset, size));
+
+    /* What's still held back isn't on the flash yet. */
+    std::uint64_t onFlash = writable ? written : total;
+    std::size_t fromFlash = std::min<std::uint64_t>(
+        ret.size(), onFlash > offset ? onFlash - offset : 0);
+    std::size_t done = 0;
+    while (done < fromFlash)
+    {
+        int bytes =
+            sys->pread(fd, ret.data() + done, fromFlash - done, offset + done);
+        if (bytes <= 0)
+        {
+            return std::nullopt;
+        }
+        done += bytes;
+    }
+    if (fromFlash < ret.size())
+    {
+        std::memcpy(ret.data() + fromFlash,
+                    held.data() + (offset + fromFlash - written),
+                    ret.size() - fromFlash);
+    }
+
+    return ret;
+}
+
+int MtdHandler::getSize()
+{
+    if (fd < 0)
+    {
+        return 0;
+    }
+
+    /* While it's written, the image is as large as what's been written, the
+     * rest of the partition isn't part of it.
+     */
+    if (writable)
+    {
+        return written + held.size() - padding;
+    }
+
+    /* The partition doesn't record how large the image on it is.  Read back,
+     * it's as large as the image last written through this handler, or the
+     * whole partition if there hasn't been one.
+     */
+    return imageSize.value_or(info.size);
+}
+
+} // namespace ipmi_flash
@@ -0,0 +1,82 @@
+#pragma once
+
+#include "image_handler.hpp"
+#include "internal/sys.hpp"
+
+#include <mtd/mtd-user.h>
+#include <sys/ioctl.h>
+
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <string>
+#include <vector>
+
+namespace ipmi_flash
+{
+
+/**
+ * Image handler that writes the image straight to an (inactive) MTD partition
+ * instead of staging it in RAM.  Flash can only be written once it's erased,
+ * in whole write units, so the image has to be written in order.  Erase blocks
+ * are erased a batch ahead of the writes, and writes are held back until
+ * they fill whole write units.  The last one is padded with 0xff once the image
+ * is complete, on flush() or close(), and nothing can be written after it.
+ */
+class MtdHandler : public ImageHandlerInterface
+{
+  public:
+    /**
+     * Create an MtdHandler.
+     *
+     * @param[in] device - the MTD character device, e.g. /dev/mtd5.
+     * @param[in] eraseAhead - erase blocks erased at once, ahead of the writes.
+     * @param[in] sys - syscall interface.
+     */
+    MtdHandler(const std::string& device, std::uint32_t eraseAhead,
+               const internal::Sys* sys = &internal::sys_impl) :
+        device(device), eraseAhead(eraseAhead), sys(sys)
+    {}
+    ~MtdHandler() override;
+
+    MtdHandler(const MtdHandler&) = delete;
+    MtdHandler& operator=(const MtdHandler&) = delete;
+
+    bool open(const std::string& path, std::ios_base::openmode mode) override;
+    void close() override;
+    bool write(std::uint32_t offset,
+               const std::vector<std::uint8_t>& data) override;
+    bool writeSpan(std::uint32_t offset,
+                   std::span<const std::uint8_t> data) override;
+    std::optional<std::vector<std::uint8_t>> read(std::uint32_t offset,
+                                                  std::uint32_t size) override;
+    int getSize() override;
+    bool flush() override;
+
+  private:
+    /** Makes sure the flash is erased up to end, returns false on failure. */
+    bool eraseThrough(std::uint64_t end);
+    /** Writes out the held back bytes that fill whole write units. */
+    bool writeOut();
+
+    std::string device;
+    std::uint32_t eraseAhead;
+    const internal::Sys* sys;
+
+    int fd = -1;
+    bool writable = false;
+    struct mtd_info_user info = {};
+
+    /** Bytes from the start of the partition that are erased. */
+    std::uint64_t erased = 0;
+    /** Bytes from the start of the partition that are written. */
+    std::uint64_t written = 0;
+    /** Bytes following those written, held back for a whole write unit. */
+    std::vector<std::uint8_t> held;
+    /** Bytes of 0xff written after the image, to fill its last write unit. */
+    std::uint64_t padding = 0;
+    /** Size of the image last written, what reads are bounded to. */
+    std::optional<std::uint64_t> imageSize;
+};
+
+} // namespace ipmi_flash
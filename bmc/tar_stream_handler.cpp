@@ -0,0 +1,489 @@
+/*
+ * Copyright 2026 Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "tar_stream_handler.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <optional>
+#include <span>
+#include <string>
+#include <system_error>
+#include <vector>
+
+namespace ipmi_flash
+{
+namespace
+{
+
+/* Offsets and lengths of the ustar header fields used. */
+constexpr std::size_t nameField = 0, nameLength = 100;
+constexpr std::size_t sizeField = 124, sizeLength = 12;
+constexpr std::size_t checksumField = 148, checksumLength = 8;
+constexpr std::size_t typeField = 156;
+constexpr std::size_t magicField = 257;
+constexpr std::size_t prefixField = 345, prefixLength = 155;
+
+/* A long name longer than this is more likely a corrupt tarball. */
+constexpr std::uint64_t maxLongName = 4096;
+
+std::string field(std::span<const std::uint8_t> header, std::size_t offset,
+                  std::size_t length)
+{
+    auto bytes = header.subspan(offset, length);
+    auto end = std::find(bytes.begin(), bytes.end(), 0);
+    return std::string(bytes.begin(), end);
+}
+
+/* Numbers are octal, padded with spaces or NULs.  The base-256 form tar uses
+ * for members of 8 GiB and over isn't supported.
+ */
+std::optional<std::uint64_t> octal(std::span<const std::uint8_t> header,
+                                   std::size_t offset, std::size_t length)
+{
+    auto bytes = header.subspan(offset, length);
+    std::uint64_t value = 0;
+    std::size_t i = 0;
+    while (i < bytes.size() && bytes[i] == ' ')
+    {
+        i++;
+    }
+    for (; i < bytes.size() && bytes[i] != 0 && bytes[i] != ' '; i++)
+    {
+        if (bytes[i] < '0' || bytes[i] > '7')
+        {
+            return std::nullopt;
+        }
+        value = value * 8 + (bytes[i] - '0');
+    }
+    return value;
+}
+
+} // namespace
+
+TarStreamHandler::~TarStreamHandler()
+{
+    close();
+}
+
+bool TarStreamHandler::open(const std::string&, std::ios_base::openmode mode)
+{
+    /* The tarball isn't kept, there's nothing to open for reading or to
+     * continue extracting.
+     */
+    if (!(mode & std::ios::out) || (mode & std::ios::app))
+    {
+        return false;
+    }
+
+    if (active)
+    {
+        return true;
+    }
+
+    std::error_code ec;
+    std::filesystem::create_directories(directory, ec);
+    if (ec)
+    {
+        std::fprintf(stderr, "Unable to create %s: %s\n", directory.c_str(),
+                     ec.message().c_str());
+        return false;
+    }
+
+    /* Like a file opened for writing, the directory is emptied, so nothing an
+     * earlier upload left there, finished or not, is installed with this one.
+     */
+    for (auto it = std::filesystem::directory_iterator(directory, ec);
+         !ec && it != std::filesystem::directory_iterator(); it.increment(ec))
+    {
+        std::filesystem::remove_all(it->path(), ec);
+    }
+    if (ec)
+    {
+        std::fprintf(stderr, "Unable to empty %s: %s\n", directory.c_str(),
+                     ec.message().c_str());
+        return false;
+    }
+
+    active = true;
+    failed = false;
+    consumed = 0;
+    size = 0;
+    ahead.clear();
+    state = State::header;
+    headerFill = 0;
+    zeroBlocks = 0;
+    remaining = 0;
+    padding = 0;
+    longName.reset();
+    extracted.clear();
+    return true;
+}
+
+void TarStreamHandler::close()
+{
+    if (!active)
+    {
+        return;
+    }
+
+    /* A member that didn't arrive in full isn't left behind to be installed.
+     */
+    if (member)
+    {
+        std::fprintf(stderr, "Tarball ended in the middle of %s\n",
+                     memberName.c_str());
+        member->close();
+        member.reset();
+        std::error_code ec;
+        std::filesystem::remove(memberPath, ec);
+    }
+    else if (state != State::end)
+    {
+        std::fprintf(stderr, "Tarball ended without its end-of-archive\n");
+    }
+
+    ahead.clear();
+    active = false;
+}
+
+bool TarStreamHandler::write(std::uint32_t offset,
+                             const std::vector<std::uint8_t>& data)
+{
+    return writeSpan(offset, data);
+}
+
+bool TarStreamHandler::writeSpan(std::uint32_t offset,
+                                 std::span<const std::uint8_t> data)
+{
+    if (!active || failed)
+    {
+        return false;
+    }
+
+    std::uint64_t end = std::uint64_t{offset} + data.size();
+    if (offset < consumed)
+    {
+        std::fprintf(stderr, "Write at 0x%x was already extracted\n", offset);
+        return false;
+    }
+    if (offset > consumed)
+    {
+        if (end - consumed > window)
+        {
+            std::fprintf(stderr, "Write at 0x%x is too far ahead of 0x%llx\n",
+                         offset, static_cast<unsigned long long>(consumed));
+            return false;
+        }
+        ahead[offset].assign(data.begin(), data.end());
+        size = std::max(size, end);
+        return true;
+    }
+
+    if (!feed(data))
+    {
+        failed = true;
+        return false;
+    }
+    size = std::max(size, end);
+
+    /* The gap may have been filled for writes held back. */
+    while (!ahead.empty() && ahead.begin()->first <= consumed)
+    {
+        auto next = ahead.extract(ahead.begin());
+        std::uint64_t skip = consumed - next.key();
+        if (skip < next.mapped().size() &&
+            !feed(std::span(next.mapped()).subspan(skip)))
+        {
+            failed = true;
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool TarStreamHandler::feed(std::span<const std::uint8_t> data)
+{
+    while (!data.empty())
+    {
+        std::size_t length = 0;
+        switch (state)
+        {
+            case State::header:
+                length = std::min(blockSize - headerFill, data.size());
+                std::copy_n(data.begin(), length, header.begin() + headerFill);
+                headerFill += length;
+                break;
+            case State::longName:
+                length = std::min<std::uint64_t>(remaining, data.size());
+                longName->append(data.begin(), data.begin() + length);
+                break;
+            case State::data:
+                length = std::min<std::uint64_t>(remaining, data.size());
+                if (!member->writeSpan(memberOffset, data.first(length)))
+                {
+                    std::fprintf(stderr, "Failed to write %s\n",
+                                 memberName.c_str());
+                    return false;
+                }
+                memberOffset += length;
+                break;
+            case State::skip:
+                length = std::min<std::uint64_t>(remaining, data.size());
+                break;
+            case State::end:
+                /* Tarballs are padded out to a whole record. */
+                length = data.size();
+                break;
+        }
+
+        data = data.subspan(length);
+        consumed += length;
+
+        if (state == State::header)
+        {
+            if (headerFill == blockSize)
+            {
+                headerFill = 0;
+                if (!startEntry())
+                {
+                    return false;
+                }
+            }
+            continue;
+        }
+        if (state == State::end)
+        {
+            continue;
+        }
+
+        remaining -= length;
+        if (remaining != 0)
+        {
+            continue;
+        }
+
+        if (state == State::longName)
+        {
+            /* The name is NUL terminated within its entry. */
+            longName->resize(longName->find('\0') == std::string::npos
+                                 ? longName->size()
+                                 : longName->find('\0'));
+            skip(padding);
+        }
+        else if (state == State::data)
+        {
+            finishMember();
+        }
+        else
+        {
+            state = State::header;
+        }
+    }
+
+    return true;
+}
+
+bool TarStreamHandler::startEntry()
+{
+    if (std::all_of(header.begin(), header.end(),
+                    [](std::uint8_t b) { return b == 0; }))
+    {
+        /* Two zero blocks end the archive. */
+        if (++zeroBlocks == 2)
+        {
+            state = State::end;
+        }
+        return true;
+    }
+    zeroBlocks = 0;
+
+    /* The checksum is computed as if its own field were spaces. */
+    std::uint64_t sum = 0;
+    for (std::size_t i = 0; i < header.size(); i++)
+    {
+        bool inField = i >= checksumField && i < checksumField + checksumLength;
+        sum += inField ? ' ' : header[i];
+    }
+    auto checksum = octal(header, checksumField, checksumLength);
+    auto entrySize = octal(header, sizeField, sizeLength);
+    if (!checksum || *checksum != sum || !entrySize)
+    {
+        std::fprintf(stderr, "Invalid tar header at 0x%llx\n",
+                     static_cast<unsigned long long>(consumed - blockSize));
+        return false;
+    }
+
+    std::string name;
+    if (longName)
+    {
+        name = std::move(*longName);
+        longName.reset();
+    }
+    else
+    {
+        name = field(header, nameField, nameLength);
+        std::string prefix = field(header, prefixField, prefixLength);
+        if (field(header, magicField, 5) == "ustar" && !prefix.empty())
+        {
+            name = prefix + "/" + name;
+        }
+    }
+
+    switch (header[typeField])
+    {
+        case '0':
+        case '\0':
+        case '7':
+            return startMember(name, *entrySize);
+        case '5':
+        {
+            auto path = destination(name);
+            std::error_code ec;
+            if (path)
+            {
+                std::filesystem::create_directories(*path, ec);
+            }
+            if (!path || ec)
+            {
+                std::fprintf(stderr, "Unable to extract directory %s\n",
+                             name.c_str());
+                return false;
+            }
+            skip(*entrySize + paddingFor(*entrySize));
+            return true;
+        }
+        case 'L':
+            if (*entrySize > maxLongName)
+            {
+                std::fprintf(stderr, "Invalid long name at 0x%llx\n",
+                             static_cast<unsigned long long>(consumed));
+                return false;
+            }
+            longName.emplace();
+            state = State::longName;
+            remaining = *entrySize;
+            padding = paddingFor(*entrySize);
+            if (remaining == 0)
+            {
+                skip(0);
+            }
+            return true;
+        case 'x':
+        case 'g':
+            /* pax attributes aren't needed to extract a firmware tarball. */
+            skip(*entrySize + paddingFor(*entrySize));
+            return true;
+        default:
+            std::fprintf(stderr, "Unsupported member type '%c' for %s\n",
+                         header[typeField], name.c_str());
+            return false;
+    }
+}
+
+bool TarStreamHandler::startMember(const std::string& name, std::uint64_t size)
+{
+    auto path = destination(name);
+    if (!path)
+    {
+        std::fprintf(stderr, "Refusing to extract %s\n", name.c_str());
+        return false;
+    }
+
+    std::error_code ec;
+    std::filesystem::create_directories(path->parent_path(), ec);
+
+    /* The size is known up front, so the file can be allocated at once. */
+    FileOptions memberOptions = options;
+    memberOptions.preallocate = size;
+    member = std::make_unique<FileHandler>(path->string(), memberOptions);
+    if (digest)
+    {
+        member = std::make_unique<DigestHandler>(std::move(member), *digest,
+                                                 path->string());
+    }
+    if (!member->open("", std::ios::out))
+    {
+        std::fprintf(stderr, "Unable to extract %s\n", name.c_str());
+        member.reset();
+        return false;
+    }
+
+    memberName = name;
+    memberPath = *path;
+    memberOffset = 0;
+    state = State::data;
+    remaining = size;
+    padding = paddingFor(size);
+    if (size == 0)
+    {
+        finishMember();
+    }
+    return true;
+}
+
+void TarStreamHandler::finishMember()
+{
+    member->close();
+    member.reset();
+    extracted.push_back(memberName);
+    skip(padding);
+}
+
+std::uint64_t TarStreamHandler::paddingFor(std::uint64_t size)
+{
+    return (blockSize - size % blockSize) % blockSize;
+}
+
+void TarStreamHandler::skip(std::uint64_t bytes)
+{
+    remaining = bytes;
+    state = remaining ? State::skip : State::header;
+}
+
+std::optional<std::filesystem::path>
+    TarStreamHandler::destination(const std::string& name) const
+{
+    auto relative = std::filesystem::path(name).lexically_normal();
+    if (relative.empty() || relative.is_absolute())
+    {
+        return std::nullopt;
+    }
+    for (const auto& part : relative)
+    {
+        if (part == "..")
+        {
+            return std::nullopt;
+        }
+    }
+    return directory / relative;
+}
+
+std::optional<std::vector<std::uint8_t>>
+    TarStreamHandler::read(std::uint32_t, std::uint32_t)
+{
+    return std::nullopt;
+}
+
+int TarStreamHandler::getSize()
+{
+    return active ? size : 0;
+}
+
+} // namespace ipmi_flash
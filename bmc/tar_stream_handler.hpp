@@ -0,0 +1,134 @@
+#pragma once
+
+#include "digest_handler.hpp"
+#include "file_handler.hpp"
+#include "image_handler.hpp"
+
+#include <array>
+#include <cstdint>
+#include <filesystem>
+#include <map>
+#include <memory>
+#include <optional>
+#include <span>
+#include <string>
+#include <vector>
+
+namespace ipmi_flash
+{
+
+/**
+ * Image handler that extracts a tarball as it's written, instead of staging
+ * the tarball and extracting it once the upload is done.  Each member is
+ * written to its file under the directory as its bytes arrive, and closed
+ * (with its digest written next to it, if configured) as soon as its last
+ * byte is in, so it can be verified while the rest is still being sent.
+ *
+ * Regular files and directories are extracted; links, devices and the like
+ * fail the upload, as do members that would land outside the directory.  The
+ * tarball itself isn't kept, so it can't be read back.  The directory is
+ * emptied when it's opened, the members of an earlier upload aren't kept.
+ */
+class TarStreamHandler : public ImageHandlerInterface
+{
+  public:
+    /**
+     * Create a TarStreamHandler.
+     *
+     * @param[in] directory - where the members are extracted to.
+     * @param[in] options - how the members' files are synced.
+     * @param[in] digest - the digest to compute for each member, if any.
+     * @param[in] window - how many bytes past the extracted ones may be
+     * written out of order and held until the gap is filled, 0 for none.
+     */
+    TarStreamHandler(const std::string& directory,
+                     const FileOptions& options = FileOptions(),
+                     std::optional<DigestHandler::Algorithm> digest =
+                         std::nullopt,
+                     std::size_t window = 0) :
+        directory(directory), options(options), digest(digest), window(window)
+    {}
+    ~TarStreamHandler() override;
+
+    TarStreamHandler(const TarStreamHandler&) = delete;
+    TarStreamHandler& operator=(const TarStreamHandler&) = delete;
+
+    bool open(const std::string& path, std::ios_base::openmode mode) override;
+    void close() override;
+    bool write(std::uint32_t offset,
+               const std::vector<std::uint8_t>& data) override;
+    bool writeSpan(std::uint32_t offset,
+                   std::span<const std::uint8_t> data) override;
+    std::optional<std::vector<std::uint8_t>> read(std::uint32_t offset,
+                                                  std::uint32_t size) override;
+    int getSize() override;
+
+    /** The members extracted so far, in the order they finished. */
+    const std::vector<std::string>& members() const
+    {
+        return extracted;
+    }
+
+  private:
+    static constexpr std::size_t blockSize = 512;
+
+    enum class State
+    {
+        header,
+        longName,
+        data,
+        skip,
+        end,
+    };
+
+    /** Parses the bytes that follow the ones extracted so far. */
+    bool feed(std::span<const std::uint8_t> data);
+    /** Acts on a complete header block. */
+    bool startEntry();
+    /** Opens the file for a regular member. */
+    bool startMember(const std::string& name, std::uint64_t size);
+    /** Closes the member that's been written out. */
+    void finishMember();
+    /** Bytes an entry is padded with, to a whole block. */
+    static std::uint64_t paddingFor(std::uint64_t size);
+    /** Skips the bytes before the next header. */
+    void skip(std::uint64_t bytes);
+    /** Where a member is extracted to, or std::nullopt if it can't be. */
+    std::optional<std::filesystem::path> destination(
+        const std::string& name) const;
+
+    std::filesystem::path directory;
+    FileOptions options;
+    std::optional<DigestHandler::Algorithm> digest;
+    std::size_t window;
+
+    bool active = false;
+    bool failed = false;
+
+    /** Bytes of the tarball parsed so far. */
+    std::uint64_t consumed = 0;
+    /** The end of the furthest write. */
+    std::uint64_t size = 0;
+    /** Writes past the parsed bytes, by offset, held until they're next. */
+    std::map<std::uint64_t, std::vector<std::uint8_t>> ahead;
+
+    State state = State::header;
+    std::array<std::uint8_t, blockSize> header = {};
+    std::size_t headerFill = 0;
+    int zeroBlocks = 0;
+    /** Bytes left of the member, long name or padding being parsed. */
+    std::uint64_t remaining = 0;
+    /** Padding after the long name or member data. */
+    std::uint64_t padding = 0;
+    /** Name from a GNU long name entry, for the next member. */
+    std::optional<std::string> longName;
+
+    std::unique_ptr<ImageHandlerInterface> member;
+    std::string memberName;
+    std::filesystem::path memberPath;
+    std::uint64_t memberOffset = 0;
+
+    std::vector<std::string> extracted;
+};
+
+} // namespace ipmi_flash
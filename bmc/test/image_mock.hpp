@@ -18,9 +18,14 @@ class ImageHandlerMock : public ImageHandlerInterface
     MOCK_METHOD(void, close, (), (override));
     MOCK_METHOD(bool, write, (std::uint32_t, const std::vector<std::uint8_t>&),
                 (override));
+    MOCK_METHOD(bool, fill, (std::uint32_t, std::uint32_t, std::uint8_t),
+                (override));
     MOCK_METHOD(std::optional<std::vector<std::uint8_t>>, read,
                 (std::uint32_t, std::uint32_t), (override));
     MOCK_METHOD(int, getSize, (), (override));
+    MOCK_METHOD(int, getFd, (), (override));
+    MOCK_METHOD(std::vector<std::uint8_t>, getDigest, (), (override));
+    MOCK_METHOD(std::optional<StagedImage>, getStaged, (), (override));
 };
 
 std::unique_ptr<ImageHandlerMock> CreateImageMock();
@@ -0,0 +1,214 @@
+/*
+ * Copyright 2026 Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "write_behind_handler.hpp"
+
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <string>
+#include <vector>
+
+namespace ipmi_flash
+{
+
+WriteBehindHandler::~WriteBehindHandler()
+{
+    close();
+}
+
+bool WriteBehindHandler::open(const std::string& path,
+                              std::ios_base::openmode mode)
+{
+    if (worker.joinable())
+    {
+        return handler->open(path, mode);
+    }
+
+    if (!handler->open(path, mode))
+    {
+        return false;
+    }
+
+    head = tail = 0;
+    stopping = failed = false;
+    worker = std::thread(&WriteBehindHandler::drain, this);
+
+    return true;
+}
+
+void WriteBehindHandler::close()
+{
+    if (!worker.joinable())
+    {
+        return;
+    }
+
+    if (!flush())
+    {
+        std::fprintf(stderr, "Queued writes to the image failed\n");
+    }
+
+    {
+        std::lock_guard<std::mutex> l(lock);
+        stopping = true;
+    }
+    cv.notify_all();
+    worker.join();
+
+    handler->close();
+}
+
+bool WriteBehindHandler::write(std::uint32_t offset,
+                               const std::vector<std::uint8_t>& data)
+{
+    return writeSpan(offset, data);
+}
+
+bool WriteBehindHandler::writeSpan(std::uint32_t offset,
+                                   std::span<const std::uint8_t> data)
+{
+    if (!worker.joinable())
+    {
+        return false;
+    }
+
+    Slot* slot;
+    {
+        std::unique_lock<std::mutex> l(lock);
+        cv.wait(l, [&] { return failed || tail - head < slots.size(); });
+        if (failed)
+        {
+            return false;
+        }
+        slot = &slots[tail % slots.size()];
+    }
+
+    /* The worker only touches the slots between head and tail, so this one is
+     * ours until it's queued.
+     */
+    slot->offset = offset;
+    slot->data.assign(data.begin(), data.end());
+
+    {
+        std::lock_guard<std::mutex> l(lock);
+        tail++;
+    }
+    cv.notify_all();
+
+    return true;
+}
+
+bool WriteBehindHandler::fill(std::uint32_t offset, std::uint32_t length,
+                              std::uint8_t value)
+{
+    if (!worker.joinable())
+    {
+        return false;
+    }
+
+    /* The handler may change the file around the region instead of writing
+     * it, so it has to be alone with it.
+     */
+    return wait() && handler->fill(offset, length, value);
+}
+
+bool WriteBehindHandler::flush()
+{
+    /* Then whatever the handler does once the image is complete. */
+    return wait() && handler->flush();
+}
+
+bool WriteBehindHandler::wait()
+{
+    std::unique_lock<std::mutex> l(lock);
+    cv.wait(l, [&] { return head == tail; });
+    return !failed;
+}
+
+std::optional<std::vector<std::uint8_t>> WriteBehindHandler::read(
+    std::uint32_t offset, std::uint32_t size)
+{
+    if (!wait())
+    {
+        return std::nullopt;
+    }
+    return handler->read(offset, size);
+}
+
+int WriteBehindHandler::getSize()
+{
+    wait();
+    return handler->getSize();
+}
+
+std::vector<std::uint8_t> WriteBehindHandler::getDigest()
+{
+    wait();
+    return handler->getDigest();
+}
+
+std::optional<StagedImage> WriteBehindHandler::getStaged()
+{
+    return handler->getStaged();
+}
+
+int WriteBehindHandler::getFd()
+{
+    /* Transports that write through the descriptor bypass the queue, so what's
+     * queued lands first.
+     */
+    if (!worker.joinable() || !wait())
+    {
+        return -1;
+    }
+    return handler->getFd();
+}
+
+void WriteBehindHandler::drain()
+{
+    std::unique_lock<std::mutex> l(lock);
+
+    while (true)
+    {
+        cv.wait(l, [&] { return stopping || head != tail; });
+        if (head == tail)
+        {
+            return;
+        }
+
+        Slot& slot = slots[head % slots.size()];
+        bool skip = failed;
+
+        /* Everything queued after a failure is dropped. */
+        l.unlock();
+        bool ok = skip || handler->writeSpan(slot.offset, slot.data);
+        l.lock();
+
+        if (!ok)
+        {
+            std::fprintf(stderr, "Failed to write %zu bytes at 0x%x\n",
+                         slot.data.size(), slot.offset);
+            failed = true;
+        }
+        head++;
+        cv.notify_all();
+    }
+}
+
+} // namespace ipmi_flash
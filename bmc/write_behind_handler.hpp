@@ -0,0 +1,97 @@
+#pragma once
+
+#include "image_handler.hpp"
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace ipmi_flash
+{
+
+/**
+ * Image handler that queues the writes for another image handler, and writes
+ * them out from a worker thread.  This lets the transport copy in the next
+ * chunk while the previous one is still being written to storage.
+ *
+ * Each write is copied into a slot, since what a transport lends is only good
+ * until its next chunk, so chunks aren't written without a copy here.  The
+ * stage pays off when storage is slower than that copy.
+ *
+ * A failed write is reported by the next write(), flush() or close().
+ */
+class WriteBehindHandler : public ImageHandlerInterface
+{
+  public:
+    /**
+     * Create a WriteBehindHandler.
+     *
+     * @param[in] handler - the handler the writes are queued for.
+     * @param[in] depth - how many writes may be queued before write() waits.
+     */
+    WriteBehindHandler(std::unique_ptr<ImageHandlerInterface> handler,
+                       std::size_t depth) :
+        handler(std::move(handler)), slots(std::max<std::size_t>(depth, 1))
+    {}
+    ~WriteBehindHandler() override;
+
+    WriteBehindHandler(const WriteBehindHandler&) = delete;
+    WriteBehindHandler& operator=(const WriteBehindHandler&) = delete;
+
+    bool open(const std::string& path, std::ios_base::openmode mode) override;
+    void close() override;
+    bool write(std::uint32_t offset,
+               const std::vector<std::uint8_t>& data) override;
+    bool writeSpan(std::uint32_t offset,
+                   std::span<const std::uint8_t> data) override;
+    bool fill(std::uint32_t offset, std::uint32_t length,
+              std::uint8_t value) override;
+    std::optional<std::vector<std::uint8_t>> read(std::uint32_t offset,
+                                                  std::uint32_t size) override;
+    int getSize() override;
+    int getFd() override;
+    bool flush() override;
+    std::vector<std::uint8_t> getDigest() override;
+    std::optional<StagedImage> getStaged() override;
+
+  private:
+    struct Slot
+    {
+        std::uint32_t offset = 0;
+        /* Kept between writes, so it only grows to the largest chunk. */
+        std::vector<std::uint8_t> data;
+    };
+
+    /** Writes out the queued slots until stopped. */
+    void drain();
+
+    /**
+     * Wait for the queued slots to be written, without ending the image the
+     * way the handler's flush() may.
+     *
+     * @return false if one of them failed.
+     */
+    bool wait();
+
+    std::unique_ptr<ImageHandlerInterface> handler;
+
+    /** Ring of queued writes, the producer fills slots[tail % size]. */
+    std::vector<Slot> slots;
+    std::size_t head = 0;
+    std::size_t tail = 0;
+    bool stopping = false;
+    bool failed = false;
+
+    std::mutex lock;
+    std::condition_variable cv;
+    std::thread worker;
+};
+
+} // namespace ipmi_flash
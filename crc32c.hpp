@@ -0,0 +1,162 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <span>
+
+#if defined(__x86_64__)
+#include <nmmintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_FEATURE_CRC32)
+#include <arm_acle.h>
+#endif
+
+namespace ipmi_flash
+{
+
+namespace internal
+{
+
+/* Tables for the reflected Castagnoli polynomial, eight bytes at a time.  The
+ * first is the usual table for a byte at a time.
+ */
+constexpr std::array<std::array<std::uint32_t, 256>, 8> crc32cTables = [] {
+    std::array<std::array<std::uint32_t, 256>, 8> tables = {};
+    for (std::uint32_t i = 0; i < 256; i++)
+    {
+        std::uint32_t crc = i;
+        for (int bit = 0; bit < 8; bit++)
+        {
+            crc = (crc >> 1) ^ ((crc & 1) ? 0x82f63b78 : 0);
+        }
+        tables[0][i] = crc;
+    }
+    for (std::uint32_t i = 0; i < 256; i++)
+    {
+        for (std::size_t t = 1; t < tables.size(); t++)
+        {
+            std::uint32_t prev = tables[t - 1][i];
+            tables[t][i] = (prev >> 8) ^ tables[0][prev & 0xff];
+        }
+    }
+    return tables;
+}();
+
+/* The kernels below take and return the CRC inverted. */
+
+inline std::uint32_t crc32cSoftware(std::uint32_t crc,
+                                    std::span<const std::uint8_t> data)
+{
+    const auto& t = crc32cTables;
+    const std::uint8_t* p = data.data();
+    std::size_t length = data.size();
+
+    for (; length >= 8; p += 8, length -= 8)
+    {
+        std::uint32_t low = crc ^ (p[0] | (p[1] << 8) | (p[2] << 16) |
+                                   (static_cast<std::uint32_t>(p[3]) << 24));
+        crc = t[7][low & 0xff] ^ t[6][(low >> 8) & 0xff] ^
+              t[5][(low >> 16) & 0xff] ^ t[4][low >> 24] ^ t[3][p[4]] ^
+              t[2][p[5]] ^ t[1][p[6]] ^ t[0][p[7]];
+    }
+    for (; length > 0; p++, length--)
+    {
+        crc = t[0][(crc ^ *p) & 0xff] ^ (crc >> 8);
+    }
+    return crc;
+}
+
+#if defined(__x86_64__)
+
+__attribute__((target("sse4.2"))) inline std::uint32_t crc32cHardware(
+    std::uint32_t crc, std::span<const std::uint8_t> data)
+{
+    const std::uint8_t* p = data.data();
+    std::size_t length = data.size();
+    std::uint64_t crc64 = crc;
+
+    for (; length >= 8; p += 8, length -= 8)
+    {
+        std::uint64_t word;
+        std::memcpy(&word, p, sizeof(word));
+        crc64 = _mm_crc32_u64(crc64, word);
+    }
+    crc = static_cast<std::uint32_t>(crc64);
+    for (; length > 0; p++, length--)
+    {
+        crc = _mm_crc32_u8(crc, *p);
+    }
+    return crc;
+}
+
+inline bool haveCrc32cHardware()
+{
+    static const bool have = __builtin_cpu_supports("sse4.2");
+    return have;
+}
+
+#elif defined(__aarch64__) && defined(__ARM_FEATURE_CRC32)
+
+inline std::uint32_t crc32cHardware(std::uint32_t crc,
+                                    std::span<const std::uint8_t> data)
+{
+    const std::uint8_t* p = data.data();
+    std::size_t length = data.size();
+
+    for (; length >= 8; p += 8, length -= 8)
+    {
+        std::uint64_t word;
+        std::memcpy(&word, p, sizeof(word));
+        crc = __crc32cd(crc, word);
+    }
+    for (; length > 0; p++, length--)
+    {
+        crc = __crc32cb(crc, *p);
+    }
+    return crc;
+}
+
+inline bool haveCrc32cHardware()
+{
+    return true;
+}
+
+#else
+
+inline std::uint32_t crc32cHardware(std::uint32_t crc,
+                                    std::span<const std::uint8_t> data)
+{
+    return crc32cSoftware(crc, data);
+}
+
+inline bool haveCrc32cHardware()
+{
+    return false;
+}
+
+#endif
+
+} // namespace internal
+
+/**
+ * Continue a CRC-32C over more bytes.  The host and the BMC use it to check
+ * they have the same bytes of an image, without sending them again, and that
+ * chunks weren't damaged on the way through a shared window.  The CPU's CRC
+ * instructions are used where there are any.
+ *
+ * @param[in] crc - the CRC of the bytes before these, 0 to start.
+ * @param[in] data - the bytes.
+ * @return the CRC of all the bytes so far.
+ */
+inline std::uint32_t crc32c(std::uint32_t crc,
+                            std::span<const std::uint8_t> data)
+{
+    if (internal::haveCrc32cHardware())
+    {
+        return ~internal::crc32cHardware(~crc, data);
+    }
+    return ~internal::crc32cSoftware(~crc, data);
+}
+
+} // namespace ipmi_flash
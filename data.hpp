@@ -10,10 +10,96 @@ struct ExtChunkHdr
     std::uint32_t length; /* Length of the data queued (little endian). */
 } __attribute__((packed));
 
+/** Extended chunk header, used when the host stages each chunk at an offset
+ * within the shared window instead of always at the start of it.
+ */
+struct ExtChunkWindowHdr
+{
+    std::uint32_t length;       /* Length of the data queued (little endian). */
+    std::uint32_t windowOffset; /* Offset of the data in the window (LE). */
+} __attribute__((packed));
+
+/** Extended chunk header with the CRC-32C of the data, so the BMC can reject
+ * a chunk damaged in the shared window and the host send it again.
+ * Only sent once the session's blob state has checkChunks set.
+ */
+struct ExtChunkCrcHdr
+{
+    std::uint32_t length;       /* Length of the data queued (little endian). */
+    std::uint32_t windowOffset; /* Offset of the data in the window (LE). */
+    std::uint32_t crc;          /* CRC-32C of the data (LE). */
+} __attribute__((packed));
+
+/** Sent in place of a chunk that's all one byte value, such as erased flash
+ * or zero padding, which is written by the BMC without the host staging it.
+ * Only sent once the session's blob state has fillChunks set.
+ */
+struct ExtChunkFillHdr
+{
+    std::uint32_t length; /* Length of the region (little endian). */
+    std::uint8_t value;   /* The byte the region is filled with. */
+} __attribute__((packed));
+
+/** Optional commit data on the verify blob id, asking the BMC to start the
+ * update itself once the verification succeeds.  The session's stat metadata
+ * then has a second byte, set once the update started, and the status covers
+ * both.
+ */
+struct VerifyCommitRequest
+{
+    std::uint8_t thenUpdate; /* Non-zero to chain the update. */
+} __attribute__((packed));
+
+/** P2A configuration request, optionally sent by the host via writeMeta. */
+struct PciConfigRequest
+{
+    std::uint32_t slots; /* Number of slots the host splits the window into. */
+} __attribute__((packed));
+
 /** P2A configuration response. */
 struct PciConfigResponse
 {
     std::uint32_t address;
 } __attribute__((packed));
 
+/** Net configuration request, optionally sent by the host via writeMeta to
+ * stripe the transfer across several connections.
+ */
+struct NetConfigRequest
+{
+    std::uint32_t streams; /* Number of connections the host wants to use. */
+} __attribute__((packed));
+
+/** Net configuration response, in the stat metadata once configured. */
+struct NetConfigResponse
+{
+    std::uint32_t streams; /* Number of connections the BMC will accept. */
+    std::uint32_t window;  /* Bytes the host may send ahead of the BMC. */
+} __attribute__((packed));
+
+/** Precedes each chunk on the connections of a striped net transfer. */
+struct NetChunkHdr
+{
+    std::uint32_t offset; /* Offset of the data in the image (LE). */
+    std::uint32_t length; /* Length of the data that follows (LE). */
+} __attribute__((packed));
+
+/** Leads the stat metadata of a firmware blob id, with the session options
+ * the BMC takes when it's opened.  Older BMCs send no metadata there.
+ */
+struct BlobOptionsHdr
+{
+    std::uint16_t options; /* FirmwareFlags::UpdateFlags options taken (LE). */
+} __attribute__((packed));
+
+/** Follows the BlobOptionsHdr when the BMC has some or all of an image from an
+ * earlier session.  The image's digest follows, if the handler computed one.
+ */
+struct StagedImageHdr
+{
+    std::uint32_t written;    /* Bytes written in order from the start (LE). */
+    std::uint32_t checkpoint; /* Where an upload can be resumed (LE). */
+    std::uint32_t crc;        /* CRC-32C of the bytes before it (LE). */
+} __attribute__((packed));
+
 } // namespace ipmi_flash
@@ -15,9 +15,35 @@ class FirmwareFlags
         ipmi = (1 << 8), /* Expect to send contents over IPMI BlockTransfer. */
         p2a = (1 << 9),  /* Expect to send contents over P2A bridge. */
         lpc = (1 << 10), /* Expect to send contents over LPC bridge. */
-        /* New bridges starting with net densely pack the rest of the bits */
+        /* New bridges densely pack the values of bits 8 to 11 left unused */
         net = (1 << 11), /* Expect to send contents over network bridge. */
-        /* nextBridge = (2 << 11) */
+        /* nextBridge = (3 << 8) */
+        /* Bits 12 to 15 are options for the session, not part of its state. */
+        /* Keep the image an earlier session staged instead of replacing it. */
+        reuseStaged = (1 << 12),
+        /* Continue the upload an earlier session left from its checkpoint. */
+        resume = (1 << 13),
+        /* The data is a zstd stream, decompressed before it's written. */
+        compressed = (1 << 14),
+        /* Part of a transaction: several firmware types are sent one after
+         * the other in one sequence, and verified and updated together.
+         */
+        transaction = (1 << 15),
+    };
+
+    /* Set in the blob state of a session, where the options were when it was
+     * opened, by a BMC that supports them in it.
+     */
+    enum SessionFlags : std::uint16_t
+    {
+        /* Takes an ExtChunkCrcHdr, and rejects the chunk if its CRC doesn't
+         * match.
+         */
+        checkChunks = (1 << 12),
+        /* Takes an ExtChunkFillHdr in place of a chunk that's all one byte
+         * value.
+         */
+        fillChunks = (1 << 13),
     };
 };
 
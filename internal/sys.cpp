@@ -62,6 +62,11 @@ int SysImpl::pwrite(int fd, const void* buf, std::size_t count,
     return static_cast<int>(::pwrite(fd, buf, count, offset));
 }
 
+off_t SysImpl::lseek(int fd, off_t offset, int whence) const
+{
+    return ::lseek(fd, offset, whence);
+}
+
 int SysImpl::close(int fd) const
 {
     return ::close(fd);
@@ -104,6 +109,17 @@ int SysImpl::connect(int sockfd, const struct sockaddr* addr,
     return ::connect(sockfd, addr, addrlen);
 }
 
+int SysImpl::shutdown(int sockfd, int how) const
+{
+    return ::shutdown(sockfd, how);
+}
+
+int SysImpl::setsockopt(int sockfd, int level, int optname,
+                        const void* optval, socklen_t optlen) const
+{
+    return ::setsockopt(sockfd, level, optname, optval, optlen);
+}
+
 ssize_t SysImpl::send(int sockfd, const void* buf, size_t len, int flags) const
 {
     return ::send(sockfd, buf, len, flags);
@@ -36,6 +36,7 @@ class Sys
                       off_t offset) const = 0;
     virtual int pwrite(int fd, const void* buf, std::size_t count,
                        off_t offset) const = 0;
+    virtual off_t lseek(int fd, off_t offset, int whence) const = 0;
     virtual int close(int fd) const = 0;
     virtual void* mmap(void* addr, std::size_t length, int prot, int flags,
                        int fd, off_t offset) const = 0;
@@ -46,6 +47,9 @@ class Sys
     virtual int socket(int domain, int type, int protocol) const = 0;
     virtual int connect(int sockfd, const struct sockaddr* addr,
                         socklen_t addrlen) const = 0;
+    virtual int shutdown(int sockfd, int how) const = 0;
+    virtual int setsockopt(int sockfd, int level, int optname,
+                           const void* optval, socklen_t optlen) const = 0;
     virtual ssize_t send(int sockfd, const void* buf, size_t len,
                          int flags) const = 0;
     virtual ssize_t sendfile(int out_fd, int in_fd, off_t* offset,
@@ -71,6 +75,7 @@ class SysImpl : public Sys
               off_t offset) const override;
     int pwrite(int fd, const void* buf, std::size_t count,
                off_t offset) const override;
+    off_t lseek(int fd, off_t offset, int whence) const override;
     int close(int fd) const override;
     void* mmap(void* addr, std::size_t length, int prot, int flags, int fd,
                off_t offset) const override;
@@ -81,6 +86,9 @@ class SysImpl : public Sys
     int socket(int domain, int type, int protocol) const override;
     int connect(int sockfd, const struct sockaddr* addr,
                 socklen_t addrlen) const override;
+    int shutdown(int sockfd, int how) const override;
+    int setsockopt(int sockfd, int level, int optname, const void* optval,
+                   socklen_t optlen) const override;
     ssize_t send(int sockfd, const void* buf, size_t len,
                  int flags) const override;
     ssize_t sendfile(int out_fd, int in_fd, off_t* offset,
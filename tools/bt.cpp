@@ -2,14 +2,16 @@
 
 #include <ipmiblob/blob_errors.hpp>
 
+#include <algorithm>
 #include <cstdint>
+#include <cstdio>
 #include <vector>
 
 namespace host_tool
 {
 
-bool BtDataHandler::sendContents(const std::string& input,
-                                 std::uint16_t session)
+bool BtDataHandler::sendContentsFrom(const std::string& input,
+                                     std::uint16_t session, std::uint32_t start)
 {
     int inputFd = sys->open(input.c_str(), 0);
     if (inputFd < 0)
@@ -17,27 +19,67 @@ bool BtDataHandler::sendContents(const std::string& input,
         return false;
     }
 
+    if (start > 0 && sys->lseek(inputFd, start, SEEK_SET) != start)
+    {
+        sys->close(inputFd);
+        return false;
+    }
+
     std::int64_t fileSize = sys->getSize(input.c_str());
-    progress->start(fileSize);
+    progress->start(fileSize - start);
 
     try
     {
-        static constexpr int btBufferLen = 50;
-        std::uint8_t readBuffer[btBufferLen];
+        /* Both buffers are allocated once, the chunk only ever shrinks
+         * within its capacity.
+         */
+        std::vector<std::uint8_t> readBuffer(payloadLengths.front());
+        std::vector<std::uint8_t> chunk;
+        chunk.reserve(payloadLengths.front());
         int bytesRead;
-        std::uint32_t offset = 0;
+        std::uint32_t offset = start;
 
         do
         {
-            bytesRead = sys->read(inputFd, readBuffer, sizeof(readBuffer));
-            if (bytesRead > 0)
+            bytesRead = sys->read(inputFd, readBuffer.data(), payloadLength);
+            std::size_t sent = 0;
+
+            while (bytesRead > 0 && sent < static_cast<std::size_t>(bytesRead))
             {
-                /* minorly awkward repackaging. */
-                std::vector<std::uint8_t> buffer(&readBuffer[0],
-                                                 &readBuffer[bytesRead]);
-                blob->writeBytes(session, offset, buffer);
-                offset += bytesRead;
-                progress->updateProgress(bytesRead);
+                std::size_t length =
+                    std::min(bytesRead - sent, payloadLength);
+                chunk.assign(readBuffer.begin() + sent,
+                             readBuffer.begin() + sent + length);
+
+                try
+                {
+                    blob->writeBytes(session, offset, chunk);
+                }
+                catch (const ipmiblob::BlobException& b)
+                {
+                    /* Until a write has gone through, assume the channel
+                     * rejected the size and retry the same bytes smaller.
+                     */
+                    auto smaller = std::find_if(
+                        payloadLengths.begin(), payloadLengths.end(),
+                        [length](std::size_t l) { return l < length; });
+                    if (payloadConfirmed || smaller == payloadLengths.end())
+                    {
+                        throw;
+                    }
+
+                    std::fprintf(stderr,
+                                 "Write of %zu bytes failed, retrying with "
+                                 "%zu\n",
+                                 length, *smaller);
+                    payloadLength = *smaller;
+                    continue;
+                }
+
+                payloadConfirmed = true;
+                offset += length;
+                sent += length;
+                progress->updateProgress(length);
             }
         } while (bytesRead > 0);
     }
@@ -6,6 +6,9 @@
 
 #include <ipmiblob/blob_interface.hpp>
 
+#include <array>
+#include <cstddef>
+
 namespace host_tool
 {
 
@@ -16,16 +19,30 @@ class BtDataHandler : public DataInterface
                   const internal::Sys* sys = &internal::sys_impl) :
         blob(blob), progress(progress), sys(sys) {};
 
-    bool sendContents(const std::string& input, std::uint16_t session) override;
+    bool sendContentsFrom(const std::string& input, std::uint16_t session,
+                          std::uint32_t start) override;
     ipmi_flash::FirmwareFlags::UpdateFlags supportedType() const override
     {
         return ipmi_flash::FirmwareFlags::UpdateFlags::ipmi;
     }
 
+    /** The payload sizes tried for each write, largest first.  The largest
+     * fills a 255 byte BT message after the blob write request's own header,
+     * the smallest is what every channel accepts.
+     */
+    static constexpr std::array<std::size_t, 4> payloadLengths = {240, 160,
+                                                                  100, 50};
+
   private:
     ipmiblob::BlobInterface* blob;
     ProgressInterface* progress;
     const internal::Sys* sys;
+
+    /* The payload size in use, it only shrinks until a write succeeds with
+     * it, and is kept for any later transfers.
+     */
+    std::size_t payloadLength = payloadLengths.front();
+    bool payloadConfirmed = false;
 };
 
 } // namespace host_tool
@@ -16,25 +16,264 @@
 
 #include "handler.hpp"
 
+#include "crc32c.hpp"
+#include "data.hpp"
 #include "flags.hpp"
 #include "helper.hpp"
 #include "status.hpp"
 #include "tool_errors.hpp"
 #include "util.hpp"
 
+#include <sys/mman.h>
+#include <unistd.h>
+#include <zstd.h>
+
+#include <openssl/evp.h>
+#include <openssl/sha.h>
+
 #include <ipmiblob/blob_errors.hpp>
 #include <stdplus/function_view.hpp>
 #include <stdplus/handle/managed.hpp>
 
 #include <algorithm>
+#include <cerrno>
 #include <cstdint>
+#include <cstdio>
 #include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <optional>
+#include <span>
 #include <string>
+#include <system_error>
+#include <thread>
 #include <vector>
 
 namespace host_tool
 {
 
+/* The stat metadata of a firmware blob starts with the options the BMC takes,
+ * and is empty from older BMCs, which take none.
+ */
+static std::uint16_t blobOptions(const ipmiblob::StatResponse& stat)
+{
+    ipmi_flash::BlobOptionsHdr header = {};
+    if (stat.metadata.size() >= sizeof(header))
+    {
+        std::memcpy(&header, stat.metadata.data(), sizeof(header));
+    }
+    return header.options;
+}
+
+/* What the BMC has of an earlier image follows the options. */
+static constexpr std::size_t stagedOffset = sizeof(ipmi_flash::BlobOptionsHdr);
+
+/* The BMC describes a staged image by its size and digest, which follows the
+ * StagedImageHdr.  The length of the digest says which algorithm it used.
+ */
+static bool stagedMatches(const ipmiblob::StatResponse& stat,
+                          const std::string& path)
+{
+    if (stat.metadata.size() <
+        stagedOffset + sizeof(ipmi_flash::StagedImageHdr))
+    {
+        return false;
+    }
+    std::vector<std::uint8_t> expected(
+        stat.metadata.begin() + stagedOffset +
+            sizeof(ipmi_flash::StagedImageHdr),
+        stat.metadata.end());
+
+    const EVP_MD* md = nullptr;
+    if (expected.size() == SHA256_DIGEST_LENGTH)
+    {
+        md = EVP_sha256();
+    }
+    else if (expected.size() == SHA512_DIGEST_LENGTH)
+    {
+        md = EVP_sha512();
+    }
+    else
+    {
+        return false;
+    }
+
+    std::error_code ec;
+    auto size = std::filesystem::file_size(path, ec);
+    if (ec || size != stat.size)
+    {
+        return false;
+    }
+
+    std::ifstream file(path, std::ios::binary);
+    std::unique_ptr<EVP_MD_CTX, decltype(&EVP_MD_CTX_free)> ctx(
+        EVP_MD_CTX_new(), EVP_MD_CTX_free);
+    if (!file || !ctx || EVP_DigestInit_ex(ctx.get(), md, nullptr) != 1)
+    {
+        return false;
+    }
+
+    std::vector<char> buffer(1024 * 1024);
+    while (file)
+    {
+        file.read(buffer.data(), buffer.size());
+        if (EVP_DigestUpdate(ctx.get(), buffer.data(), file.gcount()) != 1)
+        {
+            return false;
+        }
+    }
+    if (!file.eof())
+    {
+        return false;
+    }
+
+    std::vector<std::uint8_t> digest(EVP_MD_size(md));
+    unsigned int length = 0;
+    if (EVP_DigestFinal_ex(ctx.get(), digest.data(), &length) != 1)
+    {
+        return false;
+    }
+
+    return digest == expected;
+}
+
+/* The BMC describes what it has of an interrupted upload by how far it got,
+ * and the CRC of the bytes up to the last checkpoint it reached.
+ */
+static std::uint32_t resumableFrom(const ipmiblob::StatResponse& stat,
+                                   const std::string& path)
+{
+    ipmi_flash::StagedImageHdr header;
+    if (stat.metadata.size() < stagedOffset + sizeof(header))
+    {
+        return 0;
+    }
+    std::memcpy(&header, stat.metadata.data() + stagedOffset, sizeof(header));
+    if (header.checkpoint == 0 || header.checkpoint > header.written)
+    {
+        return 0;
+    }
+
+    /* Whatever the BMC has past the end of this file would be left in the
+     * image, so it has to be at least as large.
+     */
+    std::error_code ec;
+    auto size = std::filesystem::file_size(path, ec);
+    if (ec || size < stat.size || size < header.checkpoint)
+    {
+        return 0;
+    }
+
+    std::ifstream file(path, std::ios::binary);
+    std::vector<char> buffer(1024 * 1024);
+    std::uint32_t crc = 0;
+    for (std::uint32_t left = header.checkpoint; left > 0;)
+    {
+        auto length = std::min<std::uint32_t>(left, buffer.size());
+        if (!file.read(buffer.data(), length))
+        {
+            return 0;
+        }
+        crc = ipmi_flash::crc32c(
+            crc, std::span(reinterpret_cast<const std::uint8_t*>(buffer.data()),
+                           length));
+        left -= length;
+    }
+
+    return (crc == header.crc) ? header.checkpoint : 0;
+}
+
+static void closeFd(int&& fd)
+{
+    ::close(fd);
+}
+
+using Fd = stdplus::Managed<int>::Handle<closeFd>;
+
+/* The image is compressed into an anonymous file, which every transport can
+ * send like the image itself.  The BMC limits the window it decompresses
+ * with, the default level's is well under it.
+ */
+static Fd compressFile(const std::string& path)
+{
+    std::ifstream file(path, std::ios::binary);
+    if (!file)
+    {
+        throw ToolException("Unable to open " + path);
+    }
+
+    Fd output(::memfd_create("compressed-image", MFD_CLOEXEC));
+    if (*output < 0)
+    {
+        throw ToolException("Unable to create a file to compress into: " +
+                            std::string(std::strerror(errno)));
+    }
+
+    std::unique_ptr<ZSTD_CCtx, decltype(&ZSTD_freeCCtx)> ctx(ZSTD_createCCtx(),
+                                                             ZSTD_freeCCtx);
+    if (!ctx)
+    {
+        throw ToolException("Unable to allocate the compression context");
+    }
+    ZSTD_CCtx_setParameter(ctx.get(), ZSTD_c_compressionLevel,
+                           ZSTD_CLEVEL_DEFAULT);
+    /* A libzstd built without threads refuses this, and compresses on this
+     * thread instead.
+     */
+    ZSTD_CCtx_setParameter(
+        ctx.get(), ZSTD_c_nbWorkers,
+        static_cast<int>(std::thread::hardware_concurrency()));
+
+    std::uintmax_t inSize = 0, outSize = 0;
+    std::vector<char> inBuffer(ZSTD_CStreamInSize());
+    std::vector<char> outBuffer(ZSTD_CStreamOutSize());
+    ZSTD_EndDirective mode = ZSTD_e_continue;
+    while (mode != ZSTD_e_end)
+    {
+        file.read(inBuffer.data(), inBuffer.size());
+        if (file.bad())
+        {
+            throw ToolException("Unable to read " + path);
+        }
+        mode = file.eof() ? ZSTD_e_end : ZSTD_e_continue;
+        inSize += file.gcount();
+
+        ZSTD_inBuffer in = {inBuffer.data(),
+                            static_cast<std::size_t>(file.gcount()), 0};
+        bool done = false;
+        while (!done)
+        {
+            ZSTD_outBuffer out = {outBuffer.data(), outBuffer.size(), 0};
+            std::size_t left = ZSTD_compressStream2(ctx.get(), &out, &in, mode);
+            if (ZSTD_isError(left))
+            {
+                throw ToolException("Unable to compress " + path + ": " +
+                                    ZSTD_getErrorName(left));
+            }
+
+            for (std::size_t written = 0; written < out.pos;)
+            {
+                ssize_t n = ::write(*output, outBuffer.data() + written,
+                                    out.pos - written);
+                if (n < 0)
+                {
+                    throw ToolException("Unable to write the compressed " +
+                                        path + ": " + std::strerror(errno));
+                }
+                written += n;
+            }
+            outSize += out.pos;
+
+            done = (mode == ZSTD_e_end) ? (left == 0) : (in.pos == in.size);
+        }
+    }
+
+    std::fprintf(stderr, "Compressed %s from %ju to %ju bytes\n",
+                 path.c_str(), inSize, outSize);
+    return output;
+}
+
 static void closeBlob(uint16_t&& session, ipmiblob::BlobInterface*& blob)
 {
     blob->closeBlob(session);
@@ -71,6 +310,19 @@ bool UpdateHandler::checkAvailable(const std::string& goalFirmware)
     return true;
 }
 
+bool UpdateHandler::supportsTransactions(const std::string& goalFirmware)
+{
+    try
+    {
+        return blobOptions(blob->getStat(goalFirmware)) &
+               ipmi_flash::FirmwareFlags::UpdateFlags::transaction;
+    }
+    catch (const ipmiblob::BlobException&)
+    {
+        return false;
+    }
+}
+
 std::vector<uint8_t> UpdateHandler::retryIfFailed(
     stdplus::function_view<std::vector<uint8_t>()> callback)
 {
@@ -107,20 +359,86 @@ void UpdateHandler::retrySendFile(const std::string& target,
                                   const std::string& path)
 {
     auto supported = handler->supportedType();
-    auto session =
-        openBlob(blob, target,
-                 static_cast<std::uint16_t>(supported) |
-                     static_cast<std::uint16_t>(
-                         ipmi_flash::FirmwareFlags::UpdateFlags::openWrite));
+    std::uint16_t flags =
+        static_cast<std::uint16_t>(supported) |
+        static_cast<std::uint16_t>(
+            ipmi_flash::FirmwareFlags::UpdateFlags::openWrite);
+    if (transaction)
+    {
+        flags |= ipmi_flash::FirmwareFlags::UpdateFlags::transaction;
+    }
 
-    if (!handler->sendContents(path, *session))
+    /* The hash is small enough to always be sent whole. */
+    std::uint32_t start =
+        (target == ipmi_flash::hashBlobId) ? 0 : checkResumable(target, path);
+
+    std::optional<BlobHandle> session;
+    if (start > 0)
+    {
+        try
+        {
+            session.emplace(openBlob(
+                blob, target,
+                static_cast<std::uint16_t>(
+                    flags | ipmi_flash::FirmwareFlags::UpdateFlags::resume)));
+            std::fprintf(stderr, "Resuming %s from byte %u\n", path.c_str(),
+                         start);
+        }
+        catch (const ipmiblob::BlobException& b)
+        {
+            std::fprintf(stderr, "Unable to resume, sending all of %s: %s\n",
+                         path.c_str(), b.what());
+            start = 0;
+        }
+    }
+
+    /* A compressed image is sent whole, the BMC can't resume one. */
+    std::optional<Fd> compressed;
+    std::string input = path;
+    if (!session && compress && target != ipmi_flash::hashBlobId &&
+        checkDecompresses(target))
+    {
+        compressed.emplace(compressFile(path));
+        input = "/proc/self/fd/" + std::to_string(**compressed);
+        flags |= ipmi_flash::FirmwareFlags::UpdateFlags::compressed;
+    }
+
+    if (!session)
+    {
+        session.emplace(openBlob(blob, target, flags));
+    }
+
+    bool sent = (start > 0) ? handler->sendContentsFrom(path, **session, start)
+                            : handler->sendContents(input, **session);
+    if (!sent)
     {
         throw ToolException("Failed to send contents of " + path);
     }
 }
 
+void UpdateHandler::waitForSignature()
+{
+    for (int i = 0; i < signatureRetries; i++)
+    {
+        if (!(blob->getStat(ipmi_flash::hashBlobId).blob_state &
+              ipmiblob::StateFlags::committing))
+        {
+            return;
+        }
+        handler->waitForRetry();
+    }
+
+    throw ToolException("Timed out waiting for the BMC to verify the image "
+                        "before");
+}
+
 void UpdateHandler::sendFile(const std::string& target, const std::string& path)
 {
+    if (transaction && target == ipmi_flash::hashBlobId)
+    {
+        waitForSignature();
+    }
+
     retryIfFailed([this, target, path]() {
         this->retrySendFile(target, path);
         return std::vector<uint8_t>{};
@@ -151,6 +469,82 @@ void UpdateHandler::retryVerifyFile(const std::string& target,
     return;
 }
 
+bool UpdateHandler::checkStaged(const std::string& target,
+                                const std::string& path)
+{
+    try
+    {
+        return stagedMatches(blob->getStat(target), path);
+    }
+    catch (const ipmiblob::BlobException&)
+    {
+        /* Older BMCs don't describe a staged image at all. */
+        return false;
+    }
+}
+
+bool UpdateHandler::reuseStaged(const std::string& target,
+                                const std::string& path)
+{
+    try
+    {
+        /* Nothing is sent, so the transport doesn't need setting up. */
+        std::uint16_t flags =
+            ipmi_flash::FirmwareFlags::UpdateFlags::ipmi |
+            ipmi_flash::FirmwareFlags::UpdateFlags::openWrite |
+            ipmi_flash::FirmwareFlags::UpdateFlags::reuseStaged;
+        if (transaction)
+        {
+            flags |= ipmi_flash::FirmwareFlags::UpdateFlags::transaction;
+        }
+        {
+            auto session = openBlob(blob, target, flags);
+        }
+
+        /* The BMC hashes the image again as it's kept, so once the session
+         * is closed, this is the digest of what's actually there.
+         */
+        return stagedMatches(blob->getStat(target), path);
+    }
+    catch (const ipmiblob::BlobException& b)
+    {
+        std::fprintf(stderr, "Unable to reuse the staged image: %s\n",
+                     b.what());
+        return false;
+    }
+}
+
+bool UpdateHandler::checkDecompresses(const std::string& target)
+{
+    try
+    {
+        if (blobOptions(blob->getStat(target)) &
+            ipmi_flash::FirmwareFlags::UpdateFlags::compressed)
+        {
+            return true;
+        }
+    }
+    catch (const ipmiblob::BlobException&)
+    {}
+
+    std::fprintf(stderr, "The BMC can't decompress %s, sending it as is\n",
+                 target.c_str());
+    return false;
+}
+
+std::uint32_t UpdateHandler::checkResumable(const std::string& target,
+                                           const std::string& path)
+{
+    try
+    {
+        return resumableFrom(blob->getStat(target), path);
+    }
+    catch (const ipmiblob::BlobException&)
+    {
+        return 0;
+    }
+}
+
 bool UpdateHandler::verifyFile(const std::string& target, bool ignoreStatus)
 {
     retryIfFailed([this, target, ignoreStatus]() {
@@ -161,6 +555,34 @@ bool UpdateHandler::verifyFile(const std::string& target, bool ignoreStatus)
     return true;
 }
 
+bool UpdateHandler::verifyThenUpdate(bool ignoreUpdate)
+{
+    /* It's not retried, once it's committed the update may have started. */
+    try
+    {
+        auto session =
+            openBlob(blob, ipmi_flash::verifyBlobId,
+                     static_cast<std::uint16_t>(
+                         ipmi_flash::FirmwareFlags::UpdateFlags::openWrite));
+
+        std::fprintf(stderr, "Committing to %s to trigger service and update\n",
+                     ipmi_flash::verifyBlobId);
+        ipmi_flash::VerifyCommitRequest request = {1};
+        auto* bytes = reinterpret_cast<const std::uint8_t*>(&request);
+        blob->commit(*session, std::vector<std::uint8_t>(
+                                   bytes, bytes + sizeof(request)));
+
+        std::fprintf(stderr, "Calling stat on %s session to check status\n",
+                     ipmi_flash::verifyBlobId);
+        return pollChainedStatus(*session, blob, ignoreUpdate);
+    }
+    catch (const ipmiblob::BlobException& b)
+    {
+        throw ToolException(
+            "blob exception received: " + std::string(b.what()));
+    }
+}
+
 std::vector<uint8_t> UpdateHandler::retryReadVersion(
     const std::string& versionBlob)
 {
@@ -5,6 +5,7 @@
 #include <ipmiblob/blob_interface.hpp>
 #include <stdplus/function_view.hpp>
 
+#include <cstdint>
 #include <string>
 
 namespace host_tool
@@ -24,6 +25,15 @@ class UpdateHandlerInterface
      */
     virtual bool checkAvailable(const std::string& goalFirmware) = 0;
 
+    /**
+     * Check whether the BMC takes the goal firmware as part of a transaction,
+     * with other firmware types in the same update.
+     *
+     * @param[in] goalFirmware - the firmware to check /flash/image
+     * /flash/bios, etc.
+     */
+    virtual bool supportsTransactions(const std::string& goalFirmware) = 0;
+
     /**
      * Send the file contents at path to the blob id, target.
      *
@@ -33,6 +43,40 @@ class UpdateHandlerInterface
     virtual void sendFile(const std::string& target,
                           const std::string& path) = 0;
 
+    /**
+     * Check whether the BMC still has the file at path staged for the blob id,
+     * from an earlier attempt.
+     *
+     * @param[in] target - the blob id
+     * @param[in] path - the source file path
+     * @return true if the staged image has the file's size and digest.
+     */
+    virtual bool checkStaged(const std::string& target,
+                             const std::string& path) = 0;
+
+    /**
+     * Keep the image staged for the blob id instead of sending it again.
+     *
+     * @param[in] target - the blob id
+     * @param[in] path - the source file path
+     * @return true if the staged image is in place, false if the file has to
+     * be sent.
+     */
+    virtual bool reuseStaged(const std::string& target,
+                             const std::string& path) = 0;
+
+    /**
+     * Check how much of the file at path the BMC has for the blob id, from an
+     * upload that was interrupted.
+     *
+     * @param[in] target - the blob id
+     * @param[in] path - the source file path
+     * @return the offset sending the file can resume from, 0 if it has to
+     * start over.
+     */
+    virtual std::uint32_t checkResumable(const std::string& target,
+                                         const std::string& path) = 0;
+
     /**
      * Trigger verification.
      *
@@ -44,6 +88,17 @@ class UpdateHandlerInterface
      */
     virtual bool verifyFile(const std::string& target, bool ignoreStatus) = 0;
 
+    /**
+     * Trigger verification, asking the BMC to start the update itself once
+     * the image is verified.
+     *
+     * @param[in] ignoreUpdate - determines whether to ignore the update
+     * status.
+     * @return true if the BMC updated too, false if it only verified, and the
+     * update still has to be triggered.
+     */
+    virtual bool verifyThenUpdate(bool ignoreUpdate) = 0;
+
     /**
      * Read the active firmware version.
      *
@@ -63,24 +118,47 @@ class UpdateHandlerInterface
 class UpdateHandler : public UpdateHandlerInterface
 {
   public:
-    UpdateHandler(ipmiblob::BlobInterface* blob, DataInterface* handler) :
-        blob(blob), handler(handler)
+    /**
+     * @param[in] compress - send images compressed, if the BMC can decompress
+     * them
+     * @param[in] transaction - send each image as part of one transaction
+     */
+    UpdateHandler(ipmiblob::BlobInterface* blob, DataInterface* handler,
+                  bool compress = false, bool transaction = false) :
+        blob(blob), handler(handler), compress(compress),
+        transaction(transaction)
     {}
 
     ~UpdateHandler() = default;
 
     bool checkAvailable(const std::string& goalFirmware) override;
 
+    bool supportsTransactions(const std::string& goalFirmware) override;
+
     /**
      * @throw ToolException on failure.
      */
     void sendFile(const std::string& target, const std::string& path) override;
 
+    bool checkStaged(const std::string& target,
+                     const std::string& path) override;
+
+    bool reuseStaged(const std::string& target,
+                     const std::string& path) override;
+
+    std::uint32_t checkResumable(const std::string& target,
+                                 const std::string& path) override;
+
     /**
      * @throw ToolException on failure (TODO: throw on timeout.)
      */
     bool verifyFile(const std::string& target, bool ignoreStatus) override;
 
+    /**
+     * @throw ToolException on failure.
+     */
+    bool verifyThenUpdate(bool ignoreUpdate) override;
+
     std::vector<uint8_t> readVersion(const std::string& versionBlob) override;
 
     void cleanArtifacts() override;
@@ -88,6 +166,26 @@ class UpdateHandler : public UpdateHandlerInterface
   private:
     ipmiblob::BlobInterface* blob;
     DataInterface* handler;
+    bool compress;
+    bool transaction;
+
+    /** How many times the signature is checked before giving up on the BMC
+     * verifying the image before.
+     */
+    static constexpr int signatureRetries = 600;
+
+    /**
+     * In a transaction, wait for the BMC to be done with the signature sent
+     * for the image before.
+     *
+     * @throw ToolException on timeout.
+     */
+    void waitForSignature();
+
+    /**
+     * Check whether the BMC decompresses images sent to the blob id.
+     */
+    bool checkDecompresses(const std::string& target);
 
     /**
      * @throw ToolException on failure.
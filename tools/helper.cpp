@@ -113,6 +113,46 @@ void pollStatus(std::uint16_t session, ipmiblob::BlobInterface* blob)
              });
 }
 
+/* Poll an open verification session whose commit chained the update.  A BMC
+ * that chains it adds a byte to the status, set once the update started, and
+ * the status covers both.  An older BMC only verifies.
+ */
+bool pollChainedStatus(std::uint16_t session, ipmiblob::BlobInterface* blob,
+                       bool ignoreUpdate)
+{
+    return pollStat(
+        session, blob,
+        [ignoreUpdate](
+            const ipmiblob::StatResponse& resp) -> std::optional<bool> {
+            if (resp.metadata.size() != 1 && resp.metadata.size() != 2)
+            {
+                throw ToolException("Invalid stat metadata");
+            }
+            bool chained = resp.metadata.size() == 2;
+            bool updating = chained && resp.metadata[1] != 0;
+            auto result =
+                static_cast<ipmi_flash::ActionStatus>(resp.metadata[0]);
+            switch (result)
+            {
+                case ipmi_flash::ActionStatus::failed:
+                    throw ToolException(updating
+                                            ? "BMC reported update failure"
+                                            : "BMC reported failure");
+                case ipmi_flash::ActionStatus::unknown:
+                case ipmi_flash::ActionStatus::running:
+                    if (updating && ignoreUpdate)
+                    {
+                        return true;
+                    }
+                    return std::nullopt;
+                case ipmi_flash::ActionStatus::success:
+                    return chained;
+                default:
+                    throw ToolException("Unrecognized action status");
+            }
+        });
+}
+
 /* Poll an open blob session for reading.
  *
  * The committing bit indicates that the blob is not available for reading now
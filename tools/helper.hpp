@@ -16,6 +16,17 @@ namespace host_tool
  */
 void pollStatus(std::uint16_t session, ipmiblob::BlobInterface* blob);
 
+/**
+ * Poll an open verification session whose commit chained the update.
+ *
+ * @param[in] session - the open verification session
+ * @param[in] blob - pointer to blob interface implementation object.
+ * @param[in] ignoreUpdate - return once the update started
+ * @return true if the BMC updated too, false if it only verified.
+ */
+bool pollChainedStatus(std::uint16_t session, ipmiblob::BlobInterface* blob,
+                       bool ignoreUpdate);
+
 /**
  * Poll an open firmware version blob session and check if it ready to read.
  *
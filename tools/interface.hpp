@@ -5,6 +5,9 @@
 
 #include <chrono>
 #include <cstdint>
+#include <cstring>
+#include <optional>
+#include <span>
 #include <string>
 #include <thread>
 
@@ -14,6 +17,9 @@ namespace host_tool
 class DataInterface
 {
   public:
+    /** How many times a chunk the BMC found damaged is staged again. */
+    static constexpr int chunkRetries = 3;
+
     virtual ~DataInterface() = default;
 
     /**
@@ -25,8 +31,45 @@ class DataInterface
      * @param[in] session - the session ID to use.
      * @return bool on success.
      */
-    virtual bool sendContents(const std::string& input,
-                              std::uint16_t session) = 0;
+    virtual bool sendContents(const std::string& input, std::uint16_t session)
+    {
+        return sendContentsFrom(input, session, 0);
+    }
+
+    /**
+     * Like sendContents(), but skipping the start of the file, which the BMC
+     * already has from an interrupted upload.
+     *
+     * @param[in] input - path to file to send.
+     * @param[in] session - the session ID to use.
+     * @param[in] start - the offset in the file to send from.
+     * @return bool on success.
+     */
+    virtual bool sendContentsFrom(const std::string& input,
+                                  std::uint16_t session,
+                                  std::uint32_t start) = 0;
+
+    /**
+     * Check whether a chunk is all one byte value, such as erased flash or
+     * zero padding, which the BMC can fill in without it being staged.
+     *
+     * @param[in] data - the chunk.
+     * @return the byte, or std::nullopt if the chunk has more than one.
+     */
+    static std::optional<std::uint8_t> uniformByte(
+        std::span<const std::uint8_t> data)
+    {
+        /* Every byte matches the one after it.  memcmp() is vectorized and
+         * stops at the first difference, so next to staging the chunk this
+         * costs next to nothing.
+         */
+        if (data.empty() ||
+            std::memcmp(data.data(), data.data() + 1, data.size() - 1) != 0)
+        {
+            return std::nullopt;
+        }
+        return data[0];
+    }
 
     virtual void waitForRetry()
     {
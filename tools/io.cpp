@@ -5,19 +5,53 @@
 #include <fcntl.h>
 
 #include <cstdint>
+#include <cstdio>
 #include <cstring>
 #include <string>
+#include <utility>
 
 namespace host_tool
 {
 
 const std::string DevMemDevice::devMemPath = "/dev/mem";
 
+DevMemDevice::DevMemDevice(DevMemDevice&& other) noexcept :
+    devMemFd(std::exchange(other.devMemFd, -1)),
+    devMemMapped(std::exchange(other.devMemMapped, nullptr)),
+    mappedOffset(other.mappedOffset), mappedLength(other.mappedLength),
+    mappedDiff(other.mappedDiff), sys(other.sys)
+{}
+
+DevMemDevice::~DevMemDevice()
+{
+    finish();
+}
+
+std::uint8_t* DevMemDevice::mapped(const std::size_t offset,
+                                   const std::size_t length)
+{
+    if (!devMemMapped || offset < mappedOffset ||
+        offset - mappedOffset > mappedLength ||
+        length > mappedLength - (offset - mappedOffset))
+    {
+        return nullptr;
+    }
+
+    return static_cast<std::uint8_t*>(devMemMapped) + mappedDiff +
+           (offset - mappedOffset);
+}
+
 bool DevMemDevice::read(const std::size_t offset, const std::size_t length,
                         void* const destination)
 {
-    devMemFd = sys->open(devMemPath.c_str(), O_RDONLY);
-    if (devMemFd < 0)
+    if (std::uint8_t* source = mapped(offset, length))
+    {
+        std::memcpy(destination, source, length);
+        return true;
+    }
+
+    int fd = sys->open(devMemPath.c_str(), O_RDONLY);
+    if (fd < 0)
     {
         return false;
     }
@@ -28,25 +62,24 @@ bool DevMemDevice::read(const std::size_t offset, const std::size_t length,
     const std::size_t alignedSize = length + alignedDiff;
 
     // addr, length, prot, flags, fd, offset
-    devMemMapped = sys->mmap(nullptr, alignedSize, PROT_READ, MAP_SHARED,
-                             devMemFd, alignedOffset);
-    if (devMemMapped == MAP_FAILED)
+    void* map = sys->mmap(nullptr, alignedSize, PROT_READ, MAP_SHARED, fd,
+                          alignedOffset);
+    if (map == MAP_FAILED)
     {
         std::fprintf(stderr, "Failed to mmap at offset: 0x%zx, length: %zu\n",
                      offset, length);
-        sys->close(devMemFd);
+        sys->close(fd);
         return false;
     }
 
-    void* alignedSource =
-        static_cast<std::uint8_t*>(devMemMapped) + alignedDiff;
+    void* alignedSource = static_cast<std::uint8_t*>(map) + alignedDiff;
 
     /* Copy the bytes. */
     std::memcpy(destination, alignedSource, length);
 
-    /* Close the map between reads for now. */
-    sys->munmap(devMemMapped, length);
-    sys->close(devMemFd);
+    /* Close the map between reads outside of a session. */
+    sys->munmap(map, alignedSize);
+    sys->close(fd);
 
     return true;
 }
@@ -54,8 +87,14 @@ bool DevMemDevice::read(const std::size_t offset, const std::size_t length,
 bool DevMemDevice::write(const std::size_t offset, const std::size_t length,
                          const void* const source)
 {
-    devMemFd = sys->open(devMemPath.c_str(), O_RDWR);
-    if (devMemFd < 0)
+    if (std::uint8_t* destination = mapped(offset, length))
+    {
+        std::memcpy(destination, source, length);
+        return true;
+    }
+
+    int fd = sys->open(devMemPath.c_str(), O_RDWR);
+    if (fd < 0)
     {
         std::fprintf(stderr, "Failed to open /dev/mem for writing\n");
         return false;
@@ -67,38 +106,93 @@ bool DevMemDevice::write(const std::size_t offset, const std::size_t length,
     const std::size_t alignedSize = length + alignedDiff;
 
     // addr, length, prot, flags, fd, offset
-    devMemMapped = sys->mmap(nullptr, alignedSize, PROT_WRITE, MAP_SHARED,
-                             devMemFd, alignedOffset);
+    void* map = sys->mmap(nullptr, alignedSize, PROT_WRITE, MAP_SHARED, fd,
+                          alignedOffset);
 
-    if (devMemMapped == MAP_FAILED)
+    if (map == MAP_FAILED)
     {
         std::fprintf(stderr, "Failed to mmap at offset: 0x%zx, length: %zu\n",
                      offset, length);
-        sys->close(devMemFd);
+        sys->close(fd);
         return false;
     }
 
-    void* alignedDestination =
-        static_cast<std::uint8_t*>(devMemMapped) + alignedDiff;
+    void* alignedDestination = static_cast<std::uint8_t*>(map) + alignedDiff;
 
     /* Copy the bytes. */
     std::memcpy(alignedDestination, source, length);
 
-    /* Close the map between writes for now. */
-    sys->munmap(devMemMapped, length);
-    sys->close(devMemFd);
+    /* Close the map between writes outside of a session. */
+    sys->munmap(map, alignedSize);
+    sys->close(fd);
+
+    return true;
+}
+
+bool DevMemDevice::start(const std::size_t offset, const std::size_t length)
+{
+    finish();
+
+    devMemFd = sys->open(devMemPath.c_str(), O_RDWR);
+    if (devMemFd < 0)
+    {
+        std::fprintf(stderr, "Failed to open /dev/mem for the session\n");
+        return false;
+    }
+
+    /* Map based on aligned addresses - behind the scenes. */
+    const std::size_t alignedDiff = offset % sys->getpagesize();
+    const std::size_t alignedOffset = offset - alignedDiff;
+    const std::size_t alignedSize = length + alignedDiff;
+
+    devMemMapped = sys->mmap(nullptr, alignedSize, PROT_READ | PROT_WRITE,
+                             MAP_SHARED, devMemFd, alignedOffset);
+    if (devMemMapped == MAP_FAILED)
+    {
+        std::fprintf(stderr, "Failed to mmap at offset: 0x%zx, length: %zu\n",
+                     offset, length);
+        devMemMapped = nullptr;
+        sys->close(devMemFd);
+        devMemFd = -1;
+        return false;
+    }
+
+    mappedOffset = offset;
+    mappedLength = length;
+    mappedDiff = alignedDiff;
 
     return true;
 }
 
+void DevMemDevice::finish()
+{
+    if (devMemMapped)
+    {
+        sys->munmap(devMemMapped, mappedLength + mappedDiff);
+        devMemMapped = nullptr;
+    }
+
+    if (devMemFd >= 0)
+    {
+        sys->close(devMemFd);
+        devMemFd = -1;
+    }
+}
+
 PpcMemDevice::~PpcMemDevice()
 {
     // Attempt to close in case reads or writes didn't close themselves
-    close();
+    finish();
 }
 
 void PpcMemDevice::close()
 {
+    /* The path stays open for the whole session. */
+    if (session)
+    {
+        return;
+    }
+
     if (ppcMemFd >= 0)
     {
         sys->close(ppcMemFd);
@@ -106,9 +200,11 @@ void PpcMemDevice::close()
     }
 }
 
-bool PpcMemDevice::read(const std::size_t offset, const std::size_t length,
-                        void* const destination)
+bool PpcMemDevice::start(const std::size_t, const std::size_t)
 {
+    finish();
+
+    /* Accesses go through pread/pwrite, so only the path is kept open. */
     ppcMemFd = sys->open(ppcMemPath.c_str(), O_RDWR);
     if (ppcMemFd < 0)
     {
@@ -117,6 +213,30 @@ bool PpcMemDevice::read(const std::size_t offset, const std::size_t length,
         return false;
     }
 
+    session = true;
+    return true;
+}
+
+void PpcMemDevice::finish()
+{
+    session = false;
+    close();
+}
+
+bool PpcMemDevice::read(const std::size_t offset, const std::size_t length,
+                        void* const destination)
+{
+    if (!session)
+    {
+        ppcMemFd = sys->open(ppcMemPath.c_str(), O_RDWR);
+        if (ppcMemFd < 0)
+        {
+            std::fprintf(stderr, "Failed to open PPC LPC access path: %s",
+                         ppcMemPath.c_str());
+            return false;
+        }
+    }
+
     int ret = sys->pread(ppcMemFd, destination, length, offset);
     if (ret < 0)
     {
@@ -133,12 +253,15 @@ bool PpcMemDevice::read(const std::size_t offset, const std::size_t length,
 bool PpcMemDevice::write(const std::size_t offset, const std::size_t length,
                          const void* const source)
 {
-    ppcMemFd = sys->open(ppcMemPath.c_str(), O_RDWR);
-    if (ppcMemFd < 0)
+    if (!session)
     {
-        std::fprintf(stderr, "Failed to open PPC LPC access path: %s",
-                     ppcMemPath.c_str());
-        return false;
+        ppcMemFd = sys->open(ppcMemPath.c_str(), O_RDWR);
+        if (ppcMemFd < 0)
+        {
+            std::fprintf(stderr, "Failed to open PPC LPC access path: %s",
+                         ppcMemPath.c_str());
+            return false;
+        }
     }
 
     ssize_t ret = sys->pwrite(ppcMemFd, source, length, offset);
@@ -16,12 +16,12 @@ class DevMemDevice : public HostIoInterface
         sys(sys)
     {}
 
-    ~DevMemDevice() = default;
+    ~DevMemDevice() override;
 
     /* Don't allow copying, assignment or move assignment, only moving. */
     DevMemDevice(const DevMemDevice&) = delete;
     DevMemDevice& operator=(const DevMemDevice&) = delete;
-    DevMemDevice(DevMemDevice&&) = default;
+    DevMemDevice(DevMemDevice&& other) noexcept;
     DevMemDevice& operator=(DevMemDevice&&) = delete;
 
     bool read(const std::size_t offset, const std::size_t length,
@@ -30,10 +30,20 @@ class DevMemDevice : public HostIoInterface
     bool write(const std::size_t offset, const std::size_t length,
                const void* const source) override;
 
+    bool start(const std::size_t offset, const std::size_t length) override;
+    void finish() override;
+
   private:
+    /** Returns where the region is in the session mapping, or nullptr. */
+    std::uint8_t* mapped(const std::size_t offset, const std::size_t length);
+
     static const std::string devMemPath;
+    /* The mapping held between start() and finish(). */
     int devMemFd = -1;
     void* devMemMapped = nullptr;
+    std::size_t mappedOffset = 0;
+    std::size_t mappedLength = 0;
+    std::size_t mappedDiff = 0;
     const internal::Sys* sys;
 };
 
@@ -59,9 +69,15 @@ class PpcMemDevice : public HostIoInterface
     bool write(const std::size_t offset, const std::size_t length,
                const void* const source) override;
 
+    bool start(const std::size_t offset, const std::size_t length) override;
+    void finish() override;
+
   private:
     void close();
 
+    /* Set between start() and finish(), when the path is kept open. */
+    bool session = false;
+
     int ppcMemFd = -1;
     const std::string ppcMemPath;
     const internal::Sys* sys;
@@ -34,6 +34,23 @@ class HostIoInterface
      */
     virtual bool write(const std::size_t offset, const std::size_t length,
                        const void* const source) = 0;
+
+    /**
+     * Keep the host memory device open and the region mapped until finish()
+     * is called, so reads and writes within it don't each pay for it.
+     * Accesses outside of the region still work, they're just not faster.
+     *
+     * @param[in] offset - offset into the host memory device.
+     * @param[in] length - the number of bytes to keep mapped.
+     * @return true on success, false on failure (the device is still usable
+     * one access at a time).
+     */
+    virtual bool start(const std::size_t offset, const std::size_t length) = 0;
+
+    /**
+     * Release anything held open since start(), safe to call without it.
+     */
+    virtual void finish() = 0;
 };
 
 } // namespace host_tool
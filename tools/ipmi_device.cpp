@@ -0,0 +1,157 @@
+/*
+ * Copyright 2026 Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "ipmi_device.hpp"
+
+#include <fcntl.h>
+#include <linux/ipmi.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+
+#include <ipmiblob/ipmi_errors.hpp>
+
+#include <array>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace host_tool
+{
+
+IpmiDeviceHandler::~IpmiDeviceHandler()
+{
+    if (fd >= 0)
+    {
+        sys->close(fd);
+    }
+}
+
+void IpmiDeviceHandler::open()
+{
+    if (fd >= 0)
+    {
+        return;
+    }
+
+    /* The device node is named differently depending on the distribution. */
+    for (const char* prefix : {"/dev/ipmi", "/dev/ipmi/", "/dev/ipmidev/"})
+    {
+        std::string path = prefix + std::to_string(device);
+        fd = sys->open(path.c_str(), O_RDWR);
+        if (fd >= 0)
+        {
+            return;
+        }
+    }
+
+    throw ipmiblob::IpmiException("Unable to open IPMI device " +
+                                  std::to_string(device) + ": " +
+                                  std::strerror(errno));
+}
+
+std::vector<std::uint8_t> IpmiDeviceHandler::sendPacket(
+    std::uint8_t netfn, std::uint8_t cmd, std::vector<std::uint8_t>& data)
+{
+    open();
+
+    struct ipmi_system_interface_addr systemAddress = {};
+    systemAddress.addr_type = IPMI_SYSTEM_INTERFACE_ADDR_TYPE;
+    systemAddress.channel = IPMI_BMC_CHANNEL;
+    systemAddress.lun = 0;
+
+    struct ipmi_req request = {};
+    request.addr = reinterpret_cast<unsigned char*>(&systemAddress);
+    request.addr_len = sizeof(systemAddress);
+    request.msgid = sequence++;
+    request.msg.netfn = netfn;
+    request.msg.cmd = cmd;
+    request.msg.data = data.data();
+    request.msg.data_len = data.size();
+
+    if (sys->ioctl(fd, IPMICTL_SEND_COMMAND, &request) < 0)
+    {
+        throw ipmiblob::IpmiException(
+            std::string("Unable to send IPMI request: ") +
+            std::strerror(errno));
+    }
+
+    std::array<std::uint8_t, IPMI_MAX_MSG_LENGTH> buffer;
+    struct ipmi_addr replyAddress = {};
+    struct ipmi_recv reply = {};
+
+    /* A reply to an earlier request that timed out may still be queued, it's
+     * passed over for the one to this request.
+     */
+    auto deadline = std::chrono::steady_clock::now() +
+                    std::chrono::milliseconds(replyTimeoutMs);
+    do
+    {
+        auto remaining = std::chrono::ceil<std::chrono::milliseconds>(
+            deadline - std::chrono::steady_clock::now());
+        if (remaining.count() <= 0)
+        {
+            throw ipmiblob::IpmiException(
+                "Timed out waiting for the IPMI reply");
+        }
+
+        struct pollfd pfd = {};
+        pfd.fd = fd;
+        pfd.events = POLLIN;
+        int ready = sys->poll(&pfd, 1, remaining.count());
+        if (ready < 0)
+        {
+            throw ipmiblob::IpmiException(
+                std::string("Unable to wait for the IPMI reply: ") +
+                std::strerror(errno));
+        }
+        if (ready == 0)
+        {
+            throw ipmiblob::IpmiException(
+                "Timed out waiting for the IPMI reply");
+        }
+
+        reply = {};
+        reply.addr = reinterpret_cast<unsigned char*>(&replyAddress);
+        reply.addr_len = sizeof(replyAddress);
+        reply.msg.data = buffer.data();
+        reply.msg.data_len = buffer.size();
+
+        if (sys->ioctl(fd, IPMICTL_RECEIVE_MSG_TRUNC, &reply) < 0)
+        {
+            throw ipmiblob::IpmiException(
+                std::string("Unable to receive the IPMI reply: ") +
+                std::strerror(errno));
+        }
+    } while (reply.msgid != request.msgid);
+
+    /* The first byte is the completion code. */
+    if (reply.msg.data_len == 0)
+    {
+        throw ipmiblob::IpmiException("Empty IPMI reply");
+    }
+    if (buffer[0] != 0)
+    {
+        throw ipmiblob::IpmiException(buffer[0]);
+    }
+
+    return std::vector<std::uint8_t>(buffer.begin() + 1,
+                                     buffer.begin() + reply.msg.data_len);
+}
+
+} // namespace host_tool
@@ -0,0 +1,59 @@
+#pragma once
+
+#include "internal/sys.hpp"
+
+#include <ipmiblob/ipmi_interface.hpp>
+
+#include <cstdint>
+#include <vector>
+
+namespace host_tool
+{
+
+/**
+ * @class IpmiDeviceHandler
+ * @brief Sends IPMI requests through a chosen /dev/ipmiN, for hosts with more
+ * than one BMC.  ipmiblob's own handler always uses the first device.
+ */
+class IpmiDeviceHandler : public ipmiblob::IpmiInterface
+{
+  public:
+    /** How long to wait for the BMC to reply to a request. */
+    static constexpr int replyTimeoutMs = 5000;
+
+    explicit IpmiDeviceHandler(int device,
+                               const internal::Sys* sys = &internal::sys_impl) :
+        device(device), sys(sys)
+    {}
+    ~IpmiDeviceHandler();
+
+    IpmiDeviceHandler(const IpmiDeviceHandler&) = delete;
+    IpmiDeviceHandler& operator=(const IpmiDeviceHandler&) = delete;
+
+    /**
+     * Send a request to the BMC and wait for its reply.  The device is opened
+     * for the first request.
+     *
+     * @return the reply, without its completion code.
+     * @throws ipmiblob::IpmiException on failures, or if the completion code
+     * isn't a success.
+     */
+    std::vector<std::uint8_t> sendPacket(std::uint8_t netfn, std::uint8_t cmd,
+                                         std::vector<std::uint8_t>& data)
+        override;
+
+    int getDevice() const
+    {
+        return device;
+    }
+
+  private:
+    void open();
+
+    int device;
+    const internal::Sys* sys;
+    int fd = -1;
+    long sequence = 0;
+};
+
+} // namespace host_tool
@@ -16,7 +16,9 @@
 
 #include "lpc.hpp"
 
+#include "crc32c.hpp"
 #include "data.hpp"
+#include "flags.hpp"
 
 #include <ipmiblob/blob_errors.hpp>
 
@@ -24,13 +26,15 @@
 #include <cstdint>
 #include <cstring>
 #include <memory>
+#include <span>
 #include <string>
 
 namespace host_tool
 {
 
-bool LpcDataHandler::sendContents(const std::string& input,
-                                  std::uint16_t session)
+bool LpcDataHandler::sendContentsFrom(const std::string& input,
+                                      std::uint16_t session,
+                                      std::uint32_t start)
 {
     LpcRegion host_lpc_buf;
     host_lpc_buf.address = address;
@@ -97,6 +101,28 @@ bool LpcDataHandler::sendContents(const std::string& input,
         }
     }
 
+    /* A BMC that can fill in or check chunks says so in the session's state.
+     */
+    bool fillChunks = false;
+    bool crcChunks = false;
+    try
+    {
+        auto state = blob->getStat(session).blob_state;
+        fillChunks =
+            state & ipmi_flash::FirmwareFlags::SessionFlags::fillChunks;
+        crcChunks =
+            checkChunks &&
+            (state & ipmi_flash::FirmwareFlags::SessionFlags::checkChunks);
+    }
+    catch (const ipmiblob::BlobException& b)
+    {}
+
+    if (checkChunks && !crcChunks)
+    {
+        std::fprintf(stderr, "The BMC can't check chunks, sending them "
+                             "without their CRC\n");
+    }
+
     /* For data blockss, stage data, and send blob write command. */
     int inputFd = sys->open(input.c_str(), 0);
     if (inputFd < 0)
@@ -104,6 +130,12 @@ bool LpcDataHandler::sendContents(const std::string& input,
         return false;
     }
 
+    if (start > 0 && sys->lseek(inputFd, start, SEEK_SET) != start)
+    {
+        sys->close(inputFd);
+        return false;
+    }
+
     std::int64_t fileSize = sys->getSize(input.c_str());
     /* For Nuvoton the maximum is 4K */
     auto readBuffer = std::make_unique<std::uint8_t[]>(host_lpc_buf.length);
@@ -114,48 +146,107 @@ bool LpcDataHandler::sendContents(const std::string& input,
         return false;
     }
 
-    progress->start(fileSize);
+    /* Map the window once for the whole transfer instead of for each chunk. */
+    if (!io->start(host_lpc_buf.address, host_lpc_buf.length))
+    {
+        std::fprintf(stderr, "Unable to hold the region open, mapping it for "
+                             "each chunk instead.\n");
+    }
+
+    progress->start(fileSize - start);
 
     /* TODO: This is similar to PCI insomuch as how it sends data, so combine.
      */
     try
     {
-        int bytesRead = 0;
-        std::uint32_t offset = 0;
+        std::uint32_t offset = start;
 
-        do
+        while (true)
         {
-            bytesRead =
+            int bytesRead =
                 sys->read(inputFd, readBuffer.get(), host_lpc_buf.length);
-            if (bytesRead > 0)
+            if (bytesRead <= 0)
             {
-                if (!io->write(host_lpc_buf.address, bytesRead,
-                               readBuffer.get()))
-                {
-                    std::fprintf(stderr,
-                                 "Failed to write to region in memory!\n");
-                }
+                break;
+            }
 
-                struct ipmi_flash::ExtChunkHdr chunk;
+            std::span<const std::uint8_t> data(readBuffer.get(), bytesRead);
+            auto fill = fillChunks ? uniformByte(data) : std::nullopt;
+            if (fill)
+            {
+                /* Nothing is staged, so there's nothing to damage. */
+                struct ipmi_flash::ExtChunkFillHdr chunk;
                 chunk.length = bytesRead;
+                chunk.value = *fill;
                 std::vector<std::uint8_t> chunkBytes(sizeof(chunk));
                 std::memcpy(chunkBytes.data(), &chunk, sizeof(chunk));
-
-                /* This doesn't return anything on success. */
                 blob->writeBytes(session, offset, chunkBytes);
-                offset += bytesRead;
-                progress->updateProgress(bytesRead);
             }
-        } while (bytesRead > 0);
+            else
+            {
+                std::vector<std::uint8_t> chunkBytes;
+                if (crcChunks)
+                {
+                    struct ipmi_flash::ExtChunkCrcHdr chunk;
+                    chunk.length = bytesRead;
+                    chunk.windowOffset = 0;
+                    chunk.crc = ipmi_flash::crc32c(0, data);
+                    chunkBytes.resize(sizeof(chunk));
+                    std::memcpy(chunkBytes.data(), &chunk, sizeof(chunk));
+                }
+                else
+                {
+                    struct ipmi_flash::ExtChunkHdr chunk;
+                    chunk.length = bytesRead;
+                    chunkBytes.resize(sizeof(chunk));
+                    std::memcpy(chunkBytes.data(), &chunk, sizeof(chunk));
+                }
+
+                for (int attempt = 0;; attempt++)
+                {
+                    if (!io->write(host_lpc_buf.address, bytesRead,
+                                   readBuffer.get()))
+                    {
+                        std::fprintf(stderr,
+                                     "Failed to write to region in memory!\n");
+                    }
+
+                    try
+                    {
+                        /* This doesn't return anything on success. */
+                        blob->writeBytes(session, offset, chunkBytes);
+                        break;
+                    }
+                    catch (const ipmiblob::BlobException& b)
+                    {
+                        /* A checked chunk may have been damaged in the
+                         * window, so it's staged again.
+                         */
+                        if (!crcChunks || attempt == chunkRetries)
+                        {
+                            throw;
+                        }
+                        std::fprintf(stderr,
+                                     "Chunk at %u rejected, sending it "
+                                     "again\n",
+                                     offset);
+                    }
+                }
+            }
+            offset += bytesRead;
+            progress->updateProgress(bytesRead);
+        }
     }
     catch (const ipmiblob::BlobException& b)
     {
         progress->abort();
+        io->finish();
         sys->close(inputFd);
         return false;
     }
 
     progress->finish();
+    io->finish();
     sys->close(inputFd);
     return true;
 }
@@ -23,14 +23,20 @@ struct LpcRegion
 class LpcDataHandler : public DataInterface
 {
   public:
+    /**
+     * @param[in] checkChunks - send each chunk's CRC-32C for the BMC to check,
+     *                          if it can
+     */
     LpcDataHandler(ipmiblob::BlobInterface* blob, HostIoInterface* io,
                    std::uint32_t address, std::uint32_t length,
                    ProgressInterface* progress,
-                   const internal::Sys* sys = &internal::sys_impl) :
+                   const internal::Sys* sys = &internal::sys_impl,
+                   bool checkChunks = false) :
         blob(blob), io(io), address(address), length(length),
-        progress(progress), sys(sys) {};
+        progress(progress), sys(sys), checkChunks(checkChunks) {};
 
-    bool sendContents(const std::string& input, std::uint16_t session) override;
+    bool sendContentsFrom(const std::string& input, std::uint16_t session,
+                          std::uint32_t start) override;
     ipmi_flash::FirmwareFlags::UpdateFlags supportedType() const override
     {
         return ipmi_flash::FirmwareFlags::UpdateFlags::lpc;
@@ -43,6 +49,7 @@ class LpcDataHandler : public DataInterface
     std::uint32_t length;
     ProgressInterface* progress;
     const internal::Sys* sys;
+    bool checkChunks;
 };
 
 } // namespace host_tool
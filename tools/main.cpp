@@ -16,6 +16,7 @@
 
 #include "bt.hpp"
 #include "io.hpp"
+#include "ipmi_device.hpp"
 #include "lpc.hpp"
 #include "net.hpp"
 #include "p2a.hpp"
@@ -32,6 +33,8 @@
 #include <ipmiblob/ipmi_handler.hpp>
 
 #include <algorithm>
+#include <csignal>
+#include <cstdint>
 #include <cstdio>
 #include <cstdlib>
 #include <exception>
@@ -39,7 +42,9 @@
 #include <iterator>
 #include <limits>
 #include <memory>
+#include <optional>
 #include <string>
+#include <thread>
 #include <vector>
 
 #define IPMILPC "ipmilpc"
@@ -60,7 +65,9 @@ void usage(const char* program)
         stderr,
         "Usage: %s --command <command> --interface <interface> --image "
         "<image file> --sig <signature file> --type <layout> "
-        "[--ignore-update]\n",
+        "[--ignore-update] [--host <host> [--port <port>] [--streams <n>] "
+        "[--send-buffer <bytes>]] [--check-chunks] [--compress] "
+        "[--chain-update] [--ipmi-device <n> [--pci-device <bdf>]]...\n",
         program);
 
     std::fprintf(stderr, "interfaces: ");
@@ -69,6 +76,12 @@ void usage(const char* program)
     std::fprintf(stderr, "\n");
 
     std::fprintf(stderr, "layouts examples: image, bios\n");
+    std::fprintf(stderr,
+                 "several --ipmi-device options, each with a --pci-device "
+                 "over PCI, update that many BMCs at once\n");
+    std::fprintf(stderr,
+                 "several --image, --sig and --type options update that many "
+                 "firmware types in one transaction, in the order given\n");
     std::fprintf(stderr,
                  "the type field specifies '/flash/{layout}' for a handler\n");
 }
@@ -87,7 +100,8 @@ bool checkInterface(const std::string& interface)
 
 int main(int argc, char* argv[])
 {
-    std::string command, interface, imagePath, signaturePath, type, host;
+    std::string command, interface, host;
+    std::vector<std::string> imagePaths, signaturePaths, types;
     std::string port = "623";
     char* valueEnd = nullptr;
     long address = 0;
@@ -95,6 +109,13 @@ int main(int argc, char* argv[])
     std::uint32_t hostAddress = 0;
     std::uint32_t hostLength = 0;
     bool ignoreUpdate = false;
+    long streams = 1;
+    long sendBuffer = 0;
+    bool checkChunks = false;
+    bool compress = false;
+    bool chainUpdate = false;
+    std::vector<int> ipmiDevices;
+    std::vector<host_tool::PciAddress> pciDevices;
 
     while (1)
     {
@@ -110,13 +131,20 @@ int main(int argc, char* argv[])
             {"ignore-update", no_argument, nullptr, 'u'},
             {"host", required_argument, nullptr, 'H'},
             {"port", optional_argument, nullptr, 'p'},
+            {"streams", required_argument, nullptr, 'n'},
+            {"send-buffer", required_argument, nullptr, 'b'},
+            {"check-chunks", no_argument, nullptr, 'k'},
+            {"compress", no_argument, nullptr, 'z'},
+            {"chain-update", no_argument, nullptr, 'C'},
+            {"ipmi-device", required_argument, nullptr, 'I'},
+            {"pci-device", required_argument, nullptr, 'P'},
             {nullptr, 0, nullptr, 0}
         };
         // clang-format on
 
         int option_index = 0;
-        int c = getopt_long(argc, argv, "c:i:m:s:a:l:t:uH:p:", long_options,
-                            &option_index);
+        int c = getopt_long(argc, argv, "c:i:m:s:a:l:t:uH:p:n:b:kzCI:P:",
+                            long_options, &option_index);
         if (c == -1)
         {
             break;
@@ -142,10 +170,10 @@ int main(int argc, char* argv[])
                 }
                 break;
             case 'm':
-                imagePath = std::string{optarg};
+                imagePaths.push_back(std::string{optarg});
                 break;
             case 's':
-                signaturePath = std::string{optarg};
+                signaturePaths.push_back(std::string{optarg});
                 break;
             case 'a':
                 address = std::strtol(&optarg[0], &valueEnd, 0);
@@ -178,7 +206,7 @@ int main(int argc, char* argv[])
                 hostLength = static_cast<std::uint32_t>(length);
                 break;
             case 't':
-                type = std::string{optarg};
+                types.push_back(std::string{optarg});
                 break;
             case 'u':
                 ignoreUpdate = true;
@@ -189,6 +217,60 @@ int main(int argc, char* argv[])
             case 'p':
                 port = std::string{optarg};
                 break;
+            case 'n':
+                streams = std::strtol(&optarg[0], &valueEnd, 0);
+                if (valueEnd == nullptr || streams < 1 || streams > 64)
+                {
+                    std::fprintf(stderr, "Streams must be from 1 to 64.\n");
+                    usage(argv[0]);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 'b':
+                sendBuffer = std::strtol(&optarg[0], &valueEnd, 0);
+                if (valueEnd == nullptr || sendBuffer < 0 ||
+                    sendBuffer > std::numeric_limits<int>::max())
+                {
+                    std::fprintf(stderr, "Invalid send buffer size.\n");
+                    usage(argv[0]);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 'k':
+                checkChunks = true;
+                break;
+            case 'z':
+                compress = true;
+                break;
+            case 'C':
+                chainUpdate = true;
+                break;
+            case 'I':
+            {
+                long device = std::strtol(&optarg[0], &valueEnd, 0);
+                if (valueEnd == nullptr || *valueEnd != '\0' || device < 0 ||
+                    device > std::numeric_limits<int>::max())
+                {
+                    std::fprintf(stderr, "Invalid IPMI device.\n");
+                    usage(argv[0]);
+                    exit(EXIT_FAILURE);
+                }
+                ipmiDevices.push_back(static_cast<int>(device));
+                break;
+            }
+            case 'P':
+                try
+                {
+                    pciDevices.push_back(
+                        host_tool::parsePciAddress(std::string{optarg}));
+                }
+                catch (const host_tool::ToolException& e)
+                {
+                    std::fprintf(stderr, "%s\n", e.what());
+                    usage(argv[0]);
+                    exit(EXIT_FAILURE);
+                }
+                break;
             default:
                 usage(argv[0]);
                 exit(EXIT_FAILURE);
@@ -204,40 +286,69 @@ int main(int argc, char* argv[])
     /* They want to update the firmware. */
     if (command == "update")
     {
-        if (interface.empty() || imagePath.empty() || signaturePath.empty() ||
-            type.empty())
+        if (interface.empty() || imagePaths.empty() ||
+            signaturePaths.size() != imagePaths.size() ||
+            types.size() != imagePaths.size())
         {
             usage(argv[0]);
             exit(EXIT_FAILURE);
         }
 
-        auto ipmi = ipmiblob::IpmiHandler::CreateIpmiHandler();
-        ipmiblob::BlobHandler blob(std::move(ipmi));
-#ifdef ENABLE_PPC
-        const std::string ppcMemPath = "/sys/kernel/debug/powerpc/lpc/fw";
-        host_tool::PpcMemDevice devmem(ppcMemPath);
-#else
-        host_tool::DevMemDevice devmem;
-#endif
-        host_tool::ProgressStdoutIndicator progress;
+        /* More than one image is sent as one transaction, the images are
+         * updated in the order given.
+         */
+        std::vector<host_tool::UpdateImage> images;
+        for (std::size_t i = 0; i < imagePaths.size(); i++)
+        {
+            images.push_back({types[i], imagePaths[i], signaturePaths[i]});
+        }
+        bool transaction = images.size() > 1;
 
-        std::unique_ptr<host_tool::DataInterface> handler;
+        /* Closing the update session before it's done aborts it, and with it
+         * the updates still to come in the transaction.
+         */
+        if (transaction && ignoreUpdate)
+        {
+            std::fprintf(stderr, "--ignore-update can't be used with several "
+                                 "images\n");
+            exit(EXIT_FAILURE);
+        }
 
-        /* Input has already been validated in this case. */
-        if (interface == IPMIBT)
+        /* With more than one BMC, each is updated on its own thread, through
+         * its own IPMI device and PCI bridge.
+         */
+        std::size_t count = std::max(
+            {ipmiDevices.size(), pciDevices.size(), std::size_t{1}});
+        if (count > 1)
         {
-            handler =
-                std::make_unique<host_tool::BtDataHandler>(&blob, &progress);
+            if (interface != IPMIBT && interface != IPMIPCI &&
+                interface != IPMIPCI_SKIP_BRIDGE_DISABLE)
+            {
+                std::fprintf(stderr,
+                             "Interface %s can't update several BMCs\n",
+                             interface.c_str());
+                exit(EXIT_FAILURE);
+            }
+            if (ipmiDevices.size() != count ||
+                (interface != IPMIBT && pciDevices.size() != count))
+            {
+                std::fprintf(stderr, "Each BMC needs an IPMI device and, over "
+                                     "PCI, a PCI device\n");
+                exit(EXIT_FAILURE);
+            }
         }
-        else if (interface == IPMINET)
+
+        if (interface == IPMINET)
         {
             if (host.empty())
             {
                 std::fprintf(stderr, "Host not specified\n");
                 exit(EXIT_FAILURE);
             }
-            handler = std::make_unique<host_tool::NetDataHandler>(
-                &blob, &progress, host, port);
+            /* A failed transfer shuts the socket down while data may still be
+             * sent, report that as an error instead of dying.
+             */
+            std::signal(SIGPIPE, SIG_IGN);
         }
         else if (interface == IPMILPC)
         {
@@ -246,46 +357,159 @@ int main(int argc, char* argv[])
                 std::fprintf(stderr, "Address or Length were 0\n");
                 exit(EXIT_FAILURE);
             }
-            handler = std::make_unique<host_tool::LpcDataHandler>(
-                &blob, &devmem, hostAddress, hostLength, &progress);
-        }
-        else if (interface == IPMIPCI)
-        {
-            auto& pci = host_tool::PciAccessImpl::getInstance();
-            handler = std::make_unique<host_tool::P2aDataHandler>(
-                &blob, &pci, &progress);
         }
-        else if (interface == IPMIPCI_SKIP_BRIDGE_DISABLE)
+
+        /* Update the BMC at index, throwing on failures. */
+        auto update = [&](std::size_t index,
+                          host_tool::ProgressInterface* progress) {
+            std::unique_ptr<ipmiblob::IpmiInterface> ipmi;
+            if (index < ipmiDevices.size())
+            {
+                ipmi = std::make_unique<host_tool::IpmiDeviceHandler>(
+                    ipmiDevices[index]);
+            }
+            else
+            {
+                ipmi = ipmiblob::IpmiHandler::CreateIpmiHandler();
+            }
+            ipmiblob::BlobHandler blob(std::move(ipmi));
+#ifdef ENABLE_PPC
+            const std::string ppcMemPath = "/sys/kernel/debug/powerpc/lpc/fw";
+            host_tool::PpcMemDevice devmem(ppcMemPath);
+#else
+            host_tool::DevMemDevice devmem;
+#endif
+            std::optional<host_tool::PciAddress> pciAddress;
+            if (index < pciDevices.size())
+            {
+                pciAddress = pciDevices[index];
+            }
+
+            std::unique_ptr<host_tool::DataInterface> handler;
+
+            /* Input has already been validated in this case. */
+            if (interface == IPMIBT)
+            {
+                handler =
+                    std::make_unique<host_tool::BtDataHandler>(&blob, progress);
+            }
+            else if (interface == IPMINET)
+            {
+                handler = std::make_unique<host_tool::NetDataHandler>(
+                    &blob, progress, host, port, &internal::sys_impl,
+                    host_tool::NetDataHandler::defaultWindowSize,
+                    static_cast<std::uint32_t>(streams),
+                    static_cast<int>(sendBuffer));
+            }
+            else if (interface == IPMILPC)
+            {
+                handler = std::make_unique<host_tool::LpcDataHandler>(
+                    &blob, &devmem, hostAddress, hostLength, progress,
+                    &internal::sys_impl, checkChunks);
+            }
+            else if (interface == IPMIPCI)
+            {
+                auto& pci = host_tool::PciAccessImpl::getInstance();
+                handler = std::make_unique<host_tool::P2aDataHandler>(
+                    &blob, &pci, progress, false, &internal::sys_impl,
+                    host_tool::P2aDataHandler::defaultWindowSlots, checkChunks,
+                    pciAddress);
+            }
+            else if (interface == IPMIPCI_SKIP_BRIDGE_DISABLE)
+            {
+                auto& pci = host_tool::PciAccessImpl::getInstance();
+                handler = std::make_unique<host_tool::P2aDataHandler>(
+                    &blob, &pci, progress, true, &internal::sys_impl,
+                    host_tool::P2aDataHandler::defaultWindowSlots, checkChunks,
+                    pciAddress);
+            }
+
+            if (!handler)
+            {
+                throw host_tool::ToolException("Interface " + interface +
+                                               " is unavailable");
+            }
+
+            /* The parameters are all filled out. */
+            host_tool::UpdateHandler updater(&blob, handler.get(), compress,
+                                             transaction);
+            if (transaction)
+            {
+                host_tool::updaterTransaction(&updater, &blob, images,
+                                              ignoreUpdate, chainUpdate);
+            }
+            else
+            {
+                host_tool::updaterMain(
+                    &updater, &blob, images[0].imagePath,
+                    images[0].signaturePath, images[0].layoutType,
+                    ignoreUpdate, chainUpdate);
+            }
+        };
+
+        if (count == 1)
         {
-            auto& pci = host_tool::PciAccessImpl::getInstance();
-            handler = std::make_unique<host_tool::P2aDataHandler>(
-                &blob, &pci, &progress, true);
+            host_tool::ProgressStdoutIndicator progress;
+            try
+            {
+                update(0, &progress);
+            }
+            catch (const host_tool::ToolException& e)
+            {
+                std::fprintf(stderr, "Exception received: %s\n", e.what());
+                return -1;
+            }
+            catch (const std::exception& e)
+            {
+                std::fprintf(stderr, "Unexpected exception received: %s\n",
+                             e.what());
+                return -1;
+            }
+            return 0;
         }
 
-        if (!handler)
+        /* The update takes as long as the slowest BMC, and one failing
+         * doesn't stop the others.
+         */
+        host_tool::ProgressMultiIndicator progress(count);
+        std::vector<std::string> errors(count);
+        std::vector<std::thread> workers;
+        for (std::size_t i = 0; i < count; i++)
         {
-            /* TODO(venture): use a custom exception. */
-            std::fprintf(stderr, "Interface %s is unavailable\n",
-                         interface.c_str());
-            exit(EXIT_FAILURE);
+            workers.emplace_back([&, i] {
+                try
+                {
+                    update(i, progress.target(i));
+                }
+                catch (const std::exception& e)
+                {
+                    errors[i] = e.what();
+                }
+            });
         }
-
-        /* The parameters are all filled out. */
-        try
+        for (auto& worker : workers)
         {
-            host_tool::UpdateHandler updater(&blob, handler.get());
-            host_tool::updaterMain(&updater, &blob, imagePath, signaturePath,
-                                   type, ignoreUpdate);
+            worker.join();
         }
-        catch (const host_tool::ToolException& e)
+        std::fprintf(stdout, "\n");
+
+        bool failed = false;
+        for (std::size_t i = 0; i < count; i++)
         {
-            std::fprintf(stderr, "Exception received: %s\n", e.what());
-            return -1;
+            if (errors[i].empty())
+            {
+                std::fprintf(stderr, "BMC %zu (IPMI device %d): updated\n", i,
+                             ipmiDevices[i]);
+            }
+            else
+            {
+                std::fprintf(stderr, "BMC %zu (IPMI device %d): failed: %s\n",
+                             i, ipmiDevices[i], errors[i].c_str());
+                failed = true;
+            }
         }
-        catch (const std::exception& e)
+        if (failed)
         {
-            std::fprintf(stderr, "Unexpected exception received: %s\n",
-                         e.what());
             return -1;
         }
     }
@@ -0,0 +1,192 @@
+/*
+ * Copyright 2026 Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "mmio.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+namespace host_tool
+{
+
+namespace
+{
+
+/* The vector copy works on blocks of this size, aligned to it. */
+constexpr std::size_t blockSize = 32;
+
+template <typename T>
+void storeOne(std::uint8_t*& dest, const std::uint8_t*& src)
+{
+    T value;
+    std::memcpy(&value, src, sizeof(value));
+    *reinterpret_cast<volatile T*>(dest) = value;
+    dest += sizeof(value);
+    src += sizeof(value);
+}
+
+/** Copy using the widest naturally aligned scalar store at each position. */
+void copyNarrow(std::uint8_t* dest, const std::uint8_t* src, std::size_t size)
+{
+    const std::uint8_t* end = src + size;
+
+    while (src != end)
+    {
+        auto left = static_cast<std::size_t>(end - src);
+        auto addr = reinterpret_cast<std::uintptr_t>(dest);
+
+        if ((addr & 1) || left < 2)
+        {
+            storeOne<std::uint8_t>(dest, src);
+        }
+        else if ((addr & 2) || left < 4)
+        {
+            storeOne<std::uint16_t>(dest, src);
+        }
+        else if ((addr & 4) || left < 8)
+        {
+            storeOne<std::uint32_t>(dest, src);
+        }
+        else
+        {
+            storeOne<std::uint64_t>(dest, src);
+        }
+    }
+}
+
+using BlockCopy = void (*)(std::uint8_t* dest, const std::uint8_t* src,
+                           std::size_t blocks);
+
+#if defined(__SSE2__)
+/* Non-temporal stores bypass the cache and are combined into full bursts when
+ * the BAR is mapped write-combining, they're ordered by the sfence in
+ * mmioWriteBarrier().
+ */
+void copyBlocksSse2(std::uint8_t* dest, const std::uint8_t* src,
+                    std::size_t blocks)
+{
+    auto d = reinterpret_cast<__m128i*>(dest);
+    auto s = reinterpret_cast<const __m128i*>(src);
+
+    for (std::size_t i = 0; i < blocks; i++)
+    {
+        _mm_stream_si128(d++, _mm_loadu_si128(s++));
+        _mm_stream_si128(d++, _mm_loadu_si128(s++));
+    }
+}
+
+__attribute__((target("avx"))) void copyBlocksAvx(
+    std::uint8_t* dest, const std::uint8_t* src, std::size_t blocks)
+{
+    auto d = reinterpret_cast<__m256i*>(dest);
+    auto s = reinterpret_cast<const __m256i*>(src);
+
+    for (std::size_t i = 0; i < blocks; i++)
+    {
+        _mm256_stream_si256(d++, _mm256_loadu_si256(s++));
+    }
+}
+
+BlockCopy selectBlockCopy()
+{
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx"))
+    {
+        return copyBlocksAvx;
+    }
+
+    return copyBlocksSse2;
+}
+#elif defined(__ARM_NEON)
+void copyBlocksNeon(std::uint8_t* dest, const std::uint8_t* src,
+                    std::size_t blocks)
+{
+    for (std::size_t i = 0; i < blocks; i++)
+    {
+        vst1q_u8(dest, vld1q_u8(src));
+        vst1q_u8(dest + 16, vld1q_u8(src + 16));
+        dest += blockSize;
+        src += blockSize;
+    }
+}
+
+BlockCopy selectBlockCopy()
+{
+    return copyBlocksNeon;
+}
+#else
+void copyBlocksScalar(std::uint8_t* dest, const std::uint8_t* src,
+                      std::size_t blocks)
+{
+    copyNarrow(dest, src, blocks * blockSize);
+}
+
+BlockCopy selectBlockCopy()
+{
+    return copyBlocksScalar;
+}
+#endif
+
+} // namespace
+
+void* memcpyMmio(void* destination, const void* source, std::size_t size)
+{
+    static const BlockCopy copyBlocks = selectBlockCopy();
+
+    auto dest = reinterpret_cast<std::uint8_t*>(destination);
+    auto src = reinterpret_cast<const std::uint8_t*>(source);
+
+    std::size_t head = -reinterpret_cast<std::uintptr_t>(dest) % blockSize;
+    if (head >= size)
+    {
+        copyNarrow(dest, src, size);
+        return destination;
+    }
+
+    copyNarrow(dest, src, head);
+    dest += head;
+    src += head;
+    size -= head;
+
+    std::size_t blocks = size / blockSize;
+    copyBlocks(dest, src, blocks);
+    dest += blocks * blockSize;
+    src += blocks * blockSize;
+
+    copyNarrow(dest, src, size % blockSize);
+
+    return destination;
+}
+
+void mmioWriteBarrier()
+{
+#if defined(__SSE2__)
+    _mm_sfence();
+#elif defined(__aarch64__)
+    __asm__ __volatile__("dmb oshst" ::: "memory");
+#else
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+#endif
+}
+
+} // namespace host_tool
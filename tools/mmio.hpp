@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstddef>
+
+namespace host_tool
+{
+
+/**
+ * Copy into device memory (e.g. a mapped PCI BAR).  The bulk of the copy uses
+ * the widest vector stores the CPU supports, the unaligned head and tail are
+ * copied with the widest naturally aligned stores that fit.  The source has
+ * no alignment requirements.
+ *
+ * The stores may be weakly ordered, call mmioWriteBarrier() before telling the
+ * device the data is there.
+ *
+ * @param[out] destination - destination memory pointer
+ * @param[in] source - source memory pointer
+ * @param[in] size - bytes to copy
+ * @return destination pointer
+ */
+void* memcpyMmio(void* destination, const void* source, std::size_t size);
+
+/**
+ * Wait for all previous stores to device memory to be posted, so a following
+ * doorbell (e.g. an IPMI command) can't overtake them.
+ */
+void mmioWriteBarrier();
+
+} // namespace host_tool
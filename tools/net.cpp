@@ -30,10 +30,17 @@
 #include <stdplus/handle/managed.hpp>
 #include <stdplus/util/cexec.hpp>
 
+#include <algorithm>
 #include <array>
+#include <condition_variable>
 #include <cstdint>
 #include <cstring>
+#include <deque>
+#include <exception>
+#include <mutex>
 #include <optional>
+#include <system_error>
+#include <thread>
 #include <vector>
 
 namespace
@@ -50,10 +57,10 @@ using Fd = stdplus::Managed<int, const internal::Sys*>::Handle<closefd>;
 namespace host_tool
 {
 
-bool NetDataHandler::sendContents(const std::string& input,
-                                  std::uint16_t session)
+bool NetDataHandler::sendContentsFrom(const std::string& input,
+                                      std::uint16_t session,
+                                      std::uint32_t start)
 {
-    constexpr size_t blockSize = 64 * 1024;
     Fd inputFd(std::nullopt, sys);
 
     inputFd.reset(sys->open(input.c_str(), O_RDONLY));
@@ -64,69 +71,242 @@ bool NetDataHandler::sendContents(const std::string& input,
         return false;
     }
 
+    if (start > 0 && sys->lseek(*inputFd, start, SEEK_SET) != start)
+    {
+        std::fprintf(stderr, "Unable to seek in file: '%s'\n", input.c_str());
+        return false;
+    }
+
     std::int64_t fileSize = sys->getSize(input.c_str());
-    Fd connFd(std::nullopt, sys);
 
+    /* Striping needs to know where the file ends up front. */
+    std::optional<ipmi_flash::NetConfigResponse> config;
+    if (streams > 1 && fileSize > start)
     {
-        struct addrinfo hints;
-        std::memset(&hints, 0, sizeof(hints));
-        hints.ai_flags = AI_NUMERICHOST;
-        hints.ai_family = AF_UNSPEC;
-        hints.ai_socktype = SOCK_STREAM;
+        config = negotiateStreams(session);
+    }
 
-        struct addrinfo *addrs, *addr;
-        int ret = sys->getaddrinfo(host.c_str(), port.c_str(), &hints, &addrs);
-        if (ret < 0)
+    std::uint32_t connections = config ? config->streams : 1;
+    std::vector<Fd> connFds;
+    std::vector<int> fds;
+    connFds.reserve(connections);
+    for (std::uint32_t i = 0; i < connections; i++)
+    {
+        connFds.emplace_back(std::nullopt, sys);
+        connFds.back().reset(connectToBmc());
+        if (*connFds.back() < 0)
         {
-            std::fprintf(stderr, "Couldn't parse address %s with port %s: %s\n",
-                         host.c_str(), port.c_str(), gai_strerror(ret));
+            (void)connFds.back().release();
             return false;
         }
+        fds.push_back(*connFds.back());
+    }
 
-        for (addr = addrs; addr != nullptr; addr = addr->ai_next)
+    try
+    {
+        progress->start(fileSize - start);
+        if (config)
+        {
+            sendStriped(*inputFd, fds, fileSize, session,
+                        std::min<std::size_t>(windowSize, config->window),
+                        start);
+        }
+        else
         {
-            connFd.reset(sys->socket(addr->ai_family, addr->ai_socktype,
-                                     addr->ai_protocol));
-            if (*connFd == -1)
-                continue;
+            sendStream(*inputFd, fds[0], session, start);
+        }
+    }
+    catch (const std::system_error& e)
+    {
+        std::fprintf(stderr, "%s\n", e.what());
+        progress->abort();
+        return false;
+    }
+    catch (const ipmiblob::BlobException& b)
+    {
+        progress->abort();
+        return false;
+    }
 
-            if (sys->connect(*connFd, addr->ai_addr, addr->ai_addrlen) != -1)
-                break;
+    progress->finish();
+    return true;
+}
+
+std::optional<ipmi_flash::NetConfigResponse> NetDataHandler::negotiateStreams(
+    std::uint16_t session)
+{
+    ipmi_flash::NetConfigRequest request;
+    request.streams = streams;
+    std::vector<std::uint8_t> requestBytes(sizeof(request));
+    std::memcpy(requestBytes.data(), &request, sizeof(request));
+
+    ipmi_flash::NetConfigResponse response;
+
+    try
+    {
+        blob->writeMeta(session, 0, requestBytes);
+
+        /* Older BMCs accept any configuration, but don't report one back. */
+        ipmiblob::StatResponse stat = blob->getStat(session);
+        if (stat.metadata.size() != sizeof(response))
+        {
+            return std::nullopt;
         }
+        std::memcpy(&response, stat.metadata.data(), sizeof(response));
+    }
+    catch (const ipmiblob::BlobException& b)
+    {
+        return std::nullopt;
+    }
+
+    if (response.streams == 0 || response.window == 0)
+    {
+        return std::nullopt;
+    }
+
+    return response;
+}
+
+int NetDataHandler::connectToBmc()
+{
+    Fd connFd(std::nullopt, sys);
+
+    struct addrinfo hints;
+    std::memset(&hints, 0, sizeof(hints));
+    hints.ai_flags = AI_NUMERICHOST;
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+
+    struct addrinfo *addrs, *addr;
+    int ret = sys->getaddrinfo(host.c_str(), port.c_str(), &hints, &addrs);
+    if (ret < 0)
+    {
+        std::fprintf(stderr, "Couldn't parse address %s with port %s: %s\n",
+                     host.c_str(), port.c_str(), gai_strerror(ret));
+        return -1;
+    }
 
-        // TODO: use stdplus Managed for the addrinfo structs
-        sys->freeaddrinfo(addrs);
+    for (addr = addrs; addr != nullptr; addr = addr->ai_next)
+    {
+        connFd.reset(sys->socket(addr->ai_family, addr->ai_socktype,
+                                 addr->ai_protocol));
+        if (*connFd == -1)
+            continue;
 
-        if (addr == nullptr)
+        /* This has to be set before connecting to affect the window. */
+        if (sendBuffer > 0 &&
+            sys->setsockopt(*connFd, SOL_SOCKET, SO_SNDBUF, &sendBuffer,
+                            sizeof(sendBuffer)) < 0)
         {
-            std::fprintf(stderr, "Failed to connect\n");
-            return false;
+            std::fprintf(stderr, "Failed to set send buffer size: %s\n",
+                         std::strerror(errno));
         }
+
+        if (sys->connect(*connFd, addr->ai_addr, addr->ai_addrlen) != -1)
+            break;
     }
 
+    // TODO: use stdplus Managed for the addrinfo structs
+    sys->freeaddrinfo(addrs);
+
+    if (addr == nullptr)
+    {
+        std::fprintf(stderr, "Failed to connect\n");
+        return -1;
+    }
+
+    return connFd.release();
+}
+
+void NetDataHandler::sendStream(int inputFd, int connFd, std::uint16_t session,
+                                std::uint32_t start)
+{
+    constexpr size_t blockSize = 64 * 1024;
+
+    /* The data streams ahead of the IPMI confirmations, which another thread
+     * sends for each block in order, as long as no more than windowSize bytes
+     * are sent but unconfirmed.
+     */
+    std::mutex lock;
+    std::condition_variable cv;
+    std::deque<std::uint32_t> unconfirmed;
+    std::size_t unconfirmedBytes = 0;
+    bool done = false;
+    bool abort = false;
+    std::exception_ptr confirmError;
+
+    std::thread confirmer([&]() {
+        std::uint32_t offset = start;
+
+        try
+        {
+            while (true)
+            {
+                std::uint32_t length;
+                {
+                    std::unique_lock<std::mutex> l(lock);
+                    cv.wait(l, [&] {
+                        return abort || done || !unconfirmed.empty();
+                    });
+                    if (abort || unconfirmed.empty())
+                    {
+                        return;
+                    }
+                    length = unconfirmed.front();
+                }
+
+                struct ipmi_flash::ExtChunkHdr chunk;
+                chunk.length = length;
+                std::vector<uint8_t> chunkBytes(sizeof(chunk));
+                std::memcpy(chunkBytes.data(), &chunk, sizeof(chunk));
+                /* This doesn't return anything on success. */
+                blob->writeBytes(session, offset, chunkBytes);
+                progress->updateProgress(length);
+                offset += length;
+
+                std::lock_guard<std::mutex> l(lock);
+                unconfirmed.pop_front();
+                unconfirmedBytes -= length;
+                cv.notify_all();
+            }
+        }
+        catch (...)
+        {
+            {
+                std::lock_guard<std::mutex> l(lock);
+                confirmError = std::current_exception();
+                cv.notify_all();
+            }
+            /* The BMC won't read anything else, so unblock the sender. */
+            sys->shutdown(connFd, SHUT_RDWR);
+        }
+    });
+
     try
     {
         int bytesSent = 0;
-        off_t offset = 0;
+        off_t offset = start;
 
-        progress->start(fileSize);
         auto confirmSend = [&]() {
-            if (bytesSent == 0)
+            std::unique_lock<std::mutex> l(lock);
+            if (bytesSent > 0)
             {
-                return;
+                unconfirmed.push_back(bytesSent);
+                unconfirmedBytes += bytesSent;
+                cv.notify_all();
+            }
+            cv.wait(l, [&] {
+                return confirmError || unconfirmedBytes < windowSize;
+            });
+            if (confirmError)
+            {
+                std::rethrow_exception(confirmError);
             }
-            struct ipmi_flash::ExtChunkHdr chunk;
-            chunk.length = bytesSent;
-            std::vector<uint8_t> chunkBytes(sizeof(chunk));
-            std::memcpy(chunkBytes.data(), &chunk, sizeof(chunk));
-            /* This doesn't return anything on success. */
-            blob->writeBytes(session, offset - bytesSent, chunkBytes);
-            progress->updateProgress(bytesSent);
         };
 
         do
         {
-            bytesSent = sys->sendfile(*connFd, *inputFd, &offset, blockSize);
+            bytesSent = sys->sendfile(connFd, inputFd, &offset, blockSize);
             if (bytesSent < 0)
             {
                 // Not all input files support sendfile, fall back to a simple
@@ -139,11 +319,11 @@ bool NetDataHandler::sendContents(const std::string& input,
                 size_t left = 0;
                 do
                 {
-                    left += CHECK_ERRNO(sys->read(*inputFd, buf.data() + left,
+                    left += CHECK_ERRNO(sys->read(inputFd, buf.data() + left,
                                                   buf.size() - left),
                                         "Reading data for BMC");
                     bytesSent =
-                        CHECK_ERRNO(sys->send(*connFd, buf.data(), left, 0),
+                        CHECK_ERRNO(sys->send(connFd, buf.data(), left, 0),
                                     "Sending data to BMC");
                     std::memmove(buf.data(), buf.data() + bytesSent,
                                  left - bytesSent);
@@ -155,21 +335,202 @@ bool NetDataHandler::sendContents(const std::string& input,
             }
             confirmSend();
         } while (bytesSent > 0);
+
+        /* Wait for the remaining confirmations. */
+        {
+            std::unique_lock<std::mutex> l(lock);
+            done = true;
+            cv.notify_all();
+        }
+        confirmer.join();
+        if (confirmError)
+        {
+            std::rethrow_exception(confirmError);
+        }
     }
-    catch (const std::system_error& e)
+    catch (...)
     {
-        std::fprintf(stderr, "%s\n", e.what());
-        progress->abort();
-        return false;
+        /* Stop the confirmations without waiting for the queued ones. */
+        {
+            std::lock_guard<std::mutex> l(lock);
+            abort = true;
+            cv.notify_all();
+        }
+        if (confirmer.joinable())
+        {
+            confirmer.join();
+        }
+        throw;
     }
-    catch (const ipmiblob::BlobException& b)
+}
+
+void NetDataHandler::sendStriped(int inputFd, const std::vector<int>& connFds,
+                                 std::int64_t fileSize, std::uint16_t session,
+                                 std::size_t window, std::uint32_t start)
+{
+    constexpr std::uint32_t blockSize = 64 * 1024;
+    const std::size_t chunks = (fileSize - start + blockSize - 1) / blockSize;
+
+    /* Chunk i goes out on connection i % streams, the confirmations go in
+     * order once each chunk is sent.  No chunk is started past the window
+     * from the last confirmed one, so the BMC never holds more than that.
+     */
+    std::mutex lock;
+    std::condition_variable cv;
+    std::vector<bool> sent(chunks);
+    std::uint64_t confirmed = start;
+    std::exception_ptr error;
+
+    auto fail = [&](std::exception_ptr e) {
+        {
+            std::lock_guard<std::mutex> l(lock);
+            if (!error)
+            {
+                error = e;
+            }
+            cv.notify_all();
+        }
+        /* The BMC won't read anything else, so unblock the senders. */
+        for (int fd : connFds)
+        {
+            sys->shutdown(fd, SHUT_RDWR);
+        }
+    };
+
+    auto sendAll = [&](int connFd, const void* data, std::size_t length) {
+        auto bytes = reinterpret_cast<const std::uint8_t*>(data);
+        while (length > 0)
+        {
+            auto ret = CHECK_ERRNO(sys->send(connFd, bytes, length, 0),
+                                   "Sending data to BMC");
+            bytes += ret;
+            length -= ret;
+        }
+    };
+
+    auto sender = [&](std::size_t stream) {
+        int connFd = connFds[stream];
+        std::vector<std::uint8_t> buffer;
+
+        try
+        {
+            for (std::size_t chunk = stream; chunk < chunks;
+                 chunk += connFds.size())
+            {
+                std::uint64_t offset = start + std::uint64_t{chunk} * blockSize;
+                std::uint32_t length =
+                    std::min<std::uint64_t>(blockSize, fileSize - offset);
+
+                {
+                    std::unique_lock<std::mutex> l(lock);
+                    /* The next chunk to confirm always goes, so a window
+                     * smaller than a chunk still makes progress.
+                     */
+                    cv.wait(l, [&] {
+                        return error || offset == confirmed ||
+                               offset + length <= confirmed + window;
+                    });
+                    if (error)
+                    {
+                        return;
+                    }
+                }
+
+                struct ipmi_flash::NetChunkHdr header;
+                header.offset = offset;
+                header.length = length;
+                sendAll(connFd, &header, sizeof(header));
+
+                off_t position = offset;
+                std::uint32_t left = length;
+                while (left > 0)
+                {
+                    int bytesSent =
+                        sys->sendfile(connFd, inputFd, &position, left);
+                    if (bytesSent < 0)
+                    {
+                        // Not all input files support sendfile, fall back to
+                        // reading it if unsupported.
+                        if (errno != EINVAL)
+                        {
+                            CHECK_ERRNO(-1, "Sending data to BMC");
+                        }
+                        buffer.resize(left);
+                        bytesSent = CHECK_ERRNO(
+                            sys->pread(inputFd, buffer.data(), left, position),
+                            "Reading data for BMC");
+                        sendAll(connFd, buffer.data(), bytesSent);
+                        position += bytesSent;
+                    }
+                    if (bytesSent == 0)
+                    {
+                        throw std::system_error(EIO, std::generic_category(),
+                                                "Input file ended early");
+                    }
+                    left -= bytesSent;
+                }
+
+                std::lock_guard<std::mutex> l(lock);
+                sent[chunk] = true;
+                cv.notify_all();
+            }
+        }
+        catch (...)
+        {
+            fail(std::current_exception());
+        }
+    };
+
+    std::vector<std::thread> senders;
+    for (std::size_t stream = 0; stream < connFds.size(); stream++)
     {
-        progress->abort();
-        return false;
+        senders.emplace_back(sender, stream);
     }
 
-    progress->finish();
-    return true;
+    try
+    {
+        for (std::size_t chunk = 0; chunk < chunks; chunk++)
+        {
+            std::uint64_t offset = start + std::uint64_t{chunk} * blockSize;
+            std::uint32_t length =
+                std::min<std::uint64_t>(blockSize, fileSize - offset);
+
+            {
+                std::unique_lock<std::mutex> l(lock);
+                cv.wait(l, [&] { return error || sent[chunk]; });
+                if (error)
+                {
+                    break;
+                }
+            }
+
+            struct ipmi_flash::ExtChunkHdr confirm;
+            confirm.length = length;
+            std::vector<uint8_t> confirmBytes(sizeof(confirm));
+            std::memcpy(confirmBytes.data(), &confirm, sizeof(confirm));
+            /* This doesn't return anything on success. */
+            blob->writeBytes(session, offset, confirmBytes);
+            progress->updateProgress(length);
+
+            std::lock_guard<std::mutex> l(lock);
+            confirmed = offset + length;
+            cv.notify_all();
+        }
+    }
+    catch (...)
+    {
+        fail(std::current_exception());
+    }
+
+    for (auto& thread : senders)
+    {
+        thread.join();
+    }
+
+    if (error)
+    {
+        std::rethrow_exception(error);
+    }
 }
 
 } // namespace host_tool
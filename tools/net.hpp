@@ -1,5 +1,6 @@
 #pragma once
 
+#include "data.hpp"
 #include "interface.hpp"
 #include "internal/sys.hpp"
 #include "progress.hpp"
@@ -10,7 +11,9 @@
 #include <stdplus/handle/managed.hpp>
 
 #include <cstdint>
+#include <optional>
 #include <string>
+#include <vector>
 
 namespace host_tool
 {
@@ -18,23 +21,62 @@ namespace host_tool
 class NetDataHandler : public DataInterface
 {
   public:
+    /** How many bytes may be sent ahead of their IPMI confirmation. */
+    static constexpr std::size_t defaultWindowSize = 1024 * 1024;
+
+    /**
+     * @param[in] streams - connections to stripe the transfer across, if the
+     *     BMC supports it
+     * @param[in] sendBuffer - SO_SNDBUF for each connection, 0 for the default
+     */
     NetDataHandler(ipmiblob::BlobInterface* blob, ProgressInterface* progress,
                    const std::string& host, const std::string& port,
-                   const internal::Sys* sys = &internal::sys_impl) :
-        blob(blob), progress(progress), host(host), port(port), sys(sys) {};
+                   const internal::Sys* sys = &internal::sys_impl,
+                   std::size_t windowSize = defaultWindowSize,
+                   std::uint32_t streams = 1, int sendBuffer = 0) :
+        blob(blob), progress(progress), host(host), port(port), sys(sys),
+        windowSize(windowSize), streams(streams), sendBuffer(sendBuffer) {};
 
-    bool sendContents(const std::string& input, std::uint16_t session) override;
+    bool sendContentsFrom(const std::string& input, std::uint16_t session,
+                          std::uint32_t start) override;
     ipmi_flash::FirmwareFlags::UpdateFlags supportedType() const override
     {
         return ipmi_flash::FirmwareFlags::UpdateFlags::net;
     }
 
   private:
+    /**
+     * Ask the BMC to accept more than one connection.
+     *
+     * @return the BMC's configuration, or std::nullopt to use one connection
+     */
+    std::optional<ipmi_flash::NetConfigResponse> negotiateStreams(
+        std::uint16_t session);
+
+    /** Connect to the BMC, returns the socket or -1. */
+    int connectToBmc();
+
+    /** Stream the file in order over a single connection, from start. */
+    void sendStream(int inputFd, int connFd, std::uint16_t session,
+                    std::uint32_t start);
+
+    /**
+     * Deal the file's chunks out across the connections, each sent with its
+     * offset, and confirm them in order as they complete.  The chunks start
+     * at start in the file.
+     */
+    void sendStriped(int inputFd, const std::vector<int>& connFds,
+                     std::int64_t fileSize, std::uint16_t session,
+                     std::size_t window, std::uint32_t start);
+
     ipmiblob::BlobInterface* blob;
     ProgressInterface* progress;
     std::string host;
     std::string port;
     const internal::Sys* sys;
+    std::size_t windowSize;
+    std::uint32_t streams;
+    int sendBuffer;
 };
 
 } // namespace host_tool
@@ -16,6 +16,7 @@
 
 #include "p2a.hpp"
 
+#include "crc32c.hpp"
 #include "data.hpp"
 #include "flags.hpp"
 #include "pci.hpp"
@@ -24,12 +25,19 @@
 #include <ipmiblob/blob_errors.hpp>
 #include <stdplus/handle/managed.hpp>
 
+#include <condition_variable>
 #include <cstdint>
+#include <cstdio>
 #include <cstring>
+#include <deque>
+#include <exception>
 #include <format>
 #include <memory>
+#include <mutex>
+#include <optional>
 #include <span>
 #include <string>
+#include <thread>
 
 namespace host_tool
 {
@@ -44,25 +52,110 @@ static void closeFd(int&& fd, const internal::Sys* const& sys)
 }
 using Fd = stdplus::Managed<int, const internal::Sys* const>::Handle<closeFd>;
 
+/* Handlers updating several BMCs at once find, enable and disable their
+ * bridges one at a time, the bus is shared.
+ */
+std::mutex bridgeLock;
+
 } // namespace
 
-bool P2aDataHandler::sendContents(const std::string& input,
-                                  std::uint16_t session)
+P2aDataHandler::~P2aDataHandler()
+{
+    /* Destroying the bridge disables it, unless that's skipped. */
+    std::lock_guard<std::mutex> l(bridgeLock);
+    bridge.reset();
+}
+
+bool P2aDataHandler::sendContentsFrom(const std::string& input,
+                                      std::uint16_t session,
+                                      std::uint32_t start)
 {
-    std::unique_ptr<PciBridgeIntf> bridge;
     ipmi_flash::PciConfigResponse pciResp;
     std::int64_t fileSize;
 
+    PciBridgeIntf* bridge = getBridge();
+
+    /* Read the configuration via blobs metadata (stat). */
+    ipmiblob::StatResponse stat = blob->getStat(session);
+    if (stat.metadata.size() != sizeof(ipmi_flash::PciConfigResponse))
+    {
+        throw ToolException("Didn't receive expected size of metadata for "
+                            "PCI Configuration response");
+    }
+
+    std::memcpy(&pciResp, stat.metadata.data(), sizeof(pciResp));
+    bridge->configure(pciResp);
+
+    /* A BMC that can fill in or check chunks says so in the session's state.
+     */
+    fillChunks =
+        stat.blob_state & ipmi_flash::FirmwareFlags::SessionFlags::fillChunks;
+    crcChunks = checkChunks &&
+                (stat.blob_state &
+                 ipmi_flash::FirmwareFlags::SessionFlags::checkChunks);
+    if (checkChunks && !crcChunks)
+    {
+        std::fprintf(stderr, "The BMC can't check chunks, sending them "
+                             "without their CRC\n");
+    }
+
+    /* For data blocks in 64kb, stage data, and send blob write command. */
+    Fd inputFd(sys->open(input.c_str(), 0), sys);
+    if (*inputFd < 0)
+    {
+        (void)inputFd.release();
+        throw internal::errnoException(
+            std::format("Error opening file '{}'", input));
+    }
+
+    if (start > 0 && sys->lseek(*inputFd, start, SEEK_SET) != start)
+    {
+        throw internal::errnoException(
+            std::format("Error seeking in file '{}'", input));
+    }
+
+    fileSize = sys->getSize(input.c_str());
+    progress->start(fileSize - start);
+
+    std::uint32_t slots = negotiateSlots(session, bridge->getDataLength());
+    if (slots > 1)
+    {
+        sendPipelined(bridge, *inputFd, session, slots, start);
+    }
+    else
+    {
+        sendSingleSlot(bridge, *inputFd, session, start);
+    }
+
+    progress->finish();
+    return true;
+}
+
+PciBridgeIntf* P2aDataHandler::getBridge()
+{
+    /* Probing walks the PCI bus and maps the BAR, so it's only done once, for
+     * the first file sent.  The bridge stays enabled for the image, the hash
+     * and any retries, until the handler is destroyed.
+     */
+    if (bridge)
+    {
+        return bridge.get();
+    }
+
+    std::lock_guard<std::mutex> l(bridgeLock);
+
     try
     {
-        bridge = std::make_unique<NuvotonPciBridge>(pci, skipBridgeDisable);
+        bridge = std::make_unique<NuvotonPciBridge>(pci, skipBridgeDisable,
+                                                    address);
     }
     catch (const NotFoundException& e)
     {}
 
     try
     {
-        bridge = std::make_unique<AspeedPciBridge>(pci, skipBridgeDisable);
+        bridge = std::make_unique<AspeedPciBridge>(pci, skipBridgeDisable,
+                                                   address);
     }
     catch (const NotFoundException& e)
     {}
@@ -72,59 +165,283 @@ bool P2aDataHandler::sendContents(const std::string& input,
         throw NotFoundException("supported PCI device");
     }
 
-    /* Read the configuration via blobs metadata (stat). */
-    ipmiblob::StatResponse stat = blob->getStat(session);
-    if (stat.metadata.size() != sizeof(ipmi_flash::PciConfigResponse))
+    return bridge.get();
+}
+
+std::uint32_t P2aDataHandler::negotiateSlots(std::uint16_t session,
+                                             std::size_t dataLength)
+{
+    if (windowSlots <= 1 || dataLength < windowSlots)
     {
-        throw ToolException("Didn't receive expected size of metadata for "
-                            "PCI Configuration response");
+        return 1;
     }
 
-    std::memcpy(&pciResp, stat.metadata.data(), sizeof(pciResp));
-    bridge->configure(pciResp);
+    ipmi_flash::PciConfigRequest request;
+    request.slots = windowSlots;
+    std::vector<std::uint8_t> requestBytes(sizeof(request));
+    std::memcpy(requestBytes.data(), &request, sizeof(request));
 
-    /* For data blocks in 64kb, stage data, and send blob write command. */
-    Fd inputFd(sys->open(input.c_str(), 0), sys);
-    if (*inputFd < 0)
+    try
     {
-        (void)inputFd.release();
-        throw internal::errnoException(
-            std::format("Error opening file '{}'", input));
+        blob->writeMeta(session, 0, requestBytes);
+    }
+    catch (const ipmiblob::BlobException& b)
+    {
+        /* Older BMCs reject the configuration, fall back to one slot. */
+        return 1;
     }
 
-    fileSize = sys->getSize(input.c_str());
-    progress->start(fileSize);
+    return windowSlots;
+}
 
+void P2aDataHandler::sendSingleSlot(PciBridgeIntf* bridge, int fd,
+                                    std::uint16_t session, std::uint32_t start)
+{
     std::vector<std::uint8_t> readBuffer(bridge->getDataLength());
 
     int bytesRead = 0;
-    std::uint32_t offset = 0;
+    std::uint32_t offset = start;
 
     do
     {
-        bytesRead = sys->read(*inputFd, readBuffer.data(), readBuffer.size());
+        bytesRead = sys->read(fd, readBuffer.data(), readBuffer.size());
         if (bytesRead > 0)
         {
-            bridge->write(
-                std::span<const std::uint8_t>(readBuffer.data(), bytesRead));
+            std::span<const std::uint8_t> data(readBuffer.data(), bytesRead);
+            auto fill = fillChunks ? uniformByte(data) : std::nullopt;
+            if (fill)
+            {
+                sendFill(session, offset, bytesRead, *fill);
+                offset += bytesRead;
+                progress->updateProgress(bytesRead);
+                continue;
+            }
+
+            bridge->write(data);
 
             /* Ok, so the data is staged, now send the blob write with the
              * details.
              */
-            struct ipmi_flash::ExtChunkHdr chunk;
-            chunk.length = bytesRead;
-            std::vector<std::uint8_t> chunkBytes(sizeof(chunk));
-            std::memcpy(chunkBytes.data(), &chunk, sizeof(chunk));
+            std::vector<std::uint8_t> chunkBytes;
+            if (crcChunks)
+            {
+                ipmi_flash::ExtChunkCrcHdr chunk;
+                chunk.length = bytesRead;
+                chunk.windowOffset = 0;
+                chunk.crc = ipmi_flash::crc32c(0, data);
+                chunkBytes.resize(sizeof(chunk));
+                std::memcpy(chunkBytes.data(), &chunk, sizeof(chunk));
+            }
+            else
+            {
+                struct ipmi_flash::ExtChunkHdr chunk;
+                chunk.length = bytesRead;
+                chunkBytes.resize(sizeof(chunk));
+                std::memcpy(chunkBytes.data(), &chunk, sizeof(chunk));
+            }
 
-            /* This doesn't return anything on success. */
-            blob->writeBytes(session, offset, chunkBytes);
+            sendChunk(bridge, session, offset, 0, data, chunkBytes);
             offset += bytesRead;
             progress->updateProgress(bytesRead);
         }
     } while (bytesRead > 0);
+}
 
-    progress->finish();
-    return true;
+void P2aDataHandler::sendPipelined(PciBridgeIntf* bridge, int fd,
+                                   std::uint16_t session, std::uint32_t slots,
+                                   std::uint32_t start)
+{
+    const std::size_t slotLength = bridge->getDataLength() / slots;
+
+    /* Slots are handed from the staging thread to this one in order, and back
+     * once the BMC has copied them out (the write command returned).
+     */
+    std::mutex lock;
+    std::condition_variable cv;
+    std::deque<std::uint32_t> freeSlots;
+    struct StagedChunk
+    {
+        ipmi_flash::ExtChunkCrcHdr header;
+        /* Set if the chunk is all this byte, and wasn't staged. */
+        std::optional<std::uint8_t> fill;
+    };
+    std::deque<StagedChunk> staged;
+    bool done = false;
+    bool abort = false;
+    std::exception_ptr stageError;
+
+    for (std::uint32_t i = 0; i < slots; i++)
+    {
+        freeSlots.push_back(i * slotLength);
+    }
+
+    /* Each slot's bytes are kept until it's free again, in case the BMC
+     * rejects the chunk and it has to be staged again.
+     */
+    std::vector<std::vector<std::uint8_t>> slotBuffers(
+        slots, std::vector<std::uint8_t>(slotLength));
+
+    std::thread stager([&]() {
+
+        try
+        {
+            while (true)
+            {
+                std::uint32_t windowOffset;
+                {
+                    std::unique_lock<std::mutex> l(lock);
+                    cv.wait(l, [&] { return abort || !freeSlots.empty(); });
+                    if (abort)
+                    {
+                        return;
+                    }
+                    windowOffset = freeSlots.front();
+                    freeSlots.pop_front();
+                }
+
+                auto& readBuffer = slotBuffers[windowOffset / slotLength];
+                int bytesRead =
+                    sys->read(fd, readBuffer.data(), readBuffer.size());
+                if (bytesRead < 0)
+                {
+                    throw internal::errnoException("Error reading file");
+                }
+                if (bytesRead == 0)
+                {
+                    break;
+                }
+
+                std::span<const std::uint8_t> data(readBuffer.data(),
+                                                   bytesRead);
+                auto fill = fillChunks ? uniformByte(data) : std::nullopt;
+                std::uint32_t crc = 0;
+                if (!fill)
+                {
+                    bridge->write(data, windowOffset);
+                    crc = crcChunks ? ipmi_flash::crc32c(0, data) : 0;
+                }
+
+                std::lock_guard<std::mutex> l(lock);
+                staged.push_back({{static_cast<std::uint32_t>(bytesRead),
+                                   windowOffset, crc},
+                                  fill});
+                cv.notify_all();
+            }
+        }
+        catch (...)
+        {
+            std::lock_guard<std::mutex> l(lock);
+            stageError = std::current_exception();
+        }
+
+        std::lock_guard<std::mutex> l(lock);
+        done = true;
+        cv.notify_all();
+    });
+
+    std::uint32_t offset = start;
+
+    try
+    {
+        while (true)
+        {
+            StagedChunk next;
+            {
+                std::unique_lock<std::mutex> l(lock);
+                cv.wait(l, [&] { return done || !staged.empty(); });
+                if (staged.empty())
+                {
+                    break;
+                }
+                next = staged.front();
+                staged.pop_front();
+            }
+            const auto& chunk = next.header;
+
+            if (next.fill)
+            {
+                sendFill(session, offset, chunk.length, *next.fill);
+            }
+            else
+            {
+                /* Without the check the CRC is left off the header. */
+                std::size_t headerSize =
+                    crcChunks ? sizeof(ipmi_flash::ExtChunkCrcHdr)
+                              : sizeof(ipmi_flash::ExtChunkWindowHdr);
+                std::vector<std::uint8_t> chunkBytes(headerSize);
+                std::memcpy(chunkBytes.data(), &chunk, headerSize);
+
+                sendChunk(
+                    bridge, session, offset, chunk.windowOffset,
+                    std::span<const std::uint8_t>(
+                        slotBuffers[chunk.windowOffset / slotLength].data(),
+                        chunk.length),
+                    chunkBytes);
+            }
+            offset += chunk.length;
+            progress->updateProgress(chunk.length);
+
+            std::lock_guard<std::mutex> l(lock);
+            freeSlots.push_back(chunk.windowOffset);
+            cv.notify_all();
+        }
+    }
+    catch (...)
+    {
+        {
+            std::lock_guard<std::mutex> l(lock);
+            abort = true;
+            cv.notify_all();
+        }
+        stager.join();
+        throw;
+    }
+
+    stager.join();
+    if (stageError)
+    {
+        std::rethrow_exception(stageError);
+    }
+}
+
+void P2aDataHandler::sendChunk(PciBridgeIntf* bridge, std::uint16_t session,
+                               std::uint32_t offset, std::uint32_t windowOffset,
+                               std::span<const std::uint8_t> data,
+                               const std::vector<std::uint8_t>& header)
+{
+    for (int attempt = 0;; attempt++)
+    {
+        try
+        {
+            /* This doesn't return anything on success. */
+            blob->writeBytes(session, offset, header);
+            return;
+        }
+        catch (const ipmiblob::BlobException& b)
+        {
+            if (!crcChunks || attempt == chunkRetries)
+            {
+                throw;
+            }
+            std::fprintf(stderr, "Chunk at %u rejected, sending it again\n",
+                         offset);
+        }
+
+        bridge->write(data, windowOffset);
+    }
+}
+
+void P2aDataHandler::sendFill(std::uint16_t session, std::uint32_t offset,
+                              std::uint32_t length, std::uint8_t value)
+{
+    ipmi_flash::ExtChunkFillHdr chunk;
+    chunk.length = length;
+    chunk.value = value;
+    std::vector<std::uint8_t> chunkBytes(sizeof(chunk));
+    std::memcpy(chunkBytes.data(), &chunk, sizeof(chunk));
+
+    /* Nothing was staged, so there's nothing to damage and send again. */
+    blob->writeBytes(session, offset, chunkBytes);
 }
 
 } // namespace host_tool
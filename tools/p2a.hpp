@@ -8,6 +8,9 @@
 #include <ipmiblob/blob_interface.hpp>
 
 #include <cstdint>
+#include <memory>
+#include <optional>
+#include <span>
 #include <vector>
 
 namespace host_tool
@@ -16,11 +19,20 @@ namespace host_tool
 class P2aDataHandler : public DataInterface
 {
   public:
+    /** The number of slots the shared window is split into by default, so the
+     * next chunk can be staged while the BMC copies out the current one.
+     */
+    static constexpr std::uint32_t defaultWindowSlots = 2;
+
     explicit P2aDataHandler(ipmiblob::BlobInterface* blob, const PciAccess* pci,
                             ProgressInterface* progress, bool skipBridgeDisable,
-                            const internal::Sys* sys = &internal::sys_impl) :
+                            const internal::Sys* sys = &internal::sys_impl,
+                            std::uint32_t windowSlots = defaultWindowSlots,
+                            bool checkChunks = false,
+                            std::optional<PciAddress> address = std::nullopt) :
         blob(blob), pci(pci), progress(progress),
-        skipBridgeDisable(skipBridgeDisable), sys(sys)
+        skipBridgeDisable(skipBridgeDisable), sys(sys),
+        windowSlots(windowSlots), checkChunks(checkChunks), address(address)
     {}
 
     P2aDataHandler(ipmiblob::BlobInterface* blob, const PciAccess* pci,
@@ -28,19 +40,78 @@ class P2aDataHandler : public DataInterface
                    const internal::Sys* sys = &internal::sys_impl) :
         P2aDataHandler(blob, pci, progress, false, sys)
     {}
+    ~P2aDataHandler() override;
 
-    bool sendContents(const std::string& input, std::uint16_t session) override;
+    bool sendContentsFrom(const std::string& input, std::uint16_t session,
+                          std::uint32_t start) override;
     ipmi_flash::FirmwareFlags::UpdateFlags supportedType() const override
     {
         return ipmi_flash::FirmwareFlags::UpdateFlags::p2a;
     }
 
   private:
+    /**
+     * Find and enable the PCI bridge, the first time it's needed.
+     *
+     * @return the bridge, kept until the handler is destroyed.
+     * @throws NotFoundException if there's no supported PCI device.
+     */
+    PciBridgeIntf* getBridge();
+
+    /**
+     * Ask the BMC to accept chunks staged at an offset within the window.
+     *
+     * @return the number of slots to use, 1 if the BMC only supports the
+     * legacy single chunk header.
+     */
+    std::uint32_t negotiateSlots(std::uint16_t session,
+                                 std::size_t dataLength);
+
+    /** Send the file one chunk at a time, always staged at the window start.
+     * The file is read from its current position, start in the image.
+     */
+    void sendSingleSlot(PciBridgeIntf* bridge, int fd, std::uint16_t session,
+                        std::uint32_t start);
+
+    /** Send the file while staging the next chunk(s) in a background thread.
+     * The file is read from its current position, start in the image.
+     */
+    void sendPipelined(PciBridgeIntf* bridge, int fd, std::uint16_t session,
+                       std::uint32_t slots, std::uint32_t start);
+
+    /** Send the write command for a chunk staged at windowOffset.  If it's
+     * checked and the BMC finds it damaged, it's staged and sent again.
+     *
+     * @param[in] header - the chunk header to send
+     */
+    void sendChunk(PciBridgeIntf* bridge, std::uint16_t session,
+                   std::uint32_t offset, std::uint32_t windowOffset,
+                   std::span<const std::uint8_t> data,
+                   const std::vector<std::uint8_t>& header);
+
+    /** Send the write command for a chunk that's all one byte value, in
+     * place of staging it.
+     */
+    void sendFill(std::uint16_t session, std::uint32_t offset,
+                  std::uint32_t length, std::uint8_t value);
+
     ipmiblob::BlobInterface* blob;
     const PciAccess* pci;
     ProgressInterface* progress;
     bool skipBridgeDisable;
     const internal::Sys* sys;
+    std::uint32_t windowSlots;
+    bool checkChunks;
+    /** The bridge to use, when there's more than one, or any if not set. */
+    std::optional<PciAddress> address;
+    /** Whether the BMC takes fills, from the session's state. */
+    bool fillChunks = false;
+    /** Whether chunks are sent with their CRC, if asked to and the BMC checks
+     * them.
+     */
+    bool crcChunks = false;
+    /** The bridge found by getBridge(), shared by every file sent. */
+    std::unique_ptr<PciBridgeIntf> bridge;
 };
 
 } // namespace host_tool
@@ -23,13 +23,16 @@ extern "C"
 #include <pciaccess.h>
 } // extern "C"
 
-#include "helper.hpp"
+#include "mmio.hpp"
 
 #include <stdplus/handle/managed.hpp>
 
+#include <cerrno>
+#include <cstdio>
 #include <cstring>
 #include <format>
 #include <span>
+#include <string>
 #include <system_error>
 
 namespace host_tool
@@ -49,15 +52,52 @@ using It = stdplus::Managed<struct pci_device_iterator*,
 
 } // namespace
 
+PciAddress parsePciAddress(const std::string& address)
+{
+    unsigned int domain = 0, bus, dev, func;
+    int consumed = 0;
+
+    if (std::sscanf(address.c_str(), "%x:%x:%x.%x%n", &domain, &bus, &dev,
+                    &func, &consumed) != 4 ||
+        consumed != static_cast<int>(address.size()))
+    {
+        domain = 0;
+        consumed = 0;
+        if (std::sscanf(address.c_str(), "%x:%x.%x%n", &bus, &dev, &func,
+                        &consumed) != 3 ||
+            consumed != static_cast<int>(address.size()))
+        {
+            throw ToolException("Invalid PCI address: " + address);
+        }
+    }
+
+    if (bus > 0xff || dev > 0x1f || func > 0x7)
+    {
+        throw ToolException("Invalid PCI address: " + address);
+    }
+
+    return {domain, static_cast<std::uint8_t>(bus),
+            static_cast<std::uint8_t>(dev), static_cast<std::uint8_t>(func)};
+}
+
 PciAccessBridge::PciAccessBridge(const struct pci_id_match* match, int bar,
                                  std::size_t dataOffset, std::size_t dataLength,
-                                 const PciAccess* pci) :
+                                 const PciAccess* pci, bool writeCombine,
+                                 const std::optional<PciAddress>& address) :
     dataOffset(dataOffset), dataLength(dataLength), pci(pci)
 {
     It it(pci->pci_id_match_iterator_create(match), pci);
 
     while ((dev = pci->pci_device_next(*it)))
     {
+        /* The bus address is known before probing, so other bridges are
+         * passed over without it.
+         */
+        if (address && !address->matches(*dev))
+        {
+            continue;
+        }
+
         int ret = pci->pci_device_probe(dev);
         if (ret)
         {
@@ -72,6 +112,13 @@ PciAccessBridge::PciAccessBridge(const struct pci_id_match* match, int bar,
 
     if (!dev)
     {
+        if (address)
+        {
+            throw NotFoundException(std::format(
+                "PCI device {:#04x}:{:#04x} at {:04x}:{:02x}:{:02x}.{:x}",
+                match->vendor_id, match->device_id, address->domain,
+                address->bus, address->dev, address->func));
+        }
         throw NotFoundException(std::format(
             "PCI device {:#04x}:{:#04x}", match->vendor_id, match->device_id));
     }
@@ -82,9 +129,26 @@ PciAccessBridge::PciAccessBridge(const struct pci_id_match* match, int bar,
                  static_cast<unsigned int>(dev->regions[bar].base_addr));
 
     size = dev->regions[bar].size;
-    int ret = pci->pci_device_map_range(
-        dev, dev->regions[bar].base_addr, dev->regions[bar].size,
-        PCI_DEV_MAP_FLAG_WRITABLE, reinterpret_cast<void**>(&addr));
+    int ret = EINVAL;
+    if (writeCombine)
+    {
+        ret = pci->pci_device_map_range(
+            dev, dev->regions[bar].base_addr, dev->regions[bar].size,
+            PCI_DEV_MAP_FLAG_WRITABLE | PCI_DEV_MAP_FLAG_WRITE_COMBINE,
+            reinterpret_cast<void**>(&addr));
+        if (ret)
+        {
+            std::fprintf(stderr,
+                         "Unable to map write-combining, falling back: %s\n",
+                         std::strerror(ret));
+        }
+    }
+    if (ret)
+    {
+        ret = pci->pci_device_map_range(
+            dev, dev->regions[bar].base_addr, dev->regions[bar].size,
+            PCI_DEV_MAP_FLAG_WRITABLE, reinterpret_cast<void**>(&addr));
+    }
     if (ret)
     {
         throw std::system_error(ret, std::generic_category(),
@@ -103,16 +167,18 @@ PciAccessBridge::~PciAccessBridge()
     }
 }
 
-void PciAccessBridge::write(const std::span<const std::uint8_t> data)
+void PciAccessBridge::write(const std::span<const std::uint8_t> data,
+                            std::size_t windowOffset)
 {
-    if (data.size() > dataLength)
+    if (windowOffset > dataLength || data.size() > dataLength - windowOffset)
     {
         throw ToolException(
-            std::format("Write of {} bytes exceeds maximum of {}", data.size(),
-                        dataLength));
+            std::format("Write of {} bytes at {} exceeds maximum of {}",
+                        data.size(), windowOffset, dataLength));
     }
 
-    memcpyAligned(addr + dataOffset, data.data(), data.size());
+    memcpyMmio(addr + dataOffset + windowOffset, data.data(), data.size());
+    mmioWriteBarrier();
 }
 
 void NuvotonPciBridge::enableBridge()
@@ -24,7 +24,10 @@
 
 #include <linux/pci_regs.h>
 
+#include <cstdint>
+#include <optional>
 #include <span>
+#include <string>
 
 // Some versions of the linux/pci_regs.h header don't define this
 #ifndef PCI_STD_NUM_BARS
@@ -34,12 +37,39 @@
 namespace host_tool
 {
 
+/** Where a PCI function is on the bus, to pick one of several bridges. */
+struct PciAddress
+{
+    std::uint32_t domain = 0;
+    std::uint8_t bus = 0;
+    std::uint8_t dev = 0;
+    std::uint8_t func = 0;
+
+    bool matches(const struct pci_device& device) const
+    {
+        return device.domain == domain && device.bus == bus &&
+               device.dev == dev && device.func == func;
+    }
+};
+
+/**
+ * Parse a PCI address in the [domain:]bus:device.function form lspci prints,
+ * all in hex.
+ *
+ * @throws ToolException if the address is malformed.
+ */
+PciAddress parsePciAddress(const std::string& address);
+
 class PciBridgeIntf
 {
   public:
     virtual ~PciBridgeIntf() = default;
 
-    virtual void write(const std::span<const std::uint8_t> data) = 0;
+    /**
+     * Stage data in the shared window, starting @a windowOffset bytes into it.
+     */
+    virtual void write(const std::span<const std::uint8_t> data,
+                       std::size_t windowOffset = 0) = 0;
     virtual void configure(const ipmi_flash::PciConfigResponse& config) = 0;
 
     virtual std::size_t getDataLength() = 0;
@@ -50,7 +80,8 @@ class PciAccessBridge : public PciBridgeIntf
   public:
     virtual ~PciAccessBridge();
 
-    virtual void write(const std::span<const std::uint8_t> data) override;
+    virtual void write(const std::span<const std::uint8_t> data,
+                       std::size_t windowOffset = 0) override;
     virtual void configure(const ipmi_flash::PciConfigResponse&) override {};
 
     std::size_t getDataLength() override
@@ -60,13 +91,15 @@ class PciAccessBridge : public PciBridgeIntf
 
   protected:
     /**
-     * Finds the PCI device matching @a match and saves a reference to it in @a
-     * dev. Also maps the memory region described in BAR number @a bar to
-     * address @a addr,
+     * Finds the PCI device matching @a match, at @a address if one is given,
+     * and saves a reference to it in @a dev. Also maps the memory region
+     * described in BAR number @a bar to address @a addr, write-combining if
+     * @a writeCombine is set and the platform supports it.
      */
     PciAccessBridge(const struct pci_id_match* match, int bar,
                     std::size_t dataOffset, std::size_t dataLength,
-                    const PciAccess* pci);
+                    const PciAccess* pci, bool writeCombine = false,
+                    const std::optional<PciAddress>& address = std::nullopt);
 
     struct pci_device* dev = nullptr;
     std::uint8_t* addr = nullptr;
@@ -83,9 +116,11 @@ class PciAccessBridge : public PciBridgeIntf
 class NuvotonPciBridge : public PciAccessBridge
 {
   public:
-    explicit NuvotonPciBridge(const PciAccess* pciAccess,
-                              bool skipBridgeDisable = false) :
-        PciAccessBridge(&match, bar, dataOffset, dataLength, pciAccess),
+    explicit NuvotonPciBridge(
+        const PciAccess* pciAccess, bool skipBridgeDisable = false,
+        const std::optional<PciAddress>& address = std::nullopt) :
+        PciAccessBridge(&match, bar, dataOffset, dataLength, pciAccess,
+                        writeCombine, address),
         skipBridgeDisable(skipBridgeDisable)
     {
         enableBridge();
@@ -109,6 +144,10 @@ class NuvotonPciBridge : public PciAccessBridge
 
     static constexpr std::size_t dataOffset = 0x0;
     static constexpr std::size_t dataLength = 0x4000;
+    /* The BAR only holds the data window, the bridge control is in config
+     * space, so the whole BAR can be mapped write-combining.
+     */
+    static constexpr bool writeCombine = true;
 
     void enableBridge();
     void disableBridge();
@@ -119,9 +158,11 @@ class NuvotonPciBridge : public PciAccessBridge
 class AspeedPciBridge : public PciAccessBridge
 {
   public:
-    explicit AspeedPciBridge(const PciAccess* pciAccess,
-                             bool skipBridgeDisable = false) :
-        PciAccessBridge(&match, bar, dataOffset, dataLength, pciAccess),
+    explicit AspeedPciBridge(
+        const PciAccess* pciAccess, bool skipBridgeDisable = false,
+        const std::optional<PciAddress>& address = std::nullopt) :
+        PciAccessBridge(&match, bar, dataOffset, dataLength, pciAccess,
+                        writeCombine, address),
         skipBridgeDisable(skipBridgeDisable)
     {
         enableBridge();
@@ -148,6 +189,10 @@ class AspeedPciBridge : public PciAccessBridge
 
     static constexpr std::size_t dataOffset = 0x10000;
     static constexpr std::size_t dataLength = 0x10000;
+    /* The control registers share the BAR with the data window, and must not
+     * have their writes combined or reordered.
+     */
+    static constexpr bool writeCombine = false;
 
     void enableBridge();
     void disableBridge();
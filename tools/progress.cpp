@@ -17,6 +17,8 @@
 #include "progress.hpp"
 
 #include <cstdio>
+#include <memory>
+#include <mutex>
 
 namespace host_tool
 {
@@ -43,4 +45,39 @@ void ProgressStdoutIndicator::finish() {}
 
 void ProgressStdoutIndicator::abort() {}
 
+ProgressMultiIndicator::ProgressMultiIndicator(std::size_t count)
+{
+    for (std::size_t i = 0; i < count; i++)
+    {
+        targets.push_back(std::make_unique<Target>(this));
+    }
+}
+
+void ProgressMultiIndicator::Target::updateProgress(std::int64_t bytes)
+{
+    std::lock_guard<std::mutex> l(parent->lock);
+    currentBytes += bytes;
+    parent->print();
+}
+
+void ProgressMultiIndicator::Target::start(std::int64_t bytes)
+{
+    std::lock_guard<std::mutex> l(parent->lock);
+    totalBytes = bytes;
+    currentBytes = 0;
+}
+
+void ProgressMultiIndicator::print()
+{
+    std::fprintf(stdout, "\rProgress:");
+    for (std::size_t i = 0; i < targets.size(); i++)
+    {
+        const auto& t = *targets[i];
+        std::fprintf(stdout, " [%zu] %6.2f%%", i,
+                     t.totalBytes ? 100.0 * t.currentBytes / t.totalBytes
+                                  : 0.0);
+    }
+    std::fflush(stdout);
+}
+
 } // namespace host_tool
@@ -1,6 +1,10 @@
 #pragma once
 
+#include <cstddef>
 #include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
 
 namespace host_tool
 {
@@ -39,4 +43,43 @@ class ProgressStdoutIndicator : public ProgressInterface
     std::int64_t currentBytes = 0;
 };
 
+/**
+ * @brief Progress of several updates sent at once, each on its own thread,
+ * written to the same stdout line.  Each update reports to its own target().
+ */
+class ProgressMultiIndicator
+{
+  public:
+    explicit ProgressMultiIndicator(std::size_t count);
+
+    ProgressInterface* target(std::size_t index)
+    {
+        return targets[index].get();
+    }
+
+  private:
+    class Target : public ProgressInterface
+    {
+      public:
+        explicit Target(ProgressMultiIndicator* parent) : parent(parent) {}
+
+        void updateProgress(std::int64_t bytes) override;
+        void start(std::int64_t bytes) override;
+        void finish() override {}
+        void abort() override {}
+
+        std::int64_t totalBytes = 0;
+        std::int64_t currentBytes = 0;
+
+      private:
+        ProgressMultiIndicator* parent;
+    };
+
+    /** Print every target's progress, with lock held. */
+    void print();
+
+    std::mutex lock;
+    std::vector<std::unique_ptr<Target>> targets;
+};
+
 } // namespace host_tool
@@ -21,6 +21,7 @@ class InternalSysMock : public Sys
     MOCK_METHOD(int, pread, (int, void*, std::size_t, off_t), (const override));
     MOCK_METHOD(int, pwrite, (int, const void*, std::size_t, off_t),
                 (const override));
+    MOCK_METHOD(off_t, lseek, (int, off_t, int), (const override));
     MOCK_METHOD(int, close, (int), (const override));
     MOCK_METHOD(void*, mmap, (void*, std::size_t, int, int, int, off_t),
                 (const override));
@@ -31,6 +32,9 @@ class InternalSysMock : public Sys
     MOCK_METHOD(int, socket, (int, int, int), (const override));
     MOCK_METHOD(int, connect, (int, const struct sockaddr*, socklen_t),
                 (const override));
+    MOCK_METHOD(int, shutdown, (int, int), (const override));
+    MOCK_METHOD(int, setsockopt, (int, int, int, const void*, socklen_t),
+                (const override));
     MOCK_METHOD(ssize_t, send, (int, const void*, size_t, int),
                 (const override));
     MOCK_METHOD(ssize_t, sendfile, (int, int, off_t*, size_t),
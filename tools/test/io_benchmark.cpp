@@ -0,0 +1,94 @@
+#include "internal/sys.hpp"
+#include "io.hpp"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+namespace host_tool
+{
+namespace
+{
+
+constexpr std::size_t windowSize = 64 * 1024;
+
+/* Stands in for /dev/mem with a temporary file, so the benchmark measures the
+ * syscall and mapping overhead around each chunk without needing root.
+ */
+class TmpMemSys : public internal::SysImpl
+{
+  public:
+    TmpMemSys()
+    {
+        char name[] = "/tmp/io_benchmark.XXXXXX";
+        int fd = ::mkstemp(name);
+        if (fd < 0 || ::ftruncate(fd, windowSize) < 0)
+        {
+            std::abort();
+        }
+        ::close(fd);
+        path = name;
+    }
+
+    ~TmpMemSys() override
+    {
+        ::unlink(path.c_str());
+    }
+
+    int open(const char*, int flags) const override
+    {
+        return internal::SysImpl::open(path.c_str(), flags);
+    }
+
+  private:
+    std::string path;
+};
+
+void BM_DevMemWrite(benchmark::State& state)
+{
+    const auto chunkSize = static_cast<std::size_t>(state.range(0));
+    const bool session = state.range(1);
+
+    TmpMemSys sys;
+    DevMemDevice devmem(&sys);
+    std::vector<std::uint8_t> chunk(chunkSize, 0x5a);
+
+    if (session && !devmem.start(0, windowSize))
+    {
+        state.SkipWithError("Unable to start the session");
+        return;
+    }
+
+    for (auto _ : state)
+    {
+        for (std::size_t offset = 0; offset < windowSize; offset += chunkSize)
+        {
+            if (!devmem.write(offset, chunkSize, chunk.data()))
+            {
+                state.SkipWithError("Write failed");
+                return;
+            }
+        }
+    }
+
+    devmem.finish();
+    state.SetItemsProcessed(static_cast<std::int64_t>(state.iterations()) *
+                            static_cast<std::int64_t>(windowSize / chunkSize));
+    state.SetBytesProcessed(static_cast<std::int64_t>(state.iterations()) *
+                            static_cast<std::int64_t>(windowSize));
+}
+
+BENCHMARK(BM_DevMemWrite)
+    ->ArgNames({"chunk", "session"})
+    ->ArgsProduct({{4096, 16384, 65536}, {0, 1}});
+
+} // namespace
+} // namespace host_tool
+
+BENCHMARK_MAIN();
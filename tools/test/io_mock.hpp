@@ -17,6 +17,9 @@ class HostIoInterfaceMock : public HostIoInterface
     MOCK_METHOD(bool, write,
                 (const std::size_t, const std::size_t, const void* const),
                 (override));
+    MOCK_METHOD(bool, start, (const std::size_t, const std::size_t),
+                (override));
+    MOCK_METHOD(void, finish, (), (override));
 };
 
 } // namespace host_tool
@@ -4,6 +4,7 @@
 #include <sys/mman.h>
 
 #include <memory>
+#include <string>
 
 #include <gmock/gmock.h>
 #include <gtest/gtest.h>
@@ -98,6 +99,82 @@ TEST_F(DevMemTest, CopiesIntoMmap)
     EXPECT_THAT(destination, Eq('a'));
 }
 
+TEST_F(DevMemTest, StartOpenFails)
+{
+    EXPECT_CALL(sys_mock, open(_, _)).WillOnce(Return(-1));
+
+    EXPECT_FALSE(devmem->start(/*offset*/ 0, /*length*/ 1));
+}
+
+TEST_F(DevMemTest, StartMmapFails)
+{
+    int fd = 1;
+    EXPECT_CALL(sys_mock, open(_, _)).WillOnce(Return(fd));
+    EXPECT_CALL(sys_mock, getpagesize()).WillOnce(Return(4096));
+    EXPECT_CALL(sys_mock, mmap(0, _, _, _, fd, _)).WillOnce(Return(MAP_FAILED));
+    EXPECT_CALL(sys_mock, close(fd));
+
+    EXPECT_FALSE(devmem->start(/*offset*/ 0, /*length*/ 1));
+}
+
+TEST_F(DevMemTest, SessionMapsOnceForAllWrites)
+{
+    int fd = 1;
+    char region[8] = {};
+    /* The mapping starts at the page boundary below the offset. */
+    const std::size_t offset = 4096 + 2;
+
+    EXPECT_CALL(sys_mock, open(_, _)).WillOnce(Return(fd));
+    EXPECT_CALL(sys_mock, getpagesize()).WillOnce(Return(4096));
+    EXPECT_CALL(sys_mock, mmap(0, 6 + 2, PROT_READ | PROT_WRITE, MAP_SHARED,
+                               fd, 4096))
+        .WillOnce(Return(&region));
+
+    EXPECT_TRUE(devmem->start(offset, /*length*/ 6));
+
+    char source[] = "abc";
+    EXPECT_TRUE(devmem->write(offset, 3, &source));
+    EXPECT_TRUE(devmem->write(offset + 3, 3, &source));
+    EXPECT_THAT(std::string(region + 2, 6), Eq("abcabc"));
+
+    char destination[3];
+    EXPECT_TRUE(devmem->read(offset + 1, 3, &destination));
+    EXPECT_THAT(std::string(destination, 3), Eq("bca"));
+
+    EXPECT_CALL(sys_mock, munmap(&region, 6 + 2));
+    EXPECT_CALL(sys_mock, close(fd));
+    devmem->finish();
+}
+
+TEST_F(DevMemTest, SessionWriteOutsideRegionMapsForWrite)
+{
+    int fd = 1;
+    int sessionFd = 2;
+    char region[8] = {};
+    char destination = 'b';
+
+    EXPECT_CALL(sys_mock, open(_, _))
+        .WillOnce(Return(sessionFd))
+        .WillOnce(Return(fd));
+    EXPECT_CALL(sys_mock, getpagesize()).WillRepeatedly(Return(4096));
+    EXPECT_CALL(sys_mock, mmap(0, _, _, _, sessionFd, _))
+        .WillOnce(Return(&region));
+    EXPECT_CALL(sys_mock, mmap(0, _, _, _, fd, _))
+        .WillOnce(Return(&destination));
+    EXPECT_CALL(sys_mock, munmap(&destination, _));
+    EXPECT_CALL(sys_mock, close(fd));
+
+    EXPECT_TRUE(devmem->start(/*offset*/ 0, /*length*/ sizeof(region)));
+
+    char source = 'a';
+    EXPECT_TRUE(devmem->write(/*offset*/ 4096, /*length*/ 1, &source));
+    EXPECT_THAT(destination, Eq('a'));
+
+    /* The destructor releases the session. */
+    EXPECT_CALL(sys_mock, munmap(&region, sizeof(region)));
+    EXPECT_CALL(sys_mock, close(sessionFd));
+}
+
 class PpcMemTest : public ::testing::Test
 {
   protected:
@@ -172,5 +249,24 @@ TEST_F(PpcMemTest, PwriteWorks)
     EXPECT_TRUE(devmem->write(/*offset*/ 0, /*length*/ 1, &source));
 }
 
+TEST_F(PpcMemTest, SessionKeepsPathOpen)
+{
+    int fd = 1;
+    EXPECT_CALL(sys_mock, open(StrEq(path), _)).WillOnce(Return(fd));
+    EXPECT_CALL(sys_mock, pwrite(fd, _, 1, 0)).WillOnce(Return(1));
+    EXPECT_CALL(sys_mock, pwrite(fd, _, 1, 1)).WillOnce(Return(1));
+    EXPECT_CALL(sys_mock, close(_)).Times(0);
+
+    EXPECT_TRUE(devmem->start(/*offset*/ 0, /*length*/ 2));
+
+    char source = 'a';
+    EXPECT_TRUE(devmem->write(/*offset*/ 0, /*length*/ 1, &source));
+    EXPECT_TRUE(devmem->write(/*offset*/ 1, /*length*/ 1, &source));
+
+    testing::Mock::VerifyAndClearExpectations(&sys_mock);
+    EXPECT_CALL(sys_mock, close(fd));
+    devmem->finish();
+}
+
 } // namespace
 } // namespace host_tool
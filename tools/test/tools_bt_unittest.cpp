@@ -73,6 +73,36 @@ TEST_F(BtHandlerTest, verifySendsFileContents)
     EXPECT_TRUE(handler->sendContents(filePath, session));
 }
 
+TEST_F(BtHandlerTest, verifyResumesFromOffset)
+{
+    /* The file is read from, and written to the image at, the offset. */
+    int fd = 1;
+    std::vector<std::uint8_t> bytes = {'1', '2', '3', '4'};
+    const int fakeFileSize = 100;
+    const std::uint32_t start = 96;
+
+    EXPECT_CALL(sysMock, open(Eq(filePath), _)).WillOnce(Return(fd));
+    EXPECT_CALL(sysMock, lseek(fd, start, SEEK_SET)).WillOnce(Return(start));
+    EXPECT_CALL(sysMock, getSize(Eq(filePath))).WillOnce(Return(fakeFileSize));
+
+    EXPECT_CALL(progMock, start(fakeFileSize - start));
+
+    EXPECT_CALL(sysMock, read(fd, NotNull(), _))
+        .WillOnce(Invoke([&](int, void* buf, std::size_t) {
+            std::memcpy(buf, bytes.data(), bytes.size());
+            return bytes.size();
+        }))
+        .WillOnce(Return(0));
+
+    EXPECT_CALL(progMock, updateProgress(bytes.size()));
+
+    EXPECT_CALL(sysMock, close(fd)).WillOnce(Return(0));
+
+    EXPECT_CALL(blobMock, writeBytes(session, start, ContainerEq(bytes)));
+
+    EXPECT_TRUE(handler->sendContentsFrom(filePath, session, start));
+}
+
 TEST_F(BtHandlerTest, sendContentsFailsToOpenFile)
 {
     /* If the file doesn't exist or the permissions are wrong, the sendContents
@@ -113,5 +143,81 @@ TEST_F(BtHandlerTest, sendContentsFailsWhenBlobHandlerThrows)
     EXPECT_FALSE(handler->sendContents(filePath, session));
 }
 
+TEST_F(BtHandlerTest, sendContentsRetriesSmallerPayloadOnFirstFailure)
+{
+    /* The first write is rejected, so the same bytes are resent in smaller
+     * writes, and the smaller size is kept.
+     */
+    int fd = 1;
+    const std::size_t largest = BtDataHandler::payloadLengths[0];
+    const std::size_t smaller = BtDataHandler::payloadLengths[1];
+    std::vector<std::uint8_t> bytes(largest);
+    for (std::size_t i = 0; i < bytes.size(); i++)
+    {
+        bytes[i] = i;
+    }
+
+    EXPECT_CALL(sysMock, open(Eq(filePath), _)).WillOnce(Return(fd));
+    EXPECT_CALL(sysMock, getSize(Eq(filePath))).WillOnce(Return(bytes.size()));
+
+    EXPECT_CALL(progMock, start(bytes.size()));
+
+    EXPECT_CALL(sysMock, read(fd, NotNull(), largest))
+        .WillOnce(Invoke([&](int, void* buf, std::size_t) {
+            std::memcpy(buf, bytes.data(), bytes.size());
+            return bytes.size();
+        }));
+    EXPECT_CALL(sysMock, read(fd, NotNull(), smaller)).WillOnce(Return(0));
+
+    std::vector<std::uint8_t> first(bytes.begin(), bytes.begin() + smaller);
+    std::vector<std::uint8_t> second(bytes.begin() + smaller, bytes.end());
+
+    EXPECT_CALL(blobMock, writeBytes(session, 0, ContainerEq(bytes)))
+        .WillOnce(Throw(ipmiblob::BlobException("too large")));
+    EXPECT_CALL(blobMock, writeBytes(session, 0, ContainerEq(first)));
+    EXPECT_CALL(blobMock, writeBytes(session, smaller, ContainerEq(second)));
+
+    EXPECT_CALL(progMock, updateProgress(first.size()));
+    EXPECT_CALL(progMock, updateProgress(second.size()));
+
+    EXPECT_CALL(sysMock, close(fd)).WillOnce(Return(0));
+
+    EXPECT_TRUE(handler->sendContents(filePath, session));
+}
+
+TEST_F(BtHandlerTest, sendContentsFailsWithoutRetryOnceWritesSucceeded)
+{
+    /* After a write has gone through at the current size, a failure isn't
+     * about the size, so it's not retried.
+     */
+    int fd = 1;
+    const std::size_t largest = BtDataHandler::payloadLengths[0];
+    std::vector<std::uint8_t> bytes(largest, 'a');
+
+    EXPECT_CALL(sysMock, open(Eq(filePath), _)).WillOnce(Return(fd));
+    EXPECT_CALL(sysMock, getSize(Eq(filePath)))
+        .WillOnce(Return(2 * bytes.size()));
+
+    EXPECT_CALL(progMock, start(2 * bytes.size()));
+
+    EXPECT_CALL(sysMock, read(fd, NotNull(), largest))
+        .Times(2)
+        .WillRepeatedly(Invoke([&](int, void* buf, std::size_t) {
+            std::memcpy(buf, bytes.data(), bytes.size());
+            return bytes.size();
+        }));
+
+    EXPECT_CALL(blobMock, writeBytes(session, 0, ContainerEq(bytes)));
+    EXPECT_CALL(blobMock, writeBytes(session, largest, ContainerEq(bytes)))
+        .WillOnce(Throw(ipmiblob::BlobException("failure")));
+
+    EXPECT_CALL(progMock, updateProgress(bytes.size()));
+    EXPECT_CALL(progMock, abort());
+
+    EXPECT_CALL(sysMock, close(fd)).WillOnce(Return(0));
+
+    EXPECT_FALSE(handler->sendContents(filePath, session));
+}
+
 } // namespace
 } // namespace host_tool
@@ -0,0 +1,73 @@
+#include "crc32c.hpp"
+
+#include <cstdint>
+#include <cstring>
+#include <span>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+namespace host_tool
+{
+namespace
+{
+
+/* Staging a chunk copies it into the window, checking it adds a CRC over the
+ * same bytes.  Comparing the two shows what --check-chunks costs the host,
+ * the BMC runs the same CRC over the chunk it borrows.  The copy here is to
+ * regular memory, which is far faster than writing a PCI or LPC window, so
+ * the CRC should be compared with the window's speed too.
+ */
+void BM_Copy(benchmark::State& state)
+{
+    const auto size = static_cast<std::size_t>(state.range(0));
+
+    std::vector<std::uint8_t> source(size, 0x5a);
+    std::vector<std::uint8_t> destination(size);
+
+    for (auto _ : state)
+    {
+        std::memcpy(destination.data(), source.data(), size);
+        benchmark::ClobberMemory();
+    }
+
+    state.SetBytesProcessed(static_cast<std::int64_t>(state.iterations()) *
+                            static_cast<std::int64_t>(size));
+}
+
+template <std::uint32_t (*Crc)(std::uint32_t, std::span<const std::uint8_t>)>
+void BM_CopyCrc(benchmark::State& state)
+{
+    const auto size = static_cast<std::size_t>(state.range(0));
+
+    std::vector<std::uint8_t> source(size, 0x5a);
+    std::vector<std::uint8_t> destination(size);
+
+    for (auto _ : state)
+    {
+        std::memcpy(destination.data(), source.data(), size);
+        benchmark::DoNotOptimize(Crc(0, source));
+        benchmark::ClobberMemory();
+    }
+
+    state.SetBytesProcessed(static_cast<std::int64_t>(state.iterations()) *
+                            static_cast<std::int64_t>(size));
+}
+
+void chunkSizes(benchmark::internal::Benchmark* b)
+{
+    for (std::int64_t size = 4 * 1024; size <= 1024 * 1024; size *= 4)
+    {
+        b->Arg(size);
+    }
+}
+
+BENCHMARK(BM_Copy)->Apply(chunkSizes);
+BENCHMARK(BM_CopyCrc<ipmi_flash::crc32c>)->Apply(chunkSizes);
+BENCHMARK(BM_CopyCrc<ipmi_flash::internal::crc32cSoftware>)
+    ->Apply(chunkSizes);
+
+} // namespace
+} // namespace host_tool
+
+BENCHMARK_MAIN();
@@ -47,6 +47,62 @@ TEST_F(HelperTest, PollStatusReturnsAfterFailure)
     EXPECT_THROW(pollStatus(session, &blobMock), ToolException);
 }
 
+TEST_F(HelperTest, PollChainedStatusReturnsAfterUpdate)
+{
+    ipmiblob::StatResponse verifying = {};
+    verifying.metadata = {
+        static_cast<std::uint8_t>(ipmi_flash::ActionStatus::running), 0};
+    ipmiblob::StatResponse updating = {};
+    updating.metadata = {
+        static_cast<std::uint8_t>(ipmi_flash::ActionStatus::running), 1};
+    ipmiblob::StatResponse updated = {};
+    updated.metadata = {
+        static_cast<std::uint8_t>(ipmi_flash::ActionStatus::success), 1};
+
+    EXPECT_CALL(blobMock, getStat(TypedEq<std::uint16_t>(session)))
+        .WillOnce(Return(verifying))
+        .WillOnce(Return(updating))
+        .WillOnce(Return(updated));
+
+    EXPECT_TRUE(pollChainedStatus(session, &blobMock, false));
+}
+
+TEST_F(HelperTest, PollChainedStatusIgnoresUpdateStatus)
+{
+    ipmiblob::StatResponse updating = {};
+    updating.metadata = {
+        static_cast<std::uint8_t>(ipmi_flash::ActionStatus::running), 1};
+
+    EXPECT_CALL(blobMock, getStat(TypedEq<std::uint16_t>(session)))
+        .WillOnce(Return(updating));
+
+    EXPECT_TRUE(pollChainedStatus(session, &blobMock, true));
+}
+
+TEST_F(HelperTest, PollChainedStatusOnlyVerifiedByOlderBmc)
+{
+    ipmiblob::StatResponse verified = {};
+    verified.metadata.push_back(
+        static_cast<std::uint8_t>(ipmi_flash::ActionStatus::success));
+
+    EXPECT_CALL(blobMock, getStat(TypedEq<std::uint16_t>(session)))
+        .WillOnce(Return(verified));
+
+    EXPECT_FALSE(pollChainedStatus(session, &blobMock, false));
+}
+
+TEST_F(HelperTest, PollChainedStatusReturnsAfterFailure)
+{
+    ipmiblob::StatResponse failed = {};
+    failed.metadata = {
+        static_cast<std::uint8_t>(ipmi_flash::ActionStatus::failed), 1};
+
+    EXPECT_CALL(blobMock, getStat(TypedEq<std::uint16_t>(session)))
+        .WillOnce(Return(failed));
+
+    EXPECT_THROW(pollChainedStatus(session, &blobMock, false), ToolException);
+}
+
 TEST_F(HelperTest, PollReadReadyReturnsAfterSuccess)
 {
     ipmiblob::StatResponse blobResponse = {};
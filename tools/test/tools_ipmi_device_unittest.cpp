@@ -0,0 +1,155 @@
+#include "internal_sys_mock.hpp"
+#include "ipmi_device.hpp"
+
+#include <linux/ipmi.h>
+#include <sys/ioctl.h>
+
+#include <ipmiblob/ipmi_errors.hpp>
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+namespace host_tool
+{
+namespace
+{
+
+using ::testing::_;
+using ::testing::ElementsAre;
+using ::testing::Invoke;
+using ::testing::Return;
+using ::testing::StrEq;
+
+constexpr int fd = 7;
+
+TEST(IpmiDeviceTest, OpensTheChosenDevice)
+{
+    internal::InternalSysMock sysMock;
+    IpmiDeviceHandler handler(3, &sysMock);
+
+    EXPECT_CALL(sysMock, open(StrEq("/dev/ipmi3"), _)).WillOnce(Return(-1));
+    EXPECT_CALL(sysMock, open(StrEq("/dev/ipmi/3"), _)).WillOnce(Return(-1));
+    EXPECT_CALL(sysMock, open(StrEq("/dev/ipmidev/3"), _))
+        .WillOnce(Return(-1));
+
+    std::vector<std::uint8_t> request = {0x01};
+    EXPECT_THROW(handler.sendPacket(0x2e, 0x80, request),
+                 ipmiblob::IpmiException);
+}
+
+TEST(IpmiDeviceTest, ReturnsTheReplyWithoutItsCompletionCode)
+{
+    internal::InternalSysMock sysMock;
+    IpmiDeviceHandler handler(1, &sysMock);
+
+    EXPECT_CALL(sysMock, open(StrEq("/dev/ipmi1"), _)).WillOnce(Return(fd));
+    EXPECT_CALL(sysMock, ioctl(fd, IPMICTL_SEND_COMMAND, _))
+        .WillOnce(Invoke([](int, unsigned long, void* param) {
+            auto request = static_cast<struct ipmi_req*>(param);
+            EXPECT_EQ(request->msg.netfn, 0x2e);
+            EXPECT_EQ(request->msg.cmd, 0x80);
+            EXPECT_EQ(request->msg.data_len, 1);
+            EXPECT_EQ(request->msg.data[0], 0x01);
+            return 0;
+        }));
+    EXPECT_CALL(sysMock, poll(_, 1, IpmiDeviceHandler::replyTimeoutMs))
+        .WillOnce(Return(1));
+    EXPECT_CALL(sysMock, ioctl(fd, IPMICTL_RECEIVE_MSG_TRUNC, _))
+        .WillOnce(Invoke([](int, unsigned long, void* param) {
+            auto reply = static_cast<struct ipmi_recv*>(param);
+            const std::uint8_t data[] = {0x00, 0xcf, 0xc2};
+            std::memcpy(reply->msg.data, data, sizeof(data));
+            reply->msg.data_len = sizeof(data);
+            return 0;
+        }));
+    EXPECT_CALL(sysMock, close(fd)).WillOnce(Return(0));
+
+    std::vector<std::uint8_t> request = {0x01};
+    EXPECT_THAT(handler.sendPacket(0x2e, 0x80, request),
+                ElementsAre(0xcf, 0xc2));
+}
+
+TEST(IpmiDeviceTest, ThrowsOnAFailedCompletionCode)
+{
+    internal::InternalSysMock sysMock;
+    IpmiDeviceHandler handler(0, &sysMock);
+
+    EXPECT_CALL(sysMock, open(StrEq("/dev/ipmi0"), _)).WillOnce(Return(fd));
+    EXPECT_CALL(sysMock, ioctl(fd, IPMICTL_SEND_COMMAND, _))
+        .WillOnce(Return(0));
+    EXPECT_CALL(sysMock, poll(_, 1, _)).WillOnce(Return(1));
+    EXPECT_CALL(sysMock, ioctl(fd, IPMICTL_RECEIVE_MSG_TRUNC, _))
+        .WillOnce(Invoke([](int, unsigned long, void* param) {
+            auto reply = static_cast<struct ipmi_recv*>(param);
+            reply->msg.data[0] = 0xc1;
+            reply->msg.data_len = 1;
+            return 0;
+        }));
+    EXPECT_CALL(sysMock, close(fd)).WillOnce(Return(0));
+
+    std::vector<std::uint8_t> request;
+    EXPECT_THROW(handler.sendPacket(0x2e, 0x80, request),
+                 ipmiblob::IpmiException);
+}
+
+TEST(IpmiDeviceTest, ThrowsWhenTheReplyTimesOut)
+{
+    internal::InternalSysMock sysMock;
+    IpmiDeviceHandler handler(0, &sysMock);
+
+    EXPECT_CALL(sysMock, open(StrEq("/dev/ipmi0"), _)).WillOnce(Return(fd));
+    EXPECT_CALL(sysMock, ioctl(fd, IPMICTL_SEND_COMMAND, _))
+        .WillOnce(Return(0));
+    EXPECT_CALL(sysMock, poll(_, 1, _)).WillOnce(Return(0));
+    EXPECT_CALL(sysMock, close(fd)).WillOnce(Return(0));
+
+    std::vector<std::uint8_t> request;
+    EXPECT_THROW(handler.sendPacket(0x2e, 0x80, request),
+                 ipmiblob::IpmiException);
+}
+
+TEST(IpmiDeviceTest, PassesOverTheReplyToATimedOutRequest)
+{
+    internal::InternalSysMock sysMock;
+    IpmiDeviceHandler handler(0, &sysMock);
+
+    long sent = -1;
+    EXPECT_CALL(sysMock, open(StrEq("/dev/ipmi0"), _)).WillOnce(Return(fd));
+    EXPECT_CALL(sysMock, ioctl(fd, IPMICTL_SEND_COMMAND, _))
+        .Times(2)
+        .WillRepeatedly(Invoke([&](int, unsigned long, void* param) {
+            sent = static_cast<struct ipmi_req*>(param)->msgid;
+            return 0;
+        }));
+    EXPECT_CALL(sysMock, poll(_, 1, _))
+        .WillOnce(Return(0))
+        .WillRepeatedly(Return(1));
+
+    /* The first request's reply comes late, just before the second's. */
+    long replied = -1;
+    EXPECT_CALL(sysMock, ioctl(fd, IPMICTL_RECEIVE_MSG_TRUNC, _))
+        .Times(2)
+        .WillRepeatedly(Invoke([&](int, unsigned long, void* param) {
+            auto reply = static_cast<struct ipmi_recv*>(param);
+            reply->msgid = ++replied;
+            const std::uint8_t data[] = {0x00, static_cast<std::uint8_t>(
+                                                   0xa0 + replied)};
+            std::memcpy(reply->msg.data, data, sizeof(data));
+            reply->msg.data_len = sizeof(data);
+            return 0;
+        }));
+    EXPECT_CALL(sysMock, close(fd)).WillOnce(Return(0));
+
+    std::vector<std::uint8_t> request;
+    EXPECT_THROW(handler.sendPacket(0x2e, 0x80, request),
+                 ipmiblob::IpmiException);
+    EXPECT_THAT(handler.sendPacket(0x2e, 0x80, request), ElementsAre(0xa1));
+    EXPECT_EQ(1, sent);
+}
+
+} // namespace
+} // namespace host_tool
@@ -1,8 +1,12 @@
+#include "crc32c.hpp"
+#include "data.hpp"
+#include "flags.hpp"
 #include "internal_sys_mock.hpp"
 #include "io_mock.hpp"
 #include "lpc.hpp"
 #include "progress_mock.hpp"
 
+#include <ipmiblob/blob_errors.hpp>
 #include <ipmiblob/test/blob_interface_mock.hpp>
 
 #include <cstring>
@@ -61,6 +65,7 @@ TEST(LpcHandleTest, verifySendsFileContents)
         }))
         .WillOnce(Return(0));
 
+    EXPECT_CALL(ioMock, start(address, length)).WillOnce(Return(true));
     EXPECT_CALL(ioMock, write(_, data.size(), _))
         .WillOnce(Invoke([&data](const std::size_t, const std::size_t,
                                  const void* const source) {
@@ -69,6 +74,177 @@ TEST(LpcHandleTest, verifySendsFileContents)
         }));
 
     EXPECT_CALL(blobMock, writeBytes(session, 0, _));
+    EXPECT_CALL(ioMock, finish());
+
+    EXPECT_CALL(sysMock, close(fileDescriptor)).WillOnce(Return(0));
+
+    EXPECT_TRUE(handler.sendContents(filePath, session));
+}
+
+TEST(LpcHandleTest, verifyStagesRejectedChunkAgain)
+{
+    internal::InternalSysMock sysMock;
+    ipmiblob::BlobInterfaceMock blobMock;
+    HostIoInterfaceMock ioMock;
+    ProgressMock progMock;
+
+    const std::uint32_t address = 0xfedc1000;
+    const std::uint32_t length = 0x1000;
+
+    LpcDataHandler handler(&blobMock, &ioMock, address, length, &progMock,
+                           &sysMock, true);
+    std::uint16_t session = 0xbeef;
+    std::string filePath = "/asdf";
+    int fileDescriptor = 5;
+
+    std::vector<std::uint8_t> data = {0x01, 0x02, 0x03};
+
+    ipmi_flash::ExtChunkCrcHdr chunk;
+    chunk.length = data.size();
+    chunk.windowOffset = 0;
+    chunk.crc = ipmi_flash::crc32c(0, data);
+    std::vector<std::uint8_t> chunkBytes(sizeof(chunk));
+    std::memcpy(chunkBytes.data(), &chunk, sizeof(chunk));
+
+    ipmiblob::StatResponse stat = {};
+    stat.blob_state = ipmi_flash::FirmwareFlags::UpdateFlags::lpc;
+    stat.blob_state |= ipmi_flash::FirmwareFlags::SessionFlags::checkChunks;
+
+    EXPECT_CALL(blobMock, writeMeta(session, 0, _));
+    EXPECT_CALL(blobMock, getStat(session)).WillOnce(Return(stat));
+    EXPECT_CALL(sysMock, open(StrEq(filePath.c_str()), _))
+        .WillOnce(Return(fileDescriptor));
+    EXPECT_CALL(sysMock, getSize(StrEq(filePath.c_str())))
+        .WillOnce(Return(data.size()));
+    EXPECT_CALL(sysMock, read(_, NotNull(), Gt(data.size())))
+        .WillOnce(Invoke([&data](int, void* buf, std::size_t) {
+            std::memcpy(buf, data.data(), data.size());
+            return data.size();
+        }))
+        .WillOnce(Return(0));
+
+    EXPECT_CALL(ioMock, start(address, length)).WillOnce(Return(true));
+    EXPECT_CALL(ioMock, write(_, data.size(), _))
+        .Times(2)
+        .WillRepeatedly(Return(true));
+
+    /* The BMC finds the chunk damaged once. */
+    EXPECT_CALL(blobMock, writeBytes(session, 0, ContainerEq(chunkBytes)))
+        .WillOnce([](std::uint16_t, std::uint32_t,
+                     const std::vector<std::uint8_t>&) {
+            throw ipmiblob::BlobException("failed");
+        })
+        .WillOnce(Return());
+    EXPECT_CALL(ioMock, finish());
+
+    EXPECT_CALL(sysMock, close(fileDescriptor)).WillOnce(Return(0));
+
+    EXPECT_TRUE(handler.sendContents(filePath, session));
+}
+
+TEST(LpcHandleTest, verifySendsPlainChunksIfTheBmcCannotCheckThem)
+{
+    internal::InternalSysMock sysMock;
+    ipmiblob::BlobInterfaceMock blobMock;
+    HostIoInterfaceMock ioMock;
+    ProgressMock progMock;
+
+    const std::uint32_t address = 0xfedc1000;
+    const std::uint32_t length = 0x1000;
+
+    LpcDataHandler handler(&blobMock, &ioMock, address, length, &progMock,
+                           &sysMock, true);
+    std::uint16_t session = 0xbeef;
+    std::string filePath = "/asdf";
+    int fileDescriptor = 5;
+
+    std::vector<std::uint8_t> data = {0x01, 0x02, 0x03};
+
+    ipmi_flash::ExtChunkHdr chunk;
+    chunk.length = data.size();
+    std::vector<std::uint8_t> chunkBytes(sizeof(chunk));
+    std::memcpy(chunkBytes.data(), &chunk, sizeof(chunk));
+
+    /* An older BMC doesn't set checkChunks. */
+    ipmiblob::StatResponse stat = {};
+    stat.blob_state = ipmi_flash::FirmwareFlags::UpdateFlags::lpc;
+
+    EXPECT_CALL(blobMock, writeMeta(session, 0, _));
+    EXPECT_CALL(blobMock, getStat(session)).WillOnce(Return(stat));
+    EXPECT_CALL(sysMock, open(StrEq(filePath.c_str()), _))
+        .WillOnce(Return(fileDescriptor));
+    EXPECT_CALL(sysMock, getSize(StrEq(filePath.c_str())))
+        .WillOnce(Return(data.size()));
+    EXPECT_CALL(sysMock, read(_, NotNull(), Gt(data.size())))
+        .WillOnce(Invoke([&data](int, void* buf, std::size_t) {
+            std::memcpy(buf, data.data(), data.size());
+            return data.size();
+        }))
+        .WillOnce(Return(0));
+
+    EXPECT_CALL(ioMock, start(address, length)).WillOnce(Return(true));
+    EXPECT_CALL(ioMock, write(_, data.size(), _)).WillOnce(Return(true));
+    EXPECT_CALL(blobMock, writeBytes(session, 0, ContainerEq(chunkBytes)));
+    EXPECT_CALL(ioMock, finish());
+
+    EXPECT_CALL(sysMock, close(fileDescriptor)).WillOnce(Return(0));
+
+    EXPECT_TRUE(handler.sendContents(filePath, session));
+}
+
+TEST(LpcHandleTest, verifySendsFillForUniformChunk)
+{
+    internal::InternalSysMock sysMock;
+    ipmiblob::BlobInterfaceMock blobMock;
+    HostIoInterfaceMock ioMock;
+    ProgressMock progMock;
+
+    const std::uint32_t address = 0xfedc1000;
+    const std::uint32_t length = 0x1000;
+
+    LpcDataHandler handler(&blobMock, &ioMock, address, length, &progMock,
+                           &sysMock);
+    std::uint16_t session = 0xbeef;
+    std::string filePath = "/asdf";
+    int fileDescriptor = 5;
+
+    std::vector<std::uint8_t> erased(length, 0xff);
+    std::vector<std::uint8_t> data = {0x01, 0x02, 0x03};
+
+    ipmi_flash::ExtChunkFillHdr fill;
+    fill.length = erased.size();
+    fill.value = 0xff;
+    std::vector<std::uint8_t> fillBytes(sizeof(fill));
+    std::memcpy(fillBytes.data(), &fill, sizeof(fill));
+
+    ipmiblob::StatResponse stat = {};
+    stat.blob_state = ipmi_flash::FirmwareFlags::UpdateFlags::lpc;
+    stat.blob_state |= ipmi_flash::FirmwareFlags::SessionFlags::fillChunks;
+
+    EXPECT_CALL(blobMock, writeMeta(session, 0, _));
+    EXPECT_CALL(blobMock, getStat(session)).WillOnce(Return(stat));
+    EXPECT_CALL(sysMock, open(StrEq(filePath.c_str()), _))
+        .WillOnce(Return(fileDescriptor));
+    EXPECT_CALL(sysMock, getSize(StrEq(filePath.c_str())))
+        .WillOnce(Return(erased.size() + data.size()));
+    EXPECT_CALL(sysMock, read(_, NotNull(), length))
+        .WillOnce(Invoke([&erased](int, void* buf, std::size_t) {
+            std::memcpy(buf, erased.data(), erased.size());
+            return erased.size();
+        }))
+        .WillOnce(Invoke([&data](int, void* buf, std::size_t) {
+            std::memcpy(buf, data.data(), data.size());
+            return data.size();
+        }))
+        .WillOnce(Return(0));
+
+    /* Only the chunk that isn't uniform is staged. */
+    EXPECT_CALL(ioMock, start(address, length)).WillOnce(Return(true));
+    EXPECT_CALL(ioMock, write(_, data.size(), _)).WillOnce(Return(true));
+
+    EXPECT_CALL(blobMock, writeBytes(session, 0, ContainerEq(fillBytes)));
+    EXPECT_CALL(blobMock, writeBytes(session, erased.size(), _));
+    EXPECT_CALL(ioMock, finish());
 
     EXPECT_CALL(sysMock, close(fileDescriptor)).WillOnce(Return(0));
 
@@ -0,0 +1,53 @@
+#include "mmio.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+namespace host_tool
+{
+namespace
+{
+
+class MmioCopyTest :
+    public ::testing::TestWithParam<std::tuple<std::size_t, std::size_t>>
+{};
+
+/* Copy at every alignment around the vector block size, and verify nothing
+ * outside of the destination range is touched.
+ */
+TEST_P(MmioCopyTest, CopiesExactRange)
+{
+    auto [size, misalign] = GetParam();
+    static constexpr std::uint8_t guard = 0xa5;
+
+    std::vector<std::uint8_t> source(size + misalign);
+    std::generate(source.begin(), source.end(), std::rand);
+    std::vector<std::uint8_t> destination(size + 2 * 64, guard);
+
+    /* Misalign the source differently from the destination. */
+    const std::uint8_t* src = source.data() + (misalign ? misalign - 1 : 0);
+    std::uint8_t* dest = destination.data() + 64 + misalign;
+
+    EXPECT_EQ(dest, memcpyMmio(dest, src, size));
+    mmioWriteBarrier();
+
+    EXPECT_TRUE(std::equal(src, src + size, dest));
+    EXPECT_TRUE(std::all_of(destination.data(), dest,
+                            [](std::uint8_t b) { return b == guard; }));
+    EXPECT_TRUE(std::all_of(dest + size,
+                            destination.data() + destination.size(),
+                            [](std::uint8_t b) { return b == guard; }));
+}
+
+INSTANTIATE_TEST_SUITE_P(
+    Sizes, MmioCopyTest,
+    ::testing::Combine(::testing::Values(0, 1, 3, 7, 8, 15, 31, 32, 33, 64,
+                                         100, 4096, 4099),
+                       ::testing::Values(0, 1, 2, 4, 7, 8, 16, 31)));
+
+} // namespace
+} // namespace host_tool
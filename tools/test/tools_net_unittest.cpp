@@ -3,6 +3,7 @@
 #include "net.hpp"
 #include "progress_mock.hpp"
 
+#include <ipmiblob/blob_errors.hpp>
 #include <ipmiblob/test/blob_interface_mock.hpp>
 
 #include <cstring>
@@ -28,8 +29,11 @@ using ::testing::NotNull;
 using ::testing::Pointee;
 using ::testing::Return;
 using ::testing::SetArgPointee;
+using ::testing::Sequence;
 using ::testing::SetErrnoAndReturn;
 using ::testing::StrEq;
+using ::testing::Throw;
+using ::testing::TypedEq;
 
 class NetHandleTest : public ::testing::Test
 {
@@ -194,6 +198,47 @@ TEST_F(NetHandleTest, successMultiChunk)
     std::vector<std::uint8_t> chunkBytes(sizeof(chunk));
     std::memcpy(chunkBytes.data(), &chunk, sizeof(chunk));
 
+    /* The data is sent ahead of the confirmations, each is in order. */
+    Sequence sends, confirms;
+
+    for (std::uint32_t offset = 0; offset < fakeFileSize; offset += chunkSize)
+    {
+        EXPECT_CALL(sysMock,
+                    sendfile(connFd, inFd, Pointee(offset), Gt(chunkSize)))
+            .InSequence(sends)
+            .WillOnce(
+                DoAll(SetArgPointee<2>(offset + chunkSize), Return(chunkSize)));
+
+        EXPECT_CALL(blobMock,
+                    writeBytes(session, offset, ContainerEq(chunkBytes)))
+            .InSequence(confirms);
+        EXPECT_CALL(progMock, updateProgress(chunkSize)).InSequence(confirms);
+    }
+    EXPECT_CALL(sysMock,
+                sendfile(connFd, inFd, Pointee(fakeFileSize), Gt(chunkSize)))
+        .InSequence(sends)
+        .WillOnce(Return(0));
+
+    EXPECT_TRUE(handler.sendContents(filePath, session));
+}
+
+TEST_F(NetHandleTest, successMultiChunkWindowOfOneChunk)
+{
+    /* With a window of one chunk, each chunk is confirmed before the next one
+     * is sent.
+     */
+    NetDataHandler lockstep(&blobMock, &progMock, host, port, &sysMock,
+                            chunkSize);
+
+    expectOpenFile();
+    expectAddrInfo();
+    expectConnection();
+
+    struct ipmi_flash::ExtChunkHdr chunk;
+    chunk.length = chunkSize;
+    std::vector<std::uint8_t> chunkBytes(sizeof(chunk));
+    std::memcpy(chunkBytes.data(), &chunk, sizeof(chunk));
+
     {
         InSequence seq;
 
@@ -214,7 +259,31 @@ TEST_F(NetHandleTest, successMultiChunk)
             .WillOnce(Return(0));
     }
 
-    EXPECT_TRUE(handler.sendContents(filePath, session));
+    EXPECT_TRUE(lockstep.sendContents(filePath, session));
+}
+
+TEST_F(NetHandleTest, confirmFailShutsDownConnection)
+{
+    expectOpenFile();
+    expectAddrInfo();
+    expectConnection();
+
+    EXPECT_CALL(sysMock, sendfile(connFd, inFd, NotNull(), _))
+        .WillRepeatedly([](int, int, off_t* offset, size_t) {
+            if (*offset >= static_cast<off_t>(fakeFileSize))
+            {
+                return 0;
+            }
+            *offset += chunkSize;
+            return static_cast<int>(chunkSize);
+        });
+
+    EXPECT_CALL(blobMock, writeBytes(session, 0, _))
+        .WillOnce(Throw(ipmiblob::BlobException("failure")));
+    EXPECT_CALL(sysMock, shutdown(connFd, SHUT_RDWR)).WillOnce(Return(0));
+    EXPECT_CALL(progMock, abort());
+
+    EXPECT_FALSE(handler.sendContents(filePath, session));
 }
 
 TEST_F(NetHandleTest, successFallback)
@@ -229,8 +298,9 @@ TEST_F(NetHandleTest, successFallback)
     std::memcpy(chunkBytes.data(), &chunk, sizeof(chunk));
 
     {
-        InSequence seq;
+        Sequence sends, confirms;
         EXPECT_CALL(sysMock, sendfile(connFd, inFd, _, _))
+            .InSequence(sends)
             .WillOnce([](int, int, off_t*, size_t) {
                 errno = EINVAL;
                 return -1;
@@ -245,11 +315,13 @@ TEST_F(NetHandleTest, successFallback)
                 chunk[i] = i + offset;
             }
             EXPECT_CALL(sysMock, read(inFd, _, Ge(chunkSize)))
+                .InSequence(sends)
                 .WillOnce([chunk](int, void* buf, size_t) {
                     memcpy(buf, chunk.data(), chunkSize);
                     return chunkSize;
                 });
             EXPECT_CALL(sysMock, send(connFd, _, chunkSize, 0))
+                .InSequence(sends)
                 .WillOnce([chunk](int, const void* data, size_t len, int) {
                     std::vector<uint8_t> dcopy(len);
                     memcpy(dcopy.data(), data, len);
@@ -257,15 +329,255 @@ TEST_F(NetHandleTest, successFallback)
                     return chunkSize;
                 });
             EXPECT_CALL(blobMock,
-                        writeBytes(session, offset, ContainerEq(chunkBytes)));
-            EXPECT_CALL(progMock, updateProgress(chunkSize));
+                        writeBytes(session, offset, ContainerEq(chunkBytes)))
+                .InSequence(confirms);
+            EXPECT_CALL(progMock, updateProgress(chunkSize))
+                .InSequence(confirms);
         }
-        EXPECT_CALL(sysMock, read(inFd, _, Ge(chunkSize))).WillOnce(Return(0));
-        EXPECT_CALL(sysMock, send(connFd, _, 0, 0)).WillOnce(Return(0));
+        EXPECT_CALL(sysMock, read(inFd, _, Ge(chunkSize)))
+            .InSequence(sends)
+            .WillOnce(Return(0));
+        EXPECT_CALL(sysMock, send(connFd, _, 0, 0))
+            .InSequence(sends)
+            .WillOnce(Return(0));
     }
 
     EXPECT_TRUE(handler.sendContents(filePath, session));
 }
 
+class NetStripedTest : public NetHandleTest
+{
+  protected:
+    static constexpr std::uint32_t streams = 2;
+    static constexpr int connFd2 = 8;
+    static constexpr std::uint32_t blockSize = 64 * 1024;
+    /* Three chunks, the last one short, over two connections. */
+    static constexpr std::uint32_t stripedFileSize = 2 * blockSize + 100;
+
+    NetStripedTest() :
+        striped(&blobMock, &progMock, host, port, &sysMock,
+                NetDataHandler::defaultWindowSize, streams)
+    {}
+
+    void expectOpenStripedFile()
+    {
+        EXPECT_CALL(sysMock, open(StrEq(filePath.c_str()), _))
+            .WillOnce(Return(inFd));
+        EXPECT_CALL(sysMock, close(inFd)).WillOnce(Return(0));
+        EXPECT_CALL(sysMock, getSize(StrEq(filePath.c_str())))
+            .WillOnce(Return(stripedFileSize));
+    }
+
+    void expectNegotiation(const std::vector<std::uint8_t>& metadata)
+    {
+        ipmi_flash::NetConfigRequest request;
+        request.streams = streams;
+        std::vector<std::uint8_t> requestBytes(sizeof(request));
+        std::memcpy(requestBytes.data(), &request, sizeof(request));
+
+        ipmiblob::StatResponse stat = {};
+        stat.metadata = metadata;
+
+        EXPECT_CALL(blobMock, writeMeta(session, 0, ContainerEq(requestBytes)));
+        EXPECT_CALL(blobMock, getStat(TypedEq<std::uint16_t>(session)))
+            .WillOnce(Return(stat));
+    }
+
+    std::vector<std::uint8_t> configResponse(std::uint32_t window)
+    {
+        ipmi_flash::NetConfigResponse response;
+        response.streams = streams;
+        response.window = window;
+        std::vector<std::uint8_t> bytes(sizeof(response));
+        std::memcpy(bytes.data(), &response, sizeof(response));
+        return bytes;
+    }
+
+    void expectConnections()
+    {
+        EXPECT_CALL(
+            sysMock,
+            getaddrinfo(StrEq(host), StrEq(port),
+                        AllOf(Field(&addrinfo::ai_flags, AI_NUMERICHOST),
+                              Field(&addrinfo::ai_family, AF_UNSPEC),
+                              Field(&addrinfo::ai_socktype, SOCK_STREAM)),
+                        NotNull()))
+            .Times(2)
+            .WillRepeatedly(DoAll(SetArgPointee<3>(&addr), Return(0)));
+        EXPECT_CALL(sysMock, freeaddrinfo(&addr)).Times(2);
+
+        EXPECT_CALL(sysMock, socket(AF_INET6, SOCK_STREAM, 0))
+            .WillOnce(Return(connFd))
+            .WillOnce(Return(connFd2));
+        EXPECT_CALL(sysMock, close(connFd)).WillOnce(Return(0));
+        EXPECT_CALL(sysMock, close(connFd2)).WillOnce(Return(0));
+        EXPECT_CALL(sysMock,
+                    connect(_, reinterpret_cast<struct sockaddr*>(&sa),
+                            sizeof(sa)))
+            .Times(2)
+            .WillRepeatedly(Return(0));
+    }
+
+    /** Expect the chunk at offset on fd, sent in sequence on that fd. */
+    void expectChunk(int fd, Sequence& seq, std::uint32_t offset,
+                     std::uint32_t length)
+    {
+        EXPECT_CALL(sysMock, send(fd, NotNull(),
+                                  sizeof(ipmi_flash::NetChunkHdr), 0))
+            .InSequence(seq)
+            .WillOnce([offset, length](int, const void* data, size_t len,
+                                       int) {
+                ipmi_flash::NetChunkHdr header;
+                std::memcpy(&header, data, sizeof(header));
+                EXPECT_EQ(offset, header.offset);
+                EXPECT_EQ(length, header.length);
+                return len;
+            });
+        EXPECT_CALL(sysMock, sendfile(fd, inFd, Pointee(offset), length))
+            .InSequence(seq)
+            .WillOnce(DoAll(SetArgPointee<2>(offset + length), Return(length)));
+    }
+
+    void expectConfirm(Sequence& seq, std::uint32_t offset,
+                       std::uint32_t length)
+    {
+        struct ipmi_flash::ExtChunkHdr chunk;
+        chunk.length = length;
+        std::vector<std::uint8_t> chunkBytes(sizeof(chunk));
+        std::memcpy(chunkBytes.data(), &chunk, sizeof(chunk));
+
+        EXPECT_CALL(blobMock,
+                    writeBytes(session, offset, ContainerEq(chunkBytes)))
+            .InSequence(seq);
+        EXPECT_CALL(progMock, updateProgress(length)).InSequence(seq);
+    }
+
+    NetDataHandler striped;
+};
+
+TEST_F(NetStripedTest, oldBmcUsesOneConnection)
+{
+    /* A BMC that doesn't report a configuration gets the plain stream. */
+    expectOpenStripedFile();
+    expectNegotiation({});
+    expectAddrInfo();
+    expectConnection();
+
+    {
+        InSequence seq;
+
+        EXPECT_CALL(sysMock, sendfile(connFd, inFd, Pointee(0), _))
+            .WillOnce(DoAll(SetArgPointee<2>(stripedFileSize),
+                            Return(stripedFileSize)));
+        EXPECT_CALL(sysMock,
+                    sendfile(connFd, inFd, Pointee(stripedFileSize), _))
+            .WillOnce(Return(0));
+    }
+
+    struct ipmi_flash::ExtChunkHdr chunk;
+    chunk.length = stripedFileSize;
+    std::vector<std::uint8_t> chunkBytes(sizeof(chunk));
+    std::memcpy(chunkBytes.data(), &chunk, sizeof(chunk));
+    EXPECT_CALL(blobMock, writeBytes(session, 0, ContainerEq(chunkBytes)));
+    EXPECT_CALL(progMock, updateProgress(stripedFileSize));
+
+    EXPECT_TRUE(striped.sendContents(filePath, session));
+}
+
+TEST_F(NetStripedTest, successStriped)
+{
+    /* Chunks alternate between the connections, each tagged with its
+     * offset, and are confirmed in order.
+     */
+    expectOpenStripedFile();
+    expectNegotiation(configResponse(1024 * 1024));
+    expectConnections();
+
+    Sequence first, second, confirms;
+    expectChunk(connFd, first, 0, blockSize);
+    expectChunk(connFd2, second, blockSize, blockSize);
+    expectChunk(connFd, first, 2 * blockSize, 100);
+    expectConfirm(confirms, 0, blockSize);
+    expectConfirm(confirms, blockSize, blockSize);
+    expectConfirm(confirms, 2 * blockSize, 100);
+
+    EXPECT_TRUE(striped.sendContents(filePath, session));
+}
+
+TEST_F(NetStripedTest, windowOfOneChunkWaitsForConfirmation)
+{
+    /* The BMC's window limits how far ahead the chunks go, whichever
+     * connection they're on.
+     */
+    expectOpenStripedFile();
+    expectNegotiation(configResponse(blockSize));
+    expectConnections();
+
+    Sequence seq;
+    expectChunk(connFd, seq, 0, blockSize);
+    expectConfirm(seq, 0, blockSize);
+    expectChunk(connFd2, seq, blockSize, blockSize);
+    expectConfirm(seq, blockSize, blockSize);
+    expectChunk(connFd, seq, 2 * blockSize, 100);
+    expectConfirm(seq, 2 * blockSize, 100);
+
+    EXPECT_TRUE(striped.sendContents(filePath, session));
+}
+
+TEST_F(NetStripedTest, confirmFailShutsDownConnections)
+{
+    expectOpenStripedFile();
+    expectNegotiation(configResponse(1024 * 1024));
+    expectConnections();
+
+    EXPECT_CALL(sysMock, send(_, NotNull(), sizeof(ipmi_flash::NetChunkHdr), 0))
+        .WillRepeatedly(
+            [](int, const void*, size_t len, int) { return len; });
+    EXPECT_CALL(sysMock, sendfile(_, inFd, NotNull(), _))
+        .WillRepeatedly([](int, int, off_t* offset, size_t count) {
+            *offset += count;
+            return static_cast<int>(count);
+        });
+
+    EXPECT_CALL(blobMock, writeBytes(session, 0, _))
+        .WillOnce(Throw(ipmiblob::BlobException("failure")));
+    EXPECT_CALL(sysMock, shutdown(connFd, SHUT_RDWR)).WillOnce(Return(0));
+    EXPECT_CALL(sysMock, shutdown(connFd2, SHUT_RDWR)).WillOnce(Return(0));
+    EXPECT_CALL(progMock, abort());
+
+    EXPECT_FALSE(striped.sendContents(filePath, session));
+}
+
+TEST_F(NetHandleTest, sendBufferIsSetBeforeConnecting)
+{
+    NetDataHandler buffered(&blobMock, &progMock, host, port, &sysMock,
+                            NetDataHandler::defaultWindowSize, 1, 65536);
+
+    expectOpenFile();
+    expectAddrInfo();
+
+    EXPECT_CALL(sysMock, socket(AF_INET6, SOCK_STREAM, 0))
+        .WillOnce(Return(connFd));
+    EXPECT_CALL(sysMock, close(connFd)).WillOnce(Return(0));
+    {
+        InSequence seq;
+
+        EXPECT_CALL(sysMock, setsockopt(connFd, SOL_SOCKET, SO_SNDBUF,
+                                        NotNull(), sizeof(int)))
+            .WillOnce([](int, int, int, const void* value, socklen_t) {
+                EXPECT_EQ(65536, *reinterpret_cast<const int*>(value));
+                return 0;
+            });
+        EXPECT_CALL(sysMock,
+                    connect(connFd, reinterpret_cast<struct sockaddr*>(&sa),
+                            sizeof(sa)))
+            .WillOnce(Return(0));
+        EXPECT_CALL(sysMock, sendfile(connFd, inFd, Pointee(0), _))
+            .WillOnce(Return(0));
+    }
+
+    EXPECT_TRUE(buffered.sendContents(filePath, session));
+}
+
 } // namespace
 } // namespace host_tool
@@ -23,6 +23,7 @@
 
 #include <algorithm>
 #include <cstdlib>
+#include <optional>
 #include <span>
 #include <string>
 #include <vector>
@@ -36,6 +37,7 @@ namespace
 
 using namespace std::string_literals;
 
+using ::testing::_;
 using ::testing::Assign;
 using ::testing::ContainerEq;
 using ::testing::DoAll;
@@ -71,8 +73,13 @@ class Device
     virtual const struct pci_id_match* getMatch() const = 0;
     virtual struct pci_device getDevice() const = 0;
     virtual void expectSetup(PciAccessMock&, const struct pci_device&) const {};
+    virtual unsigned getMapFlags() const
+    {
+        return PCI_DEV_MAP_FLAG_WRITABLE;
+    }
     virtual std::unique_ptr<PciBridgeIntf> getBridge(
-        PciAccess* pci, bool skipBridgeDisable = false) const = 0;
+        PciAccess* pci, bool skipBridgeDisable = false,
+        const std::optional<PciAddress>& address = std::nullopt) const = 0;
     virtual std::string getName() const = 0;
 };
 
@@ -121,10 +128,18 @@ class NuvotonDevice : public Device
             .WillOnce(Return(0));
     }
 
+    unsigned getMapFlags() const override
+    {
+        return PCI_DEV_MAP_FLAG_WRITABLE | PCI_DEV_MAP_FLAG_WRITE_COMBINE;
+    }
+
     std::unique_ptr<PciBridgeIntf> getBridge(
-        PciAccess* pci, bool skipBridgeDisable = false) const override
+        PciAccess* pci, bool skipBridgeDisable = false,
+        const std::optional<PciAddress>& address =
+            std::nullopt) const override
     {
-        return std::make_unique<NuvotonPciBridge>(pci, skipBridgeDisable);
+        return std::make_unique<NuvotonPciBridge>(pci, skipBridgeDisable,
+                                                  address);
     }
 
     std::string getName() const override
@@ -165,9 +180,12 @@ class AspeedDevice : public Device
     }
 
     std::unique_ptr<PciBridgeIntf> getBridge(
-        PciAccess* pci, bool skipBridgeDisable = false) const override
+        PciAccess* pci, bool skipBridgeDisable = false,
+        const std::optional<PciAddress>& address =
+            std::nullopt) const override
     {
-        return std::make_unique<AspeedPciBridge>(pci, skipBridgeDisable);
+        return std::make_unique<AspeedPciBridge>(pci, skipBridgeDisable,
+                                                 address);
     }
 
     std::string getName() const override
@@ -246,10 +264,10 @@ TEST_P(PciSetupTest, MapFail)
     EXPECT_CALL(pciMock, pci_device_probe(Eq(&dev)))
         .WillOnce(DoAll(Assign(&dev, GetParam()->getDevice()), Return(0)));
 
-    EXPECT_CALL(pciMock,
-                pci_device_map_range(Eq(&dev), mockBaseAddr, mockRegionSize,
-                                     PCI_DEV_MAP_FLAG_WRITABLE, NotNull()))
-        .WillOnce(Return(EFAULT));
+    /* Write-combining mappings fall back to a regular mapping. */
+    EXPECT_CALL(pciMock, pci_device_map_range(Eq(&dev), mockBaseAddr,
+                                              mockRegionSize, _, NotNull()))
+        .WillRepeatedly(Return(EFAULT));
 
     EXPECT_CALL(pciMock, pci_iterator_destroy(Eq(mockIter))).Times(1);
 
@@ -273,9 +291,10 @@ TEST_P(PciSetupTest, UnmapFail)
     EXPECT_CALL(pciMock, pci_device_probe(Eq(&dev)))
         .WillOnce(DoAll(Assign(&dev, GetParam()->getDevice()), Return(0)));
 
-    EXPECT_CALL(pciMock,
-                pci_device_map_range(Eq(&dev), mockBaseAddr, mockRegionSize,
-                                     PCI_DEV_MAP_FLAG_WRITABLE, NotNull()))
+    EXPECT_CALL(pciMock, pci_device_map_range(Eq(&dev), mockBaseAddr,
+                                              mockRegionSize,
+                                              GetParam()->getMapFlags(),
+                                              NotNull()))
         .WillOnce(DoAll(SetArgPointee<4>(region.data()), Return(0)));
 
     EXPECT_CALL(pciMock, pci_iterator_destroy(Eq(mockIter))).Times(1);
@@ -303,9 +322,9 @@ void expectSetup(PciAccessMock& pciMock, struct pci_device& dev, Device* param,
     EXPECT_CALL(pciMock, pci_device_probe(Eq(&dev)))
         .WillOnce(DoAll(Assign(&dev, param->getDevice()), Return(0)));
 
-    EXPECT_CALL(pciMock,
-                pci_device_map_range(Eq(&dev), mockBaseAddr, mockRegionSize,
-                                     PCI_DEV_MAP_FLAG_WRITABLE, NotNull()))
+    EXPECT_CALL(pciMock, pci_device_map_range(Eq(&dev), mockBaseAddr,
+                                              mockRegionSize,
+                                              param->getMapFlags(), NotNull()))
         .WillOnce(DoAll(SetArgPointee<4>(region), Return(0)));
 
     EXPECT_CALL(pciMock, pci_iterator_destroy(Eq(mockIter))).Times(1);
@@ -331,12 +350,93 @@ TEST_P(PciSetupTest, Success)
     GetParam()->getBridge(&pciMock);
 }
 
+/* Test choosing the device by its address */
+TEST_P(PciSetupTest, AddressMatches)
+{
+    PciAccessMock pciMock;
+    struct pci_device dev;
+    std::vector<std::uint8_t> region(mockRegionSize);
+
+    dev.domain = 0;
+    dev.bus = 0x3;
+    dev.dev = 0x0;
+    dev.func = 0x1;
+
+    expectSetup(pciMock, dev, GetParam(), region.data());
+
+    GetParam()->getBridge(&pciMock, false, PciAddress{0, 0x3, 0x0, 0x1});
+}
+
+/* Test passing over a device at another address, without probing it */
+TEST_P(PciSetupTest, OtherAddressNotFound)
+{
+    PciAccessMock pciMock;
+    struct pci_device dev;
+
+    dev.domain = 0;
+    dev.bus = 0x3;
+    dev.dev = 0x0;
+    dev.func = 0x1;
+
+    EXPECT_CALL(pciMock, pci_id_match_iterator_create(
+                             PciIdMatch(GetParam()->getMatch())))
+        .WillOnce(Return(mockIter));
+    EXPECT_CALL(pciMock, pci_device_next(Eq(mockIter)))
+        .WillOnce(Return(&dev))
+        .WillRepeatedly(Return(nullptr));
+    EXPECT_CALL(pciMock, pci_device_probe(_)).Times(0);
+    EXPECT_CALL(pciMock, pci_iterator_destroy(Eq(mockIter))).Times(1);
+
+    EXPECT_THROW(
+        GetParam()->getBridge(&pciMock, false, PciAddress{0, 0x4, 0x0, 0x1}),
+        NotFoundException);
+}
+
 INSTANTIATE_TEST_SUITE_P(Default, PciSetupTest,
                          ::testing::Values(&nuvotonDevice, &aspeedDevice),
                          [](const testing::TestParamInfo<Device*>& info) {
                              return info.param->getName();
                          });
 
+/* Test falling back to a regular mapping without write-combining support */
+TEST(NuvotonSetupTest, WriteCombineFallback)
+{
+    PciAccessMock pciMock;
+    struct pci_device dev;
+    std::vector<std::uint8_t> region(mockRegionSize);
+
+    EXPECT_CALL(pciMock, pci_id_match_iterator_create(
+                             PciIdMatch(nuvotonDevice.getMatch())))
+        .WillOnce(Return(mockIter));
+    EXPECT_CALL(pciMock, pci_device_next(Eq(mockIter)))
+        .WillOnce(Return(&dev))
+        .WillRepeatedly(Return(nullptr));
+
+    EXPECT_CALL(pciMock, pci_device_probe(Eq(&dev)))
+        .WillOnce(DoAll(Assign(&dev, nuvotonDevice.getDevice()), Return(0)));
+
+    EXPECT_CALL(pciMock, pci_device_map_range(
+                             Eq(&dev), mockBaseAddr, mockRegionSize,
+                             PCI_DEV_MAP_FLAG_WRITABLE |
+                                 PCI_DEV_MAP_FLAG_WRITE_COMBINE,
+                             NotNull()))
+        .WillOnce(Return(ENOSYS));
+    EXPECT_CALL(pciMock,
+                pci_device_map_range(Eq(&dev), mockBaseAddr, mockRegionSize,
+                                     PCI_DEV_MAP_FLAG_WRITABLE, NotNull()))
+        .WillOnce(DoAll(SetArgPointee<4>(region.data()), Return(0)));
+
+    EXPECT_CALL(pciMock, pci_iterator_destroy(Eq(mockIter))).Times(1);
+    EXPECT_CALL(pciMock, pci_device_unmap_range(Eq(&dev), Eq(region.data()),
+                                                mockRegionSize))
+        .WillOnce(Return(0));
+
+    EXPECT_CALL(pciMock, pci_device_enable(Eq(&dev))).Times(1);
+    nuvotonDevice.expectSetup(pciMock, dev);
+
+    nuvotonDevice.getBridge(&pciMock);
+}
+
 TEST(NuvotonWriteTest, TooLarge)
 {
     PciAccessMock pciMock;
@@ -609,6 +709,38 @@ TEST(AspeedWriteTest, Success)
                 SpanEq(std::span<uint8_t>(data)));
 }
 
+TEST(AspeedWriteTest, WindowOffsetTooLarge)
+{
+    PciAccessMock pciMock;
+    struct pci_device dev;
+    std::vector<std::uint8_t> region(mockRegionSize);
+    std::vector<std::uint8_t> data(0x8001);
+
+    expectSetup(pciMock, dev, &aspeedDevice, region.data());
+
+    std::unique_ptr<PciBridgeIntf> bridge = aspeedDevice.getBridge(&pciMock);
+    EXPECT_THROW(bridge->write(std::span<std::uint8_t>(data), 0x8000),
+                 ToolException);
+}
+
+TEST(AspeedWriteTest, WindowOffsetSuccess)
+{
+    PciAccessMock pciMock;
+    struct pci_device dev;
+    std::vector<std::uint8_t> region(mockRegionSize);
+    std::vector<std::uint8_t> data(0x8000);
+
+    std::generate(data.begin(), data.end(), std::rand);
+
+    expectSetup(pciMock, dev, &aspeedDevice, region.data());
+
+    std::unique_ptr<PciBridgeIntf> bridge = aspeedDevice.getBridge(&pciMock);
+    bridge->write(std::span<std::uint8_t>(data), 0x8000);
+
+    EXPECT_THAT(std::span<uint8_t>(&region[0x18000], data.size()),
+                SpanEq(std::span<uint8_t>(data)));
+}
+
 TEST(AspeedConfigureTest, Success)
 {
     PciAccessMock pciMock;
@@ -736,5 +868,29 @@ TEST(AspeedBridgeTest, NotEnabledSuccess)
     }
 }
 
+TEST(PciAddressTest, ParsesWithAndWithoutDomain)
+{
+    PciAddress address = parsePciAddress("0001:c3:1f.7");
+    EXPECT_EQ(address.domain, 0x1);
+    EXPECT_EQ(address.bus, 0xc3);
+    EXPECT_EQ(address.dev, 0x1f);
+    EXPECT_EQ(address.func, 0x7);
+
+    address = parsePciAddress("03:00.1");
+    EXPECT_EQ(address.domain, 0x0);
+    EXPECT_EQ(address.bus, 0x3);
+    EXPECT_EQ(address.dev, 0x0);
+    EXPECT_EQ(address.func, 0x1);
+}
+
+TEST(PciAddressTest, RejectsMalformed)
+{
+    EXPECT_THROW(parsePciAddress(""), ToolException);
+    EXPECT_THROW(parsePciAddress("03:00"), ToolException);
+    EXPECT_THROW(parsePciAddress("03:00.1x"), ToolException);
+    EXPECT_THROW(parsePciAddress("03:20.1"), ToolException);
+    EXPECT_THROW(parsePciAddress("03:00.8"), ToolException);
+}
+
 } // namespace
 } // namespace host_tool
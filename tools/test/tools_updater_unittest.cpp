@@ -1,3 +1,5 @@
+#include "crc32c.hpp"
+#include "data.hpp"
 #include "data_interface_mock.hpp"
 #include "flags.hpp"
 #include "status.hpp"
@@ -6,10 +8,16 @@
 #include "updater_mock.hpp"
 #include "util.hpp"
 
+#include <zstd.h>
+
 #include <blobs-ipmid/blobs.hpp>
 #include <ipmiblob/blob_errors.hpp>
 #include <ipmiblob/test/blob_interface_mock.hpp>
 
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <span>
 #include <string>
 #include <vector>
 
@@ -149,6 +157,373 @@ TEST_F(UpdateHandlerTest, SendFileHandlerPassWithRetries)
     updater.sendFile(ipmi_flash::staticLayoutBlobId, firmwareImage);
 }
 
+class UpdateHandlerStagedTest : public UpdateHandlerTest
+{
+  protected:
+    void SetUp() override
+    {
+        std::ofstream(image) << "abc";
+    }
+
+    void TearDown() override
+    {
+        (void)std::remove(image);
+    }
+
+    static constexpr char image[] = "staged.bin";
+
+    /* The sha256 of "abc", after the options and the StagedImageHdr of the
+     * stat metadata.
+     */
+    std::vector<std::uint8_t> abcSha256 = {
+        0x00, 0xf0, 0,    0,    0,    0,    0,    0,    0,    0,    0,
+        0,    0,    0,    0xba, 0x78, 0x16, 0xbf, 0x8f, 0x01, 0xcf, 0xea,
+        0x41, 0x41, 0x40, 0xde, 0x5d, 0xae, 0x22, 0x23, 0xb0, 0x03, 0x61,
+        0xa3, 0x96, 0x17, 0x7a, 0x9c, 0xb4, 0x10, 0xff, 0x61, 0xf2, 0x00,
+        0x15, 0xad};
+};
+
+TEST_F(UpdateHandlerStagedTest, CheckStagedMatchesSizeAndDigest)
+{
+    ipmiblob::StatResponse staged = {0xff00, 3, abcSha256};
+    EXPECT_CALL(blobMock, getStat(TypedEq<const std::string&>(
+                              ipmi_flash::staticLayoutBlobId)))
+        .WillOnce(Return(staged));
+
+    EXPECT_TRUE(updater.checkStaged(ipmi_flash::staticLayoutBlobId, image));
+}
+
+TEST_F(UpdateHandlerStagedTest, CheckStagedFailsOnDifferentImage)
+{
+    ipmiblob::StatResponse wrongSize = {0xff00, 4, abcSha256};
+    ipmiblob::StatResponse wrongDigest = {0xff00, 3, abcSha256};
+    wrongDigest.metadata.back() ^= 1;
+    /* What older BMCs return. */
+    ipmiblob::StatResponse nothing = {0xff00, 0, {}};
+    EXPECT_CALL(blobMock, getStat(TypedEq<const std::string&>(
+                              ipmi_flash::staticLayoutBlobId)))
+        .WillOnce(Return(wrongSize))
+        .WillOnce(Return(wrongDigest))
+        .WillOnce(Return(nothing));
+
+    EXPECT_FALSE(updater.checkStaged(ipmi_flash::staticLayoutBlobId, image));
+    EXPECT_FALSE(updater.checkStaged(ipmi_flash::staticLayoutBlobId, image));
+    EXPECT_FALSE(updater.checkStaged(ipmi_flash::staticLayoutBlobId, image));
+}
+
+TEST_F(UpdateHandlerStagedTest, ReuseStagedKeepsTheImage)
+{
+    std::uint16_t flags = ipmi_flash::FirmwareFlags::UpdateFlags::ipmi |
+                          ipmi_flash::FirmwareFlags::UpdateFlags::openWrite |
+                          ipmi_flash::FirmwareFlags::UpdateFlags::reuseStaged;
+    EXPECT_CALL(blobMock, openBlob(ipmi_flash::staticLayoutBlobId, flags))
+        .WillOnce(Return(session));
+    EXPECT_CALL(blobMock, closeBlob(session));
+    ipmiblob::StatResponse staged = {0xff00, 3, abcSha256};
+    EXPECT_CALL(blobMock, getStat(TypedEq<const std::string&>(
+                              ipmi_flash::staticLayoutBlobId)))
+        .WillOnce(Return(staged));
+
+    EXPECT_TRUE(updater.reuseStaged(ipmi_flash::staticLayoutBlobId, image));
+}
+
+TEST_F(UpdateHandlerStagedTest, ReuseStagedFailsIfTheBmcRefuses)
+{
+    EXPECT_CALL(blobMock, openBlob(ipmi_flash::staticLayoutBlobId, _))
+        .WillOnce(Throw(ipmiblob::BlobException("asdf")));
+
+    EXPECT_FALSE(updater.reuseStaged(ipmi_flash::staticLayoutBlobId, image));
+}
+
+class UpdateHandlerResumeTest : public UpdateHandlerTest
+{
+  protected:
+    void SetUp() override
+    {
+        contents.resize(checkpoint + 100);
+        for (std::size_t i = 0; i < contents.size(); i++)
+        {
+            contents[i] = static_cast<std::uint8_t>(i);
+        }
+        std::ofstream(image, std::ios::binary)
+            .write(reinterpret_cast<const char*>(contents.data()),
+                   contents.size());
+
+        EXPECT_CALL(handlerMock, supportedType())
+            .WillRepeatedly(
+                Return(ipmi_flash::FirmwareFlags::UpdateFlags::lpc));
+    }
+
+    void TearDown() override
+    {
+        (void)std::remove(image);
+    }
+
+    /* What the BMC describes after getting partway through the image. */
+    ipmiblob::StatResponse interrupted(std::uint32_t crc)
+    {
+        ipmi_flash::BlobOptionsHdr options = {
+            ipmi_flash::FirmwareFlags::UpdateFlags::resume};
+        ipmi_flash::StagedImageHdr header = {checkpoint + 50,
+                                             checkpoint, crc};
+        auto* bytes = reinterpret_cast<const std::uint8_t*>(&options);
+        std::vector<std::uint8_t> metadata(bytes, bytes + sizeof(options));
+        bytes = reinterpret_cast<const std::uint8_t*>(&header);
+        metadata.insert(metadata.end(), bytes, bytes + sizeof(header));
+        return {0xff00, checkpoint + 50, metadata};
+    }
+
+    std::uint32_t checkpointCrc()
+    {
+        return ipmi_flash::crc32c(
+            0, std::span(contents).first(checkpoint));
+    }
+
+    static constexpr char image[] = "resumed.bin";
+    /* Where the BMC's checkpoint is. */
+    static constexpr std::uint32_t checkpoint = 64 * 1024;
+
+    std::uint16_t flags = ipmi_flash::FirmwareFlags::UpdateFlags::lpc |
+                          ipmi_flash::FirmwareFlags::UpdateFlags::openWrite;
+    std::vector<std::uint8_t> contents;
+};
+
+TEST_F(UpdateHandlerResumeTest, SendFileResumesFromCheckpoint)
+{
+    EXPECT_CALL(blobMock, getStat(TypedEq<const std::string&>(
+                              ipmi_flash::staticLayoutBlobId)))
+        .WillOnce(Return(interrupted(checkpointCrc())));
+    EXPECT_CALL(
+        blobMock,
+        openBlob(ipmi_flash::staticLayoutBlobId,
+                 flags | ipmi_flash::FirmwareFlags::UpdateFlags::resume))
+        .WillOnce(Return(session));
+    EXPECT_CALL(handlerMock,
+                sendContentsFrom(std::string(image), session, checkpoint))
+        .WillOnce(Return(true));
+    EXPECT_CALL(blobMock, closeBlob(session));
+
+    updater.sendFile(ipmi_flash::staticLayoutBlobId, image);
+}
+
+TEST_F(UpdateHandlerResumeTest, SendFileStartsOverIfTheBytesDiffer)
+{
+    EXPECT_CALL(blobMock, getStat(TypedEq<const std::string&>(
+                              ipmi_flash::staticLayoutBlobId)))
+        .WillOnce(Return(interrupted(checkpointCrc() ^ 1)));
+    EXPECT_CALL(blobMock, openBlob(ipmi_flash::staticLayoutBlobId, flags))
+        .WillOnce(Return(session));
+    EXPECT_CALL(handlerMock, sendContents(std::string(image), session))
+        .WillOnce(Return(true));
+    EXPECT_CALL(blobMock, closeBlob(session));
+
+    updater.sendFile(ipmi_flash::staticLayoutBlobId, image);
+}
+
+TEST_F(UpdateHandlerResumeTest, SendFileStartsOverIfTheBmcRefuses)
+{
+    EXPECT_CALL(blobMock, getStat(TypedEq<const std::string&>(
+                              ipmi_flash::staticLayoutBlobId)))
+        .WillOnce(Return(interrupted(checkpointCrc())));
+    EXPECT_CALL(
+        blobMock,
+        openBlob(ipmi_flash::staticLayoutBlobId,
+                 flags | ipmi_flash::FirmwareFlags::UpdateFlags::resume))
+        .WillOnce(Throw(ipmiblob::BlobException("asdf")));
+    EXPECT_CALL(blobMock, openBlob(ipmi_flash::staticLayoutBlobId, flags))
+        .WillOnce(Return(session));
+    EXPECT_CALL(handlerMock, sendContents(std::string(image), session))
+        .WillOnce(Return(true));
+    EXPECT_CALL(blobMock, closeBlob(session));
+
+    updater.sendFile(ipmi_flash::staticLayoutBlobId, image);
+}
+
+TEST_F(UpdateHandlerResumeTest, CheckResumableNeedsTheWholeImage)
+{
+    /* The BMC has more than this file, which would be left in the image. */
+    auto stat = interrupted(checkpointCrc());
+    stat.size = contents.size() + 1;
+    EXPECT_CALL(blobMock, getStat(TypedEq<const std::string&>(
+                              ipmi_flash::staticLayoutBlobId)))
+        .WillOnce(Return(stat));
+
+    EXPECT_EQ(0, updater.checkResumable(ipmi_flash::staticLayoutBlobId, image));
+}
+
+class UpdateHandlerCompressTest : public UpdateHandlerTest
+{
+  protected:
+    void SetUp() override
+    {
+        /* Mostly erased, like a BIOS image. */
+        contents.assign(256 * 1024, 0xff);
+        for (std::size_t i = 0; i < 1000; i++)
+        {
+            contents[i] = static_cast<std::uint8_t>(i);
+        }
+        std::ofstream(image, std::ios::binary)
+            .write(reinterpret_cast<const char*>(contents.data()),
+                   contents.size());
+
+        EXPECT_CALL(handlerMock, supportedType())
+            .WillRepeatedly(
+                Return(ipmi_flash::FirmwareFlags::UpdateFlags::lpc));
+    }
+
+    void TearDown() override
+    {
+        (void)std::remove(image);
+    }
+
+    static constexpr char image[] = "compressed.bin";
+
+    std::uint16_t flags = ipmi_flash::FirmwareFlags::UpdateFlags::lpc |
+                          ipmi_flash::FirmwareFlags::UpdateFlags::openWrite;
+    std::vector<std::uint8_t> contents;
+    UpdateHandler compressing{&blobMock, &handlerMock, true};
+};
+
+TEST_F(UpdateHandlerCompressTest, SendFileCompressesImage)
+{
+    ipmi_flash::BlobOptionsHdr options = {
+        ipmi_flash::FirmwareFlags::UpdateFlags::compressed};
+    auto* bytes = reinterpret_cast<const std::uint8_t*>(&options);
+    ipmiblob::StatResponse stat = {
+        0xff00, 0, std::vector<std::uint8_t>(bytes, bytes + sizeof(options))};
+    EXPECT_CALL(blobMock, getStat(TypedEq<const std::string&>(
+                              ipmi_flash::staticLayoutBlobId)))
+        .WillRepeatedly(Return(stat));
+    EXPECT_CALL(
+        blobMock,
+        openBlob(ipmi_flash::staticLayoutBlobId,
+                 flags | ipmi_flash::FirmwareFlags::UpdateFlags::compressed))
+        .WillOnce(Return(session));
+    EXPECT_CALL(handlerMock, sendContents(_, session))
+        .WillOnce([this](const std::string& input, std::uint16_t) {
+            std::ifstream file(input, std::ios::binary);
+            std::vector<char> stream((std::istreambuf_iterator<char>(file)),
+                                     std::istreambuf_iterator<char>());
+            EXPECT_LT(stream.size(), contents.size() / 16);
+
+            std::vector<std::uint8_t> decompressed(contents.size());
+            EXPECT_EQ(contents.size(),
+                      ZSTD_decompress(decompressed.data(), decompressed.size(),
+                                      stream.data(), stream.size()));
+            EXPECT_EQ(contents, decompressed);
+            return true;
+        });
+    EXPECT_CALL(blobMock, closeBlob(session));
+
+    compressing.sendFile(ipmi_flash::staticLayoutBlobId, image);
+}
+
+TEST_F(UpdateHandlerCompressTest, SendFileAsIsIfTheBmcCannotDecompress)
+{
+    ipmiblob::StatResponse stat = {0xff00, 0, {}};
+    EXPECT_CALL(blobMock, getStat(TypedEq<const std::string&>(
+                              ipmi_flash::staticLayoutBlobId)))
+        .WillRepeatedly(Return(stat));
+    EXPECT_CALL(blobMock, openBlob(ipmi_flash::staticLayoutBlobId, flags))
+        .WillOnce(Return(session));
+    EXPECT_CALL(handlerMock, sendContents(std::string(image), session))
+        .WillOnce(Return(true));
+    EXPECT_CALL(blobMock, closeBlob(session));
+
+    compressing.sendFile(ipmi_flash::staticLayoutBlobId, image);
+}
+
+TEST_F(UpdateHandlerCompressTest, SendFileSendsHashAsIs)
+{
+    EXPECT_CALL(blobMock, getStat(TypedEq<const std::string&>(
+                              ipmi_flash::hashBlobId)))
+        .Times(0);
+    EXPECT_CALL(blobMock, openBlob(ipmi_flash::hashBlobId, flags))
+        .WillOnce(Return(session));
+    EXPECT_CALL(handlerMock, sendContents(std::string(image), session))
+        .WillOnce(Return(true));
+    EXPECT_CALL(blobMock, closeBlob(session));
+
+    compressing.sendFile(ipmi_flash::hashBlobId, image);
+}
+
+class UpdateHandlerTransactionTest : public UpdateHandlerTest
+{
+  protected:
+    void SetUp() override
+    {
+        EXPECT_CALL(handlerMock, supportedType())
+            .WillRepeatedly(
+                Return(ipmi_flash::FirmwareFlags::UpdateFlags::lpc));
+        EXPECT_CALL(blobMock, getStat(TypedEq<const std::string&>(
+                                  ipmi_flash::staticLayoutBlobId)))
+            .WillRepeatedly(Return(ipmiblob::StatResponse{0xff00, 0, {}}));
+    }
+
+    std::uint16_t flags = ipmi_flash::FirmwareFlags::UpdateFlags::lpc |
+                          ipmi_flash::FirmwareFlags::UpdateFlags::openWrite |
+                          ipmi_flash::FirmwareFlags::UpdateFlags::transaction;
+    UpdateHandler transaction{&blobMock, &handlerMock, false, true};
+};
+
+TEST_F(UpdateHandlerTransactionTest, SupportsTransactionsChecksTheBmc)
+{
+    ipmi_flash::BlobOptionsHdr options = {
+        ipmi_flash::FirmwareFlags::UpdateFlags::transaction};
+    auto* bytes = reinterpret_cast<const std::uint8_t*>(&options);
+    EXPECT_CALL(blobMock, getStat(TypedEq<const std::string&>(
+                              ipmi_flash::biosBlobId)))
+        .WillOnce(Return(ipmiblob::StatResponse{
+            0xff00, 0,
+            std::vector<std::uint8_t>(bytes, bytes + sizeof(options))}));
+
+    EXPECT_TRUE(transaction.supportsTransactions(ipmi_flash::biosBlobId));
+    EXPECT_FALSE(
+        transaction.supportsTransactions(ipmi_flash::staticLayoutBlobId));
+}
+
+TEST_F(UpdateHandlerTransactionTest, SendFileOpensAsPartOfTransaction)
+{
+    EXPECT_CALL(blobMock, openBlob(ipmi_flash::staticLayoutBlobId, flags))
+        .WillOnce(Return(session));
+    EXPECT_CALL(handlerMock, sendContents(std::string("image.bin"), session))
+        .WillOnce(Return(true));
+    EXPECT_CALL(blobMock, closeBlob(session));
+
+    transaction.sendFile(ipmi_flash::staticLayoutBlobId, "image.bin");
+}
+
+TEST_F(UpdateHandlerTransactionTest, SendFileWaitsForTheSignature)
+{
+    /* The BMC is still verifying the image before with the last signature. */
+    EXPECT_CALL(blobMock, getStat(TypedEq<const std::string&>(
+                              ipmi_flash::hashBlobId)))
+        .WillOnce(Return(ipmiblob::StatResponse{
+            0xff00 | blobs::StateFlags::committing, 0, {}}))
+        .WillOnce(Return(ipmiblob::StatResponse{0xff00, 0, {}}));
+    EXPECT_CALL(handlerMock, waitForRetry()).Times(1);
+    EXPECT_CALL(blobMock, openBlob(ipmi_flash::hashBlobId, flags))
+        .WillOnce(Return(session));
+    EXPECT_CALL(handlerMock, sendContents(std::string("sig.bin"), session))
+        .WillOnce(Return(true));
+    EXPECT_CALL(blobMock, closeBlob(session));
+
+    transaction.sendFile(ipmi_flash::hashBlobId, "sig.bin");
+}
+
+TEST_F(UpdateHandlerTransactionTest, SendFileGivesUpWaitingForTheSignature)
+{
+    EXPECT_CALL(blobMock, getStat(TypedEq<const std::string&>(
+                              ipmi_flash::hashBlobId)))
+        .WillRepeatedly(Return(ipmiblob::StatResponse{
+            0xff00 | blobs::StateFlags::committing, 0, {}}));
+    EXPECT_CALL(handlerMock, waitForRetry()).WillRepeatedly(Return());
+    EXPECT_CALL(blobMock, openBlob(ipmi_flash::hashBlobId, _)).Times(0);
+
+    EXPECT_THROW(transaction.sendFile(ipmi_flash::hashBlobId, "sig.bin"),
+                 ToolException);
+}
+
 TEST_F(UpdateHandlerTest, VerifyFileHandleReturnsTrueOnSuccess)
 {
     EXPECT_CALL(blobMock, openBlob(ipmi_flash::verifyBlobId, _))
@@ -178,6 +553,38 @@ TEST_F(UpdateHandlerTest, VerifyFileHandleSkipsPollingIfIgnoreStatus)
     EXPECT_TRUE(updater.verifyFile(ipmi_flash::verifyBlobId, true));
 }
 
+TEST_F(UpdateHandlerTest, VerifyThenUpdateAsksTheBmcToChainTheUpdate)
+{
+    EXPECT_CALL(blobMock, openBlob(ipmi_flash::verifyBlobId, _))
+        .WillOnce(Return(session));
+    EXPECT_CALL(blobMock, commit(session, std::vector<std::uint8_t>({1})))
+        .WillOnce(Return());
+    ipmiblob::StatResponse updated = {};
+    updated.metadata = {
+        static_cast<std::uint8_t>(ipmi_flash::ActionStatus::success), 1};
+    EXPECT_CALL(blobMock, getStat(TypedEq<std::uint16_t>(session)))
+        .WillOnce(Return(updated));
+    EXPECT_CALL(blobMock, closeBlob(session)).WillOnce(Return());
+
+    EXPECT_TRUE(updater.verifyThenUpdate(false));
+}
+
+TEST_F(UpdateHandlerTest, VerifyThenUpdateDoesNotRetry)
+{
+    EXPECT_CALL(blobMock, openBlob(ipmi_flash::verifyBlobId, _))
+        .WillOnce(Return(session));
+    EXPECT_CALL(blobMock, commit(session, _)).WillOnce(Return());
+    ipmiblob::StatResponse failed = {};
+    failed.metadata = {
+        static_cast<std::uint8_t>(ipmi_flash::ActionStatus::failed), 1};
+    EXPECT_CALL(blobMock, getStat(TypedEq<std::uint16_t>(session)))
+        .WillOnce(Return(failed));
+    EXPECT_CALL(blobMock, closeBlob(session)).WillOnce(Return());
+    EXPECT_CALL(handlerMock, waitForRetry()).Times(0);
+
+    EXPECT_THROW(updater.verifyThenUpdate(false), ToolException);
+}
+
 TEST_F(UpdateHandlerTest, VerifyFileConvertsOpenBlobExceptionToToolException)
 {
     /* On open, it can except and this is converted to a ToolException. */
@@ -462,6 +869,140 @@ TEST_F(UpdaterTest, UpdateMainExceptsOnUpdateBlobFailure)
                  ToolException);
 }
 
+TEST_F(UpdaterTest, UpdateMainChainsUpdate)
+{
+    UpdateHandlerMock handler;
+    bool updateIgnore = true;
+
+    EXPECT_CALL(handler, checkAvailable(path)).WillOnce(Return(true));
+    EXPECT_CALL(handler, sendFile(path, image)).WillOnce(Return());
+    EXPECT_CALL(handler, sendFile(ipmi_flash::hashBlobId, signature))
+        .WillOnce(Return());
+    EXPECT_CALL(handler, verifyThenUpdate(updateIgnore))
+        .WillOnce(Return(true));
+    EXPECT_CALL(handler, verifyFile(_, _)).Times(0);
+    EXPECT_CALL(blobMock, getBlobList())
+        .WillOnce(Return(std::vector<std::string>({})));
+
+    updaterMain(&handler, &blobMock, image, signature, layout, updateIgnore,
+                true);
+}
+
+TEST_F(UpdaterTest, UpdateMainUpdatesIfTheBmcOnlyVerified)
+{
+    UpdateHandlerMock handler;
+
+    EXPECT_CALL(handler, checkAvailable(path)).WillOnce(Return(true));
+    EXPECT_CALL(handler, sendFile(path, image)).WillOnce(Return());
+    EXPECT_CALL(handler, sendFile(ipmi_flash::hashBlobId, signature))
+        .WillOnce(Return());
+    EXPECT_CALL(handler, verifyThenUpdate(defaultIgnore))
+        .WillOnce(Return(false));
+    EXPECT_CALL(handler, verifyFile(ipmi_flash::verifyBlobId, _)).Times(0);
+    EXPECT_CALL(handler, verifyFile(ipmi_flash::updateBlobId, defaultIgnore))
+        .WillOnce(Return(true));
+    EXPECT_CALL(blobMock, getBlobList())
+        .WillOnce(Return(std::vector<std::string>({})));
+
+    updaterMain(&handler, &blobMock, image, signature, layout, defaultIgnore,
+                true);
+}
+
+TEST_F(UpdaterTest, UpdateMainReusesStagedImage)
+{
+    UpdateHandlerMock handler;
+
+    EXPECT_CALL(handler, checkAvailable(path)).WillOnce(Return(true));
+    EXPECT_CALL(handler, checkStaged(path, image)).WillOnce(Return(true));
+    /* The BMC's state is reset, but the staged image isn't cleaned up. */
+    EXPECT_CALL(blobMock, deleteBlob(ipmi_flash::activeImageBlobId))
+        .WillOnce(Return(true));
+    EXPECT_CALL(handler, cleanArtifacts()).Times(0);
+    EXPECT_CALL(handler, reuseStaged(path, image)).WillOnce(Return(true));
+    EXPECT_CALL(handler, sendFile(path, image)).Times(0);
+    EXPECT_CALL(handler, sendFile(ipmi_flash::hashBlobId, signature))
+        .WillOnce(Return());
+    EXPECT_CALL(handler, verifyFile(ipmi_flash::verifyBlobId, defaultIgnore))
+        .WillOnce(Return(true));
+    EXPECT_CALL(handler, verifyFile(ipmi_flash::updateBlobId, defaultIgnore))
+        .WillOnce(Return(true));
+    EXPECT_CALL(blobMock, getBlobList())
+        .WillOnce(Return(std::vector<std::string>(
+            {ipmi_flash::staticLayoutBlobId, ipmi_flash::activeImageBlobId})));
+
+    updaterMain(&handler, &blobMock, image, signature, layout, defaultIgnore);
+}
+
+TEST_F(UpdaterTest, UpdateMainSendsImageIfItCannotBeReused)
+{
+    UpdateHandlerMock handler;
+
+    EXPECT_CALL(handler, checkAvailable(path)).WillOnce(Return(true));
+    EXPECT_CALL(handler, checkStaged(path, image))
+        .WillOnce(Return(true))
+        .WillOnce(Return(true));
+    EXPECT_CALL(handler, reuseStaged(path, image)).WillOnce(Return(false));
+    EXPECT_CALL(handler, sendFile(path, image)).WillOnce(Return());
+    EXPECT_CALL(handler, sendFile(ipmi_flash::hashBlobId, signature))
+        .WillOnce(Return());
+    EXPECT_CALL(handler, verifyFile(ipmi_flash::verifyBlobId, defaultIgnore))
+        .WillOnce(Return(true));
+    EXPECT_CALL(handler, verifyFile(ipmi_flash::updateBlobId, defaultIgnore))
+        .WillOnce(Return(true));
+    EXPECT_CALL(blobMock, getBlobList())
+        .WillOnce(Return(std::vector<std::string>({})));
+
+    updaterMain(&handler, &blobMock, image, signature, layout, defaultIgnore);
+}
+
+TEST_F(UpdaterTest, UpdateMainKeepsStagedImageOnFailure)
+{
+    UpdateHandlerMock handler;
+
+    EXPECT_CALL(handler, checkAvailable(path)).WillOnce(Return(true));
+    EXPECT_CALL(handler, checkStaged(path, image))
+        .WillOnce(Return(false))
+        .WillOnce(Return(true));
+    EXPECT_CALL(handler, sendFile(path, image)).WillOnce(Return());
+    EXPECT_CALL(handler, sendFile(ipmi_flash::hashBlobId, signature))
+        .WillOnce(Return());
+    EXPECT_CALL(handler, verifyFile(ipmi_flash::verifyBlobId, defaultIgnore))
+        .WillOnce(Return(false));
+    EXPECT_CALL(handler, cleanArtifacts()).Times(0);
+    EXPECT_CALL(blobMock, getBlobList())
+        .WillOnce(Return(std::vector<std::string>({})));
+
+    EXPECT_THROW(updaterMain(&handler, &blobMock, image, signature, layout,
+                             defaultIgnore),
+                 ToolException);
+}
+
+TEST_F(UpdaterTest, UpdateMainKeepsResumableUploadOnFailure)
+{
+    UpdateHandlerMock handler;
+
+    EXPECT_CALL(handler, checkAvailable(path)).WillOnce(Return(true));
+    EXPECT_CALL(handler, checkStaged(path, image)).WillOnce(Return(false));
+    EXPECT_CALL(handler, checkResumable(path, image))
+        .WillOnce(Return(64 * 1024))
+        .WillOnce(Return(128 * 1024));
+    /* The BMC's state is reset, but what it has of the image isn't cleaned
+     * up, before or after sending it fails again.
+     */
+    EXPECT_CALL(blobMock, deleteBlob(ipmi_flash::activeImageBlobId))
+        .WillOnce(Return(true));
+    EXPECT_CALL(handler, cleanArtifacts()).Times(0);
+    EXPECT_CALL(handler, sendFile(path, image))
+        .WillOnce(Throw(ToolException("asdf")));
+    EXPECT_CALL(blobMock, getBlobList())
+        .WillOnce(Return(std::vector<std::string>(
+            {ipmi_flash::staticLayoutBlobId, ipmi_flash::activeImageBlobId})));
+
+    EXPECT_THROW(updaterMain(&handler, &blobMock, image, signature, layout,
+                             defaultIgnore),
+                 ToolException);
+}
+
 TEST_F(UpdaterTest, UpdateMainExceptsIfAvailableNotFound)
 {
     UpdateHandlerMock handler;
@@ -473,4 +1014,67 @@ TEST_F(UpdaterTest, UpdateMainExceptsIfAvailableNotFound)
                  ToolException);
 }
 
+class UpdaterTransactionTest : public UpdaterTest
+{
+  protected:
+    static constexpr char biosImage[] = "bios.bin";
+    static constexpr char biosSignature[] = "bios.sig";
+    static constexpr char biosPath[] = "/flash/bios";
+
+    std::vector<UpdateImage> images = {{layout, image, signature},
+                                       {"bios", biosImage, biosSignature}};
+    UpdateHandlerMock handler;
+};
+
+TEST_F(UpdaterTransactionTest, SendsEveryImageThenVerifiesAndUpdates)
+{
+    ::testing::InSequence seq;
+
+    EXPECT_CALL(handler, checkAvailable(path)).WillOnce(Return(true));
+    EXPECT_CALL(handler, supportsTransactions(path)).WillOnce(Return(true));
+    EXPECT_CALL(handler, checkAvailable(biosPath)).WillOnce(Return(true));
+    EXPECT_CALL(handler, supportsTransactions(biosPath))
+        .WillOnce(Return(true));
+    EXPECT_CALL(blobMock, getBlobList())
+        .WillOnce(Return(std::vector<std::string>({})));
+    EXPECT_CALL(handler, sendFile(path, image));
+    EXPECT_CALL(handler, sendFile(ipmi_flash::hashBlobId, signature));
+    EXPECT_CALL(handler, sendFile(biosPath, biosImage));
+    EXPECT_CALL(handler, sendFile(ipmi_flash::hashBlobId, biosSignature));
+    EXPECT_CALL(handler, verifyFile(ipmi_flash::verifyBlobId, defaultIgnore))
+        .WillOnce(Return(true));
+    EXPECT_CALL(handler, verifyFile(ipmi_flash::updateBlobId, defaultIgnore))
+        .WillOnce(Return(true));
+
+    updaterTransaction(&handler, &blobMock, images, defaultIgnore);
+}
+
+TEST_F(UpdaterTransactionTest, ExceptsIfTheBmcCannotTakeATransaction)
+{
+    EXPECT_CALL(handler, checkAvailable(_)).WillRepeatedly(Return(true));
+    EXPECT_CALL(handler, supportsTransactions(path)).WillOnce(Return(true));
+    EXPECT_CALL(handler, supportsTransactions(biosPath))
+        .WillOnce(Return(false));
+    EXPECT_CALL(handler, sendFile(_, _)).Times(0);
+
+    EXPECT_THROW(updaterTransaction(&handler, &blobMock, images, defaultIgnore),
+                 ToolException);
+}
+
+TEST_F(UpdaterTransactionTest, CleansUpIfAnyFailsVerification)
+{
+    EXPECT_CALL(handler, checkAvailable(_)).WillRepeatedly(Return(true));
+    EXPECT_CALL(handler, supportsTransactions(_)).WillRepeatedly(Return(true));
+    EXPECT_CALL(blobMock, getBlobList())
+        .WillOnce(Return(std::vector<std::string>({})));
+    EXPECT_CALL(handler, sendFile(_, _)).Times(4);
+    EXPECT_CALL(handler, verifyFile(ipmi_flash::verifyBlobId, defaultIgnore))
+        .WillOnce(Return(false));
+    EXPECT_CALL(handler, verifyFile(ipmi_flash::updateBlobId, _)).Times(0);
+    EXPECT_CALL(handler, cleanArtifacts());
+
+    EXPECT_THROW(updaterTransaction(&handler, &blobMock, images, defaultIgnore),
+                 ToolException);
+}
+
 } // namespace host_tool
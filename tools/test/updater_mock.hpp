@@ -15,11 +15,20 @@ class UpdateHandlerMock : public UpdateHandlerInterface
 {
   public:
     MOCK_METHOD(bool, checkAvailable, (const std::string&), (override));
+    MOCK_METHOD(bool, supportsTransactions, (const std::string&),
+                (override));
     MOCK_METHOD(std::vector<uint8_t>, readVersion, (const std::string&),
                 (override));
     MOCK_METHOD(void, sendFile, (const std::string&, const std::string&),
                 (override));
+    MOCK_METHOD(bool, checkStaged, (const std::string&, const std::string&),
+                (override));
+    MOCK_METHOD(bool, reuseStaged, (const std::string&, const std::string&),
+                (override));
+    MOCK_METHOD(std::uint32_t, checkResumable,
+                (const std::string&, const std::string&), (override));
     MOCK_METHOD(bool, verifyFile, (const std::string&, bool), (override));
+    MOCK_METHOD(bool, verifyThenUpdate, (bool), (override));
     MOCK_METHOD(void, cleanArtifacts, (), (override));
 };
 
@@ -35,9 +35,67 @@
 namespace host_tool
 {
 
+/* Verify what was sent, then update.  Chained, the BMC starts the update
+ * itself once it's verified, so there's one commit and one status to poll.
+ */
+static void verifyAndUpdate(UpdateHandlerInterface* updater, bool ignoreUpdate,
+                            bool chainUpdate)
+{
+    bool updated = false;
+    if (chainUpdate)
+    {
+        std::fprintf(stderr, "Opening the verification file to verify and "
+                             "update\n");
+        updated = updater->verifyThenUpdate(ignoreUpdate);
+        if (!updated)
+        {
+            std::fprintf(stderr, "The BMC only verified the image\n");
+        }
+    }
+    else
+    {
+        /* Trigger the verification by opening and committing the verify
+         * file.
+         */
+        std::fprintf(stderr, "Opening the verification file\n");
+        if (updater->verifyFile(ipmi_flash::verifyBlobId, false))
+        {
+            std::fprintf(stderr, "succeeded\n");
+        }
+        else
+        {
+            std::fprintf(stderr, "failed\n");
+            throw ToolException("Verification failed");
+        }
+    }
+
+    if (updated)
+    {
+        return;
+    }
+
+    /* Trigger the update by opening and committing the update file. */
+    std::fprintf(stderr, "Opening the update file\n");
+    if (updater->verifyFile(ipmi_flash::updateBlobId, ignoreUpdate))
+    {
+        std::fprintf(stderr, "succeeded\n");
+    }
+    else
+    {
+        /* Depending on the update mechanism used, this may be
+         * uninteresting. For instance, for the static layout, we use the
+         * reboot update mechanism.  Which doesn't always lead to a
+         * successful return before the BMC starts shutting down services.
+         */
+        std::fprintf(stderr, "failed\n");
+        throw ToolException("Update failed");
+    }
+}
+
 void updaterMain(UpdateHandlerInterface* updater, ipmiblob::BlobInterface* blob,
                  const std::string& imagePath, const std::string& signaturePath,
-                 const std::string& layoutType, bool ignoreUpdate)
+                 const std::string& layoutType, bool ignoreUpdate,
+                 bool chainUpdate)
 {
     /* TODO: validate the layoutType isn't a special value such as: 'update',
      * 'verify', or 'hash'
@@ -50,6 +108,12 @@ void updaterMain(UpdateHandlerInterface* updater, ipmiblob::BlobInterface* blob,
         throw ToolException("Goal firmware not supported");
     }
 
+    // An image staged by an earlier attempt that matches this one doesn't
+    // have to be sent again, and one that was partly sent can be resumed, so
+    // they're left out of the cleanup below.
+    bool staged = updater->checkStaged(layout, imagePath);
+    bool resumable = !staged && updater->checkResumable(layout, imagePath) > 0;
+
     // Clean all active blobs to support multiple stages
     // Check for any active blobs and delete the first one found to reset the
     // BMC's phosphor-ipmi-flash state machine then clean any leftover artifacts
@@ -62,7 +126,10 @@ void updaterMain(UpdateHandlerInterface* updater, ipmiblob::BlobInterface* blob,
             std::fprintf(stderr, "Found an active blob, deleting %s\n",
                          activeBlob.c_str());
             blob->deleteBlob(activeBlob);
-            updater->cleanArtifacts();
+            if (!staged && !resumable)
+            {
+                updater->cleanArtifacts();
+            }
             break;
         }
     }
@@ -70,43 +137,90 @@ void updaterMain(UpdateHandlerInterface* updater, ipmiblob::BlobInterface* blob,
     /* Yay, our layout type is supported. */
     try
     {
-        /* Send over the firmware image. */
-        std::fprintf(stderr, "Sending over the firmware image.\n");
-        updater->sendFile(layout, imagePath);
+        if (staged && updater->reuseStaged(layout, imagePath))
+        {
+            std::fprintf(stderr, "The firmware image is already staged.\n");
+        }
+        else
+        {
+            /* Send over the firmware image. */
+            std::fprintf(stderr, "Sending over the firmware image.\n");
+            staged = false;
+            updater->sendFile(layout, imagePath);
+            staged = updater->checkStaged(layout, imagePath);
+        }
 
         /* Send over the hash contents. */
         std::fprintf(stderr, "Sending over the hash file.\n");
         updater->sendFile(ipmi_flash::hashBlobId, signaturePath);
 
-        /* Trigger the verification by opening and committing the verify file.
+        verifyAndUpdate(updater, ignoreUpdate, chainUpdate);
+    }
+    catch (...)
+    {
+        /* A staged image the BMC can vouch for is left for the next attempt,
+         * e.g. after the wrong signature was sent, as is one that can be
+         * resumed.
          */
-        std::fprintf(stderr, "Opening the verification file\n");
-        if (updater->verifyFile(ipmi_flash::verifyBlobId, false))
+        if (!staged && updater->checkResumable(layout, imagePath) == 0)
         {
-            std::fprintf(stderr, "succeeded\n");
+            updater->cleanArtifacts();
         }
-        else
+        throw;
+    }
+}
+
+void updaterTransaction(UpdateHandlerInterface* updater,
+                        ipmiblob::BlobInterface* blob,
+                        const std::vector<UpdateImage>& images,
+                        bool ignoreUpdate, bool chainUpdate)
+{
+    for (const auto& image : images)
+    {
+        std::string layout = "/flash/" + image.layoutType;
+        if (!updater->checkAvailable(layout))
         {
-            std::fprintf(stderr, "failed\n");
-            throw ToolException("Verification failed");
+            throw ToolException("Goal firmware not supported: " + layout);
         }
+        if (!updater->supportsTransactions(layout))
+        {
+            throw ToolException("The BMC can't update " + layout +
+                                " in a transaction");
+        }
+    }
 
-        /* Trigger the update by opening and committing the update file. */
-        std::fprintf(stderr, "Opening the update file\n");
-        if (updater->verifyFile(ipmi_flash::updateBlobId, ignoreUpdate))
+    /* Nothing staged is kept, the BMC starts the transaction over. */
+    const auto blobList = blob->getBlobList();
+    for (const auto& activeBlob : blobList)
+    {
+        if (activeBlob.starts_with("/flash/active/"))
         {
-            std::fprintf(stderr, "succeeded\n");
+            std::fprintf(stderr, "Found an active blob, deleting %s\n",
+                         activeBlob.c_str());
+            blob->deleteBlob(activeBlob);
+            updater->cleanArtifacts();
+            break;
         }
-        else
+    }
+
+    try
+    {
+        /* Each image is verified on the BMC while the next one is sent. */
+        for (const auto& image : images)
         {
-            /* Depending on the update mechanism used, this may be
-             * uninteresting. For instance, for the static layout, we use the
-             * reboot update mechanism.  Which doesn't always lead to a
-             * successful return before the BMC starts shutting down services.
-             */
-            std::fprintf(stderr, "failed\n");
-            throw ToolException("Update failed");
+            std::fprintf(stderr, "Sending over the %s image.\n",
+                         image.layoutType.c_str());
+            updater->sendFile("/flash/" + image.layoutType, image.imagePath);
+
+            std::fprintf(stderr, "Sending over the %s hash file.\n",
+                         image.layoutType.c_str());
+            updater->sendFile(ipmi_flash::hashBlobId, image.signaturePath);
         }
+
+        /* The BMC runs the updates one after the other, the status is for
+         * all of them.
+         */
+        verifyAndUpdate(updater, ignoreUpdate, chainUpdate);
     }
     catch (...)
     {
@@ -5,6 +5,7 @@
 #include <ipmiblob/blob_interface.hpp>
 
 #include <string>
+#include <vector>
 
 namespace host_tool
 {
@@ -18,10 +19,36 @@ namespace host_tool
  * @param[in] signaturePath - the path to the signature file.
  * @param[in] layoutType - the image update layout type (static/ubi/other)
  * @param[in] ignoreUpdate - determines whether to ignore the update status
+ * @param[in] chainUpdate - have the BMC start the update once it's verified
  * @throws ToolException on failures.
  */
 void updaterMain(UpdateHandlerInterface* updater, ipmiblob::BlobInterface* blob,
                  const std::string& imagePath, const std::string& signaturePath,
-                 const std::string& layoutType, bool ignoreUpdate);
+                 const std::string& layoutType, bool ignoreUpdate,
+                 bool chainUpdate = false);
+
+/** One firmware image of a transaction. */
+struct UpdateImage
+{
+    std::string layoutType;
+    std::string imagePath;
+    std::string signaturePath;
+};
+
+/**
+ * Attempt to update several firmware types in one transaction, so they're
+ * verified before any of them is updated, and updated in the order given.
+ *
+ * @param[in] updater - update handler object, sending as a transaction.
+ * @param[in] blob - ipmi blob object.
+ * @param[in] images - the images, their signatures and layout types.
+ * @param[in] ignoreUpdate - determines whether to ignore the update status
+ * @param[in] chainUpdate - have the BMC start the update once it's verified
+ * @throws ToolException on failures.
+ */
+void updaterTransaction(UpdateHandlerInterface* updater,
+                        ipmiblob::BlobInterface* blob,
+                        const std::vector<UpdateImage>& images,
+                        bool ignoreUpdate, bool chainUpdate = false);
 
 } // namespace host_tool